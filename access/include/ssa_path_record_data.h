@@ -41,54 +41,235 @@ extern "C" {
 
 #define LFT_NO_PATH		255
 #define MAX_LOOKUP_LID		0xBFFF
-#define MAX_LOOKUP_PORT		254
-#define MAX_LFT_BLOCK_NUM	(MAX_LOOKUP_LID / 64)
 #define NO_REAL_PORT_NUM	-1
 
+/*
+ * ssa_pr_route - route from a switch to a destination LID
+ *
+ *@out_port - egress port of the switch. LFT_NO_PATH if there is no path.
+ *@mtu - minimal MTU of the ports on the way from the egress port of
+ *       the switch to the destination port, both included.
+ *@rate - minimal rate on the same ports.
+ *@hops - number of switches on the way, the switch itself included.
+ *        0 - the route is not computed yet.
+ *
+ * The whole entry is read and written through @val, so workers sharing
+ * an index see either a complete route or an empty one.
+ */
+union ssa_pr_route {
+	uint32_t val;
+	struct {
+		uint8_t out_port;
+		uint8_t mtu;
+		uint8_t rate;
+		uint8_t hops;
+	};
+};
+
+#define INDEX_NONE		0xFFFFFFFF
+#define SSA_PR_DIGEST_INIT	0xCBF29CE484222325ULL
+
+/*
+ * ssa_pr_lid_index - SMDB index entry of a LID
+ *
+ *@port_offset - offset of the LID entries in port_lookup and link_lookup.
+ *@lft_block_offset - offset of the LID entries in lft_block_lookup.
+ *@route_offset - offset of the LID entries in route_cache.
+ *                INDEX_NONE if there is no LFT top record for the LID.
+ *@lft_offset - offset of the LID forwarding array in lft.
+ *              INDEX_NONE if there is no LFT top record for the LID, or
+ *              some of its LFT blocks are missing. lft_block_lookup
+ *              is used for such LIDs.
+ *@lft_top - LFT top LID.
+ *@lft_block_count - number of the LID entries in lft_block_lookup:
+ *                   the highest LFT block number + 1. Index: block number.
+ *@port_count - number of the LID entries in port_lookup and link_lookup.
+ *              For switch it's the highest port number + 1. Index: port number.
+ *              For CA there is one entry, port number is not relevant.
+ *@is_switch - boolean flag is switch.
+ */
+struct ssa_pr_lid_index {
+	uint32_t port_offset;
+	uint32_t lft_block_offset;
+	uint32_t route_offset;
+	uint32_t lft_offset;
+	uint16_t lft_top;
+	uint16_t lft_block_count;
+	uint16_t port_count;
+	uint8_t  is_switch;
+};
+
 /*
  * SMDB index improves the speed of data retrieval operations on a smdb tables.
  * For this propose we use lookup tables that replaces runtime iteration by
  * indexing operation.
  *
+ * All lookup tables are allocated in one arena and are freed together.
+ * Per LID tables are stored back to back, each of them is sized by the
+ * actual number of ports or LFT blocks of the LID. Values are 32 bit
+ * record indices, INDEX_NONE - no record.
+ *
  *@epoch  Corresponds to smdb epoch. If they are different, the index will
  *        be rebuilt automatically.
  *
- *@is_switch_lookups - lookup table. Index: LID, value: boolean flag is switch.
- *@lft_top_lookup - lookup table. Index: LID. Value: LFT top LID.
- *@lft_block_lookup - lookup table for LFT blocks.
- *                    The table allows lookup by pair (LID, block num).
- *                    Index is a LID.
- *                    If LID is for CA port, the corresponding value in lft_block_lookup is NULL.
- *                    If not, the value is pointer to dynamically allocated lookup
- *                    table for switch's LFT blocks. The table's length is MAX_LFT_BLOCK_NUM.
- *@ca_port_lookup - lookup table for CA ports.
- *                  Index: LID , value: index in SMDB_TBL_ID_PORT table.
- *@switch_port_lookup - lookup table for switch ports. The table allows lookup by pair (LID, port num).
- *						Index is a LID.
- *                      If LID is for CA port, the corresponding value in switch_port_lookup is NULL.
- *                      If not, the value is pointer to dynamically allocated lookup
- *                      table for switch's ports. The table's length is MAX_LOOKUP_PORT.
- *
- *@ca_link_lookup - lookup table for links from CA.
- *                  Index: LID, value: index in SMDB_TBL_ID_LINK table.
- *@switch_link_lookup - lookup table for links from switch ports.
- *                      The table allows lookup by pair (LID, port num).
- *						Index is a LID.
- *                      If LID is for CA port, the corresponding value in switch_link_lookup is NULL.
- *                      If not, the value is pointer to dynamically allocated lookup
- *                      table for switch's links. The table's length is MAX_LOOKUP_PORT.
+ *@arena - memory of all lookup tables.
+ *@arena_size - arena size in bytes.
+ *@lid_count - the highest LID in SMDB + 1.
+ *@lid_lookup - lookup table. Index: LID, value: LID entry.
+ *@lid_digest - digest of the LID ports, their pkeys and linked ports.
+ *              Index: LID. It's used for detection of changed LIDs
+ *              between two indexes.
+ *@guid2lid_digest - digest of SMDB_TBL_ID_GUID2LID table.
+ *@port_lookup - lookup table for ports. The table allows lookup by pair
+ *               (LID, port num). Value: index in SMDB_TBL_ID_PORT table.
+ *@link_lookup - lookup table for links. The table allows lookup by pair
+ *               (LID, port num). Value: index of the linked port
+ *               in SMDB_TBL_ID_PORT table.
+ *@lft_block_lookup - lookup table for LFT blocks. The table allows lookup
+ *                    by pair (LID, block num).
+ *                    Value: index in SMDB_TBL_ID_LFT_BLOCK table.
+ *@lft - flattened forwarding tables. Each switch has LFT top + 1 entries.
+ *       The table allows lookup by pair (switch LID, destination LID).
+ *       Value: egress port, LFT_NO_PATH if there is no path.
+ *@route_cache - memoized routes from switches to destination LIDs.
+ *               The table allows lookup by pair (switch LID, destination LID).
+ *               Each switch has LFT top + 1 entries. Entries are filled lazily
+ *               during path record computation and dropped together with the
+ *               rest of the index when SMDB epoch changes.
+ *@guid_hash - open addressing hash table for GUID lookups.
+ *             Value: index in SMDB_TBL_ID_GUID2LID table + 1, 0 - empty slot.
+ *             Collisions are resolved by linear probing.
+ *@guid_hash_mask - number of slots in guid_hash - 1. The number of slots
+ *                  is a power of 2, at least twice the number of records.
+ *
+ * Compute view - host order copy of the fields used by path record
+ * computation, one array per field. Wire and storage formats of SMDB
+ * are not changed.
+ *
+ *@port_rec_count - number of SMDB_TBL_ID_PORT records.
+ *@port_lid - port LID. Index: SMDB_TBL_ID_PORT record index.
+ *@port_num - port number. Index: the same.
+ *@port_mtu - port MTU capability. Index: the same.
+ *@port_rate - port rate with the switch and FDR10 flags. Index: the same.
+ *@port_link - index of the linked port record, INDEX_NONE - no link.
+ *             Index: the same.
+ *@guid2lid_count - number of SMDB_TBL_ID_GUID2LID records.
+ *@rec_lid - base LID. Index: SMDB_TBL_ID_GUID2LID record index.
+ *@rec_lmc - LMC. Index: the same.
+ *@rec_is_switch - boolean flag is switch. Index: the same.
+ *
+ *@tbl_epoch - epochs of the indexed SMDB tables. Index: table id.
+ *@tbl_count - record counts of the indexed SMDB tables. Index: table id.
+ *             They are used to detect SMDB updates, which change only
+ *             LFT blocks, so the index is patched instead of rebuilt.
  */
 struct ssa_pr_smdb_index {
 	uint64_t epoch;
-	uint8_t  is_switch_lookup[MAX_LOOKUP_LID + 1];
-	uint16_t lft_top_lookup[MAX_LOOKUP_LID + 1];
-	uint64_t *lft_block_lookup[MAX_LOOKUP_LID + 1];
-	uint64_t ca_port_lookup[MAX_LOOKUP_LID + 1];
-	uint64_t *switch_port_lookup[MAX_LOOKUP_LID + 1];
-	uint64_t ca_link_lookup[MAX_LOOKUP_LID + 1];
-	uint64_t *switch_link_lookup[MAX_LOOKUP_LID + 1];
+	void *arena;
+	size_t arena_size;
+	uint32_t lid_count;
+	struct ssa_pr_lid_index *lid_lookup;
+	uint64_t *lid_digest;
+	uint64_t guid2lid_digest;
+	uint32_t *port_lookup;
+	uint32_t *link_lookup;
+	uint32_t *lft_block_lookup;
+	uint8_t *lft;
+	union ssa_pr_route *route_cache;
+	uint32_t *guid_hash;
+	uint32_t guid_hash_mask;
+	uint32_t port_rec_count;
+	uint16_t *port_lid;
+	uint8_t *port_num;
+	uint8_t *port_mtu;
+	uint8_t *port_rate;
+	uint32_t *port_link;
+	uint32_t guid2lid_count;
+	uint16_t *rec_lid;
+	uint8_t *rec_lmc;
+	uint8_t *rec_is_switch;
+	uint64_t tbl_epoch[SMDB_TBL_ID_MAX];
+	uint64_t tbl_count[SMDB_TBL_ID_MAX];
 };
 
+/*
+ * Host order lookups of the compute view. They don't report errors.
+ */
+
+/*
+ * ssa_pr_port_entry - index of a port record
+ * @lid: LID in host order
+ * @port_num: Port number. For CA, parameter is not relevant.
+ *
+ * @return value: index in SMDB_TBL_ID_PORT table. INDEX_NONE - not found.
+ */
+static inline uint32_t ssa_pr_port_entry(const struct ssa_pr_smdb_index *p_index,
+					 const uint16_t lid,
+					 const unsigned int port_num)
+{
+	const struct ssa_pr_lid_index *p_lid = NULL;
+
+	if (lid >= p_index->lid_count)
+		return INDEX_NONE;
+
+	p_lid = p_index->lid_lookup + lid;
+	if (!p_lid->is_switch)
+		return p_lid->port_count ?
+		       p_index->port_lookup[p_lid->port_offset] : INDEX_NONE;
+	else if (port_num >= p_lid->port_count)
+		return INDEX_NONE;
+
+	return p_index->port_lookup[p_lid->port_offset + port_num];
+}
+
+/*
+ * ssa_pr_lft_port - egress port from the flattened forwarding table
+ * @switch_lid: switch's LID in host order
+ * @dest_lid: destination LID in host order
+ *
+ * @return value: egress port, LFT_NO_PATH if there is no path.
+ *                -1 - the switch has no forwarding array or the LID
+ *                exceeds LFT top, find_destination_port has to be used.
+ */
+static inline int ssa_pr_lft_port(const struct ssa_pr_smdb_index *p_index,
+				  const uint16_t switch_lid,
+				  const uint16_t dest_lid)
+{
+	const struct ssa_pr_lid_index *p_lid = NULL;
+
+	if (switch_lid >= p_index->lid_count)
+		return -1;
+
+	p_lid = p_index->lid_lookup + switch_lid;
+	if (INDEX_NONE == p_lid->lft_offset || dest_lid > p_lid->lft_top)
+		return -1;
+
+	return p_index->lft[p_lid->lft_offset + dest_lid];
+}
+
+/*
+ * ssa_pr_route_entry - route cache entry
+ * @switch_lid: switch's LID in host order
+ * @dest_lid: destination LID in host order
+ *
+ * @return value: pointer to the cache entry. NULL - the route can't be cached.
+ */
+static inline union ssa_pr_route *ssa_pr_route_entry(const struct ssa_pr_smdb_index *p_index,
+						     const uint16_t switch_lid,
+						     const uint16_t dest_lid)
+{
+	const struct ssa_pr_lid_index *p_lid = NULL;
+
+	if (switch_lid >= p_index->lid_count)
+		return NULL;
+
+	p_lid = p_index->lid_lookup + switch_lid;
+	if (INDEX_NONE == p_lid->route_offset || dest_lid > p_lid->lft_top)
+		return NULL;
+
+	return p_index->route_cache + p_lid->route_offset + dest_lid;
+}
+
 /*
  * ssa_pr_build_indexes - builds index for smdb database
  * @p_index: Pointer to an index
@@ -122,18 +303,38 @@ void ssa_pr_destroy_indexes(struct ssa_pr_smdb_index *p_index);
 int ssa_pr_rebuild_indexes(struct ssa_pr_smdb_index *p_index,
 			   const struct ssa_db *p_smdb);
 
+/*
+ * ssa_pr_patch_lft_blocks - updates an smdb index for changed LFT blocks
+ * @p_index: Pointer to an index
+ * @p_smdb: Pointer to new smdb database
+ * @p_block_indices: indices of the changed records in SMDB_TBL_ID_LFT_BLOCK table
+ * @count: number of the changed records
+ *
+ * @return value: 0 - success; otherwise - failure, the index has to be rebuilt.
+ *
+ * The function is used by ssa_pr_rebuild_indexes, if the new smdb database
+ * differs from the indexed one only by content of some LFT blocks. Forwarding arrays are patched in place
+ * and routes to LIDs of the changed blocks are dropped from the route cache.
+ * The index must not be shared by other threads during the update.
+ */
+int ssa_pr_patch_lft_blocks(struct ssa_pr_smdb_index *p_index,
+			    const struct ssa_db *p_smdb,
+			    const uint64_t *p_block_indices, size_t count);
+
 /*
  * find_guid_to_lid_rec_by_guid - search in SMDB_TBL_ID_GUID2LID table
  * @p_smdb: Pointer to smdb database
+ * @p_index: Pointer to an smdb index. It's used for boot retrieval operations
  * @port_guid: GUID in network order
  *
  * @return value: pointer to found record. NULL - failure.
  *
- * The function iterates SMDB_TBL_ID_GUID2LID table and searches for a
- * record with given GUID
+ * The function searches for a record with given GUID. If there are
+ * several records with the same GUID, the first one is returned.
  */
 const struct smdb_guid2lid
 *find_guid_to_lid_rec_by_guid(const struct ssa_db *p_smdb,
+			      const struct ssa_pr_smdb_index *p_index,
 			      const be64_t port_guid);
 
 /*
@@ -151,6 +352,18 @@ const struct smdb_port *find_port(const struct ssa_db *p_smdb,
 				  const struct ssa_pr_smdb_index *p_index,
 				  const be16_t lid, const int port_num);
 
+/*
+ * find_port_pkeys - search in SMDB_TBL_ID_PKEY table
+ * @p_smdb: Pointer to smdb database
+ * @p_port: Pointer to port record
+ * @p_count: Output. Number of the port pkeys.
+ *
+ * @return value: pointer to the first pkey of the port (in network order).
+ *                NULL - the port has no pkeys.
+ */
+const be16_t *find_port_pkeys(const struct ssa_db *p_smdb,
+			      const struct smdb_port *p_port, size_t *p_count);
+
 /*
  * find_destination_port - search in SMDB_TBL_ID_LFT_BLOCK table
  * @p_smdb: Pointer to smdb database
@@ -186,11 +399,13 @@ const struct smdb_port
 /*
  * is_port_exist - check if a port exists in smdb
  * @p_smdb: Pointer to smdb database
+ * @p_index: Pointer to an smdb index. It's used for boot retrieval operations
  * @guid: port's GUID in network order.
  *
  * @return value: 1 - the guid is found, 0 - else.
  */
-int is_port_exist(const struct ssa_db *p_smdb, be64_t guid);
+int is_port_exist(const struct ssa_db *p_smdb,
+		  const struct ssa_pr_smdb_index *p_index, be64_t guid);
 
 #ifdef __cplusplus
 }
@@ -32,10 +32,13 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <osd.h>
 #include <infiniband/ssa_db.h>
 #include <infiniband/ssa_smdb.h>
 #include <infiniband/ssa_prdb.h>
@@ -53,9 +56,73 @@
 #define MAX_HOPS 64
 #define PK_DEFAULT_VAL ntohs(0xffff)
 #define SL_DEFAULT_VAL 0
+#define PK_BASE_MASK 0x7FFF
+#define PK_FULL_MEMBER 0x8000
+/*
+ * PRDB is recomputed completely, if more than 1/SSA_PR_DELTA_MAX_PART
+ * of destinations are affected by SMDB changes.
+ */
+#define SSA_PR_DELTA_MAX_PART 4
+/* Number of shared PRDB hash buckets of a snapshot */
+#define SSA_PR_SHARED_BUCKETS 256
 
+/*
+ * @p_smdb - SMDB of a snapshot context. Snapshot index is immutable,
+ *           it's never rebuilt. The snapshot holds a reference to it.
+ *           NULL for a regular context.
+ * @refcnt - snapshot reference count.
+ * @partitions - path records are computed only for destinations sharing
+ *               a partition with the source.
+ * @prev_epoch - SMDB epoch of the previous snapshot, the snapshot was
+ *               compared with. DB_EPOCH_INVALID - there is no delta.
+ * @p_lid_changed - LIDs, which ports or links differ from the previous
+ *                  snapshot. Index: LID.
+ * @p_route_changed - bitmap of route cache entries differing from
+ *                    the previous snapshot.
+ * @shared_lock - protects the shared PRDB table.
+ * @pp_shared - "half world" PRDBs shared by sources of the same class,
+ *              hashed by the first switch LID. Allocated for snapshots only.
+ * @shared_released - the shared PRDBs were released, PRDBs aren't shared
+ *                    anymore.
+ */
 struct ssa_pr_context {
 	struct ssa_pr_smdb_index *p_index;
+	struct ssa_db *p_smdb;
+	atomic_t refcnt;
+	int partitions;
+	uint64_t prev_epoch;
+	uint8_t *p_lid_changed;
+	uint8_t *p_route_changed;
+	pthread_mutex_t shared_lock;
+	struct ssa_pr_shared_prdb **pp_shared;
+	int shared_released;
+};
+
+/*
+ * Hosts attached to the same switch by links of the same MTU and rate,
+ * with the same LMC and pkeys, have equal path records to all destinations
+ * except each other. Only reverse reachability differs.
+ */
+struct ssa_pr_source_class {
+	be16_t switch_lid;
+	uint8_t lmc;
+	uint8_t mtu;
+	uint8_t rate;
+	uint8_t link_mtu;
+	uint8_t link_rate;
+	const be16_t *p_pkeys;
+	size_t pkey_count;
+};
+
+/*
+ * @p_source_rec - GUID to LID record of the source the PRDB was computed for.
+ * @p_prdb - its "half world" PRDB. NULL while it's being computed.
+ */
+struct ssa_pr_shared_prdb {
+	struct ssa_pr_shared_prdb *p_next;
+	struct ssa_pr_source_class source_class;
+	const struct smdb_guid2lid *p_source_rec;
+	struct ssa_db *p_prdb;
 };
 
 struct prdb_prm {
@@ -63,12 +130,39 @@ struct prdb_prm {
 	uint64_t max_count;
 };
 
+/*
+ * Work of a single "whole world" thread: a contiguous range
+ * [first, last) of GUID2LID records.
+ */
+struct ssa_pr_worker {
+	pthread_t thread;
+	struct ssa_db *p_ssa_db_smdb;
+	struct ssa_pr_context *p_context;
+	size_t first;
+	size_t last;
+	ssa_pr_path_dump_t dump_clbk;
+	void *clbk_prm;
+	ssa_pr_status_t res;
+};
+
 static
 ssa_pr_status_t ssa_pr_path_params(const struct ssa_db *p_ssa_db_smdb,
 				   const struct ssa_pr_context *p_context,
 				   const struct smdb_guid2lid *p_source_rec,
 				   const struct smdb_guid2lid *p_dest_rec,
 				   ssa_path_parms_t *p_path_prm);
+static
+ssa_pr_status_t ssa_pr_switch_route(const struct ssa_db *p_ssa_db_smdb,
+				    const struct ssa_pr_context *p_context,
+				    const be16_t switch_lid,
+				    const struct smdb_guid2lid *p_dest_rec,
+				    const struct smdb_port *dest_port,
+				    union ssa_pr_route *p_route);
+static
+void ssa_pr_reverse_reachability(const struct ssa_db *p_ssa_db_smdb,
+				 const struct ssa_pr_context *p_context,
+				 const struct smdb_guid2lid *p_source_rec,
+				 uint8_t *p_reverse_res);
 
 inline static size_t get_dataset_count(const struct ssa_db *p_ssa_db_smdb,
 				       unsigned int table_id)
@@ -80,6 +174,30 @@ inline static size_t get_dataset_count(const struct ssa_db *p_ssa_db_smdb,
 	return ntohll(p_ssa_db_smdb->p_db_tables[table_id].set_count);
 }
 
+/*
+ * Makes the context index correspond to the SMDB. A regular context
+ * index is rebuilt if SMDB epoch is changed. A snapshot index is
+ * only checked, so it can be used by several threads.
+ */
+static int ssa_pr_prepare_index(struct ssa_pr_context *p_context,
+				const struct ssa_db *p_ssa_db_smdb)
+{
+	uint64_t epoch = DB_EPOCH_INVALID;
+
+	if (!p_context->p_smdb)
+		return ssa_pr_rebuild_indexes(p_context->p_index, p_ssa_db_smdb);
+
+	epoch = ssa_db_get_epoch(p_ssa_db_smdb, DB_DEF_TBL_ID);
+	if (p_context->p_index->epoch != epoch) {
+		SSA_PR_LOG_ERROR("SMDB epoch 0x%" PRIx64 " differs from "
+				 "path record snapshot epoch 0x%" PRIx64,
+				 epoch, p_context->p_index->epoch);
+		return -1;
+	}
+
+	return 0;
+}
+
 static int insert_pr_to_prdb(const ssa_path_parms_t *p_path_prm, void *prm)
 {
 	struct prdb_prm *p_prm;
@@ -121,6 +239,164 @@ static int insert_pr_to_prdb(const ssa_path_parms_t *p_path_prm, void *prm)
 	return 0;
 }
 
+/*
+ * Returns pkeys of a GUID to LID record port. For a switch
+ * they are stored in port 0 record.
+ */
+static const be16_t *ssa_pr_rec_pkeys(const struct ssa_db *p_ssa_db_smdb,
+				      const struct ssa_pr_smdb_index *p_index,
+				      const struct smdb_guid2lid *p_rec,
+				      size_t *p_count)
+{
+	const struct smdb_port *p_port = NULL;
+
+	*p_count = 0;
+
+	p_port = find_port(p_ssa_db_smdb, p_index, p_rec->lid, 0);
+	if (!p_port)
+		return NULL;
+
+	return find_port_pkeys(p_ssa_db_smdb, p_port, p_count);
+}
+
+/*
+ * Searches for the first source pkey matching one of the destination pkeys.
+ * Pkeys match if their base values are equal and at least one of them
+ * is a full member.
+ */
+static int ssa_pr_shared_pkey(const be16_t *p_source_pkeys, size_t source_count,
+			      const be16_t *p_dest_pkeys, size_t dest_count,
+			      be16_t *p_pkey)
+{
+	size_t i = 0, j = 0;
+
+	for (i = 0; i < source_count; i++) {
+		uint16_t source_pkey = ntohs(p_source_pkeys[i]);
+
+		if (!(source_pkey & PK_BASE_MASK))
+			continue;
+
+		for (j = 0; j < dest_count; j++) {
+			uint16_t dest_pkey = ntohs(p_dest_pkeys[j]);
+
+			if ((source_pkey & PK_BASE_MASK) == (dest_pkey & PK_BASE_MASK) &&
+			    ((source_pkey | dest_pkey) & PK_FULL_MEMBER)) {
+				*p_pkey = p_source_pkeys[i];
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int ssa_pr_dest_pkey(const struct ssa_db *p_ssa_db_smdb,
+			    const struct ssa_pr_context *p_context,
+			    const be16_t *p_source_pkeys, size_t source_count,
+			    const struct smdb_guid2lid *p_dest_rec,
+			    be16_t *p_pkey)
+{
+	const be16_t *p_dest_pkeys = NULL;
+	size_t dest_count = 0;
+
+	p_dest_pkeys = ssa_pr_rec_pkeys(p_ssa_db_smdb, p_context->p_index,
+					p_dest_rec, &dest_count);
+
+	return ssa_pr_shared_pkey(p_source_pkeys, source_count,
+				  p_dest_pkeys, dest_count, p_pkey);
+}
+
+/*
+ * Partitions are used only if the context is partition aware
+ * and SMDB has pkeys.
+ */
+static int ssa_pr_source_pkeys(const struct ssa_db *p_ssa_db_smdb,
+			       const struct ssa_pr_context *p_context,
+			       const struct smdb_guid2lid *p_source_rec,
+			       const be16_t **pp_pkeys, size_t *p_count)
+{
+	*pp_pkeys = NULL;
+	*p_count = 0;
+
+	if (!p_context->partitions)
+		return 0;
+
+	if (!get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_PKEY)) {
+		SSA_PR_LOG_INFO("There are no pkeys in SMDB. "
+				"Path records are computed for all destinations.");
+		return 0;
+	}
+
+	*pp_pkeys = ssa_pr_rec_pkeys(p_ssa_db_smdb, p_context->p_index,
+				     p_source_rec, p_count);
+	return 1;
+}
+
+/*
+ * Computes path records from a source LID to all LIDs of a destination.
+ *
+ * @return value: 0 - success, > 0 - dump callback stopped processing,
+ *                < 0 - failure.
+ */
+static int ssa_pr_dest_paths(const struct ssa_db *p_ssa_db_smdb,
+			     const struct ssa_pr_context *p_context,
+			     const struct smdb_guid2lid *p_source_rec,
+			     const uint16_t source_lid,
+			     const struct smdb_guid2lid *p_dest_rec,
+			     const be16_t pkey, const uint8_t reverse_res,
+			     ssa_pr_path_dump_t dump_clbk, void *clbk_prm)
+{
+	uint16_t dest_base_lid = 0;
+	uint16_t dest_last_lid = 0;
+	uint16_t dest_lid = 0;
+	int rt;
+
+	dest_base_lid = ntohs(p_dest_rec->lid);
+	dest_last_lid = dest_base_lid + (0x01 << p_dest_rec->lmc) - 1;
+
+	for (dest_lid = dest_base_lid; dest_lid <= dest_last_lid; ++dest_lid) {
+		ssa_path_parms_t path_prm;
+		ssa_pr_status_t path_res = SSA_PR_SUCCESS;
+
+		path_prm.from_guid = p_source_rec->guid;
+		path_prm.from_lid = htons(source_lid);
+		path_prm.to_guid = p_dest_rec->guid;
+		path_prm.to_lid = htons(dest_lid);
+		path_prm.sl = SL_DEFAULT_VAL;
+		path_prm.pkey = pkey;
+
+		path_res = ssa_pr_path_params(p_ssa_db_smdb, p_context,
+					      p_source_rec, p_dest_rec,
+					      &path_prm);
+		if (SSA_PR_SUCCESS == path_res) {
+			path_prm.reversible = SSA_PR_SUCCESS == reverse_res;
+			if (SSA_PR_ERROR == reverse_res)
+				SSA_PR_LOG_INFO("Reverse path calculation failed. Source LID %u Destination LID: %u",
+						source_lid, dest_lid);
+
+			if (NULL != dump_clbk) {
+				rt = dump_clbk(&path_prm, clbk_prm);
+				if(rt < 0) {
+					SSA_PR_LOG_ERROR("Dump callback is failed. Ret. value %d",
+							 rt);
+					return -1;
+				} else if(rt > 0) {
+					SSA_PR_LOG_INFO("Dump callback stopped processing."
+							" Ret. value %d", rt);
+					return 1;
+				}
+			}
+		} else if (SSA_PR_ERROR == path_res) {
+			SSA_PR_LOG_ERROR("Path calculation failed: (%u) -> (%u) "
+					 "\"Half World\" calculation stopped.",
+					 source_lid, dest_lid);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 ssa_pr_status_t ssa_pr_half_world(struct ssa_db *p_ssa_db_smdb, void *p_ctnx,
 				  be64_t port_guid,
 				  ssa_pr_path_dump_t dump_clbk, void *clbk_prm)
@@ -133,18 +409,23 @@ ssa_pr_status_t ssa_pr_half_world(struct ssa_db *p_ssa_db_smdb, void *p_ctnx,
 	uint16_t source_last_lid = 0;
 	uint16_t source_lid = 0;
 	struct ssa_pr_context *p_context = (struct ssa_pr_context *)p_ctnx;
+	uint8_t *p_reverse_res = NULL;
+	const be16_t *p_source_pkeys = NULL;
+	size_t source_pkey_count = 0;
+	int partitions = 0;
+	ssa_pr_status_t res = SSA_PR_SUCCESS;
 	int rt;
 
 	SSA_ASSERT(port_guid);
 	SSA_ASSERT(p_ssa_db_smdb);
 	SSA_ASSERT(p_context);
 
-	if (ssa_pr_rebuild_indexes(p_context->p_index, p_ssa_db_smdb)) {
+	if (ssa_pr_prepare_index(p_context, p_ssa_db_smdb)) {
 		SSA_PR_LOG_ERROR("Index rebuild failed.");
 		return SSA_PR_ERROR;
 	}
 
-	if (!is_port_exist(p_ssa_db_smdb, port_guid)) {
+	if (!is_port_exist(p_ssa_db_smdb, p_context->p_index, port_guid)) {
 		SSA_PR_LOG_ERROR("Port does not exist.");
 		return SSA_PR_PORT_ABSENT;
 	}
@@ -155,92 +436,60 @@ ssa_pr_status_t ssa_pr_half_world(struct ssa_db *p_ssa_db_smdb, void *p_ctnx,
 
 	guid_to_lid_count = get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_GUID2LID);
 
-	p_source_rec = find_guid_to_lid_rec_by_guid(p_ssa_db_smdb, port_guid);
+	p_source_rec = find_guid_to_lid_rec_by_guid(p_ssa_db_smdb, p_context->p_index,
+						    port_guid);
 	if (NULL == p_source_rec) {
 		SSA_PR_LOG_ERROR("GUID to LID record not found. GUID: 0x%016" PRIx64,
 				 ntohll(port_guid));
 		return SSA_PR_ERROR;
 	}
 
+	/*
+	 * Routing uses base LIDs only, so the reverse path result
+	 * is the same for all LIDs of a destination.
+	 */
+	p_reverse_res = (uint8_t *)malloc(guid_to_lid_count * sizeof(*p_reverse_res));
+	if (!p_reverse_res) {
+		SSA_PR_LOG_ERROR("Cannot allocate reverse path results. Count: %zu",
+				 guid_to_lid_count);
+		return SSA_PR_ERROR;
+	}
+
+	ssa_pr_reverse_reachability(p_ssa_db_smdb, p_context,
+				    p_source_rec, p_reverse_res);
+
+	partitions = ssa_pr_source_pkeys(p_ssa_db_smdb, p_context, p_source_rec,
+					 &p_source_pkeys, &source_pkey_count);
+
 	source_base_lid = ntohs(p_source_rec->lid);
 	source_last_lid = source_base_lid + (0x01 << p_source_rec->lmc) - 1;
 
 	for (source_lid = source_base_lid; source_lid <= source_last_lid; ++source_lid) {
 		for (i = 0; i < guid_to_lid_count; i++) {
-			uint16_t dest_base_lid = 0;
-			uint16_t dest_last_lid = 0;
-			uint16_t dest_lid = 0;
-
 			const struct smdb_guid2lid *p_dest_rec = p_guid2lid_tbl + i;
-			dest_base_lid = ntohs(p_dest_rec->lid);
-			dest_last_lid = dest_base_lid +
-					(0x01 << p_dest_rec->lmc) - 1;
-
-			for (dest_lid = dest_base_lid; dest_lid <= dest_last_lid; ++dest_lid) {
-				ssa_path_parms_t path_prm;
-				ssa_pr_status_t path_res = SSA_PR_SUCCESS;
-
-				path_prm.from_guid = port_guid;
-				path_prm.from_lid = htons(source_lid);
-				path_prm.to_guid = p_dest_rec->guid;
-				path_prm.to_lid = htons(dest_lid);
-				path_prm.sl = SL_DEFAULT_VAL;
-				path_prm.pkey = PK_DEFAULT_VAL;
-
-				path_res = ssa_pr_path_params(p_ssa_db_smdb,
-							      p_context,
-							      p_source_rec,
-							      p_dest_rec,
-							      &path_prm);
-				if (SSA_PR_SUCCESS == path_res) {
-					ssa_path_parms_t revers_path_prm;
-					ssa_pr_status_t revers_path_res = SSA_PR_SUCCESS;
-
-					revers_path_prm.from_guid = path_prm.to_guid;
-					revers_path_prm.from_lid = path_prm.to_lid;
-					revers_path_prm.to_guid = path_prm.from_guid;
-					revers_path_prm.to_lid = path_prm.from_lid;
-					revers_path_prm.reversible = 1;
-					revers_path_prm.sl = SL_DEFAULT_VAL;
-					revers_path_prm.pkey= PK_DEFAULT_VAL;
-
-					revers_path_res = ssa_pr_path_params(p_ssa_db_smdb,
-									     p_context,
-									     p_dest_rec,
-									     p_source_rec,
-									     &revers_path_prm);
-
-					if (SSA_PR_ERROR == revers_path_res) {
-						SSA_PR_LOG_INFO("Reverse path calculation failed. Source LID %u Destination LID: %u",
-								source_lid,
-								dest_lid);
-					} else
-						path_prm.reversible = SSA_PR_SUCCESS == revers_path_res;
-
-					if (NULL != dump_clbk) {
-						rt = dump_clbk(&path_prm, clbk_prm);
-						if(rt < 0) {
-							SSA_PR_LOG_ERROR("Dump callback is failed. Ret. value %d",
-									rt);
-							return SSA_PR_ERROR;
-						} else if(rt > 0) {
-							SSA_PR_LOG_INFO("Dump callback stopped processing."
-									" Ret. value %d",
-									rt);
-							return SSA_PR_SUCCESS;
-						}
-					}
-
-				} else if (SSA_PR_ERROR == path_res) {
-					SSA_PR_LOG_ERROR("Path calculation failed: (%u) -> (%u) "
-							 "\"Half World\" calculation stopped.",
-							 source_lid, dest_lid);
-					return SSA_PR_ERROR;
-				}
+			be16_t pkey = PK_DEFAULT_VAL;
+
+			if (partitions &&
+			    !ssa_pr_dest_pkey(p_ssa_db_smdb, p_context,
+					      p_source_pkeys, source_pkey_count,
+					      p_dest_rec, &pkey))
+				continue;
+
+			rt = ssa_pr_dest_paths(p_ssa_db_smdb, p_context,
+					       p_source_rec, source_lid,
+					       p_dest_rec, pkey, p_reverse_res[i],
+					       dump_clbk, clbk_prm);
+			if (rt) {
+				if (rt < 0)
+					res = SSA_PR_ERROR;
+				goto Exit;
 			}
 		}
 	}
-	return SSA_PR_SUCCESS;
+
+Exit:
+	free(p_reverse_res);
+	return res;
 }
 
 uint64_t ssa_pr_compute_pr_max_number(struct ssa_db *p_ssa_db_smdb,
@@ -283,12 +532,12 @@ ssa_pr_status_t ssa_pr_compute_half_world(struct ssa_db *p_ssa_db_smdb,
 
 	*pp_prdb = NULL;
 
-	if (ssa_pr_rebuild_indexes(p_context->p_index, p_ssa_db_smdb)) {
+	if (ssa_pr_prepare_index(p_context, p_ssa_db_smdb)) {
 		SSA_PR_LOG_ERROR("Index rebuild failed.");
 		return SSA_PR_ERROR;
 	}
 
-	if (!is_port_exist(p_ssa_db_smdb, port_guid)) {
+	if (!is_port_exist(p_ssa_db_smdb, p_context->p_index, port_guid)) {
 		SSA_PR_LOG_ERROR("Port does not exist.");
 		return SSA_PR_PORT_ABSENT;
 	}
@@ -336,7 +585,7 @@ ssa_pr_status_t ssa_pr_whole_world(struct ssa_db *p_ssa_db_smdb,
 
 	SSA_ASSERT(p_context);
 
-	if (ssa_pr_rebuild_indexes(p_context->p_index, p_ssa_db_smdb)) {
+	if (ssa_pr_prepare_index(p_context, p_ssa_db_smdb)) {
 		SSA_PR_LOG_ERROR("Index rebuild failed.");
 		return SSA_PR_ERROR;
 	}
@@ -384,6 +633,379 @@ const struct smdb_port *get_host_port(const struct ssa_db *p_ssa_db_smdb,
 	return find_port(p_ssa_db_smdb, p_index, lid, 0);
 }
 
+/*
+ * Fills the route cache entries of all switches toward the destinations
+ * of the worker range. Entries are keyed by destination LID, so workers
+ * with disjoint ranges never write the same entry.
+ */
+static void *ssa_pr_route_worker(void *arg)
+{
+	struct ssa_pr_worker *p_worker = (struct ssa_pr_worker *)arg;
+	const struct ssa_db *p_ssa_db_smdb = p_worker->p_ssa_db_smdb;
+	const struct ssa_pr_context *p_context = p_worker->p_context;
+	const struct ssa_pr_smdb_index *p_index = p_context->p_index;
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	size_t i = 0;
+	uint16_t lid = 0;
+
+	p_guid2lid_tbl = (const struct smdb_guid2lid *)
+		p_ssa_db_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+
+	for (i = p_worker->first; i < p_worker->last; i++) {
+		const struct smdb_guid2lid *p_dest_rec = p_guid2lid_tbl + i;
+		const struct smdb_port *dest_port = NULL;
+		uint16_t dest_lid = p_index->rec_lid[i];
+		uint32_t dest_index = 0;
+		union ssa_pr_route route;
+
+		dest_index = ssa_pr_port_entry(p_index, dest_lid, 0);
+		if (dest_index >= p_index->port_rec_count)
+			continue;
+		dest_port = (const struct smdb_port *)
+			p_ssa_db_smdb->pp_tables[SMDB_TBL_ID_PORT] + dest_index;
+
+		/* errors are reported by the path record computation itself */
+		for (lid = 1; lid < p_index->lid_count; lid++) {
+			union ssa_pr_route *p_cached =
+				ssa_pr_route_entry(p_index, lid, dest_lid);
+
+			if (p_cached && !p_cached->hops)
+				ssa_pr_switch_route(p_ssa_db_smdb, p_context,
+						    htons(lid), p_dest_rec,
+						    dest_port, &route);
+		}
+	}
+
+	p_worker->res = SSA_PR_SUCCESS;
+	return NULL;
+}
+
+static void *ssa_pr_whole_world_worker(void *arg)
+{
+	struct ssa_pr_worker *p_worker = (struct ssa_pr_worker *)arg;
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	size_t i = 0;
+
+	p_guid2lid_tbl = (const struct smdb_guid2lid *)
+		p_worker->p_ssa_db_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+
+	p_worker->res = SSA_PR_SUCCESS;
+	for (i = p_worker->first; i < p_worker->last; i++) {
+		p_worker->res = ssa_pr_half_world(p_worker->p_ssa_db_smdb,
+						  p_worker->p_context,
+						  p_guid2lid_tbl[i].guid,
+						  p_worker->dump_clbk,
+						  p_worker->clbk_prm);
+		if (SSA_PR_ERROR == p_worker->res) {
+			SSA_PR_LOG_ERROR("\"Half world\" calculation failed for GUID: 0x%" PRIx64
+					 " . \"Whole world\" calculation stopped.",
+					 ntohll(p_guid2lid_tbl[i].guid));
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Runs the workers and waits for all of them. If a thread can't be
+ * started, its range is processed by the calling thread.
+ */
+static void ssa_pr_run_workers(struct ssa_pr_worker *p_workers,
+			       unsigned int thread_num,
+			       void *(*worker_fn)(void *))
+{
+	unsigned int i = 0;
+	int ret = 0;
+	char *p_started = NULL;
+
+	p_started = (char *)calloc(thread_num, sizeof(*p_started));
+
+	for (i = 0; i < thread_num; i++) {
+		if (p_started) {
+			ret = pthread_create(&p_workers[i].thread, NULL,
+					     worker_fn, p_workers + i);
+			if (!ret) {
+				p_started[i] = 1;
+				continue;
+			}
+			SSA_PR_LOG_ERROR("Unable to create path record worker thread %u."
+					 " ERROR %d (%s)", i, ret, strerror(ret));
+		}
+		worker_fn(p_workers + i);
+	}
+
+	for (i = 0; p_started && i < thread_num; i++)
+		if (p_started[i])
+			pthread_join(p_workers[i].thread, NULL);
+
+	free(p_started);
+}
+
+/*
+ * Splits GUID2LID records into thread_num contiguous ranges
+ */
+static struct ssa_pr_worker *ssa_pr_create_workers(struct ssa_db *p_ssa_db_smdb,
+						   struct ssa_pr_context *p_context,
+						   unsigned int thread_num)
+{
+	struct ssa_pr_worker *p_workers = NULL;
+	size_t count = 0;
+	unsigned int i = 0;
+
+	count = get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_GUID2LID);
+
+	p_workers = (struct ssa_pr_worker *)calloc(thread_num, sizeof(*p_workers));
+	if (!p_workers) {
+		SSA_PR_LOG_ERROR("Cannot allocate %u path record workers",
+				 thread_num);
+		return NULL;
+	}
+
+	for (i = 0; i < thread_num; i++) {
+		p_workers[i].p_ssa_db_smdb = p_ssa_db_smdb;
+		p_workers[i].p_context = p_context;
+		p_workers[i].first = count * i / thread_num;
+		p_workers[i].last = count * (i + 1) / thread_num;
+	}
+
+	return p_workers;
+}
+
+ssa_pr_status_t ssa_pr_whole_world_parallel(struct ssa_db *p_ssa_db_smdb,
+					    void *context,
+					    unsigned int thread_num,
+					    ssa_pr_path_dump_t dump_clbk,
+					    void **clbk_prm)
+{
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)context;
+	struct ssa_pr_worker *p_workers = NULL;
+	ssa_pr_status_t res = SSA_PR_SUCCESS;
+	size_t count = 0;
+	unsigned int i = 0;
+
+	SSA_ASSERT(p_ssa_db_smdb);
+	SSA_ASSERT(p_context);
+
+	if (ssa_pr_prepare_index(p_context, p_ssa_db_smdb)) {
+		SSA_PR_LOG_ERROR("Index rebuild failed.");
+		return SSA_PR_ERROR;
+	}
+
+	count = get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_GUID2LID);
+	if (!count)
+		return SSA_PR_SUCCESS;
+
+	if (!thread_num)
+		thread_num = 1;
+	if (thread_num > count)
+		thread_num = count;
+
+	p_workers = ssa_pr_create_workers(p_ssa_db_smdb, p_context,
+					  thread_num);
+	if (!p_workers)
+		return SSA_PR_ERROR;
+
+	for (i = 0; i < thread_num; i++) {
+		p_workers[i].dump_clbk = dump_clbk;
+		p_workers[i].clbk_prm = clbk_prm ? clbk_prm[i] : NULL;
+	}
+
+	/*
+	 * The route cache is filled lazily. Fill it completely first,
+	 * so it is only read while the path records are computed
+	 * and the index can be shared by all threads.
+	 */
+	ssa_pr_run_workers(p_workers, thread_num, ssa_pr_route_worker);
+	ssa_pr_run_workers(p_workers, thread_num, ssa_pr_whole_world_worker);
+
+	for (i = 0; i < thread_num; i++)
+		if (SSA_PR_ERROR == p_workers[i].res)
+			res = SSA_PR_ERROR;
+
+	free(p_workers);
+	return res;
+}
+
+/*
+ * ssa_pr_switch_route - computes the route from a switch to a destination
+ *
+ * The route starts at the egress port of the switch and ends at the
+ * destination port. Routes are memoized in the index per (switch LID,
+ * destination LID), so all consumers behind the same switch walk the
+ * LFTs only once per SMDB epoch. Switches visited on the way are cached
+ * as well.
+ */
+static
+ssa_pr_status_t ssa_pr_switch_route(const struct ssa_db *p_ssa_db_smdb,
+				    const struct ssa_pr_context *p_context,
+				    const be16_t switch_lid,
+				    const struct smdb_guid2lid *p_dest_rec,
+				    const struct smdb_port *dest_port,
+				    union ssa_pr_route *p_route)
+{
+	struct {
+		uint16_t lid;
+		uint8_t out_port;
+		uint32_t egress;
+		uint32_t ingress;
+	} path[MAX_HOPS + 1];
+	const struct ssa_pr_smdb_index *p_index = p_context->p_index;
+	const struct smdb_port *p_port_tbl = NULL;
+	union ssa_pr_route *p_cached = NULL;
+	union ssa_pr_route route;
+	uint16_t dest_lid = ntohs(p_dest_rec->lid);
+	uint16_t lid = ntohs(switch_lid);
+	uint32_t dest_index = 0;
+	int depth = 0;
+
+	p_port_tbl = (const struct smdb_port *)p_ssa_db_smdb->pp_tables[SMDB_TBL_ID_PORT];
+	dest_index = dest_port - p_port_tbl;
+
+	route.val = 0;
+
+	/* The walk uses host order compute view of the index */
+	while (1) {
+		uint32_t port = INDEX_NONE;
+		int out_port_num = -1;
+
+		p_cached = ssa_pr_route_entry(p_index, lid, dest_lid);
+		if (p_cached) {
+			route.val = p_cached->val;
+			if (route.hops)
+				break;
+		}
+
+		if (depth > MAX_HOPS) {
+			SSA_PR_LOG_ERROR("Path from switch LID %u "
+					 "to lid %u GUID 0x%016" PRIx64 " (port %d) "
+					 "needs more than %d hops, max %d hops allowed.",
+					 ntohs(switch_lid), dest_lid,
+					 ntohll(p_dest_rec->guid), dest_port->port_num,
+					 depth, MAX_HOPS);
+			return SSA_PR_ERROR;
+		}
+
+		out_port_num = ssa_pr_lft_port(p_index, lid, dest_lid);
+		if (out_port_num < 0)
+			out_port_num = find_destination_port(p_ssa_db_smdb, p_index,
+							     htons(lid),
+							     p_dest_rec->lid);
+		if (out_port_num < 0) {
+			SSA_PR_LOG_ERROR("Failed to find outgoing port for LID: %u"
+					 " on switch LID: %u. "
+					 "Path record calculation stopped.",
+					 dest_lid, lid);
+			return SSA_PR_ERROR;
+		} else if (LFT_NO_PATH == out_port_num) {
+			route.out_port = LFT_NO_PATH;
+			route.mtu = 0;
+			route.rate = 0;
+			route.hops = 1;
+			if (p_cached)
+				p_cached->val = route.val;
+			break;
+		}
+
+		port = ssa_pr_port_entry(p_index, lid, out_port_num);
+		if (port >= p_index->port_rec_count) {
+			SSA_PR_LOG_ERROR("Port not found. Path record calculation stopped."
+					 " LID: %u num: %d",
+					 lid, out_port_num);
+			return SSA_PR_ERROR;
+		}
+
+		path[depth].lid = lid;
+		path[depth].out_port = out_port_num;
+		path[depth].egress = port;
+		path[depth].ingress = INDEX_NONE;
+		depth++;
+
+		if (port == dest_index)
+			break;
+
+		port = p_index->port_link[port];
+		if (port >= p_index->port_rec_count) {
+			SSA_PR_LOG_ERROR("Port not found. Path record calculation stopped."
+					 " LID: %u num: %d",
+					 lid, out_port_num);
+			return SSA_PR_ERROR;
+		}
+
+		if (port == dest_index)
+			break;
+
+		if (!(p_index->port_rate[port] & SSA_DB_PORT_IS_SWITCH_MASK)) {
+			SSA_PR_LOG_ERROR("Error: Internal error, bad path while routing "
+					 "from switch LID %u to "
+					 "(GUID: 0x%016" PRIx64 ") port %d; "
+					 "ended at (LID: %u) port %d",
+					 ntohs(switch_lid),
+					 ntohll(p_dest_rec->guid),
+					 dest_port->port_num,
+					 p_index->port_lid[port],
+					 p_index->port_num[port]);
+			return SSA_PR_ERROR;
+		}
+
+		path[depth - 1].ingress = port;
+		lid = p_index->port_lid[port];
+	}
+
+	if (!route.hops) {
+		/* the walk reached the destination port */
+		route.mtu = p_index->port_mtu[dest_index];
+		route.rate = p_index->port_rate[dest_index] & SSA_DB_PORT_RATE_MASK;
+	}
+
+	/*
+	 * Unwind the walk. Ports are folded in the same order
+	 * as a hop by hop walk would do.
+	 */
+	while (depth-- > 0) {
+		union ssa_pr_route hop;
+		uint32_t port = path[depth].egress;
+
+		hop.out_port = LFT_NO_PATH == route.out_port ?
+			       LFT_NO_PATH : path[depth].out_port;
+		hop.mtu = p_index->port_mtu[port];
+		hop.rate = p_index->port_rate[port] & SSA_DB_PORT_RATE_MASK;
+		hop.hops = route.hops + 1;
+
+		if (hop.hops > MAX_HOPS) {
+			SSA_PR_LOG_ERROR("Path from switch LID %u "
+					 "to lid %u GUID 0x%016" PRIx64 " (port %d) "
+					 "needs more than %d hops, max %d hops allowed.",
+					 path[depth].lid, dest_lid,
+					 ntohll(p_dest_rec->guid), dest_port->port_num,
+					 hop.hops, MAX_HOPS);
+			return SSA_PR_ERROR;
+		}
+
+		if (INDEX_NONE != path[depth].ingress) {
+			uint8_t rate = p_index->port_rate[path[depth].ingress] &
+				       SSA_DB_PORT_RATE_MASK;
+
+			hop.mtu = MIN(hop.mtu, p_index->port_mtu[path[depth].ingress]);
+			if (ib_path_compare_rates_fast(hop.rate, rate) > 0)
+				hop.rate = rate;
+		}
+
+		hop.mtu = MIN(hop.mtu, route.mtu);
+		if (ib_path_compare_rates_fast(hop.rate, route.rate) > 0)
+			hop.rate = route.rate;
+
+		p_cached = ssa_pr_route_entry(p_index, path[depth].lid, dest_lid);
+		if (p_cached)
+			p_cached->val = hop.val;
+		route.val = hop.val;
+	}
+
+	*p_route = route;
+
+	return LFT_NO_PATH == route.out_port ? SSA_PR_NO_PATH : SSA_PR_SUCCESS;
+}
+
 static
 ssa_pr_status_t ssa_pr_path_params(const struct ssa_db *p_ssa_db_smdb,
 				   const struct ssa_pr_context *p_context,
@@ -471,13 +1093,12 @@ ssa_pr_status_t ssa_pr_path_params(const struct ssa_db *p_ssa_db_smdb,
 		port = source_port;
 	}
 
-	while (port != dest_port) {
-		int out_port_num = -1;
-		int port_num;
-		be16_t port_lid;
+	if (port != dest_port) {
+		be16_t port_lid = port->port_lid;
+		int port_num = port->port_num;
+		union ssa_pr_route route;
+		ssa_pr_status_t route_res = SSA_PR_SUCCESS;
 
-		port_lid = port->port_lid;
-		port_num = port->port_num;
 		port = find_linked_port(p_ssa_db_smdb, p_context->p_index,
 					port_lid, port_num);
 		if (NULL == port) {
@@ -487,71 +1108,193 @@ ssa_pr_status_t ssa_pr_path_params(const struct ssa_db *p_ssa_db_smdb,
 			return SSA_PR_ERROR;
 		}
 
-		if (port == dest_port)
-			break;
+		if (port != dest_port) {
+			if (!(port->rate & SSA_DB_PORT_IS_SWITCH_MASK)) {
+				SSA_PR_LOG_ERROR("Error: Internal error, bad path while routing "
+						 "(GUID: 0x%016" PRIx64 ") port %d to "
+						 "(GUID: 0x%016" PRIx64 ") port %d; "
+						 "ended at (LID: %u) port %d",
+						 ntohll(p_source_rec->guid),
+						 source_port->port_num,
+						 ntohll(p_dest_rec->guid),
+						 dest_port->port_num,
+						 ntohs(port->port_lid),
+						 port->port_num);
+				return SSA_PR_ERROR;
+			}
 
-		if (!(port->rate & SSA_DB_PORT_IS_SWITCH_MASK)) {
-			SSA_PR_LOG_ERROR("Error: Internal error, bad path while routing "
-					 "(GUID: 0x%016" PRIx64 ") port %d to "
-					 "(GUID: 0x%016" PRIx64 ") port %d; "
-					 "ended at (LID: %u) port %d",
-					 ntohll(p_source_rec->guid),
-					 source_port->port_num,
-					 ntohll(p_dest_rec->guid),
-					 dest_port->port_num,
-					 ntohs(port->port_lid),
-					 port->port_num);
-			return SSA_PR_ERROR;
+			p_path_prm->mtu = MIN(p_path_prm->mtu,port->mtu_cap);
+			if (ib_path_compare_rates_fast(p_path_prm->rate,port->rate & SSA_DB_PORT_RATE_MASK) > 0)
+				p_path_prm->rate = port->rate & SSA_DB_PORT_RATE_MASK;
+
+			route_res = ssa_pr_switch_route(p_ssa_db_smdb, p_context,
+							port->port_lid, p_dest_rec,
+							dest_port, &route);
+			if (SSA_PR_NO_PATH == route_res) {
+				SSA_PR_LOG_DEBUG("There is no path from LID: %u to LID: %u.",
+						 ntohs(p_source_rec->lid),
+						 ntohs(p_dest_rec->lid));
+				return SSA_PR_NO_PATH;
+			} else if (SSA_PR_SUCCESS != route_res) {
+				return route_res;
+			}
+
+			p_path_prm->mtu = MIN(p_path_prm->mtu, route.mtu);
+			if (ib_path_compare_rates_fast(p_path_prm->rate, route.rate) > 0)
+				p_path_prm->rate = route.rate;
+			p_path_prm->hops = route.hops;
+			port = dest_port;
 		}
+	}
 
-		p_path_prm->mtu = MIN(p_path_prm->mtu,port->mtu_cap);
-		if (ib_path_compare_rates_fast(p_path_prm->rate,port->rate & SSA_DB_PORT_RATE_MASK) > 0)
-			p_path_prm->rate = port->rate & SSA_DB_PORT_RATE_MASK;
+	p_path_prm->mtu = MIN(p_path_prm->mtu, port->mtu_cap);
+	if(ib_path_compare_rates_fast(p_path_prm->rate,port->rate & SSA_DB_PORT_RATE_MASK) > 0)
+		p_path_prm->rate = port->rate & SSA_DB_PORT_RATE_MASK;
 
-		out_port_num  = find_destination_port(p_ssa_db_smdb,
-						      p_context->p_index,
-						      port->port_lid,
-						      p_dest_rec->lid);
-		if (LFT_NO_PATH == out_port_num) {
-			SSA_PR_LOG_DEBUG("There is no path from LID: %u to LID: %u.",
-					 ntohs(p_source_rec->lid),
-					 ntohs(p_dest_rec->lid));
-			return SSA_PR_NO_PATH;
-		}
+	return SSA_PR_SUCCESS;
+}
 
-		port_lid = port->port_lid;
-		port = find_port(p_ssa_db_smdb, p_context->p_index,
-				 port_lid, out_port_num);
-		if (NULL == port) {
-			SSA_PR_LOG_ERROR("Port not found. Path record calculation stopped."
-					 " LID: %u num: %d",
-					 ntohs(port_lid), out_port_num);
+/*
+ * ssa_pr_reverse_path_res - checks if a path exists from a port to the source
+ *
+ * Follows the same steps as ssa_pr_path_params, but only resolves
+ * reachability. Path parameters are not folded.
+ */
+static
+ssa_pr_status_t ssa_pr_reverse_path_res(const struct ssa_db *p_ssa_db_smdb,
+					const struct ssa_pr_context *p_context,
+					const struct smdb_guid2lid *p_from_rec,
+					const struct smdb_guid2lid *p_source_rec,
+					const struct smdb_port *source_port)
+{
+	const struct smdb_port *from_port = NULL;
+	const struct smdb_port *port = NULL;
+	union ssa_pr_route route;
+
+	if (p_from_rec->is_switch)
+		from_port = get_switch_port(p_ssa_db_smdb, p_context->p_index,
+					    p_from_rec->lid, 0);
+	else
+		from_port = get_host_port(p_ssa_db_smdb, p_context->p_index,
+					  p_from_rec->lid);
+	if (NULL == from_port) {
+		SSA_PR_LOG_ERROR("Source port not found. Path record calculation stopped."
+				 " LID: %u",
+				 ntohs(p_from_rec->lid));
+		return SSA_PR_ERROR;
+	}
+
+	if (p_from_rec->is_switch) {
+		const int out_port_num = find_destination_port(p_ssa_db_smdb,
+							       p_context->p_index,
+							       p_from_rec->lid,
+							       p_source_rec->lid);
+		if (out_port_num < 0) {
+			SSA_PR_LOG_ERROR("Failed to find outgoing port for LID: %u"
+					 " on switch LID: %u. "
+					 "Path record calculation stopped.",
+					 ntohs(p_source_rec->lid),
+					 ntohs(p_from_rec->lid));
 			return SSA_PR_ERROR;
+		} else if (LFT_NO_PATH == out_port_num) {
+			return SSA_PR_NO_PATH;
 		}
 
-		p_path_prm->mtu = MIN(p_path_prm->mtu,port->mtu_cap);
-		if (ib_path_compare_rates_fast(p_path_prm->rate,port->rate & SSA_DB_PORT_RATE_MASK) > 0)
-			p_path_prm->rate = port->rate & SSA_DB_PORT_RATE_MASK;
-		p_path_prm->hops++;
-
-		if (p_path_prm->hops > MAX_HOPS) {
-			SSA_PR_LOG_ERROR(
-				"Path from GUID 0x%016" PRIx64 " (port %d) "
-				"to lid %u GUID 0x%016" PRIx64 " (port %d) "
-				"needs more than %d hops, max %d hops allowed.",
-				ntohll(p_source_rec->guid),
-				source_port->port_num, ntohs(p_dest_rec->lid),
-				ntohll(p_dest_rec->guid), dest_port->port_num,
-				p_path_prm->hops, MAX_HOPS);
+		port = find_port(p_ssa_db_smdb, p_context->p_index,
+				 p_from_rec->lid, out_port_num);
+		if (NULL == port) {
+			SSA_PR_LOG_ERROR("Port not found. Path record calculation stopped."
+					 " LID: %u num: %d",
+					 ntohs(p_from_rec->lid), out_port_num);
 			return SSA_PR_ERROR;
 		}
+	} else {
+		port = from_port;
 	}
 
-	p_path_prm->mtu = MIN(p_path_prm->mtu, port->mtu_cap);
-	if(ib_path_compare_rates_fast(p_path_prm->rate,port->rate & SSA_DB_PORT_RATE_MASK) > 0)
-		p_path_prm->rate = port->rate & SSA_DB_PORT_RATE_MASK;
+	if (port == source_port)
+		return SSA_PR_SUCCESS;
 
-	return SSA_PR_SUCCESS;
+	port = find_linked_port(p_ssa_db_smdb, p_context->p_index,
+				port->port_lid, port->port_num);
+	if (NULL == port) {
+		SSA_PR_LOG_ERROR("Linked port not found. Path record calculation stopped."
+				 " LID: %u", ntohs(p_from_rec->lid));
+		return SSA_PR_ERROR;
+	}
+
+	if (port == source_port)
+		return SSA_PR_SUCCESS;
+
+	if (!(port->rate & SSA_DB_PORT_IS_SWITCH_MASK)) {
+		SSA_PR_LOG_ERROR("Error: Internal error, bad path while routing "
+				 "(GUID: 0x%016" PRIx64 ") port %d to "
+				 "(GUID: 0x%016" PRIx64 ") port %d; "
+				 "ended at (LID: %u) port %d",
+				 ntohll(p_from_rec->guid),
+				 from_port->port_num,
+				 ntohll(p_source_rec->guid),
+				 source_port->port_num,
+				 ntohs(port->port_lid),
+				 port->port_num);
+		return SSA_PR_ERROR;
+	}
+
+	return ssa_pr_switch_route(p_ssa_db_smdb, p_context, port->port_lid,
+				   p_source_rec, source_port, &route);
+}
+
+/*
+ * ssa_pr_reverse_reachability - checks which destinations reach the source
+ *
+ * All reverse paths of a "half world" end at the same source port.
+ * They are resolved in one pass over GUID2LID records instead of once
+ * per LID pair, and the switch routes toward the source LID are shared
+ * through the route cache, so each switch LFT is consulted only once.
+ *
+ * p_reverse_res[i] is set to the reverse path result of the i-th
+ * GUID2LID record.
+ */
+static
+void ssa_pr_reverse_reachability(const struct ssa_db *p_ssa_db_smdb,
+				 const struct ssa_pr_context *p_context,
+				 const struct smdb_guid2lid *p_source_rec,
+				 uint8_t *p_reverse_res)
+{
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	const struct smdb_port *source_port = NULL;
+	size_t guid_to_lid_count = 0;
+	size_t i = 0;
+
+	SSA_ASSERT(p_ssa_db_smdb);
+	SSA_ASSERT(p_context);
+	SSA_ASSERT(p_source_rec);
+	SSA_ASSERT(p_reverse_res);
+
+	p_guid2lid_tbl = (const struct smdb_guid2lid *)
+		p_ssa_db_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	guid_to_lid_count = get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_GUID2LID);
+
+	if (p_source_rec->is_switch)
+		source_port = get_switch_port(p_ssa_db_smdb, p_context->p_index,
+					      p_source_rec->lid, 0);
+	else
+		source_port = get_host_port(p_ssa_db_smdb, p_context->p_index,
+					    p_source_rec->lid);
+	if (NULL == source_port) {
+		SSA_PR_LOG_ERROR("Destination port not found. Path record calculation stopped."
+				 " LID: %u",
+				 ntohs(p_source_rec->lid));
+		memset(p_reverse_res, SSA_PR_ERROR,
+		       guid_to_lid_count * sizeof(*p_reverse_res));
+		return;
+	}
+
+	for (i = 0; i < guid_to_lid_count; i++)
+		p_reverse_res[i] = ssa_pr_reverse_path_res(p_ssa_db_smdb, p_context,
+							   p_guid2lid_tbl + i,
+							   p_source_rec,
+							   source_port);
 }
 
 void ssa_pr_reinit_context(void *context, struct ssa_db *smdb)
@@ -573,6 +1316,7 @@ void *ssa_pr_create_context()
 	}
 
 	memset(p_context,'\0',sizeof(struct ssa_pr_context));
+	p_context->prev_epoch = DB_EPOCH_INVALID;
 
 	p_context->p_index = (struct ssa_pr_smdb_index *)malloc(sizeof(struct ssa_pr_smdb_index));
 	if (!p_context->p_index) {
@@ -598,6 +1342,20 @@ Error:
 	return NULL;
 }
 
+static void ssa_pr_destroy_shared(struct ssa_pr_context *p_context)
+{
+	struct ssa_pr_shared_prdb *p_shared = NULL;
+	size_t i = 0;
+
+	for (i = 0; i < SSA_PR_SHARED_BUCKETS; i++) {
+		while ((p_shared = p_context->pp_shared[i])) {
+			p_context->pp_shared[i] = p_shared->p_next;
+			ssa_db_release(p_shared->p_prdb);
+			free(p_shared);
+		}
+	}
+}
+
 void ssa_pr_destroy_context(void *ctx)
 {
 	struct ssa_pr_context *p_context = (struct ssa_pr_context *)ctx;
@@ -608,7 +1366,796 @@ void ssa_pr_destroy_context(void *ctx)
 			free(p_context->p_index);
 			p_context->p_index = NULL;
 		}
+		free(p_context->p_lid_changed);
+		free(p_context->p_route_changed);
+		ssa_db_release(p_context->p_smdb);
+		if (p_context->pp_shared) {
+			ssa_pr_destroy_shared(p_context);
+			free(p_context->pp_shared);
+			p_context->pp_shared = NULL;
+			pthread_mutex_destroy(&p_context->shared_lock);
+		}
 		free(p_context);
 		p_context = NULL;
 	}
 }
+
+void ssa_pr_set_partitions(void *ctx, int enable)
+{
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)ctx;
+
+	if (p_context)
+		p_context->partitions = enable;
+}
+
+void *ssa_pr_create_snapshot(struct ssa_db *smdb, unsigned int thread_num)
+{
+	struct ssa_pr_context *p_context = NULL;
+	struct ssa_pr_worker *p_workers = NULL;
+	size_t count = 0;
+
+	SSA_ASSERT(smdb);
+
+	p_context = (struct ssa_pr_context *)ssa_pr_create_context();
+	if (!p_context)
+		return NULL;
+
+	if (ssa_pr_build_indexes(p_context->p_index, smdb)) {
+		SSA_PR_LOG_ERROR("SMDB index creation failed. epoch: 0x%" PRIx64,
+				 ssa_db_get_epoch(smdb, DB_DEF_TBL_ID));
+		goto Error;
+	}
+
+	count = get_dataset_count(smdb, SMDB_TBL_ID_GUID2LID);
+	if (!thread_num)
+		thread_num = 1;
+	if (thread_num > count)
+		thread_num = count;
+
+	/*
+	 * Route cache is filled completely, so the snapshot
+	 * is never written after it's published.
+	 */
+	p_workers = ssa_pr_create_workers(smdb, p_context, thread_num);
+	if (!p_workers)
+		goto Error;
+	ssa_pr_run_workers(p_workers, thread_num, ssa_pr_route_worker);
+	free(p_workers);
+
+	p_context->pp_shared = (struct ssa_pr_shared_prdb **)
+		calloc(SSA_PR_SHARED_BUCKETS, sizeof(*p_context->pp_shared));
+	if (!p_context->pp_shared) {
+		SSA_PR_LOG_ERROR("Cannot allocate shared PRDB table");
+		goto Error;
+	}
+	pthread_mutex_init(&p_context->shared_lock, NULL);
+
+	p_context->p_smdb = ssa_db_get(smdb);
+	atomic_init(&p_context->refcnt);
+	atomic_set(&p_context->refcnt, 1);
+
+	SSA_PR_LOG_INFO("Path record snapshot created. epoch: 0x%" PRIx64,
+			p_context->p_index->epoch);
+
+	return p_context;
+
+Error:
+	ssa_pr_destroy_context(p_context);
+	return NULL;
+}
+
+void *ssa_pr_get_snapshot(void *ctx)
+{
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)ctx;
+
+	if (p_context)
+		atomic_inc(&p_context->refcnt);
+
+	return p_context;
+}
+
+void ssa_pr_put_snapshot(void *ctx)
+{
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)ctx;
+
+	if (p_context && !atomic_dec(&p_context->refcnt))
+		ssa_pr_destroy_context(p_context);
+}
+
+void ssa_pr_release_shared(void *ctx)
+{
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)ctx;
+
+	if (!p_context || !p_context->pp_shared)
+		return;
+
+	pthread_mutex_lock(&p_context->shared_lock);
+	ssa_pr_destroy_shared(p_context);
+	p_context->shared_released = 1;
+	pthread_mutex_unlock(&p_context->shared_lock);
+}
+
+static size_t route_count(const struct ssa_pr_smdb_index *p_index)
+{
+	size_t i = 0, count = 0;
+
+	for (i = 0; i < p_index->lid_count; i++) {
+		const struct ssa_pr_lid_index *p_lid = p_index->lid_lookup + i;
+
+		if (INDEX_NONE != p_lid->route_offset)
+			count = MAX(count, p_lid->route_offset + p_lid->lft_top + 1);
+	}
+
+	return count;
+}
+
+int ssa_pr_diff_snapshot(void *ctx, const void *prev_ctx)
+{
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)ctx;
+	const struct ssa_pr_context *p_prev = (const struct ssa_pr_context *)prev_ctx;
+	const struct ssa_pr_smdb_index *p_index = NULL;
+	const struct ssa_pr_smdb_index *p_prev_index = NULL;
+	size_t i = 0, count = 0;
+	size_t lid_changes = 0, route_changes = 0;
+
+	SSA_ASSERT(p_context);
+	SSA_ASSERT(p_prev);
+
+	p_index = p_context->p_index;
+	p_prev_index = p_prev->p_index;
+
+	/*
+	 * Delta is used only if LIDs and routing tables are laid out
+	 * the same way, so indexes can be compared entry by entry.
+	 */
+	if (!p_context->p_smdb || !p_prev->p_smdb ||
+	    p_context->partitions != p_prev->partitions ||
+	    p_index->lid_count != p_prev_index->lid_count ||
+	    p_index->guid2lid_digest != p_prev_index->guid2lid_digest ||
+	    memcmp(p_index->lid_lookup, p_prev_index->lid_lookup,
+		   p_index->lid_count * sizeof(*p_index->lid_lookup))) {
+		SSA_PR_LOG_INFO("SMDB layout is changed. epoch: 0x%" PRIx64
+				" previous epoch: 0x%" PRIx64 ". Path records"
+				" will be recomputed completely.",
+				p_index->epoch, p_prev_index->epoch);
+		return -1;
+	}
+
+	count = route_count(p_index);
+
+	p_context->p_lid_changed = (uint8_t *)calloc(p_index->lid_count,
+						     sizeof(uint8_t));
+	p_context->p_route_changed = (uint8_t *)calloc(count / 8 + 1,
+						       sizeof(uint8_t));
+	if (!p_context->p_lid_changed || !p_context->p_route_changed) {
+		SSA_PR_LOG_ERROR("Cannot allocate path record snapshot delta");
+		goto Error;
+	}
+
+	for (i = 0; i < p_index->lid_count; i++) {
+		if (p_index->lid_digest[i] != p_prev_index->lid_digest[i]) {
+			p_context->p_lid_changed[i] = 1;
+			lid_changes++;
+		}
+	}
+
+	/* Route caches of both snapshots are filled completely */
+	for (i = 0; i < count; i++) {
+		if (p_index->route_cache[i].val != p_prev_index->route_cache[i].val) {
+			p_context->p_route_changed[i / 8] |= 1 << (i % 8);
+			route_changes++;
+		}
+	}
+
+	p_context->prev_epoch = p_prev_index->epoch;
+
+	SSA_PR_LOG_INFO("Path record snapshot epoch: 0x%" PRIx64
+			" previous epoch: 0x%" PRIx64 ". Changed LIDs: %zu"
+			" changed routes: %zu",
+			p_index->epoch, p_context->prev_epoch,
+			lid_changes, route_changes);
+
+	return 0;
+
+Error:
+	free(p_context->p_lid_changed);
+	free(p_context->p_route_changed);
+	p_context->p_lid_changed = NULL;
+	p_context->p_route_changed = NULL;
+	return -1;
+}
+
+static int ssa_pr_route_changed(const struct ssa_pr_context *p_context,
+				const be16_t switch_lid, const be16_t dest_lid)
+{
+	const struct ssa_pr_lid_index *p_lid = NULL;
+	size_t entry = 0;
+
+	if (ntohs(switch_lid) >= p_context->p_index->lid_count)
+		return 1;
+
+	p_lid = p_context->p_index->lid_lookup + ntohs(switch_lid);
+	if (INDEX_NONE == p_lid->route_offset || ntohs(dest_lid) > p_lid->lft_top)
+		return 0;
+
+	entry = p_lid->route_offset + ntohs(dest_lid);
+	return (p_context->p_route_changed[entry / 8] >> (entry % 8)) & 1;
+}
+
+/*
+ * Path records are computed for every LID of the destination,
+ * each of them is routed by its own LFT entry.
+ */
+static int ssa_pr_dest_route_changed(const struct ssa_pr_context *p_context,
+				     const be16_t switch_lid,
+				     const struct smdb_guid2lid *p_dest_rec)
+{
+	uint16_t dest_lid = ntohs(p_dest_rec->lid);
+	uint16_t dest_last_lid = dest_lid + (0x01 << p_dest_rec->lmc) - 1;
+
+	for (; dest_lid <= dest_last_lid; ++dest_lid)
+		if (ssa_pr_route_changed(p_context, switch_lid, htons(dest_lid)))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * A switch source doesn't use its own egress port, so the route
+ * from the next switch to the destination LID is checked.
+ */
+static int ssa_pr_next_hop_changed(const struct ssa_db *p_ssa_db_smdb,
+				   const struct ssa_pr_context *p_context,
+				   const struct smdb_guid2lid *p_source_rec,
+				   const be16_t dest_lid)
+{
+	const struct smdb_port *port = NULL;
+	int out_port_num = find_destination_port(p_ssa_db_smdb,
+						 p_context->p_index,
+						 p_source_rec->lid, dest_lid);
+
+	if (out_port_num < 0)
+		return 1;
+	if (LFT_NO_PATH == out_port_num || !out_port_num)
+		return 0;
+
+	port = find_linked_port(p_ssa_db_smdb, p_context->p_index,
+				p_source_rec->lid, out_port_num);
+	return !port || ssa_pr_route_changed(p_context, port->port_lid, dest_lid);
+}
+
+/*
+ * Returns LID of the first switch on the way from a GUID to LID record port.
+ * For a switch it's the switch itself. 0 - there is no such switch.
+ */
+static be16_t ssa_pr_first_switch(const struct ssa_db *p_ssa_db_smdb,
+				  const struct ssa_pr_context *p_context,
+				  const struct smdb_guid2lid *p_rec)
+{
+	const struct smdb_port *port = NULL;
+
+	if (p_rec->is_switch)
+		return p_rec->lid;
+
+	port = find_linked_port(p_ssa_db_smdb, p_context->p_index,
+				p_rec->lid, 0);
+	if (!port || !(port->rate & SSA_DB_PORT_IS_SWITCH_MASK))
+		return 0;
+
+	return port->port_lid;
+}
+
+/*
+ * Path record from the source to a destination depends on ports and links
+ * of both of them, on the routes from the first switch of the source to each
+ * LID of the destination, and on the route back. If the source is a switch,
+ * its own egress port is not used, so the routes from the next switch are
+ * checked too.
+ *
+ * p_affected[i] is set, if the path record to the i-th GUID2LID record
+ * has to be recomputed.
+ *
+ * @return value: number of affected destinations. < 0 - all destinations
+ *                are affected.
+ */
+static int64_t ssa_pr_affected_dests(const struct ssa_db *p_ssa_db_smdb,
+				     const struct ssa_pr_context *p_context,
+				     const struct smdb_guid2lid *p_source_rec,
+				     uint8_t *p_affected)
+{
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	size_t guid_to_lid_count = 0;
+	size_t i = 0;
+	int64_t count = 0;
+	be16_t source_switch = 0;
+
+	p_guid2lid_tbl = (const struct smdb_guid2lid *)
+		p_ssa_db_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	guid_to_lid_count = get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_GUID2LID);
+
+	if (p_context->p_lid_changed[ntohs(p_source_rec->lid)])
+		return -1;
+
+	source_switch = ssa_pr_first_switch(p_ssa_db_smdb, p_context, p_source_rec);
+	if (!source_switch)
+		return -1;
+
+	for (i = 0; i < guid_to_lid_count; i++) {
+		const struct smdb_guid2lid *p_dest_rec = p_guid2lid_tbl + i;
+		uint16_t dest_lid = ntohs(p_dest_rec->lid);
+		uint16_t dest_last_lid = dest_lid + (0x01 << p_dest_rec->lmc) - 1;
+		be16_t dest_switch = 0;
+		int affected = 0;
+
+		affected = p_context->p_lid_changed[ntohs(p_dest_rec->lid)] ||
+			   ssa_pr_dest_route_changed(p_context, source_switch,
+						     p_dest_rec);
+
+		if (p_source_rec->is_switch &&
+		    p_source_rec->lid != p_dest_rec->lid)
+			for (; !affected && dest_lid <= dest_last_lid; ++dest_lid)
+				affected = ssa_pr_next_hop_changed(p_ssa_db_smdb,
+								   p_context,
+								   p_source_rec,
+								   htons(dest_lid));
+
+		if (!affected) {
+			dest_switch = ssa_pr_first_switch(p_ssa_db_smdb, p_context,
+							  p_dest_rec);
+			affected = !dest_switch ||
+				   ssa_pr_route_changed(p_context, dest_switch,
+							p_source_rec->lid);
+		}
+
+		p_affected[i] = affected;
+		count += affected;
+	}
+
+	return count;
+}
+
+static int copy_pr_to_prdb(const struct prdb_pr *p_pr, struct prdb_prm *p_prm)
+{
+	struct db_dataset *p_dataset = NULL;
+	uint64_t set_count = 0;
+
+	p_dataset = p_prm->prdb->p_db_tables + PRDB_TBL_ID_PR;
+	set_count = ntohll(p_dataset->set_count);
+
+	if (set_count >= p_prm->max_count) {
+		SSA_PR_LOG_INFO("PRDB is full");
+		return 1;
+	}
+
+	memcpy((struct prdb_pr *)p_prm->prdb->pp_tables[PRDB_TBL_ID_PR] + set_count,
+	       p_pr, sizeof(*p_pr));
+
+	p_dataset->set_count = htonll(set_count + 1);
+	p_dataset->set_size = htonll(ntohll(p_dataset->set_size) + sizeof(*p_pr));
+
+	return 0;
+}
+
+/*
+ * Builds "half world" path records from the previous PRDB. Records of
+ * the affected destinations are recomputed, others are copied. Records
+ * of a destination are consecutive in both databases, and destinations
+ * are in the same order, because GUID2LID table is not changed.
+ *
+ * If p_reverse_res is set, reversibility of the copied records is taken
+ * from it, see ssa_pr_reverse_reachability.
+ *
+ * @return value: SSA_PR_PRDB_ERROR - the previous PRDB doesn't correspond
+ *                to the SMDB.
+ */
+static ssa_pr_status_t ssa_pr_half_world_delta(const struct ssa_db *p_ssa_db_smdb,
+					       const struct ssa_pr_context *p_context,
+					       const struct smdb_guid2lid *p_source_rec,
+					       const uint8_t *p_affected,
+					       const uint8_t *p_reverse_res,
+					       const struct ssa_db *p_prev_prdb,
+					       struct prdb_prm *p_prm)
+{
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	const struct prdb_pr *p_prev_tbl = NULL;
+	const struct smdb_port *source_port = NULL;
+	const be16_t *p_source_pkeys = NULL;
+	size_t guid_to_lid_count = 0, source_pkey_count = 0;
+	size_t prev_count = 0, k = 0, i = 0;
+	uint16_t source_lid = 0;
+	uint16_t source_last_lid = 0;
+	int partitions = 0;
+	int rt = 0;
+
+	p_guid2lid_tbl = (const struct smdb_guid2lid *)
+		p_ssa_db_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	guid_to_lid_count = get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_GUID2LID);
+
+	p_prev_tbl = (const struct prdb_pr *)p_prev_prdb->pp_tables[PRDB_TBL_ID_PR];
+	prev_count = ntohll(p_prev_prdb->p_db_tables[PRDB_TBL_ID_PR].set_count);
+
+	if (p_source_rec->is_switch)
+		source_port = get_switch_port(p_ssa_db_smdb, p_context->p_index,
+					      p_source_rec->lid, 0);
+	else
+		source_port = get_host_port(p_ssa_db_smdb, p_context->p_index,
+					    p_source_rec->lid);
+	if (NULL == source_port) {
+		SSA_PR_LOG_ERROR("Source port not found. LID: %u",
+				 ntohs(p_source_rec->lid));
+		return SSA_PR_ERROR;
+	}
+
+	partitions = ssa_pr_source_pkeys(p_ssa_db_smdb, p_context, p_source_rec,
+					 &p_source_pkeys, &source_pkey_count);
+
+	source_lid = ntohs(p_source_rec->lid);
+	source_last_lid = source_lid + (0x01 << p_source_rec->lmc) - 1;
+
+	for (; source_lid <= source_last_lid; ++source_lid) {
+		for (i = 0; i < guid_to_lid_count; i++) {
+			const struct smdb_guid2lid *p_dest_rec = p_guid2lid_tbl + i;
+			uint16_t dest_base_lid = ntohs(p_dest_rec->lid);
+			uint16_t dest_last_lid = dest_base_lid +
+						 (0x01 << p_dest_rec->lmc) - 1;
+			be16_t pkey = PK_DEFAULT_VAL;
+			uint8_t reverse_res = SSA_PR_SUCCESS;
+
+			for (; k < prev_count &&
+			       p_prev_tbl[k].guid == p_dest_rec->guid &&
+			       ntohs(p_prev_tbl[k].lid) >= dest_base_lid &&
+			       ntohs(p_prev_tbl[k].lid) <= dest_last_lid; k++) {
+				struct prdb_pr rec;
+
+				if (p_affected[i])
+					continue;
+				rec = p_prev_tbl[k];
+				if (p_reverse_res)
+					rec.is_reversible =
+						SSA_PR_SUCCESS == p_reverse_res[i];
+				rt = copy_pr_to_prdb(&rec, p_prm);
+				if (rt)
+					return SSA_PR_SUCCESS;
+			}
+
+			if (!p_affected[i])
+				continue;
+
+			if (partitions &&
+			    !ssa_pr_dest_pkey(p_ssa_db_smdb, p_context,
+					      p_source_pkeys, source_pkey_count,
+					      p_dest_rec, &pkey))
+				continue;
+
+			reverse_res = ssa_pr_reverse_path_res(p_ssa_db_smdb,
+							      p_context,
+							      p_dest_rec,
+							      p_source_rec,
+							      source_port);
+
+			rt = ssa_pr_dest_paths(p_ssa_db_smdb, p_context,
+					       p_source_rec, source_lid,
+					       p_dest_rec, pkey, reverse_res,
+					       insert_pr_to_prdb, p_prm);
+			if (rt < 0)
+				return SSA_PR_ERROR;
+			else if (rt > 0)
+				return SSA_PR_SUCCESS;
+		}
+	}
+
+	if (k != prev_count) {
+		SSA_PR_LOG_INFO("Previous PRDB doesn't correspond to SMDB. "
+				"Records used: %zu records: %zu", k, prev_count);
+		return SSA_PR_PRDB_ERROR;
+	}
+
+	return SSA_PR_SUCCESS;
+}
+
+/*
+ * Returns 0, if the source doesn't have a class: it's a switch
+ * or it isn't attached to a switch.
+ */
+static int ssa_pr_source_class(const struct ssa_db *p_ssa_db_smdb,
+			       const struct ssa_pr_context *p_context,
+			       const struct smdb_guid2lid *p_source_rec,
+			       struct ssa_pr_source_class *p_class)
+{
+	const struct smdb_port *port = NULL;
+	const struct smdb_port *link = NULL;
+
+	if (p_source_rec->is_switch)
+		return 0;
+
+	port = get_host_port(p_ssa_db_smdb, p_context->p_index,
+			     p_source_rec->lid);
+	if (!port)
+		return 0;
+
+	link = find_linked_port(p_ssa_db_smdb, p_context->p_index,
+				port->port_lid, port->port_num);
+	if (!link || !(link->rate & SSA_DB_PORT_IS_SWITCH_MASK))
+		return 0;
+
+	memset(p_class, 0, sizeof(*p_class));
+	p_class->switch_lid = link->port_lid;
+	p_class->lmc = p_source_rec->lmc;
+	p_class->mtu = port->mtu_cap;
+	p_class->rate = port->rate & SSA_DB_PORT_RATE_MASK;
+	p_class->link_mtu = link->mtu_cap;
+	p_class->link_rate = link->rate & SSA_DB_PORT_RATE_MASK;
+	ssa_pr_source_pkeys(p_ssa_db_smdb, p_context, p_source_rec,
+			    &p_class->p_pkeys, &p_class->pkey_count);
+
+	return 1;
+}
+
+static int ssa_pr_same_class(const struct ssa_pr_source_class *p_class1,
+			     const struct ssa_pr_source_class *p_class2)
+{
+	return p_class1->switch_lid == p_class2->switch_lid &&
+	       p_class1->lmc == p_class2->lmc &&
+	       p_class1->mtu == p_class2->mtu &&
+	       p_class1->rate == p_class2->rate &&
+	       p_class1->link_mtu == p_class2->link_mtu &&
+	       p_class1->link_rate == p_class2->link_rate &&
+	       p_class1->pkey_count == p_class2->pkey_count &&
+	       (!p_class1->pkey_count ||
+		!memcmp(p_class1->p_pkeys, p_class2->p_pkeys,
+			p_class1->pkey_count * sizeof(*p_class1->p_pkeys)));
+}
+
+/*
+ * Derives "half world" path records of a source from the PRDB of another
+ * source of the same class. Records to both sources are recomputed, others
+ * are copied with the reverse reachability of the source.
+ */
+static ssa_pr_status_t ssa_pr_derive_half_world(const struct ssa_db *p_ssa_db_smdb,
+						const struct ssa_pr_context *p_context,
+						const struct smdb_guid2lid *p_source_rec,
+						const struct ssa_pr_shared_prdb *p_shared,
+						struct prdb_prm *p_prm)
+{
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	uint8_t *p_affected = NULL;
+	uint8_t *p_reverse_res = NULL;
+	size_t guid_to_lid_count = 0;
+	ssa_pr_status_t res = SSA_PR_ERROR;
+
+	p_guid2lid_tbl = (const struct smdb_guid2lid *)
+		p_ssa_db_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	guid_to_lid_count = get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_GUID2LID);
+
+	p_affected = (uint8_t *)calloc(guid_to_lid_count, sizeof(*p_affected));
+	p_reverse_res = (uint8_t *)malloc(guid_to_lid_count * sizeof(*p_reverse_res));
+	if (!p_affected || !p_reverse_res) {
+		SSA_PR_LOG_ERROR("Cannot allocate destination arrays. Count: %zu",
+				 guid_to_lid_count);
+		goto Exit;
+	}
+
+	p_affected[p_source_rec - p_guid2lid_tbl] = 1;
+	p_affected[p_shared->p_source_rec - p_guid2lid_tbl] = 1;
+
+	ssa_pr_reverse_reachability(p_ssa_db_smdb, p_context,
+				    p_source_rec, p_reverse_res);
+
+	res = ssa_pr_half_world_delta(p_ssa_db_smdb, p_context, p_source_rec,
+				      p_affected, p_reverse_res,
+				      p_shared->p_prdb, p_prm);
+Exit:
+	free(p_reverse_res);
+	free(p_affected);
+	return res;
+}
+
+ssa_pr_status_t ssa_pr_compute_half_world_shared(struct ssa_db *p_ssa_db_smdb,
+						 void *p_ctnx, be64_t port_guid,
+						 struct ssa_db **pp_prdb)
+{
+	uint64_t records_num[PRDB_TBL_ID_MAX] = { 0 };
+	const struct smdb_guid2lid *p_source_rec = NULL;
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)p_ctnx;
+	struct ssa_pr_shared_prdb *p_shared = NULL;
+	struct ssa_pr_shared_prdb shared;
+	struct ssa_pr_source_class source_class;
+	ssa_pr_status_t res = SSA_PR_SUCCESS;
+	struct prdb_prm prm;
+	size_t bucket = 0;
+	int owner = 0;
+
+	SSA_ASSERT(p_context);
+
+	*pp_prdb = NULL;
+
+	if (!p_context->pp_shared)
+		goto Full;
+
+	if (ssa_pr_prepare_index(p_context, p_ssa_db_smdb)) {
+		SSA_PR_LOG_ERROR("Index rebuild failed.");
+		return SSA_PR_ERROR;
+	}
+
+	p_source_rec = find_guid_to_lid_rec_by_guid(p_ssa_db_smdb, p_context->p_index,
+						    port_guid);
+	if (NULL == p_source_rec ||
+	    !ssa_pr_source_class(p_ssa_db_smdb, p_context, p_source_rec,
+				 &source_class))
+		goto Full;
+
+	bucket = ntohs(source_class.switch_lid) % SSA_PR_SHARED_BUCKETS;
+
+	memset(&shared, 0, sizeof(shared));
+
+	pthread_mutex_lock(&p_context->shared_lock);
+	if (p_context->shared_released) {
+		pthread_mutex_unlock(&p_context->shared_lock);
+		goto Full;
+	}
+
+	for (p_shared = p_context->pp_shared[bucket]; p_shared;
+	     p_shared = p_shared->p_next)
+		if (ssa_pr_same_class(&p_shared->source_class, &source_class))
+			break;
+
+	if (p_shared) {
+		/* the entry may be released while the PRDB is derived */
+		shared = *p_shared;
+		ssa_db_get(shared.p_prdb);
+	} else {
+		p_shared = (struct ssa_pr_shared_prdb *)calloc(1, sizeof(*p_shared));
+		if (p_shared) {
+			p_shared->source_class = source_class;
+			p_shared->p_source_rec = p_source_rec;
+			p_shared->p_next = p_context->pp_shared[bucket];
+			p_context->pp_shared[bucket] = p_shared;
+			owner = 1;
+		}
+	}
+	pthread_mutex_unlock(&p_context->shared_lock);
+
+	/* The shared PRDB is still being computed by another thread */
+	if (!shared.p_prdb)
+		goto Full;
+
+	records_num[PRDB_TBL_ID_PR] =
+		ssa_pr_compute_pr_max_number(p_ssa_db_smdb, port_guid);
+
+	*pp_prdb = ssa_prdb_create(DB_EPOCH_INVALID /* epoch */, records_num);
+	if (!*pp_prdb) {
+		SSA_PR_LOG_ERROR("Path record database creation failed."
+				 " Number of records: %"PRIu64, records_num[PRDB_TBL_ID_PR]);
+		ssa_db_release(shared.p_prdb);
+		return SSA_PR_PRDB_ERROR;
+	}
+
+	prm.prdb = *pp_prdb;
+	prm.max_count = records_num[PRDB_TBL_ID_PR];
+
+	res = ssa_pr_derive_half_world(p_ssa_db_smdb, p_context, p_source_rec,
+				       &shared, &prm);
+	ssa_db_release(shared.p_prdb);
+	if (SSA_PR_SUCCESS == res) {
+		SSA_PR_LOG_DEBUG("GUID: 0x%016" PRIx64 " PRDB derived from GUID: 0x%016" PRIx64,
+				 ntohll(port_guid), ntohll(shared.p_source_rec->guid));
+		return SSA_PR_SUCCESS;
+	}
+
+	ssa_db_destroy(*pp_prdb);
+	*pp_prdb = NULL;
+	if (SSA_PR_ERROR == res) {
+		SSA_PR_LOG_ERROR("\"Half world\" calculation failed for GUID: 0x%" PRIx64,
+				 ntohll(port_guid));
+		return SSA_PR_ERROR;
+	}
+
+Full:
+	res = ssa_pr_compute_half_world(p_ssa_db_smdb, p_ctnx, port_guid, pp_prdb);
+
+	/*
+	 * The PRDB isn't modified after it's computed, so the shared
+	 * entry takes a reference instead of a copy. The entry itself
+	 * is gone, if the shared PRDBs were released meanwhile.
+	 */
+	if (owner) {
+		pthread_mutex_lock(&p_context->shared_lock);
+		if (!p_context->shared_released && SSA_PR_SUCCESS == res)
+			p_shared->p_prdb = ssa_db_get(*pp_prdb);
+		pthread_mutex_unlock(&p_context->shared_lock);
+	}
+
+	return res;
+}
+
+ssa_pr_status_t ssa_pr_compute_half_world_delta(struct ssa_db *p_ssa_db_smdb,
+						void *p_ctnx, be64_t port_guid,
+						const struct ssa_db *p_prev_prdb,
+						uint64_t prev_epoch,
+						struct ssa_db **pp_prdb)
+{
+	uint64_t records_num[PRDB_TBL_ID_MAX] = { 0 };
+	const struct smdb_guid2lid *p_source_rec = NULL;
+	struct ssa_pr_context *p_context = (struct ssa_pr_context *)p_ctnx;
+	uint8_t *p_affected = NULL;
+	size_t guid_to_lid_count = 0;
+	int64_t affected_count = 0;
+	ssa_pr_status_t res = SSA_PR_SUCCESS;
+	struct prdb_prm prm;
+
+	SSA_ASSERT(p_context);
+
+	*pp_prdb = NULL;
+
+	if (!p_prev_prdb || !p_context->p_lid_changed ||
+	    DB_EPOCH_INVALID == prev_epoch || prev_epoch != p_context->prev_epoch)
+		goto Full;
+
+	if (ssa_pr_prepare_index(p_context, p_ssa_db_smdb)) {
+		SSA_PR_LOG_ERROR("Index rebuild failed.");
+		return SSA_PR_ERROR;
+	}
+
+	p_source_rec = find_guid_to_lid_rec_by_guid(p_ssa_db_smdb, p_context->p_index,
+						    port_guid);
+	if (NULL == p_source_rec)
+		goto Full;
+
+	guid_to_lid_count = get_dataset_count(p_ssa_db_smdb, SMDB_TBL_ID_GUID2LID);
+	p_affected = (uint8_t *)malloc(guid_to_lid_count * sizeof(*p_affected));
+	if (!p_affected) {
+		SSA_PR_LOG_ERROR("Cannot allocate affected destinations. Count: %zu",
+				 guid_to_lid_count);
+		goto Full;
+	}
+
+	affected_count = ssa_pr_affected_dests(p_ssa_db_smdb, p_context,
+					       p_source_rec, p_affected);
+	if (affected_count < 0 ||
+	    (size_t)affected_count > guid_to_lid_count / SSA_PR_DELTA_MAX_PART)
+		goto Full;
+
+	SSA_PR_LOG_DEBUG("GUID: 0x%016" PRIx64 " affected destinations: %" PRId64,
+			 ntohll(port_guid), affected_count);
+
+	/* The previous PRDB is still valid */
+	if (!affected_count) {
+		free(p_affected);
+		return SSA_PR_SUCCESS;
+	}
+
+	records_num[PRDB_TBL_ID_PR] =
+		ssa_pr_compute_pr_max_number(p_ssa_db_smdb, port_guid);
+
+	*pp_prdb = ssa_prdb_create(DB_EPOCH_INVALID /* epoch */, records_num);
+	if (!*pp_prdb) {
+		SSA_PR_LOG_ERROR("Path record database creation failed."
+				 " Number of records: %"PRIu64, records_num[PRDB_TBL_ID_PR]);
+		free(p_affected);
+		return SSA_PR_PRDB_ERROR;
+	}
+
+	prm.prdb = *pp_prdb;
+	prm.max_count = records_num[PRDB_TBL_ID_PR];
+
+	res = ssa_pr_half_world_delta(p_ssa_db_smdb, p_context, p_source_rec,
+				      p_affected, NULL, p_prev_prdb, &prm);
+	if (SSA_PR_SUCCESS == res) {
+		free(p_affected);
+		return SSA_PR_SUCCESS;
+	}
+
+	ssa_db_destroy(*pp_prdb);
+	*pp_prdb = NULL;
+	if (SSA_PR_ERROR == res) {
+		SSA_PR_LOG_ERROR("\"Half world\" calculation failed for GUID: 0x%" PRIx64,
+				 ntohll(port_guid));
+		free(p_affected);
+		return SSA_PR_ERROR;
+	}
+
+Full:
+	free(p_affected);
+	return ssa_pr_compute_half_world_shared(p_ssa_db_smdb, p_ctnx,
+						port_guid, pp_prdb);
+}
@@ -39,9 +39,30 @@
 #include "ssa_path_record_helper.h"
 #include "ssa_path_record_data.h"
 
+#ifndef MIN
+#define MIN(X,Y) ((X) < (Y) ?  (X) : (Y))
+#endif
+#ifndef MAX
+#define MAX(X,Y) ((X) > (Y) ?  (X) : (Y))
+#endif
+
 static size_t find_port_index(const struct ssa_pr_smdb_index *p_index,
 			      const be16_t lid, const unsigned int port_num);
 
+/*
+ * Sizes of the arena parts, in number of entries
+ */
+struct index_layout {
+	size_t lid_count;
+	size_t port_count;
+	size_t lft_block_count;
+	size_t lft_count;
+	size_t route_count;
+	size_t guid_hash_count;
+	size_t port_rec_count;
+	size_t guid2lid_count;
+};
+
 inline static size_t get_dataset_count(const struct ssa_db *p_smdb,
 				       unsigned int table_id)
 {
@@ -52,60 +73,167 @@ inline static size_t get_dataset_count(const struct ssa_db *p_smdb,
 	return ntohll(p_smdb->p_db_tables[table_id].set_count);
 }
 
-static int build_is_switch_lookup(struct ssa_pr_smdb_index *p_index,
-				  const struct ssa_db *p_smdb)
+static inline uint32_t guid_hash_slot(const struct ssa_pr_smdb_index *p_index,
+				      const be64_t guid)
 {
-	size_t i = 0, count = 0;
-	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	/* Fibonacci hashing: the upper bits of the product are well mixed */
+	return (uint32_t)((guid * 0x9E3779B97F4A7C15ULL) >> 32) &
+	       p_index->guid_hash_mask;
+}
 
-	SSA_ASSERT(p_smdb);
-	SSA_ASSERT(p_index);
+static int get_lid_count(const struct ssa_db *p_smdb, size_t *p_lid_count)
+{
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	const struct smdb_port *p_port_tbl = NULL;
+	const struct smdb_lft_top *p_lft_top_tbl = NULL;
+	const struct smdb_lft_block *p_lft_block_tbl = NULL;
+	size_t i = 0, count = 0;
+	uint16_t max_lid = 0;
 
 	p_guid2lid_tbl =
-		(struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
-	SSA_ASSERT(p_guid_to_lid_tbl);
+		(const struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_GUID2LID);
+	for (i = 0; i < count; i++)
+		max_lid = MAX(max_lid, ntohs(p_guid2lid_tbl[i].lid));
 
-	memset(p_index->is_switch_lookup, '\0',
-	       (MAX_LOOKUP_LID + 1) * sizeof(p_index->is_switch_lookup[0]));
+	p_port_tbl = (const struct smdb_port *)p_smdb->pp_tables[SMDB_TBL_ID_PORT];
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_PORT);
+	for (i = 0; i < count; i++)
+		max_lid = MAX(max_lid, ntohs(p_port_tbl[i].port_lid));
 
-	count = get_dataset_count(p_smdb,SMDB_TBL_ID_GUID2LID);
-	if (!count) {
-		SSA_PR_LOG_ERROR("Guid to LID table is empty");
-		return 1;
-	}
+	p_lft_top_tbl =
+		(const struct smdb_lft_top *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_TOP];
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_LFT_TOP);
+	for (i = 0; i < count; i++)
+		max_lid = MAX(max_lid, ntohs(p_lft_top_tbl[i].lid));
 
-	for (i = 0; i < count; i++) {
-		uint16_t lid = ntohs(p_guid2lid_tbl[i].lid);
-		p_index->is_switch_lookup[lid] = p_guid2lid_tbl[i].is_switch;
+	p_lft_block_tbl =
+		(const struct smdb_lft_block *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_LFT_BLOCK);
+	for (i = 0; i < count; i++)
+		max_lid = MAX(max_lid, ntohs(p_lft_block_tbl[i].lid));
+
+	if (max_lid > MAX_LOOKUP_LID) {
+		SSA_PR_LOG_ERROR("LID %u exceeds max. unicast LID %u",
+				 max_lid, MAX_LOOKUP_LID);
+		return -1;
 	}
 
+	*p_lid_count = max_lid + 1;
 	return 0;
 }
 
-static int build_lft_top_lookup(struct ssa_pr_smdb_index *p_index,
-				const struct ssa_db *p_smdb)
+/*
+ * The first pass: computes the number of entries of each LID
+ * and the arena layout.
+ */
+static int build_lid_lookup(struct ssa_pr_lid_index *p_lids,
+			    struct index_layout *p_layout,
+			    const struct ssa_db *p_smdb)
 {
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	const struct smdb_port *p_port_tbl = NULL;
+	const struct smdb_lft_top *p_lft_top_tbl = NULL;
+	const struct smdb_lft_block *p_lft_block_tbl = NULL;
 	size_t i = 0, count = 0;
-	struct smdb_lft_top *p_lft_top_tbl = NULL;
 
+	SSA_ASSERT(p_lids);
+	SSA_ASSERT(p_layout);
 	SSA_ASSERT(p_smdb);
-	SSA_ASSERT(p_index);
+
+	for (i = 0; i < p_layout->lid_count; i++) {
+		p_lids[i].route_offset = INDEX_NONE;
+		p_lids[i].lft_offset = INDEX_NONE;
+	}
+
+	p_guid2lid_tbl =
+		(const struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	SSA_ASSERT(p_guid2lid_tbl);
+
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_GUID2LID);
+	if (!count) {
+		SSA_PR_LOG_ERROR("Guid to LID table is empty");
+		return 1;
+	}
+
+	for (i = 0; i < count; i++)
+		p_lids[ntohs(p_guid2lid_tbl[i].lid)].is_switch =
+			p_guid2lid_tbl[i].is_switch;
+	p_layout->guid2lid_count = count;
+
+	/*
+	 * Guarantees that count * 2 fits into uint32_t guid_hash_mask
+	 */
+	p_layout->guid_hash_count = 1;
+	while (p_layout->guid_hash_count < 2 * count)
+		p_layout->guid_hash_count <<= 1;
+
+	p_port_tbl = (const struct smdb_port *)p_smdb->pp_tables[SMDB_TBL_ID_PORT];
+	SSA_ASSERT(p_port_tbl);
+
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_PORT);
+	if (!count) {
+		SSA_PR_LOG_ERROR("Port table is empty");
+		return 1;
+	}
+	p_layout->port_rec_count = count;
+
+	for (i = 0; i < count; i++) {
+		struct ssa_pr_lid_index *p_lid = p_lids + ntohs(p_port_tbl[i].port_lid);
+		uint16_t port_count = p_lid->is_switch ? p_port_tbl[i].port_num + 1 : 1;
+
+		p_lid->port_count = MAX(p_lid->port_count, port_count);
+	}
 
 	p_lft_top_tbl =
-		(struct smdb_lft_top *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_TOP];
+		(const struct smdb_lft_top *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_TOP];
 	SSA_ASSERT(p_lft_top_tbl);
 
-	memset(p_index->lft_top_lookup, '\0',
-	       (MAX_LOOKUP_LID + 1) * sizeof(p_index->lft_top_lookup[0]));
-
 	count = get_dataset_count(p_smdb, SMDB_TBL_ID_LFT_TOP);
 	if (!count) {
 		SSA_PR_LOG_ERROR("LFT top table is empty");
 		return 1;
 	}
 
-	for (i = 0; i < count; i++)
-		p_index->lft_top_lookup[ntohs(p_lft_top_tbl[i].lid)] = ntohs(p_lft_top_tbl[i].lft_top);
+	for (i = 0; i < count; i++) {
+		struct ssa_pr_lid_index *p_lid = p_lids + ntohs(p_lft_top_tbl[i].lid);
+
+		p_lid->lft_top = ntohs(p_lft_top_tbl[i].lft_top);
+		p_lid->route_offset = 0;
+	}
+
+	p_lft_block_tbl =
+		(const struct smdb_lft_block *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
+	SSA_ASSERT(p_lft_block_tbl);
+
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_LFT_BLOCK);
+	if (!count) {
+		SSA_PR_LOG_ERROR("LFT block table is empty");
+		return 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct ssa_pr_lid_index *p_lid = p_lids + ntohs(p_lft_block_tbl[i].lid);
+
+		p_lid->lft_block_count = MAX(p_lid->lft_block_count,
+					     ntohs(p_lft_block_tbl[i].block_num) + 1);
+	}
+
+	for (i = 0; i < p_layout->lid_count; i++) {
+		p_lids[i].port_offset = p_layout->port_count;
+		p_layout->port_count += p_lids[i].port_count;
+
+		p_lids[i].lft_block_offset = p_layout->lft_block_count;
+		p_layout->lft_block_count += p_lids[i].lft_block_count;
+
+		if (p_lids[i].route_offset != INDEX_NONE) {
+			p_lids[i].route_offset = p_layout->route_count;
+			p_layout->route_count += p_lids[i].lft_top + 1;
+
+			p_lids[i].lft_offset = p_layout->lft_count;
+			p_layout->lft_count += p_lids[i].lft_top + 1;
+		}
+	}
 
 	return 0;
 }
@@ -113,112 +241,103 @@ static int build_lft_top_lookup(struct ssa_pr_smdb_index *p_index,
 static int build_port_index(struct ssa_pr_smdb_index *p_index,
 			    const struct ssa_db *p_smdb)
 {
-	size_t i = 0, count = 0, switch_count = 0;
+	size_t i = 0, count = 0;
 	const struct smdb_port *p_port_tbl = NULL;
-	uint64_t default_val = 0;
 
 	SSA_ASSERT(p_smdb);
 	SSA_ASSERT(p_index);
 
-	p_port_tbl = (struct smdb_port *)p_smdb->pp_tables[SMDB_TBL_ID_PORT];
+	p_port_tbl = (const struct smdb_port *)p_smdb->pp_tables[SMDB_TBL_ID_PORT];
 	SSA_ASSERT(p_port_tbl);
 
-	memset(p_index->ca_port_lookup, '\0',
-	       (MAX_LOOKUP_LID + 1) * sizeof(p_index->ca_port_lookup[0]));
-	memset(p_index->switch_port_lookup, '\0',
-	       (MAX_LOOKUP_LID + 1) * sizeof(p_index->switch_port_lookup[0]));
-
 	count = get_dataset_count(p_smdb, SMDB_TBL_ID_PORT);
-	if (!count) {
-		SSA_PR_LOG_ERROR("Port table is empty");
-		return 1;
-	}
-	default_val = count + 1;
 
 	for (i = 0; i < count; i++) {
-		if (p_port_tbl[i].rate & SSA_DB_PORT_IS_SWITCH_MASK) {
-			uint64_t *port_lookup = p_index->switch_port_lookup[ntohs(p_port_tbl[i].port_lid)];
-			if (!port_lookup) {
-				size_t j = 0;
+		const struct ssa_pr_lid_index *p_lid =
+			p_index->lid_lookup + ntohs(p_port_tbl[i].port_lid);
 
-				port_lookup = (uint64_t*)malloc((MAX_LOOKUP_PORT + 1) * sizeof(uint64_t));
-				for (j = 0; j <= MAX_LOOKUP_PORT; ++j)
-					port_lookup[j] = default_val;
-
-				p_index->switch_port_lookup[ntohs(p_port_tbl[i].port_lid)] = port_lookup;
-				switch_count++;
-			}
-			port_lookup[p_port_tbl[i].port_num] = i;
-		} else {
-			p_index->ca_port_lookup[ntohs(p_port_tbl[i].port_lid)] = i;
-		}
+		p_index->port_lookup[p_lid->port_offset +
+				     (p_lid->is_switch ? p_port_tbl[i].port_num : 0)] = i;
 	}
 
-	SSA_PR_LOG_INFO("Switch ports lookup table size: %"PRIu64" bytes",
-			switch_count * sizeof(uint64_t) * MAX_LOOKUP_PORT);
-
 	return 0;
 }
 
+static void copy_lft_block(struct ssa_pr_smdb_index *p_index,
+			   const struct smdb_lft_block *p_block)
+{
+	const struct ssa_pr_lid_index *p_lid =
+		p_index->lid_lookup + ntohs(p_block->lid);
+	size_t first_lid = ntohs(p_block->block_num) * UMAD_LEN_SMP_DATA;
+
+	if (INDEX_NONE == p_lid->lft_offset || first_lid > p_lid->lft_top)
+		return;
+
+	memcpy(p_index->lft + p_lid->lft_offset + first_lid, p_block->block,
+	       MIN(UMAD_LEN_SMP_DATA, p_lid->lft_top - first_lid + 1));
+}
+
 static int build_lft_block_lookup(struct ssa_pr_smdb_index *p_index,
 				  const struct ssa_db *p_smdb)
 {
-	size_t i = 0, count = 0;
+	size_t i = 0, j = 0, count = 0;
 	const struct smdb_lft_block *p_lft_block_tbl = NULL;
-	size_t lookup_size = 0;
-	uint64_t default_val = 0;
 
 	SSA_ASSERT(p_smdb);
 	SSA_ASSERT(p_index);
 
-	p_lft_block_tbl =(struct smdb_lft_block *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
+	p_lft_block_tbl =
+		(const struct smdb_lft_block *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
 	SSA_ASSERT(p_lft_block_tbl);
 
-	memset(p_index->lft_block_lookup, '\0',
-	       (MAX_LOOKUP_LID + 1) * sizeof(p_index->lft_block_lookup[0]));
-
 	count = get_dataset_count(p_smdb, SMDB_TBL_ID_LFT_BLOCK);
-	if (!count) {
-		SSA_PR_LOG_ERROR("LFT block table is empty");
-		return 1;
-	}
-	default_val = count + 1;
 
 	for (i = 0; i < count; i++) {
-		size_t j = 0;
-		uint64_t *block_lookup =
-			p_index->lft_block_lookup[ntohs(p_lft_block_tbl[i].lid)];
+		const struct ssa_pr_lid_index *p_lid =
+			p_index->lid_lookup + ntohs(p_lft_block_tbl[i].lid);
+
+		p_index->lft_block_lookup[p_lid->lft_block_offset +
+					  ntohs(p_lft_block_tbl[i].block_num)] = i;
+	}
 
-		if (!block_lookup) {
-			block_lookup = (uint64_t *)malloc(MAX_LFT_BLOCK_NUM * sizeof(uint64_t));
-			lookup_size += MAX_LFT_BLOCK_NUM * sizeof(uint64_t);
+	/*
+	 * Forwarding arrays are used only for switches with all LFT
+	 * blocks up to LFT top, so a missing block is still reported.
+	 */
+	for (i = 0; i < p_index->lid_count; i++) {
+		struct ssa_pr_lid_index *p_lid = p_index->lid_lookup + i;
+		size_t block_count = p_lid->lft_top / UMAD_LEN_SMP_DATA + 1;
 
-			p_index->lft_block_lookup[ntohs(p_lft_block_tbl[i].lid)] = block_lookup;
+		if (INDEX_NONE == p_lid->lft_offset)
+			continue;
 
-			for (j = 0; j < MAX_LFT_BLOCK_NUM; ++j)
-				block_lookup[j] = default_val;
+		if (p_lid->lft_block_count < block_count) {
+			p_lid->lft_offset = INDEX_NONE;
+			continue;
+		}
+
+		for (j = 0; j < block_count; j++) {
+			if (INDEX_NONE == p_index->lft_block_lookup[p_lid->lft_block_offset + j]) {
+				p_lid->lft_offset = INDEX_NONE;
+				break;
+			}
 		}
-		block_lookup[ntohs(p_lft_block_tbl[i].block_num)] = i;
 	}
 
-	SSA_PR_LOG_INFO("LFT lookup size: %"PRIu64" bytes", lookup_size);
+	for (i = 0; i < count; i++)
+		copy_lft_block(p_index, p_lft_block_tbl + i);
+
 	return 0;
 }
+
 static int build_link_index(struct ssa_pr_smdb_index *p_index,
 			    const struct ssa_db *p_smdb)
 {
 	size_t i = 0, link_count = 0, port_count = 0;
 	const struct smdb_link *p_link_tbl = NULL;
-	uint64_t default_val = 0;
 
 	SSA_ASSERT(p_smdb);
 	SSA_ASSERT(p_index);
-	SSA_ASSERT(p_index->is_switch_lookup);
-
-	memset(p_index->ca_link_lookup, '\0',
-	       (MAX_LOOKUP_LID + 1) * sizeof(p_index->ca_link_lookup[0]));
-	memset(p_index->switch_link_lookup, '\0',
-	       (MAX_LOOKUP_PORT + 1) * sizeof(p_index->switch_link_lookup[0]));
 
 	p_link_tbl = (const struct smdb_link *)p_smdb->pp_tables[SMDB_TBL_ID_LINK];
 	SSA_ASSERT(p_link_tbl);
@@ -229,13 +348,10 @@ static int build_link_index(struct ssa_pr_smdb_index *p_index,
 		return 1;
 	}
 	port_count = get_dataset_count(p_smdb, SMDB_TBL_ID_PORT);
-	if (!port_count) {
-		SSA_PR_LOG_ERROR("Port table is empty");
-		return 1;
-	}
-	default_val = port_count + 1;
 
 	for (i = 0; i < link_count; i++) {
+		const struct ssa_pr_lid_index *p_lid = NULL;
+		size_t from_port_index = 0;
 		size_t to_port_index = find_port_index(p_index,
 						       p_link_tbl[i].to_lid,
 						       p_link_tbl[i].to_port_num);
@@ -246,103 +362,506 @@ static int build_link_index(struct ssa_pr_smdb_index *p_index,
 			return -1;
 		}
 
-		if (p_index->is_switch_lookup[ntohs(p_link_tbl[i].from_lid)]) {
-			uint64_t *port_lookup = p_index->switch_link_lookup[ntohs(p_link_tbl[i].from_lid)];
-			if (!port_lookup) {
-				size_t j = 0;
-				port_lookup = (uint64_t *)malloc((MAX_LOOKUP_PORT + 1) * sizeof(uint64_t));
-				p_index->switch_link_lookup[ntohs(p_link_tbl[i].from_lid)] = port_lookup;
-				for (j = 0; j <= MAX_LOOKUP_PORT; ++j)
-					port_lookup[j] = default_val;
-			}
-			port_lookup[p_link_tbl[i].from_port_num] = to_port_index ;
-		} else {
-			p_index->ca_link_lookup[ntohs(p_link_tbl[i].from_lid)] = to_port_index;
+		from_port_index = find_port_index(p_index,
+						  p_link_tbl[i].from_lid,
+						  p_link_tbl[i].from_port_num);
+		if (from_port_index >= port_count) {
+			SSA_PR_LOG_ERROR("Can't find port for LID: %u. Link index build failed",
+					 ntohs(p_link_tbl[i].from_lid));
+			return -1;
+		}
+
+		p_lid = p_index->lid_lookup + ntohs(p_link_tbl[i].from_lid);
+		p_index->link_lookup[p_lid->port_offset +
+				     (p_lid->is_switch ? p_link_tbl[i].from_port_num : 0)] =
+			to_port_index;
+		p_index->port_link[from_port_index] = to_port_index;
+	}
+
+	return 0;
+}
+
+static inline uint64_t digest_update(uint64_t digest, const void *p_data,
+				     size_t size)
+{
+	const uint8_t *p_byte = (const uint8_t *)p_data;
+	size_t i = 0;
+
+	/* FNV-1a */
+	for (i = 0; i < size; i++) {
+		digest ^= p_byte[i];
+		digest *= 0x100000001B3ULL;
+	}
+
+	return digest;
+}
+
+static uint64_t port_digest(const struct ssa_db *p_smdb, uint64_t digest,
+			    const struct smdb_port *p_port)
+{
+	const be16_t *p_pkeys = NULL;
+	size_t pkey_count = 0;
+
+	/* pkey table offset depends on other ports, so pkeys are used instead */
+	digest = digest_update(digest, &p_port->port_lid, sizeof(p_port->port_lid));
+	digest = digest_update(digest, &p_port->port_num, sizeof(p_port->port_num));
+	digest = digest_update(digest, &p_port->mtu_cap, sizeof(p_port->mtu_cap));
+	digest = digest_update(digest, &p_port->rate, sizeof(p_port->rate));
+	digest = digest_update(digest, &p_port->vl_enforce, sizeof(p_port->vl_enforce));
+
+	p_pkeys = find_port_pkeys(p_smdb, p_port, &pkey_count);
+	if (p_pkeys)
+		digest = digest_update(digest, p_pkeys, pkey_count * sizeof(*p_pkeys));
+
+	return digest;
+}
+
+/*
+ * LID digest covers the LID ports and ports linked to them. Routes through
+ * the ports are not covered, they are compared using route cache.
+ */
+static void build_lid_digest(struct ssa_pr_smdb_index *p_index,
+			     const struct ssa_db *p_smdb)
+{
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	const struct smdb_port *p_port_tbl = NULL;
+	size_t i = 0, j = 0, count = 0;
+
+	p_guid2lid_tbl =
+		(const struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	p_port_tbl = (const struct smdb_port *)p_smdb->pp_tables[SMDB_TBL_ID_PORT];
+
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_GUID2LID);
+	p_index->guid2lid_digest = SSA_PR_DIGEST_INIT;
+	for (i = 0; i < count; i++) {
+		const struct smdb_guid2lid *p_rec = p_guid2lid_tbl + i;
+		uint64_t digest = p_index->guid2lid_digest;
+
+		digest = digest_update(digest, &p_rec->guid, sizeof(p_rec->guid));
+		digest = digest_update(digest, &p_rec->lid, sizeof(p_rec->lid));
+		digest = digest_update(digest, &p_rec->lmc, sizeof(p_rec->lmc));
+		digest = digest_update(digest, &p_rec->is_switch, sizeof(p_rec->is_switch));
+		p_index->guid2lid_digest = digest;
+	}
+
+	for (i = 0; i < p_index->lid_count; i++) {
+		const struct ssa_pr_lid_index *p_lid = p_index->lid_lookup + i;
+		uint64_t digest = SSA_PR_DIGEST_INIT;
+
+		for (j = 0; j < p_lid->port_count; j++) {
+			uint32_t port_index = p_index->port_lookup[p_lid->port_offset + j];
+			uint32_t linked_index = p_index->link_lookup[p_lid->port_offset + j];
+
+			if (INDEX_NONE == port_index)
+				continue;
+
+			digest = port_digest(p_smdb, digest, p_port_tbl + port_index);
+			if (INDEX_NONE != linked_index)
+				digest = port_digest(p_smdb, digest,
+						     p_port_tbl + linked_index);
 		}
+
+		p_index->lid_digest[i] = digest;
+	}
+}
+
+static void build_compute_view(struct ssa_pr_smdb_index *p_index,
+			       const struct ssa_db *p_smdb)
+{
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+	const struct smdb_port *p_port_tbl = NULL;
+	size_t i = 0;
+
+	p_port_tbl = (const struct smdb_port *)p_smdb->pp_tables[SMDB_TBL_ID_PORT];
+	for (i = 0; i < p_index->port_rec_count; i++) {
+		p_index->port_lid[i] = ntohs(p_port_tbl[i].port_lid);
+		p_index->port_num[i] = p_port_tbl[i].port_num;
+		p_index->port_mtu[i] = p_port_tbl[i].mtu_cap;
+		p_index->port_rate[i] = p_port_tbl[i].rate;
+	}
+
+	p_guid2lid_tbl =
+		(const struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	for (i = 0; i < p_index->guid2lid_count; i++) {
+		p_index->rec_lid[i] = ntohs(p_guid2lid_tbl[i].lid);
+		p_index->rec_lmc[i] = p_guid2lid_tbl[i].lmc;
+		p_index->rec_is_switch[i] = p_guid2lid_tbl[i].is_switch;
+	}
+}
+
+static int build_guid_hash(struct ssa_pr_smdb_index *p_index,
+			   const struct ssa_db *p_smdb)
+{
+	size_t i = 0, count = 0;
+	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
+
+	SSA_ASSERT(p_smdb);
+	SSA_ASSERT(p_index);
+
+	p_guid2lid_tbl =
+		(const struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	SSA_ASSERT(p_guid2lid_tbl);
+
+	count = get_dataset_count(p_smdb, SMDB_TBL_ID_GUID2LID);
+
+	for (i = 0; i < count; i++) {
+		uint32_t slot = guid_hash_slot(p_index, p_guid2lid_tbl[i].guid);
+
+		while (p_index->guid_hash[slot] &&
+		       p_guid2lid_tbl[p_index->guid_hash[slot] - 1].guid !=
+		       p_guid2lid_tbl[i].guid)
+			slot = (slot + 1) & p_index->guid_hash_mask;
+
+		/* keep the first record, as a table scan would find it */
+		if (!p_index->guid_hash[slot])
+			p_index->guid_hash[slot] = i + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Allocates the arena and lays the lookup tables out in it.
+ * Route cache and GUID hash have to be zeroed, the rest is filled
+ * with INDEX_NONE.
+ */
+static int alloc_arena(struct ssa_pr_smdb_index *p_index,
+		       const struct ssa_pr_lid_index *p_lids,
+		       const struct index_layout *p_layout)
+{
+	size_t lid_size = p_layout->lid_count * sizeof(struct ssa_pr_lid_index);
+	size_t lid_digest_size = p_layout->lid_count * sizeof(uint64_t);
+	size_t port_size = p_layout->port_count * sizeof(uint32_t);
+	size_t lft_block_size = p_layout->lft_block_count * sizeof(uint32_t);
+	size_t lft_size = p_layout->lft_count * sizeof(uint8_t);
+	size_t route_size = p_layout->route_count * sizeof(union ssa_pr_route);
+	size_t guid_hash_size = p_layout->guid_hash_count * sizeof(uint32_t);
+	size_t port_link_size = p_layout->port_rec_count * sizeof(uint32_t);
+	size_t port_lid_size = p_layout->port_rec_count * sizeof(uint16_t);
+	size_t port_field_size = p_layout->port_rec_count * sizeof(uint8_t);
+	size_t rec_lid_size = p_layout->guid2lid_count * sizeof(uint16_t);
+	size_t rec_field_size = p_layout->guid2lid_count * sizeof(uint8_t);
+	char *p_mem = NULL;
+
+	/* tables go by entry size, to keep all entries aligned */
+	p_index->arena_size = lid_size + lid_digest_size +
+			      2 * port_size + lft_block_size +
+			      route_size + guid_hash_size + port_link_size +
+			      port_lid_size + rec_lid_size + lft_size +
+			      3 * port_field_size + 2 * rec_field_size;
+
+	/*
+	 * Zeroed pages are not committed until they are written,
+	 * so unused parts of the route cache cost nothing.
+	 */
+	p_index->arena = calloc(1, p_index->arena_size);
+	if (!p_index->arena) {
+		SSA_PR_LOG_ERROR("SMDB index allocation failed. Size: %zu bytes",
+				 p_index->arena_size);
+		p_index->arena_size = 0;
+		return -1;
 	}
 
+	p_mem = (char *)p_index->arena;
+
+	p_index->lid_count = p_layout->lid_count;
+	p_index->lid_lookup = (struct ssa_pr_lid_index *)p_mem;
+	memcpy(p_index->lid_lookup, p_lids, lid_size);
+	p_mem += lid_size;
+
+	p_index->lid_digest = (uint64_t *)p_mem;
+	p_mem += lid_digest_size;
+
+	p_index->port_lookup = (uint32_t *)p_mem;
+	memset(p_index->port_lookup, 0xff, port_size);
+	p_mem += port_size;
+
+	p_index->link_lookup = (uint32_t *)p_mem;
+	memset(p_index->link_lookup, 0xff, port_size);
+	p_mem += port_size;
+
+	p_index->lft_block_lookup = (uint32_t *)p_mem;
+	memset(p_index->lft_block_lookup, 0xff, lft_block_size);
+	p_mem += lft_block_size;
+
+	p_index->route_cache = (union ssa_pr_route *)p_mem;
+	p_mem += route_size;
+
+	p_index->guid_hash = (uint32_t *)p_mem;
+	p_index->guid_hash_mask = p_layout->guid_hash_count - 1;
+	p_mem += guid_hash_size;
+
+	p_index->port_rec_count = p_layout->port_rec_count;
+	p_index->port_link = (uint32_t *)p_mem;
+	memset(p_index->port_link, 0xff, port_link_size);
+	p_mem += port_link_size;
+
+	p_index->port_lid = (uint16_t *)p_mem;
+	p_mem += port_lid_size;
+
+	p_index->guid2lid_count = p_layout->guid2lid_count;
+	p_index->rec_lid = (uint16_t *)p_mem;
+	p_mem += rec_lid_size;
+
+	p_index->lft = (uint8_t *)p_mem;
+	p_mem += lft_size;
+
+	p_index->port_num = (uint8_t *)p_mem;
+	p_mem += port_field_size;
+	p_index->port_mtu = (uint8_t *)p_mem;
+	p_mem += port_field_size;
+	p_index->port_rate = (uint8_t *)p_mem;
+	p_mem += port_field_size;
+
+	p_index->rec_lmc = (uint8_t *)p_mem;
+	p_mem += rec_field_size;
+	p_index->rec_is_switch = (uint8_t *)p_mem;
+
 	return 0;
 }
 
 int ssa_pr_build_indexes(struct ssa_pr_smdb_index *p_index,
 			 const struct ssa_db *p_smdb)
 {
+	struct ssa_pr_lid_index *p_lids = NULL;
+	struct index_layout layout;
+	size_t i = 0;
 	int res = 0;
 
 	SSA_ASSERT(p_smdb);
 	SSA_ASSERT(p_index);
 
-	res = build_is_switch_lookup(p_index, p_smdb);
-	if (res) {
-		SSA_PR_LOG_ERROR("Build for is_switch_lookup failed");
+	memset(&layout, '\0', sizeof(layout));
+
+	res = get_lid_count(p_smdb, &layout.lid_count);
+	if (res)
 		return res;
+
+	p_lids = (struct ssa_pr_lid_index *)calloc(layout.lid_count,
+						   sizeof(*p_lids));
+	if (!p_lids) {
+		SSA_PR_LOG_ERROR("LID lookup allocation failed. LID count: %zu",
+				 layout.lid_count);
+		return -1;
 	}
-	res = build_port_index(p_index, p_smdb);
+
+	res = build_lid_lookup(p_lids, &layout, p_smdb);
 	if (res) {
-		SSA_PR_LOG_ERROR("Build for port index failed");
-		return res;
+		SSA_PR_LOG_ERROR("Build for LID lookup failed");
+		goto Exit;
 	}
-	res = build_lft_top_lookup(p_index, p_smdb);
+	res = alloc_arena(p_index, p_lids, &layout);
+	if (res)
+		goto Exit;
+	build_compute_view(p_index, p_smdb);
+	res = build_guid_hash(p_index, p_smdb);
 	if (res) {
-		SSA_PR_LOG_ERROR("Build for lft_top failed");
-		return res;
+		SSA_PR_LOG_ERROR("Build for GUID hash failed");
+		goto Exit;
+	}
+	res = build_port_index(p_index, p_smdb);
+	if (res) {
+		SSA_PR_LOG_ERROR("Build for port index failed");
+		goto Exit;
 	}
 	res = build_lft_block_lookup(p_index, p_smdb);
 	if (res) {
 		SSA_PR_LOG_ERROR("Build for lft block lookup failed");
-		return res;
+		goto Exit;
 	}
 	res = build_link_index(p_index, p_smdb);
 	if (res) {
 		SSA_PR_LOG_ERROR("Build for link index failed");
-		return res;
+		goto Exit;
 	}
+	build_lid_digest(p_index, p_smdb);
 
 	p_index->epoch = ssa_db_get_epoch(p_smdb, DB_DEF_TBL_ID);
+	for (i = 0; i < SMDB_TBL_ID_MAX; i++) {
+		p_index->tbl_epoch[i] = ssa_db_get_epoch(p_smdb, i);
+		p_index->tbl_count[i] = get_dataset_count(p_smdb, i);
+	}
 
-	return 0;
+	SSA_PR_LOG_INFO("SMDB index size: %zu bytes. LIDs: %zu ports: %zu "
+			"LFT blocks: %zu LFT entries: %zu routes: %zu "
+			"GUID hash slots: %zu",
+			p_index->arena_size, layout.lid_count,
+			layout.port_count, layout.lft_block_count,
+			layout.lft_count, layout.route_count,
+			layout.guid_hash_count);
+
+Exit:
+	free(p_lids);
+	return res;
 }
 
 void ssa_pr_destroy_indexes(struct ssa_pr_smdb_index *p_index)
 {
-	size_t i = 0;
+	SSA_ASSERT(p_index);
+
+	free(p_index->arena);
+	memset(p_index, '\0', sizeof(*p_index));
+
+	p_index->epoch = DB_EPOCH_INVALID;
+}
+
+int ssa_pr_patch_lft_blocks(struct ssa_pr_smdb_index *p_index,
+			    const struct ssa_db *p_smdb,
+			    const uint64_t *p_block_indices, size_t count)
+{
+	const struct smdb_lft_block *p_lft_block_tbl = NULL;
+	size_t lft_block_count = 0;
+	size_t i = 0, j = 0;
 
 	SSA_ASSERT(p_index);
+	SSA_ASSERT(p_smdb);
 
-	memset(p_index->is_switch_lookup, '\0',
-	       (MAX_LOOKUP_LID + 1) * sizeof(p_index->is_switch_lookup[0]));
-	memset(p_index->lft_top_lookup , '\0',
-	       (MAX_LOOKUP_LID + 1) * sizeof(p_index->lft_top_lookup[0]));
-	memset(p_index->ca_port_lookup, '\0',
-	       (MAX_LOOKUP_LID +1) * sizeof(p_index->ca_port_lookup[0]));
+	if (!p_index->arena)
+		return -1;
+
+	p_lft_block_tbl =
+		(const struct smdb_lft_block *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
+	lft_block_count = get_dataset_count(p_smdb, SMDB_TBL_ID_LFT_BLOCK);
 
-	for (i = 0; i <= MAX_LOOKUP_LID; ++i) {
-		free(p_index->switch_port_lookup[i]);
-		p_index->switch_port_lookup[i] = NULL;
+	/* Changed blocks have to be at the same places as indexed ones */
+	for (i = 0; i < count; i++) {
+		const struct smdb_lft_block *p_block = NULL;
+		const struct ssa_pr_lid_index *p_lid = NULL;
+		uint16_t block_num;
+
+		if (p_block_indices[i] >= lft_block_count)
+			return -1;
+
+		p_block = p_lft_block_tbl + p_block_indices[i];
+		block_num = ntohs(p_block->block_num);
+		if (ntohs(p_block->lid) >= p_index->lid_count)
+			return -1;
+
+		p_lid = p_index->lid_lookup + ntohs(p_block->lid);
+		if (block_num >= p_lid->lft_block_count ||
+		    p_index->lft_block_lookup[p_lid->lft_block_offset + block_num] !=
+		    p_block_indices[i])
+			return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		const struct smdb_lft_block *p_block =
+			p_lft_block_tbl + p_block_indices[i];
+		size_t first_lid = ntohs(p_block->block_num) * UMAD_LEN_SMP_DATA;
+
+		copy_lft_block(p_index, p_block);
+
+		/*
+		 * Routes to the block LIDs from any switch may
+		 * go through the changed switch.
+		 */
+		for (j = 0; j < p_index->lid_count; j++) {
+			const struct ssa_pr_lid_index *p_lid = p_index->lid_lookup + j;
+
+			if (INDEX_NONE == p_lid->route_offset ||
+			    first_lid > p_lid->lft_top)
+				continue;
+
+			memset(p_index->route_cache + p_lid->route_offset + first_lid,
+			       '\0', MIN(UMAD_LEN_SMP_DATA,
+					 p_lid->lft_top - first_lid + 1) *
+			       sizeof(union ssa_pr_route));
+		}
 	}
 
-	memset(p_index->ca_link_lookup, '\0',
-	       (MAX_LOOKUP_LID +1) * sizeof(p_index->ca_link_lookup[0]));
+	p_index->epoch = ssa_db_get_epoch(p_smdb, DB_DEF_TBL_ID);
+	p_index->tbl_epoch[SMDB_TBL_ID_LFT_BLOCK] =
+		ssa_db_get_epoch(p_smdb, SMDB_TBL_ID_LFT_BLOCK);
+
+	SSA_PR_LOG_INFO("SMDB index patched for %zu LFT blocks. epoch: 0x%" PRIx64,
+			count, p_index->epoch);
 
-	for (i = 0; i <= MAX_LOOKUP_LID; ++i) {
-		free(p_index->switch_link_lookup[i]);
-		p_index->switch_link_lookup[i] = NULL;
+	return 0;
+}
+
+/*
+ * Collects LFT block records of the new SMDB, which differ from the
+ * indexed forwarding arrays. Blocks of switches without a forwarding
+ * array are always collected, their content isn't kept in the index.
+ *
+ * Returns the number of the collected blocks, or -1 if some other
+ * table was changed or the blocks can't be collected.
+ */
+static ssize_t find_changed_lft_blocks(const struct ssa_pr_smdb_index *p_index,
+				       const struct ssa_db *p_smdb,
+				       uint64_t **pp_block_indices)
+{
+	const struct smdb_lft_block *p_lft_block_tbl = NULL;
+	uint64_t *p_block_indices = NULL;
+	size_t lft_block_count = 0, count = 0, i = 0;
+
+	if (!p_index->arena || p_smdb->data_tbl_cnt != SMDB_TBL_ID_MAX)
+		return -1;
+
+	/* Table epochs are changed by the core only for changed tables */
+	for (i = 0; i < SMDB_TBL_ID_MAX; i++) {
+		if (get_dataset_count(p_smdb, i) != p_index->tbl_count[i])
+			return -1;
+		if (i == SMDB_TBL_ID_LFT_BLOCK)
+			continue;
+		if (p_index->tbl_epoch[i] == DB_EPOCH_INVALID ||
+		    ssa_db_get_epoch(p_smdb, i) != p_index->tbl_epoch[i])
+			return -1;
 	}
 
-	for (i = 0; i <= MAX_LOOKUP_LID; ++i) {
-		if (p_index->lft_block_lookup[i]) {
-			free(p_index->lft_block_lookup[i]);
-			p_index->lft_block_lookup[i] = NULL;
+	p_lft_block_tbl =
+		(const struct smdb_lft_block *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
+	lft_block_count = get_dataset_count(p_smdb, SMDB_TBL_ID_LFT_BLOCK);
+
+	p_block_indices = (uint64_t *)malloc(MAX(lft_block_count, 1) *
+					     sizeof(*p_block_indices));
+	if (!p_block_indices) {
+		SSA_PR_LOG_ERROR("Changed LFT blocks allocation failed. "
+				 "count: %zu", lft_block_count);
+		return -1;
+	}
+
+	for (i = 0; i < lft_block_count; i++) {
+		const struct smdb_lft_block *p_block = p_lft_block_tbl + i;
+		const struct ssa_pr_lid_index *p_lid = NULL;
+		uint16_t block_num = ntohs(p_block->block_num);
+		size_t first_lid = block_num * UMAD_LEN_SMP_DATA;
+
+		if (ntohs(p_block->lid) >= p_index->lid_count)
+			goto Error;
+
+		/* lookup has to stay valid for the unchanged blocks as well */
+		p_lid = p_index->lid_lookup + ntohs(p_block->lid);
+		if (block_num >= p_lid->lft_block_count ||
+		    p_index->lft_block_lookup[p_lid->lft_block_offset + block_num] != i)
+			goto Error;
+
+		if (INDEX_NONE != p_lid->lft_offset) {
+			if (first_lid > p_lid->lft_top)
+				continue;
+			if (!memcmp(p_index->lft + p_lid->lft_offset + first_lid,
+				    p_block->block,
+				    MIN(UMAD_LEN_SMP_DATA,
+					p_lid->lft_top - first_lid + 1)))
+				continue;
 		}
+		p_block_indices[count++] = i;
 	}
 
-	p_index->epoch = DB_EPOCH_INVALID;
+	*pp_block_indices = p_block_indices;
+	return count;
+
+Error:
+	free(p_block_indices);
+	return -1;
 }
 
 int ssa_pr_rebuild_indexes(struct ssa_pr_smdb_index *p_index,
 			   const struct ssa_db *p_smdb)
 {
 	uint64_t smdb_epoch = DB_EPOCH_INVALID;
+	uint64_t *p_block_indices = NULL;
+	ssize_t count = 0;
 	int res = 0;
 
 	SSA_ASSERT(p_smdb);
@@ -351,6 +870,16 @@ int ssa_pr_rebuild_indexes(struct ssa_pr_smdb_index *p_index,
 	smdb_epoch = ssa_db_get_epoch(p_smdb, DB_DEF_TBL_ID);
 
 	if (p_index->epoch != smdb_epoch) {
+		count = find_changed_lft_blocks(p_index, p_smdb,
+						&p_block_indices);
+		if (count >= 0) {
+			res = ssa_pr_patch_lft_blocks(p_index, p_smdb,
+						      p_block_indices, count);
+			free(p_block_indices);
+			if (!res)
+				return 0;
+		}
+
 		ssa_pr_destroy_indexes(p_index);
 		res = ssa_pr_build_indexes(p_index, p_smdb);
 		if (res) {
@@ -365,31 +894,47 @@ int ssa_pr_rebuild_indexes(struct ssa_pr_smdb_index *p_index,
 	return 0;
 }
 
-const struct smdb_guid2lid
-*find_guid_to_lid_rec_by_guid(const struct ssa_db *p_smdb,
-			      const be64_t port_guid)
+static const struct smdb_guid2lid
+*find_guid_to_lid_rec(const struct ssa_db *p_smdb,
+		      const struct ssa_pr_smdb_index *p_index,
+		      const be64_t port_guid)
 {
-	size_t i = 0;
 	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
-	size_t count = 0;
+	uint32_t slot = 0;
 
 	SSA_ASSERT(p_smdb);
-	SSA_ASSERT(port_guid);
+	SSA_ASSERT(p_index);
+
+	if (!p_index->guid_hash)
+		return NULL;
 
-	p_guid2lid_tbl = (struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	p_guid2lid_tbl =
+		(const struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
 	SSA_ASSERT(p_guid2lid_tbl);
 
-	count = get_dataset_count(p_smdb, SMDB_TBL_ID_GUID2LID);
+	for (slot = guid_hash_slot(p_index, port_guid); p_index->guid_hash[slot];
+	     slot = (slot + 1) & p_index->guid_hash_mask)
+		if (p_guid2lid_tbl[p_index->guid_hash[slot] - 1].guid == port_guid)
+			return p_guid2lid_tbl + p_index->guid_hash[slot] - 1;
 
-	for (i = 0; i < count; i++) {
-		if (port_guid == p_guid2lid_tbl[i].guid)
-			return p_guid2lid_tbl + i;
-	}
+	return NULL;
+}
 
-	SSA_PR_LOG_ERROR("GUID to LID record not found. GUID: 0x%016" PRIx64,
-			 ntohll(port_guid));
+const struct smdb_guid2lid
+*find_guid_to_lid_rec_by_guid(const struct ssa_db *p_smdb,
+			      const struct ssa_pr_smdb_index *p_index,
+			      const be64_t port_guid)
+{
+	const struct smdb_guid2lid *p_rec = NULL;
 
-	return NULL;
+	SSA_ASSERT(port_guid);
+
+	p_rec = find_guid_to_lid_rec(p_smdb, p_index, port_guid);
+	if (!p_rec)
+		SSA_PR_LOG_ERROR("GUID to LID record not found. GUID: 0x%016" PRIx64,
+				 ntohll(port_guid));
+
+	return p_rec;
 }
 
 int find_destination_port(const struct ssa_db *p_smdb,
@@ -402,12 +947,31 @@ int find_destination_port(const struct ssa_db *p_smdb,
 	size_t lft_port_shift = 0;
 	size_t lft_block_index = 0;
 	uint16_t lft_top = 0;
+	const struct ssa_pr_lid_index *p_lid = NULL;
 
 	SSA_ASSERT(p_smdb);
 	SSA_ASSERT(p_index);
 	SSA_ASSERT(source_lid);
 	SSA_ASSERT(dest_lid);
 
+	if (ntohs(source_lid) >= p_index->lid_count) {
+		SSA_PR_LOG_ERROR("LFT routing failed. Unknown source LID (%u)",
+				 ntohs(source_lid));
+		return -1;
+	}
+	p_lid = p_index->lid_lookup + ntohs(source_lid);
+	lft_top = p_lid->lft_top;
+
+	if (ntohs(dest_lid) > lft_top) {
+		SSA_PR_LOG_ERROR("LFT routing failed. Destination LID exceeds LFT top. "
+				 "Source LID (%u) Destination LID: (%u) LFT top: %u",
+				 ntohs(source_lid), ntohs(dest_lid), lft_top);
+		return -1;
+	}
+
+	if (p_lid->lft_offset != INDEX_NONE)
+		return p_index->lft[p_lid->lft_offset + ntohs(dest_lid)];
+
 	p_lft_block_tbl = (struct smdb_lft_block *)p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
 	SSA_ASSERT(p_lft_block_tbl);
 
@@ -420,50 +984,49 @@ int find_destination_port(const struct ssa_db *p_smdb,
 	 */
 	lft_block_num = ntohs(dest_lid) >> 6;
 	lft_port_shift = ntohs(dest_lid) % UMAD_LEN_SMP_DATA;
-	lft_top = p_index->lft_top_lookup[ntohs(source_lid)];
-
-	if (ntohs(dest_lid) > lft_top) {
-		SSA_PR_LOG_ERROR("LFT routing failed. Destination LID exceeds LFT top. "
-				 "Source LID (%u) Destination LID: (%u) LFT top: %u",
-				 ntohs(source_lid), ntohs(dest_lid), lft_top);
-		return -1;
-	}
 
-	if (!p_index->lft_block_lookup[ntohs(source_lid)] ||
-	    p_index->lft_block_lookup[ntohs(source_lid)][lft_block_num] > lft_block_count) {
+	if (lft_block_num >= p_lid->lft_block_count ||
+	    p_index->lft_block_lookup[p_lid->lft_block_offset + lft_block_num] >= lft_block_count) {
 		SSA_PR_LOG_ERROR("LFT routing failed. Destination LID exceeds LFT top. "
 				 "Source LID (%u) Destination LID: (%u) LFT top: %u",
 				 ntohs(source_lid), ntohs(dest_lid), lft_top);
 		return -1;
 	}
 
-	lft_block_index = p_index->lft_block_lookup[ntohs(source_lid)][lft_block_num];
+	lft_block_index = p_index->lft_block_lookup[p_lid->lft_block_offset + lft_block_num];
 	return p_lft_block_tbl[lft_block_index].block[lft_port_shift];
 }
 
-static size_t find_port_index(const struct ssa_pr_smdb_index *p_index,
+/*
+ * Returns offset of (LID, port num) entry in port_lookup and link_lookup.
+ * INDEX_NONE - there is no such entry.
+ */
+static size_t find_port_entry(const struct ssa_pr_smdb_index *p_index,
 			      const be16_t lid, const unsigned int port_num)
 {
-	size_t port_index = -1;
+	const struct ssa_pr_lid_index *p_lid = NULL;
 
 	SSA_ASSERT(p_index);
-	SSA_ASSERT(p_index->is_switch_lookup);
 	SSA_ASSERT(lid);
 
-	if (p_index->is_switch_lookup[ntohs(lid)]) {
-		uint64_t *switch_port_lookup = p_index->switch_port_lookup[ntohs(lid)];
+	if (ntohs(lid) >= p_index->lid_count)
+		return INDEX_NONE;
 
-		if (!switch_port_lookup) {
-			SSA_PR_LOG_ERROR("Port not found. LID: %u Port num: %u",
-					 ntohs(lid), port_num);
-			return -1;
-		}
-		port_index = switch_port_lookup[port_num];
-	} else {
-		port_index = p_index->ca_port_lookup[ntohs(lid)];
-	}
+	p_lid = p_index->lid_lookup + ntohs(lid);
+	if (!p_lid->is_switch)
+		return p_lid->port_count ? p_lid->port_offset : INDEX_NONE;
+	else if (port_num >= p_lid->port_count)
+		return INDEX_NONE;
+
+	return p_lid->port_offset + port_num;
+}
 
-	return port_index;
+static size_t find_port_index(const struct ssa_pr_smdb_index *p_index,
+			      const be16_t lid, const unsigned int port_num)
+{
+	size_t entry = find_port_entry(p_index, lid, port_num);
+
+	return INDEX_NONE == entry ? INDEX_NONE : p_index->port_lookup[entry];
 }
 
 const struct smdb_port *find_port(const struct ssa_db *p_smdb,
@@ -478,9 +1041,9 @@ const struct smdb_port *find_port(const struct ssa_db *p_smdb,
 		(const struct smdb_port *)p_smdb->pp_tables[SMDB_TBL_ID_PORT];
 	SSA_ASSERT(p_port_tbl);
 
-	count = get_dataset_count(p_smdb, SMDB_TBL_ID_PORT);
+	count = p_index->port_rec_count;
 
-	port_index = find_port_index(p_index, lid, port_num);
+	port_index = ssa_pr_port_entry(p_index, ntohs(lid), port_num);
 
 	if (port_index >= count) {
 		SSA_PR_LOG_ERROR("Port not found. LID: %u Port num: %d",
@@ -490,6 +1053,42 @@ const struct smdb_port *find_port(const struct ssa_db *p_smdb,
 	return p_port_tbl + port_index;
 }
 
+const be16_t *find_port_pkeys(const struct ssa_db *p_smdb,
+			      const struct smdb_port *p_port, size_t *p_count)
+{
+	const uint8_t *p_pkey_tbl = NULL;
+	uint64_t pkey_tbl_size = 0;
+	uint64_t offset = 0;
+	uint16_t size = 0;
+
+	SSA_ASSERT(p_smdb);
+	SSA_ASSERT(p_port);
+	SSA_ASSERT(p_count);
+
+	*p_count = 0;
+
+	p_pkey_tbl = (const uint8_t *)p_smdb->pp_tables[SMDB_TBL_ID_PKEY];
+	pkey_tbl_size = ntohll(p_smdb->p_db_tables[SMDB_TBL_ID_PKEY].set_size);
+
+	/* pkey table offset and size are in bytes */
+	offset = ntohll(p_port->pkey_tbl_offset);
+	size = ntohs(p_port->pkey_tbl_size);
+
+	if (!p_pkey_tbl || !size)
+		return NULL;
+
+	if (offset + size > pkey_tbl_size || offset % sizeof(be16_t)) {
+		SSA_PR_LOG_ERROR("Invalid pkey table. LID: %u Port num: %u "
+				 "offset: %" PRIu64 " size: %u",
+				 ntohs(p_port->port_lid), p_port->port_num,
+				 offset, size);
+		return NULL;
+	}
+
+	*p_count = size / sizeof(be16_t);
+	return (const be16_t *)(p_pkey_tbl + offset);
+}
+
 const struct smdb_port *find_linked_port(const struct ssa_db *p_smdb,
 					 const struct ssa_pr_smdb_index *p_index,
 					 const be16_t lid, const int port_num)
@@ -500,25 +1099,16 @@ const struct smdb_port *find_linked_port(const struct ssa_db *p_smdb,
 
 	SSA_ASSERT(p_smdb);
 	SSA_ASSERT(p_index);
-	SSA_ASSERT(p_index->is_switch_lookup);
 	SSA_ASSERT(lid);
 
 	p_port_tbl = (const struct smdb_port *)p_smdb->pp_tables[SMDB_TBL_ID_PORT];
 	SSA_ASSERT(p_port_tbl);
 
-	if (p_index->is_switch_lookup[ntohs(lid)]) {
-		uint64_t *port_lookup = p_index->switch_link_lookup[ntohs(lid)];
-		if (!port_lookup) {
-			SSA_PR_LOG_ERROR("Link not found. LID: %u Port num: %u",
-					 ntohs(lid), port_num);
-			return NULL;
-		}
-		record_index = port_lookup[port_num];
-	} else {
-		record_index = p_index->ca_link_lookup[ntohs(lid)];
-	}
+	record_index = find_port_entry(p_index, lid, port_num);
+	if (INDEX_NONE != record_index)
+		record_index = p_index->link_lookup[record_index];
 
-	port_count = get_dataset_count(p_smdb, SMDB_TBL_ID_PORT);
+	port_count = p_index->port_rec_count;
 
 	if (record_index >= port_count) {
 		if (port_num >= 0) {
@@ -533,26 +1123,15 @@ const struct smdb_port *find_linked_port(const struct ssa_db *p_smdb,
 	return p_port_tbl + record_index;
 }
 
-int is_port_exist(const struct ssa_db *p_smdb, be64_t guid)
+int is_port_exist(const struct ssa_db *p_smdb,
+		  const struct ssa_pr_smdb_index *p_index, be64_t guid)
 {
-	size_t i = 0, count = 0;
-	const struct smdb_guid2lid *p_guid2lid_tbl = NULL;
-
 	SSA_ASSERT(p_smdb);
 
-	p_guid2lid_tbl =
-		(struct smdb_guid2lid *)p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
-	SSA_ASSERT(p_guid2lid_tbl);
-
-	count = get_dataset_count(p_smdb, SMDB_TBL_ID_GUID2LID);
-	if (!count) {
+	if (!get_dataset_count(p_smdb, SMDB_TBL_ID_GUID2LID)) {
 		SSA_PR_LOG_INFO("Guid to LID table is empty");
 		return 0;
 	}
 
-	for (i = 0; i < count; i++)
-		if (p_guid2lid_tbl[i].guid == guid)
-			return 1;
-
-	return 0;
+	return NULL != find_guid_to_lid_rec(p_smdb, p_index, guid);
 }
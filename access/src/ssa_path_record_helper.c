@@ -148,7 +148,7 @@ int rates_cmp_table[19][19] = {
 	{ 1, 1, 1, -1, -1, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
 	{ 1, 1, 1, 1, -1, 1, 0, -1, -1, -1, -1, 1, -1, -1, -1, -1, -1, -1, -1 },
 	{ 1, 1, 1, 1, 1, 1, 1, 0, -1, -1, -1, 1, -1, -1, -1, 1, -1, -1, -1 },
-	{ 1, 1, 1, 1, 1, 1, 1, 1, 0, -1, -1, 1, -1, -1, -1, 1, -1, 1, -1 },
+	{ 1, 1, 1, 1, 1, 1, 1, 1, 0, -1, -1, 1, -1, -1, -1, 1, -1, -1, -1 },
 	{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, -1, 1, 1, -1, -1, 1, -1, -1, -1 },
 	{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, -1, -1, 1, -1, -1, -1 },
 	{ 1, 1, 1, 1, -1, 1, -1, -1, -1, -1, -1, 0, -1, -1, -1, -1, -1, -1, -1 },
@@ -31,6 +31,9 @@
  *
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <infiniband/ssa_db.h>
 #include <infiniband/ssa_prdb.h>
 #include <asm/byteorder.h>
@@ -45,16 +48,43 @@ static struct db_table_def def_tbl[] = {
 		"PR", __constant_htonl(sizeof(struct prdb_pr)), 0 },
 	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DEF, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR, 0 },
 		"PR fields", __constant_htonl(sizeof(struct db_field_def)), __constant_htonl(PRDB_TBL_ID_PR) },
+	[PRDB_TBL_ID_PR_LMC * 2] =
+	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DATA, 0, { 0, PRDB_TBL_ID_PR_LMC, 0 },
+		"PR LMC", __constant_htonl(sizeof(struct prdb_pr_lmc)), 0 },
+	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DEF, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, 0 },
+		"PR LMC fields", __constant_htonl(sizeof(struct db_field_def)), __constant_htonl(PRDB_TBL_ID_PR_LMC) },
+	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DATA, 0, { 0, PRDB_TBL_ID_PR_V2, 0 },
+		"PR V2", __constant_htonl(sizeof(struct prdb_pr_v2)), 0 },
+	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DEF, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2, 0 },
+		"PR V2 fields", __constant_htonl(sizeof(struct db_field_def)), __constant_htonl(PRDB_TBL_ID_PR_V2) },
+	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DATA, 0, { 0, PRDB_TBL_ID_PR_V2_ATTR, 0 },
+		"PR V2 ATTR", __constant_htonl(sizeof(struct prdb_pr_v2_attr)), 0 },
+	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DEF, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_ATTR, 0 },
+		"PR V2 ATTR fields", __constant_htonl(sizeof(struct db_field_def)), __constant_htonl(PRDB_TBL_ID_PR_V2_ATTR) },
+	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DATA, 0, { 0, PRDB_TBL_ID_PR_V2_GUID, 0 },
+		"PR V2 GUID", __constant_htonl(sizeof(uint8_t)), 0 },
+	{ DBT_DEF_VERSION, sizeof(struct db_table_def), DBT_TYPE_DEF, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_GUID, 0 },
+		"PR V2 GUID fields", __constant_htonl(sizeof(struct db_field_def)), __constant_htonl(PRDB_TBL_ID_PR_V2_GUID) },
 	[PRDB_TBLS] = { DB_VERSION_INVALID }
 };
 
 static struct db_dataset dataset_tbl[] = {
 	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_PR, 0 }, 0, 0, 0, 0 },
+	[PRDB_TBL_ID_PR_LMC] =
+	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_PR_LMC, 0 }, 0, 0, 0, 0 },
+	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_PR_V2, 0 }, 0, 0, 0, 0 },
+	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_PR_V2_ATTR, 0 }, 0, 0, 0, 0 },
+	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_PR_V2_GUID, 0 }, 0, 0, 0, 0 },
 	[PRDB_DATA_TBLS] = { DB_VERSION_INVALID }
 };
 
 static struct db_dataset field_dataset_tbl[] = {
 	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR, 0 }, 0, 0, 0, 0 },
+	[PRDB_TBL_ID_PR_LMC] =
+	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, 0 }, 0, 0, 0, 0 },
+	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2, 0 }, 0, 0, 0, 0 },
+	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_ATTR, 0 }, 0, 0, 0, 0 },
+	{ DB_DS_VERSION, sizeof(struct db_dataset), 0, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_GUID, 0 }, 0, 0, 0, 0 },
 	[PRDB_DATA_TBLS] = { DB_VERSION_INVALID }
 };
 
@@ -66,6 +96,25 @@ static struct db_field_def field_tbl[] = {
 	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR, PRDB_FIELD_ID_PR_RATE       }, "rate",       __constant_htonl(8),  __constant_htonl(104) },
 	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR, PRDB_FIELD_ID_PR_SL         }, "sl",         __constant_htonl(8),  __constant_htonl(112) },
 	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR, PRDB_FIELD_ID_PR_REVERSIBLE }, "reversible", __constant_htonl(8),  __constant_htonl(120) },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_NET64, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_DGUID      }, "guid",       __constant_htonl(64),                  0    },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_NET16, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_DLID       }, "dlid",       __constant_htonl(16), __constant_htonl(64)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_NET16, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_PK         }, "pkey",       __constant_htonl(16), __constant_htonl(80)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_MTU        }, "mtu",        __constant_htonl(8),  __constant_htonl(96)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_RATE       }, "rate",       __constant_htonl(8),  __constant_htonl(104) },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_SL         }, "sl",         __constant_htonl(8),  __constant_htonl(112) },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_REVERSIBLE }, "reversible", __constant_htonl(8),  __constant_htonl(120) },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_LMC        }, "lmc",        __constant_htonl(8),  __constant_htonl(128) },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_LMC, PRDB_FIELD_ID_PR_LMC_RESERVED   }, "reserved",   __constant_htonl(8 * 7), __constant_htonl(136) },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_NET16, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2, PRDB_FIELD_ID_PR_V2_DLID     }, "dlid",       __constant_htonl(16),                  0    },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2, PRDB_FIELD_ID_PR_V2_ATTR     }, "attr",       __constant_htonl(8),  __constant_htonl(16)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2, PRDB_FIELD_ID_PR_V2_GUID_LEN }, "guid_len",   __constant_htonl(8),  __constant_htonl(24)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_NET16, 0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_ATTR, PRDB_FIELD_ID_PR_V2_ATTR_PK         }, "pkey",       __constant_htonl(16),                  0    },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_ATTR, PRDB_FIELD_ID_PR_V2_ATTR_MTU        }, "mtu",        __constant_htonl(8),  __constant_htonl(16)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_ATTR, PRDB_FIELD_ID_PR_V2_ATTR_RATE       }, "rate",       __constant_htonl(8),  __constant_htonl(24)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_ATTR, PRDB_FIELD_ID_PR_V2_ATTR_SL         }, "sl",         __constant_htonl(8),  __constant_htonl(32)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_ATTR, PRDB_FIELD_ID_PR_V2_ATTR_REVERSIBLE }, "reversible", __constant_htonl(8),  __constant_htonl(40)  },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_ATTR, PRDB_FIELD_ID_PR_V2_ATTR_RESERVED   }, "reserved",   __constant_htonl(8 * 2), __constant_htonl(48) },
+	{ DBF_DEF_VERSION, 0, DBF_TYPE_U8,    0, { 0, PRDB_TBL_ID_MAX + PRDB_TBL_ID_PR_V2_GUID, PRDB_FIELD_ID_PR_V2_GUID_DELTA },   "delta",      __constant_htonl(8),                   0    },
 	[PRDB_FIELDS] = { DB_VERSION_INVALID }
 };
 
@@ -75,7 +124,7 @@ static void prdb_attach_ipdb()
 	uint8_t offset;
 
 	offset = PRDB_TBL_OFFSET * 2;
-	for (i = offset; i < PRDB_TBLS; i++) {
+	for (i = offset; i < offset + IPDB_TBL_ID_MAX * 2; i++) {
 		def_tbl[i] = ip_def_tbl[i - offset];
 		if (def_tbl[i].type == DBT_TYPE_DATA) {
 			def_tbl[i].id.table += PRDB_TBL_OFFSET;
@@ -89,13 +138,13 @@ static void prdb_attach_ipdb()
 	}
 
 	offset = PRDB_TBL_OFFSET;
-	for (i = offset; i < PRDB_DATA_TBLS; i++) {
+	for (i = offset; i < offset + IPDB_TBL_ID_MAX; i++) {
 		dataset_tbl[i] = ip_dataset_tbl[i - offset];
 		dataset_tbl[i].id.table += offset;
 	}
 
 	offset = PRDB_TBL_OFFSET;
-	for (i = offset; i < PRDB_DATA_TBLS; i++) {
+	for (i = offset; i < offset + IPDB_TBL_ID_MAX; i++) {
 		field_dataset_tbl[i] = ip_field_dataset_tbl[i - offset];
 		field_dataset_tbl[i].id.table -= IPDB_TBL_ID_MAX;
 		field_dataset_tbl[i].id.table +=
@@ -123,11 +172,19 @@ struct ssa_db  *ssa_prdb_create(uint64_t epoch, uint64_t num_recs[PRDB_DATA_TBLS
 	recs_size_arr[PRDB_TBL_ID_IPv4]	= sizeof(struct ipdb_ipv4);
 	recs_size_arr[PRDB_TBL_ID_IPv6]	= sizeof(struct ipdb_ipv6);
 	recs_size_arr[PRDB_TBL_ID_NAME]	= sizeof(struct ipdb_name);
+	recs_size_arr[PRDB_TBL_ID_PR_LMC] = sizeof(struct prdb_pr_lmc);
+	recs_size_arr[PRDB_TBL_ID_PR_V2] = sizeof(struct prdb_pr_v2);
+	recs_size_arr[PRDB_TBL_ID_PR_V2_ATTR] = sizeof(struct prdb_pr_v2_attr);
+	recs_size_arr[PRDB_TBL_ID_PR_V2_GUID] = sizeof(uint8_t);
 
 	num_field_recs_arr[PRDB_TBL_ID_PR]	= PRDB_FIELD_ID_PR_MAX;
 	num_field_recs_arr[PRDB_TBL_ID_IPv4]	= IPDB_FIELD_ID_IPv4_MAX;
 	num_field_recs_arr[PRDB_TBL_ID_IPv6]	= IPDB_FIELD_ID_IPv6_MAX;
 	num_field_recs_arr[PRDB_TBL_ID_NAME]	= IPDB_FIELD_ID_NAME_MAX;
+	num_field_recs_arr[PRDB_TBL_ID_PR_LMC]	= PRDB_FIELD_ID_PR_LMC_MAX;
+	num_field_recs_arr[PRDB_TBL_ID_PR_V2]	= PRDB_FIELD_ID_PR_V2_MAX;
+	num_field_recs_arr[PRDB_TBL_ID_PR_V2_ATTR] = PRDB_FIELD_ID_PR_V2_ATTR_MAX;
+	num_field_recs_arr[PRDB_TBL_ID_PR_V2_GUID] = PRDB_FIELD_ID_PR_V2_GUID_MAX;
 
 	p_ssa_db = ssa_db_alloc(num_recs, recs_size_arr,
 				num_field_recs_arr, PRDB_DATA_TBLS);
@@ -139,3 +196,313 @@ struct ssa_db  *ssa_prdb_create(uint64_t epoch, uint64_t num_recs[PRDB_DATA_TBLS
 
 	return p_ssa_db;
 }
+
+static int prdb_pr_same_attrs(const struct prdb_pr *p_rec1,
+			      const struct prdb_pr *p_rec2)
+{
+	return p_rec1->pk == p_rec2->pk && p_rec1->mtu == p_rec2->mtu &&
+	       p_rec1->rate == p_rec2->rate && p_rec1->sl == p_rec2->sl &&
+	       p_rec1->is_reversible == p_rec2->is_reversible;
+}
+
+/*
+ * Returns the number of records of the LID run starting at the i-th record:
+ * consecutive LIDs of the same port.
+ */
+static uint64_t prdb_pr_run(const struct prdb_pr *p_pr_tbl, uint64_t pr_cnt,
+			    uint64_t i)
+{
+	uint64_t j = i + 1;
+
+	while (j < pr_cnt && p_pr_tbl[j].guid == p_pr_tbl[i].guid &&
+	       ntohs(p_pr_tbl[j].lid) == ntohs(p_pr_tbl[i].lid) + (j - i))
+		j++;
+
+	return j - i;
+}
+
+/*
+ * Returns LMC of a LID run, or -1 if the run can't be a PR_LMC entry:
+ * its length isn't a power of 2 or the base LID isn't aligned to it.
+ */
+static int prdb_pr_run_lmc(uint16_t base_lid, uint64_t len)
+{
+	int lmc = 0;
+
+	if (len < 2 || (len & (len - 1)) || (base_lid & (len - 1)))
+		return -1;
+
+	while ((1ULL << lmc) < len)
+		lmc++;
+
+	return lmc;
+}
+
+/* IP tables are copied as is */
+static void prdb_copy_ip_tables(struct ssa_db *p_dest, const struct ssa_db *p_src)
+{
+	int i;
+
+	for (i = PRDB_TBL_OFFSET; i < PRDB_TBL_OFFSET + IPDB_TBL_ID_MAX; i++) {
+		memcpy(p_dest->pp_tables[i], p_src->pp_tables[i],
+		       ntohll(p_src->p_db_tables[i].set_size));
+		p_dest->p_db_tables[i].set_count = p_src->p_db_tables[i].set_count;
+		p_dest->p_db_tables[i].set_size = p_src->p_db_tables[i].set_size;
+	}
+}
+
+/*
+ * Walks LID runs of a PRDB. If p_dest is NULL, only counts records
+ * of the compressed PRDB.
+ */
+static void prdb_compress_lmc(const struct prdb_pr *p_pr_tbl, uint64_t pr_cnt,
+			      uint8_t *p_seen, uint64_t num_recs[PRDB_TBL_ID_MAX],
+			      struct ssa_db *p_dest)
+{
+	struct prdb_pr *p_dest_pr = NULL;
+	struct prdb_pr_lmc *p_dest_lmc = NULL;
+	uint64_t i = 0, k = 0, len = 0;
+	uint16_t base_lid;
+	int lmc;
+
+	if (p_dest) {
+		p_dest_pr = (struct prdb_pr *) p_dest->pp_tables[PRDB_TBL_ID_PR];
+		p_dest_lmc = (struct prdb_pr_lmc *) p_dest->pp_tables[PRDB_TBL_ID_PR_LMC];
+	}
+
+	num_recs[PRDB_TBL_ID_PR] = 0;
+	num_recs[PRDB_TBL_ID_PR_LMC] = 0;
+
+	for (i = 0; i < pr_cnt; i += len) {
+		len = prdb_pr_run(p_pr_tbl, pr_cnt, i);
+		base_lid = ntohs(p_pr_tbl[i].lid);
+
+		/* Same records computed for another source LID */
+		if (p_seen[base_lid / 8] & (1 << (base_lid % 8)))
+			continue;
+		for (k = 0; k < len; k++)
+			p_seen[(base_lid + k) / 8] |= 1 << ((base_lid + k) % 8);
+
+		lmc = prdb_pr_run_lmc(base_lid, len);
+		if (lmc >= 0) {
+			if (p_dest) {
+				struct prdb_pr_lmc *p_entry =
+					p_dest_lmc + num_recs[PRDB_TBL_ID_PR_LMC];
+
+				memset(p_entry, 0, sizeof(*p_entry));
+				p_entry->guid = p_pr_tbl[i].guid;
+				p_entry->lid = p_pr_tbl[i].lid;
+				p_entry->pk = p_pr_tbl[i].pk;
+				p_entry->mtu = p_pr_tbl[i].mtu;
+				p_entry->rate = p_pr_tbl[i].rate;
+				p_entry->sl = p_pr_tbl[i].sl;
+				p_entry->is_reversible = p_pr_tbl[i].is_reversible;
+				p_entry->lmc = lmc;
+			}
+			num_recs[PRDB_TBL_ID_PR_LMC]++;
+		}
+
+		for (k = 0; k < len; k++) {
+			if (lmc >= 0 &&
+			    prdb_pr_same_attrs(p_pr_tbl + i, p_pr_tbl + i + k))
+				continue;
+			if (p_dest)
+				p_dest_pr[num_recs[PRDB_TBL_ID_PR]] = p_pr_tbl[i + k];
+			num_recs[PRDB_TBL_ID_PR]++;
+		}
+	}
+}
+
+/** =========================================================================
+ */
+struct ssa_db *ssa_prdb_compress_lmc(const struct ssa_db *p_prdb)
+{
+	struct ssa_db *p_ssa_db = NULL;
+	const struct prdb_pr *p_pr_tbl;
+	uint64_t num_recs[PRDB_TBL_ID_MAX] = {};
+	uint64_t pr_cnt;
+	uint8_t *p_seen;
+	int i;
+
+	if (!p_prdb || p_prdb->data_tbl_cnt != PRDB_DATA_TBLS)
+		return NULL;
+
+	/* bitmap of LIDs with path records */
+	p_seen = calloc(1, (UINT16_MAX + 1) / 8);
+	if (!p_seen)
+		return NULL;
+
+	p_pr_tbl = (const struct prdb_pr *) p_prdb->pp_tables[PRDB_TBL_ID_PR];
+	pr_cnt = ntohll(p_prdb->p_db_tables[PRDB_TBL_ID_PR].set_count);
+
+	for (i = 0; i < PRDB_DATA_TBLS; i++)
+		num_recs[i] = ntohll(p_prdb->p_db_tables[i].set_count);
+	prdb_compress_lmc(p_pr_tbl, pr_cnt, p_seen, num_recs, NULL);
+
+	p_ssa_db = ssa_prdb_create(ssa_db_get_epoch(p_prdb, DB_DEF_TBL_ID),
+				   num_recs);
+	if (!p_ssa_db)
+		goto out;
+
+	memset(p_seen, 0, (UINT16_MAX + 1) / 8);
+	prdb_compress_lmc(p_pr_tbl, pr_cnt, p_seen, num_recs, p_ssa_db);
+
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR].set_count =
+		htonll(num_recs[PRDB_TBL_ID_PR]);
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR].set_size =
+		htonll(num_recs[PRDB_TBL_ID_PR] * sizeof(struct prdb_pr));
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_LMC].set_count =
+		htonll(num_recs[PRDB_TBL_ID_PR_LMC]);
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_LMC].set_size =
+		htonll(num_recs[PRDB_TBL_ID_PR_LMC] * sizeof(struct prdb_pr_lmc));
+
+	prdb_copy_ip_tables(p_ssa_db, p_prdb);
+out:
+	free(p_seen);
+	return p_ssa_db;
+}
+
+static int prdb_pr_v2_attr_idx(const struct prdb_pr *p_rec,
+			       struct prdb_pr_v2_attr *p_attrs, int *p_attr_cnt)
+{
+	int i;
+
+	for (i = 0; i < *p_attr_cnt; i++)
+		if (p_attrs[i].pk == p_rec->pk && p_attrs[i].mtu == p_rec->mtu &&
+		    p_attrs[i].rate == p_rec->rate && p_attrs[i].sl == p_rec->sl &&
+		    p_attrs[i].is_reversible == p_rec->is_reversible)
+			return i;
+
+	if (*p_attr_cnt == PRDB_PR_V2_ATTRS_MAX)
+		return -1;
+
+	memset(p_attrs + i, 0, sizeof(*p_attrs));
+	p_attrs[i].pk = p_rec->pk;
+	p_attrs[i].mtu = p_rec->mtu;
+	p_attrs[i].rate = p_rec->rate;
+	p_attrs[i].sl = p_rec->sl;
+	p_attrs[i].is_reversible = p_rec->is_reversible;
+	(*p_attr_cnt)++;
+
+	return i;
+}
+
+/*
+ * Walks path records in LID order. If p_dest is NULL, only counts
+ * records of PR V2 tables and builds attribute dictionary.
+ */
+static int prdb_encode_v2(const struct prdb_pr **pp_by_lid,
+			  struct prdb_pr_v2_attr *p_attrs, int *p_attr_cnt,
+			  uint64_t num_recs[PRDB_TBL_ID_MAX],
+			  struct ssa_db *p_dest)
+{
+	struct prdb_pr_v2 *p_dest_v2 = NULL;
+	uint8_t *p_dest_guid = NULL;
+	uint64_t guid, prev_guid = 0, delta;
+	uint32_t lid;
+	int attr, len, i;
+
+	if (p_dest) {
+		p_dest_v2 = (struct prdb_pr_v2 *) p_dest->pp_tables[PRDB_TBL_ID_PR_V2];
+		p_dest_guid = (uint8_t *) p_dest->pp_tables[PRDB_TBL_ID_PR_V2_GUID];
+	}
+
+	num_recs[PRDB_TBL_ID_PR_V2] = 0;
+	num_recs[PRDB_TBL_ID_PR_V2_GUID] = 0;
+
+	for (lid = 0; lid <= UINT16_MAX; lid++) {
+		if (!pp_by_lid[lid])
+			continue;
+
+		attr = prdb_pr_v2_attr_idx(pp_by_lid[lid], p_attrs, p_attr_cnt);
+		if (attr < 0)
+			return -1;
+
+		guid = ntohll(pp_by_lid[lid]->guid);
+		delta = guid ^ prev_guid;
+		prev_guid = guid;
+		for (len = 0; len < 8 && (delta >> (8 * len)); len++)
+			;
+
+		if (p_dest) {
+			struct prdb_pr_v2 *p_entry =
+				p_dest_v2 + num_recs[PRDB_TBL_ID_PR_V2];
+
+			p_entry->lid = pp_by_lid[lid]->lid;
+			p_entry->attr = (uint8_t) attr;
+			p_entry->guid_len = (uint8_t) len;
+			for (i = 0; i < len; i++)
+				p_dest_guid[num_recs[PRDB_TBL_ID_PR_V2_GUID] + i] =
+					(uint8_t) (delta >> (8 * (len - 1 - i)));
+		}
+		num_recs[PRDB_TBL_ID_PR_V2]++;
+		num_recs[PRDB_TBL_ID_PR_V2_GUID] += len;
+	}
+
+	num_recs[PRDB_TBL_ID_PR_V2_ATTR] = *p_attr_cnt;
+	return 0;
+}
+
+/** =========================================================================
+ */
+struct ssa_db *ssa_prdb_encode_v2(const struct ssa_db *p_prdb)
+{
+	struct ssa_db *p_ssa_db = NULL;
+	const struct prdb_pr *p_pr_tbl;
+	const struct prdb_pr **pp_by_lid;
+	struct prdb_pr_v2_attr attrs[PRDB_PR_V2_ATTRS_MAX];
+	uint64_t num_recs[PRDB_TBL_ID_MAX] = {};
+	uint64_t pr_cnt, k;
+	uint16_t lid;
+	int i, attr_cnt = 0;
+
+	if (!p_prdb || p_prdb->data_tbl_cnt != PRDB_DATA_TBLS)
+		return NULL;
+
+	pp_by_lid = calloc(UINT16_MAX + 1, sizeof(*pp_by_lid));
+	if (!pp_by_lid)
+		return NULL;
+
+	p_pr_tbl = (const struct prdb_pr *) p_prdb->pp_tables[PRDB_TBL_ID_PR];
+	pr_cnt = ntohll(p_prdb->p_db_tables[PRDB_TBL_ID_PR].set_count);
+
+	/* Same records are computed for each source LID, first one is kept */
+	for (k = 0; k < pr_cnt; k++) {
+		lid = ntohs(p_pr_tbl[k].lid);
+		if (!pp_by_lid[lid])
+			pp_by_lid[lid] = p_pr_tbl + k;
+	}
+
+	for (i = PRDB_TBL_OFFSET; i < PRDB_TBL_OFFSET + IPDB_TBL_ID_MAX; i++)
+		num_recs[i] = ntohll(p_prdb->p_db_tables[i].set_count);
+	if (prdb_encode_v2(pp_by_lid, attrs, &attr_cnt, num_recs, NULL))
+		goto out;
+
+	p_ssa_db = ssa_prdb_create(ssa_db_get_epoch(p_prdb, DB_DEF_TBL_ID),
+				   num_recs);
+	if (!p_ssa_db)
+		goto out;
+
+	prdb_encode_v2(pp_by_lid, attrs, &attr_cnt, num_recs, p_ssa_db);
+	if (attr_cnt)
+		memcpy(p_ssa_db->pp_tables[PRDB_TBL_ID_PR_V2_ATTR], attrs,
+		       attr_cnt * sizeof(*attrs));
+
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_V2].set_count =
+		htonll(num_recs[PRDB_TBL_ID_PR_V2]);
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_V2].set_size =
+		htonll(num_recs[PRDB_TBL_ID_PR_V2] * sizeof(struct prdb_pr_v2));
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_V2_ATTR].set_count =
+		htonll(num_recs[PRDB_TBL_ID_PR_V2_ATTR]);
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_V2_ATTR].set_size =
+		htonll(num_recs[PRDB_TBL_ID_PR_V2_ATTR] * sizeof(struct prdb_pr_v2_attr));
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_V2_GUID].set_count =
+		htonll(num_recs[PRDB_TBL_ID_PR_V2_GUID]);
+	p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_V2_GUID].set_size =
+		htonll(num_recs[PRDB_TBL_ID_PR_V2_GUID]);
+
+	prdb_copy_ip_tables(p_ssa_db, p_prdb);
+out:
+	free(pp_by_lid);
+	return p_ssa_db;
+}
@@ -226,6 +226,9 @@ extern int prdb_dump;
 extern char prdb_dump_dir[128];
 extern short prdb_port;
 extern int keepalive;
+extern int db_stream;
+extern int db_rdma;
+extern int db_compress;
 extern int reconnect_timeout;
 extern int reconnect_max_count;
 extern int rejoin_timeout;
@@ -3076,30 +3079,127 @@ err:
 	return ret;
 }
 
+/* PR LMC table is absent in PRDBs of older versions */
+static struct prdb_pr_lmc *acm_access_v1_lmc_tbl(struct ssa_db *p_ssa_db,
+						 uint64_t *p_cnt)
+{
+	*p_cnt = 0;
+	if (p_ssa_db->data_tbl_cnt <= PRDB_TBL_ID_PR_LMC)
+		return NULL;
+
+	*p_cnt = ntohll(p_ssa_db->p_db_tables[PRDB_TBL_ID_PR_LMC].set_count);
+	return (struct prdb_pr_lmc *) p_ssa_db->pp_tables[PRDB_TBL_ID_PR_LMC];
+}
+
+static void acm_access_v1_set_lid2guid(uint64_t *lid2guid, uint16_t lid,
+				       uint64_t guid)
+{
+	if (lid >= IB_LID_MCAST_START)
+		return;
+	if (lid2guid[lid] && lid2guid[lid] != guid)
+		ssa_log(SSA_LOG_DEFAULT, "ERROR - duplicate lid %u\n", lid);
+	else
+		lid2guid[lid] = guid;
+}
+
 /* Parse "access layer v1" file to build LID to GUID table */
 static void acm_parse_access_v1_lid2guid(struct ssa_db *p_ssa_db, uint64_t *lid2guid)
 {
 	struct prdb_pr *p_pr_tbl;
 	struct prdb_pr *p_pr_rec;
-	uint64_t guid;
-	uint64_t pr_cnt;
+	struct prdb_pr_lmc *p_lmc_tbl;
+	struct prdb_pr_v2_iter iter;
+	struct prdb_pr v2_rec;
+	uint64_t pr_cnt, lmc_cnt;
 	uint64_t i;
-	uint16_t lid;
+	uint32_t k;
+	int ret;
 
 	p_pr_tbl = (struct prdb_pr *) p_ssa_db->pp_tables[PRDB_TBL_ID_PR];
 	pr_cnt = ntohll(p_ssa_db->p_db_tables[PRDB_TBL_ID_PR].set_count);
+	p_lmc_tbl = acm_access_v1_lmc_tbl(p_ssa_db, &lmc_cnt);
+
+	for (i = 0; i < lmc_cnt; i++)
+		for (k = 0; k < (1U << p_lmc_tbl[i].lmc); k++)
+			acm_access_v1_set_lid2guid(lid2guid,
+						   ntohs(p_lmc_tbl[i].lid) + k,
+						   p_lmc_tbl[i].guid);
 
 	for (i = 0; i < pr_cnt; i++) {
 		p_pr_rec = p_pr_tbl + i;
-		guid = p_pr_rec->guid;
-		lid = ntohs(p_pr_rec->lid);
+		acm_access_v1_set_lid2guid(lid2guid, ntohs(p_pr_rec->lid),
+					   p_pr_rec->guid);
+	}
 
-		if (lid >= IB_LID_MCAST_START)
-			continue;
-		if (lid2guid[lid])
-			ssa_log(SSA_LOG_DEFAULT, "ERROR - duplicate lid %u\n", lid);
-		else
-			lid2guid[lid] = guid;
+	prdb_pr_v2_iter_init(&iter, p_ssa_db);
+	while ((ret = prdb_pr_v2_next(&iter, &v2_rec)) > 0)
+		acm_access_v1_set_lid2guid(lid2guid, ntohs(v2_rec.lid),
+					   v2_rec.guid);
+	if (ret < 0)
+		ssa_log(SSA_LOG_DEFAULT, "ERROR - malformed PR V2 table\n");
+}
+
+static void acm_add_access_v1_dest(struct acm_ep *ep, union ibv_gid *sgid,
+				   uint16_t port_lid, struct ibv_port_attr *attr,
+				   uint64_t *lid2guid, uint16_t dlid,
+				   int sl, int mtu, int rate)
+{
+	union ibv_gid dgid;
+	struct acm_dest *dest;
+	uint8_t addr[ACM_MAX_ADDRESS];
+	union ibv_gid *gid_addr = (union ibv_gid *) &addr;
+	uint16_t *lid_addr = (uint16_t *) &addr;
+	uint8_t addr_type;
+	int i;
+
+	if (!lid2guid[dlid]) {
+		ssa_log(SSA_LOG_DEFAULT,
+			"ERROR - dlid %u not found in lid2guid table\n", dlid);
+		return;
+	}
+
+	dgid.global.subnet_prefix = sgid->global.subnet_prefix;
+	dgid.global.interface_id = lid2guid[dlid];
+
+	for (i = 0; i < 2; i++) {
+		memset(addr, 0, sizeof(addr));
+		if (i == 0) {
+			addr_type = ACM_ADDRESS_LID;
+			*lid_addr = htons(dlid);
+		} else {
+			addr_type = ACM_ADDRESS_GID;
+			memcpy(gid_addr, &dgid, sizeof(dgid));
+		}
+		dest = acm_acquire_dest(ep, addr_type, addr);
+		if (!dest) {
+			ssa_log(SSA_LOG_DEFAULT,
+				"ERROR - unable to create dest\n");
+			break;
+		}
+
+		dest->path.sgid = *sgid;
+		dest->path.slid = htons(port_lid);
+		dest->path.dgid = dgid;
+		dest->path.dlid = htons(dlid);
+		dest->path.reversible_numpath = IBV_PATH_RECORD_REVERSIBLE;
+		dest->path.pkey = htons(ep->pkey);
+		dest->path.mtu = (uint8_t) mtu;
+		dest->path.rate = (uint8_t) rate;
+		dest->path.qosclass_sl = htons((uint16_t) sl & 0xF);
+		if (dlid == port_lid) {
+			dest->path.packetlifetime = 0;
+			dest->addr_timeout = (uint64_t)~0ULL;
+			dest->route_timeout = (uint64_t)~0ULL;
+		} else {
+			dest->path.packetlifetime = attr->subnet_timeout;
+			dest->addr_timeout = time_stamp_min() + (unsigned) addr_timeout;
+			dest->route_timeout = time_stamp_min() + (unsigned) route_timeout;
+		}
+		dest->remote_qpn = 1;
+		dest->state = ACM_READY;
+		acm_put_dest(dest);
+		ssa_log(SSA_LOG_VERBOSE, "added cached dest %s\n",
+			dest->name);
 	}
 }
 
@@ -3107,21 +3207,19 @@ static void acm_parse_access_v1_lid2guid(struct ssa_db *p_ssa_db, uint64_t *lid2
 static int acm_parse_access_v1_paths(struct ssa_db *p_ssa_db,
 				     uint64_t *lid2guid, struct acm_ep *ep)
 {
-	union ibv_gid sgid, dgid;
+	union ibv_gid sgid;
 	struct ibv_port_attr attr = { 0 };
 	struct ibv_context *verbs;
-	struct acm_dest *dest;
 	struct prdb_pr *p_pr_tbl, *p_pr_rec;
+	struct prdb_pr_lmc *p_lmc_tbl, *p_lmc_rec;
+	struct prdb_pr_v2_iter iter;
+	struct prdb_pr v2_rec;
 	uint16_t *port_lid;
 	uint8_t *port_num;
-	uint64_t guid, i, k, pr_cnt;
-	uint16_t lid, dlid;
-	int sl, mtu, rate;
+	uint64_t i, k, pr_cnt, lmc_cnt;
+	uint16_t lid;
+	uint32_t n;
 	int ret = 1;
-	uint8_t addr[ACM_MAX_ADDRESS];
-	union ibv_gid *gid_addr = (union ibv_gid *) &addr;
-	uint16_t *lid_addr = (uint16_t *) &addr;
-	uint8_t addr_type;
 
 	if (acm_mode == ACM_MODE_ACM)
 		verbs = ((struct acm_port *)(ep->port))->dev->verbs;
@@ -3139,17 +3237,27 @@ static int acm_parse_access_v1_paths(struct ssa_db *p_ssa_db,
 
 	p_pr_tbl = (struct prdb_pr *) p_ssa_db->pp_tables[PRDB_TBL_ID_PR];
 	pr_cnt = ntohll(p_ssa_db->p_db_tables[PRDB_TBL_ID_PR].set_count);
-
-	/* Search for endpoint's SLID */
-	for (i = 0; i < pr_cnt; i++) {
-		p_pr_rec = p_pr_tbl + i;
-		guid = p_pr_rec->guid;
-		if (guid !=  sgid.global.interface_id)
-			continue;
-
-		lid = ntohs(p_pr_rec->lid);
-		if (lid != *port_lid)
-		        continue;
+	p_lmc_tbl = acm_access_v1_lmc_tbl(p_ssa_db, &lmc_cnt);
+	prdb_pr_v2_iter_init(&iter, p_ssa_db);
+
+	/* Search for endpoint's SLID, PR V2 records are sorted by LID */
+	for (i = 0; i < pr_cnt + lmc_cnt + 1; i++) {
+		if (i < pr_cnt) {
+			p_pr_rec = p_pr_tbl + i;
+			if (p_pr_rec->guid != sgid.global.interface_id ||
+			    ntohs(p_pr_rec->lid) != *port_lid)
+				continue;
+		} else if (i < pr_cnt + lmc_cnt) {
+			p_lmc_rec = p_lmc_tbl + i - pr_cnt;
+			lid = ntohs(p_lmc_rec->lid);
+			if (p_lmc_rec->guid != sgid.global.interface_id ||
+			    *port_lid < lid ||
+			    *port_lid >= lid + (1U << p_lmc_rec->lmc))
+				continue;
+		} else if (prdb_pr_v2_find(&iter, *port_lid) < 0 ||
+			   lid2guid[*port_lid] != sgid.global.interface_id) {
+			break;
+		}
 
 		ret = ibv_query_port(verbs, *port_num, &attr);
 		if (ret) {
@@ -3161,63 +3269,31 @@ static int acm_parse_access_v1_paths(struct ssa_db *p_ssa_db,
 		break;
 	}
 
+	/*
+	 * LMC entries are expanded first, PR records of LIDs
+	 * with different attributes override them.
+	 */
+	for (k = 0; k < lmc_cnt; k++) {
+		p_lmc_rec = p_lmc_tbl + k;
+		for (n = 0; n < (1U << p_lmc_rec->lmc); n++)
+			acm_add_access_v1_dest(ep, &sgid, *port_lid, &attr,
+					       lid2guid,
+					       ntohs(p_lmc_rec->lid) + n,
+					       p_lmc_rec->sl, p_lmc_rec->mtu,
+					       p_lmc_rec->rate);
+	}
+
 	for (k = 0; k < pr_cnt; k++) {
 		p_pr_rec = p_pr_tbl + k;
-		dlid = ntohs(p_pr_rec->lid);
-		sl = p_pr_rec->sl;
-		mtu = p_pr_rec->mtu;
-		rate = p_pr_rec->rate;
-
-		if (!lid2guid[dlid]) {
-			ssa_log(SSA_LOG_DEFAULT,
-				"ERROR - dlid %u not found in lid2guid table\n", dlid);
-			continue;
-	        }
-
-	        dgid.global.subnet_prefix = sgid.global.subnet_prefix;
-	        dgid.global.interface_id = lid2guid[dlid];
-
-	        for (i = 0; i < 2; i++) {
-			memset(addr, 0, sizeof(addr));
-			if (i == 0) {
-				addr_type = ACM_ADDRESS_LID;
-				*lid_addr = htons(dlid);
-			} else {
-				addr_type = ACM_ADDRESS_GID;
-				memcpy(gid_addr, &dgid, sizeof(dgid));
-			}
-			dest = acm_acquire_dest(ep, addr_type, addr);
-			if (!dest) {
-				ssa_log(SSA_LOG_DEFAULT,
-					"ERROR - unable to create dest\n");
-				break;
-			}
-
-			dest->path.sgid = sgid;
-			dest->path.slid = htons(*port_lid);
-			dest->path.dgid = dgid;
-			dest->path.dlid = htons(dlid);
-			dest->path.reversible_numpath = IBV_PATH_RECORD_REVERSIBLE;
-			dest->path.pkey = htons(ep->pkey);
-			dest->path.mtu = (uint8_t) mtu;
-			dest->path.rate = (uint8_t) rate;
-			dest->path.qosclass_sl = htons((uint16_t) sl & 0xF);
-			if (dlid == *port_lid) {
-				dest->path.packetlifetime = 0;
-				dest->addr_timeout = (uint64_t)~0ULL;
-				dest->route_timeout = (uint64_t)~0ULL;
-			} else {
-				dest->path.packetlifetime = attr.subnet_timeout;
-				dest->addr_timeout = time_stamp_min() + (unsigned) addr_timeout;
-				dest->route_timeout = time_stamp_min() + (unsigned) route_timeout;
-			}
-			dest->remote_qpn = 1;
-			dest->state = ACM_READY;
-			acm_put_dest(dest);
-			ssa_log(SSA_LOG_VERBOSE, "added cached dest %s\n",
-				dest->name);
-	        }
+		acm_add_access_v1_dest(ep, &sgid, *port_lid, &attr, lid2guid,
+				       ntohs(p_pr_rec->lid), p_pr_rec->sl,
+				       p_pr_rec->mtu, p_pr_rec->rate);
 	}
+
+	while (prdb_pr_v2_next(&iter, &v2_rec) > 0)
+		acm_add_access_v1_dest(ep, &sgid, *port_lid, &attr, lid2guid,
+				       ntohs(v2_rec.lid), v2_rec.sl,
+				       v2_rec.mtu, v2_rec.rate);
 	return ret;
 }
 
@@ -4611,6 +4687,12 @@ static void acm_set_options(void)
 			acm_query_retries = atoi(value);
 		else if (!strcasecmp("keepalive", opt))
 			keepalive = atoi(value);
+		else if (!strcasecmp("db_stream", opt))
+			db_stream = atoi(value);
+		else if (!strcasecmp("db_rdma", opt))
+			db_rdma = atoi(value);
+		else if (!strcasecmp("db_compress", opt))
+			db_compress = atoi(value);
 		else if (!strcasecmp("reconnect_max_count", opt))
 			 reconnect_max_count = atoi(value);
 		else if (!strcasecmp("reconnect_timeout", opt))
@@ -4660,6 +4742,9 @@ static void acm_log_options(void)
 	ssa_log(SSA_LOG_DEFAULT, "acm_query_timeout %lu\n",acm_query_timeout);
 	ssa_log(SSA_LOG_DEFAULT, "acm_query_retries %d\n", acm_query_retries);
 	ssa_log(SSA_LOG_DEFAULT, "keepalive time %d\n", keepalive);
+	ssa_log(SSA_LOG_DEFAULT, "db stream %d\n", db_stream);
+	ssa_log(SSA_LOG_DEFAULT, "db rdma %d\n", db_rdma);
+	ssa_log(SSA_LOG_DEFAULT, "db compress %d\n", db_compress);
 	if (reconnect_max_count < 0 || reconnect_timeout < 0) {
 		ssa_log(SSA_LOG_DEFAULT, "reconnection to upstream node disabled\n");
 	} else {
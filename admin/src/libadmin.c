@@ -734,6 +734,11 @@ static struct ssa_admin_counter_descr counters_descr[] = {
 	[COUNTER_ID_TIME_LAST_SSA_MAD_RCV] = {"TIME_LAST_SSA_MAD_RCV", "Time of last MAD received" },
 	[COUNTER_ID_TIME_LAST_ERR] = {"TIME_LAST_ERR", "Time of last error" },
 	[COUNTER_ID_DB_EPOCH] = {"DB_EPOCH", "DB epoch" },
+	[COUNTER_ID_COMPRESS_RAW_BYTES] = {"COMPRESS_RAW_BYTES", "Bytes of tables reaching the compression threshold" },
+	[COUNTER_ID_COMPRESS_WIRE_BYTES] = {"COMPRESS_WIRE_BYTES", "Bytes those tables were sent in" },
+	[COUNTER_ID_COMPRESS_RATIO] = {"COMPRESS_RATIO", "Sent to raw bytes of those tables, in percent" },
+	[COUNTER_ID_COMPRESS_USEC] = {"COMPRESS_USEC", "CPU time spent compressing tables, in usec" },
+	[COUNTER_ID_DECOMPRESS_USEC] = {"DECOMPRESS_USEC", "CPU time spent decompressing tables, in usec" },
 };
 
 
@@ -59,11 +59,21 @@ extern int accum_log_file;
 extern int smdb_dump;
 extern int err_smdb_dump;
 extern int prdb_dump;
+extern int prdb_partitions;
+extern int prdb_lmc_compress;
+extern int prdb_v2;
 extern char smdb_dump_dir[128];
 extern char prdb_dump_dir[128];
 extern short smdb_port;
 extern short prdb_port;
 extern int keepalive;
+extern int db_stream;
+extern int db_rdma;
+extern int db_tbl_epoch;
+extern int db_tbl_log;
+extern int db_compress;
+extern int db_compress_threshold;
+extern int downstream_workers;
 #ifdef SIM_SUPPORT_FAKE_ACM
 extern int fake_acm_num;
 #endif
@@ -263,12 +273,34 @@ static void distrib_set_options(void)
 			err_smdb_dump = atoi(value);
 		else if (!strcasecmp("prdb_dump", opt))
 			prdb_dump = atoi(value);
+		else if (!strcasecmp("prdb_partitions", opt))
+			prdb_partitions = atoi(value);
+		else if (!strcasecmp("prdb_lmc_compress", opt))
+			prdb_lmc_compress = atoi(value);
+		else if (!strcasecmp("prdb_v2", opt))
+			prdb_v2 = atoi(value);
+		else if (!strcasecmp("db_hugepages", opt))
+			ssa_db_set_alloc_backend(atoi(value));
 		else if (!strcasecmp("smdb_port", opt))
 			smdb_port = (short) atoi(value);
 		else if (!strcasecmp("prdb_port", opt))
 			prdb_port = (short) atoi(value);
 		else if (!strcasecmp("keepalive", opt))
 			keepalive = atoi(value);
+		else if (!strcasecmp("db_stream", opt))
+			db_stream = atoi(value);
+		else if (!strcasecmp("db_rdma", opt))
+			db_rdma = atoi(value);
+		else if (!strcasecmp("db_tbl_epoch", opt))
+			db_tbl_epoch = atoi(value);
+		else if (!strcasecmp("db_tbl_log", opt))
+			db_tbl_log = atoi(value);
+		else if (!strcasecmp("db_compress", opt))
+			db_compress = atoi(value);
+		else if (!strcasecmp("db_compress_threshold", opt))
+			db_compress_threshold = atoi(value);
+		else if (!strcasecmp("downstream_workers", opt))
+			downstream_workers = atoi(value);
 #ifdef SIM_SUPPORT_FAKE_ACM
 		else if (!strcasecmp("fake_acm_num", opt))
 			fake_acm_num = atoi(value);
@@ -296,9 +328,22 @@ static void distrib_log_options(void)
 	ssa_log(SSA_LOG_DEFAULT, "smdb dump dir %s\n", smdb_dump_dir);
 	ssa_log(SSA_LOG_DEFAULT, "prdb dump %d\n", prdb_dump);
 	ssa_log(SSA_LOG_DEFAULT, "prdb dump dir %s\n", prdb_dump_dir);
+	ssa_log(SSA_LOG_DEFAULT, "prdb partitions %d\n", prdb_partitions);
+	ssa_log(SSA_LOG_DEFAULT, "prdb lmc compress %d\n", prdb_lmc_compress);
+	ssa_log(SSA_LOG_DEFAULT, "prdb v2 %d\n", prdb_v2);
+	ssa_log(SSA_LOG_DEFAULT, "db hugepages %d\n",
+		ssa_db_get_alloc_backend());
 	ssa_log(SSA_LOG_DEFAULT, "smdb port %u\n", smdb_port);
 	ssa_log(SSA_LOG_DEFAULT, "prdb port %u\n", prdb_port);
 	ssa_log(SSA_LOG_DEFAULT, "keepalive time %d\n", keepalive);
+	ssa_log(SSA_LOG_DEFAULT, "db stream %d\n", db_stream);
+	ssa_log(SSA_LOG_DEFAULT, "db rdma %d\n", db_rdma);
+	ssa_log(SSA_LOG_DEFAULT, "db table epoch %d\n", db_tbl_epoch);
+	ssa_log(SSA_LOG_DEFAULT, "db table log %d\n", db_tbl_log);
+	ssa_log(SSA_LOG_DEFAULT, "db compress %d\n", db_compress);
+	ssa_log(SSA_LOG_DEFAULT, "db compress threshold %d\n",
+		db_compress_threshold);
+	ssa_log(SSA_LOG_DEFAULT, "downstream workers %d\n", downstream_workers);
 #ifdef SIM_SUPPORT_FAKE_ACM
 	if (node_type & SSA_NODE_ACCESS) {
 		ssa_log(SSA_LOG_DEFAULT, "running in ACM clients simulated mode\n");
@@ -187,6 +187,18 @@ enum ssa_db_phase {
 	SSA_DB_DATA
 };
 
+enum ssa_conn_bulk {
+	SSA_BULK_NONE,
+	SSA_BULK_NEGOTIATED,	/* RDMA window not passed yet */
+	SSA_BULK_WINDOW
+};
+
+enum ssa_conn_tbl_epoch {
+	SSA_TBL_EPOCH_NONE,
+	SSA_TBL_EPOCH_NEGOTIATED,	/* held table epochs not passed yet */
+	SSA_TBL_EPOCH_ADVERTISED
+};
+
 struct ssa_conn {
 	int			rsock;
 	enum ssa_conn_type	type;
@@ -214,6 +226,23 @@ struct ssa_conn {
 	uint32_t		epoch_len;
 	uint16_t		remote_lid;
 	int			reconnect_count;
+	int			stream;
+	int			slot;	/* in downstream connection table */
+	enum ssa_conn_bulk	bulk;
+	void			*bulk_buf;
+	uint32_t		bulk_len;
+	uint64_t		bulk_offset;
+	uint64_t		bulk_pos;
+	uint64_t		rdma_offset;
+	enum ssa_conn_tbl_epoch	tbl_epoch;
+	uint64_t		*peer_epochs;	/* table epochs held by peer */
+	int			peer_epoch_cnt;
+	int			tbl_missing;	/* data table not rebuilt */
+	int			full_xfer;	/* retransfer raw, without held tables */
+	int			tbl_log;
+	int			compress;
+	void			*zbuf;	/* compressed table being sent */
+	uint64_t		notify_epoch;	/* DB update deferred by a stream */
 };
 
 enum ssa_svc_state {
@@ -228,6 +257,9 @@ enum ssa_svc_state {
 	SSA_STATE_HAVE_BACKUP
 };
 
+struct ssa_conn_table;
+struct ssa_downstream_worker;
+
 struct ssa_svc {
 	struct ssa_port		*port;
 	char			name[SSA_NAME_SIZE];
@@ -246,7 +278,10 @@ struct ssa_svc {
 	struct ssa_conn		conn_listen_smdb;
 	struct ssa_conn		conn_listen_prdb;
 	struct ssa_conn		conn_dataup;
-	struct ssa_conn		*fd_to_conn[FD_SETSIZE];
+	struct ssa_conn_table	*conn_table;	/* downstream connections */
+	struct ssa_downstream_worker *workers;	/* connection shards */
+	int			num_workers;
+	int			next_worker;
 	uint16_t		index;
 	uint16_t		tid;
 	pthread_t		upstream;
@@ -351,6 +386,7 @@ void ssa_init_runtime_statistics();
 void ssa_set_runtime_counter(int id, long val);
 long  ssa_get_runtime_counter(int id);
 long  ssa_inc_runtime_counter(int id);
+long  ssa_add_runtime_counter(int id, long val);
 void ssa_set_runtime_counter_time(int id);
 int ssa_get_runtime_counter_time(int id, struct timeval *time_stamp);
 void ssa_db_update_change_counters(uint64_t epoch);
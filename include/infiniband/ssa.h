@@ -53,7 +53,12 @@ enum {
 	/* SSA_MSG_CLASS_MAD */
 
 	SSA_MSG_FLAG_RESP		= (1 << 0),
-	SSA_MSG_FLAG_END		= (1 << 1)
+	SSA_MSG_FLAG_END		= (1 << 1),
+	SSA_MSG_FLAG_STREAM		= (1 << 2),
+	SSA_MSG_FLAG_RDMA		= (1 << 3),
+	SSA_MSG_FLAG_TBL_EPOCH		= (1 << 4),
+	SSA_MSG_FLAG_TBL_LOG		= (1 << 5),
+	SSA_MSG_FLAG_COMPRESS		= (1 << 6)
 };
 
 enum {
@@ -78,6 +83,37 @@ enum {
  * then the end of the message must be determined using class specific
  * means.  An ssa_msg_hdr with the END flag set transferred after class
  * specific data may be used to mark the end of response.
+ *
+ * A DB query for the database definitions with the STREAM flag set asks
+ * for a streaming transfer. A parent supporting it sets the flag in the
+ * response and sends all remaining responses of the transfer in query
+ * order with the id of that query, without waiting for the queries.
+ * Peers not aware of the flag ignore it and keep the query per response
+ * transfer.
+ *
+ * Similarly, the RDMA flag in that query and its response agrees on bulk
+ * transfer of data tables. The receiver then maps a window for all data
+ * tables and passes it in rdma_addr and rdma_len of the first query for
+ * a data table, which is sent in streaming transfer too. The sender
+ * writes each table into the window and responds by a header with
+ * rdma_addr and rdma_len of the written table instead of the table data.
+ *
+ * The TBL_EPOCH flag in that query and its response agrees on skipping
+ * unchanged data tables. The first query for a data table then carries
+ * the epochs of the data tables the receiver holds, one be64_t per data
+ * table following the header. Tables whose epoch matches are responded
+ * by a header with the TBL_EPOCH flag set, and the receiver keeps its
+ * own copy of them.
+ *
+ * The TBL_LOG flag set along with TBL_EPOCH agrees on table logs as well.
+ * A table changed since the epoch held by the receiver may then be
+ * responded by the transaction log taking the held table to the current
+ * one (see db_trans_log_entry), with the TBL_LOG flag set.
+ *
+ * The COMPRESS flag in that query and its response agrees on compressed
+ * data tables. A table or table log sent by rsend above the sender's size
+ * threshold may then be responded compressed (see ssa_db_compress), with
+ * the COMPRESS flag set. Tables written into the RDMA window are not.
  */
 struct ssa_msg_hdr {
 	uint8_t			version;
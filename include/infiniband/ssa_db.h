@@ -38,6 +38,7 @@
 
 #include <stdint.h>
 #include <byteswap.h>
+#include <pthread.h>
 #include <infiniband/umad.h>
 #include <infiniband/ssa.h>
 
@@ -75,6 +76,9 @@ struct db_id {
  * @name - user-friendly name for a specific database
  * @epoch - static or dynamic version of DB (is equal to maximum table epoch)
  * @table_def_size - size of each table definition (db_table_def)
+ * @lineage - identifier of the producer instance, which assigned the
+ *	      epochs, 0 - unknown. Table epochs of two databases are only
+ *	      comparable, if both have the same non zero lineage.
  *
  * A database is comprised of:
  *    - a single db_def, which includes a unique ID for the database
@@ -94,7 +98,7 @@ struct db_def {
 	char		name[DB_NAME_LEN];
 	be64_t		epoch;
 	be32_t		table_def_size;
-	uint8_t		reserved2[4];
+	be32_t		lineage;
 };
 
 enum {
@@ -252,6 +256,22 @@ struct db_dataset {
 
 /**
  * Transaction logs provide information to query incremental updates
+ *
+ * A table log is a sequence of db_trans_log_entry records followed by
+ * the record data they reference. It takes a data table from one epoch
+ * to the next one, entries are applied in order to the table as modified
+ * by the previous entries. Offsets and sizes are in bytes, entry_offset
+ * is relative to the start of the log.
+ *
+ * DB_OP_START	- epoch and size (record_offset) of the table the log
+ *		  applies to, entry_offset locates the record data
+ * DB_OP_INSERT	- entry_size bytes at entry_offset are inserted
+ *		  at record_offset
+ * DB_OP_DELETE	- entry_size bytes at record_offset are removed
+ * DB_OP_UPDATE	- entry_size bytes at record_offset are replaced by
+ *		  the ones at entry_offset
+ * DB_OP_END	- epoch and size (record_offset) of the resulting table,
+ *		  entry_offset is the size of the log
  */
 enum db_trans_op {
 	DB_OP_INSERT,
@@ -328,6 +348,17 @@ void ssa_db_field_def_insert(struct db_field_def * p_tbl,
  * @pp_field_tables - database tables fields definitions
  * @p_db_tables - datasets of database data tables
  * @pp_tables - database data tables
+ * @data_tbl_cnt - number of data tables
+ * @region_size - size of the region holding the database, 0 if
+ *		  the database parts are allocated separately
+ * @region_mapped - length of the region mapping, 0 if the region is
+ *		    allocated from the heap
+ * @refcnt - references taken by ssa_db_get() in addition to the owner's
+ * @p_digests - data tables content digests, NULL if the database parts
+ *		are allocated separately
+ * @p_data_buf - single buffer holding the data tables of a database
+ *		 received by RDMA, NULL otherwise
+ * @data_buf_size - size of p_data_buf
  *
  * All data that belongs to a certain database is unified under
  * a single "ssa_db" structure. It includes:
@@ -395,7 +426,61 @@ void ssa_db_field_def_insert(struct db_field_def * p_tbl,
  * [3] ssa_db_init() method has to be called with the arguments that
  *     were defined at stage 1.
  *
+ * ssa_db_alloc() places the ssa_db structure, definitions, field tables
+ * and data tables at SSA_DB_REGION_ALIGN aligned offsets of a single
+ * region, so ssa_db_copy() of such a database is a single memcpy
+ * followed by rebasing of the pointers and ssa_db_destroy() is a single
+ * free. Tables attached later by ssa_db_attach() are kept outside
+ * of the region.
+ *
+ * ssa_db_update_digests() has to be called once data tables are filled,
+ * so ssa_db_cmp() compares table digests instead of the table data.
+ * Code modifying data tables afterwards has to call it again.
+ * Tables are hashed in one pass rather than record by record as they
+ * are written: path record tables are merged, copied from the previous
+ * PRDB and rewritten in place by several writers, so a streaming hash
+ * would have to follow each of them. The pass reads each table once,
+ * while it is still in cache after the computation.
+ *
+ * ssa_db_set_log() keeps a transaction log of a data table with the
+ * database, so a peer holding the table at the log's start epoch may be
+ * updated by the log instead of the table. Logs are freed with the
+ * database and aren't copied by ssa_db_copy(). ssa_db_build_log()
+ * builds the log of a fixed record size table from the table of the
+ * previous database.
+ *
+ */
+#define SSA_DB_REGION_ALIGN	64
+#define SSA_DB_HUGEPAGE_SIZE	(2 * 1024 * 1024)
+
+enum ssa_db_alloc_backend {
+	SSA_DB_ALLOC_HEAP,
+	SSA_DB_ALLOC_THP,
+	SSA_DB_ALLOC_HUGETLB
+};
+
+/**
+ * ssa_db_digest:
+ * @hash - 128 bit hash of the table data
+ * @set_size - size of the hashed data, network order
+ * @valid - the hash corresponds to the table data
  */
+struct ssa_db_digest {
+	uint64_t		hash[2];
+	be64_t			set_size;
+	uint64_t		valid;
+};
+
+/**
+ * ssa_db_log:
+ * @p_log - transaction log taking the data table to its current epoch
+ * @size - size of the log, in bytes
+ */
+struct ssa_db_log {
+	void			*p_log;
+	uint64_t		size;
+};
+
 struct ssa_db {
 	struct db_def		db_def;
 
@@ -408,8 +493,40 @@ struct ssa_db {
 	struct db_dataset	*p_db_tables;
 	void			**pp_tables;
 	uint64_t		data_tbl_cnt;
+	size_t			region_size;
+	size_t			region_mapped;
+	volatile long		refcnt;
+	struct ssa_db_digest	*p_digests;
+	void			*p_data_buf;
+	size_t			data_buf_size;
+	struct ssa_db_log	*p_logs;
 };
 
+/**
+ * ssa_db_ref:
+ * @lock - protects reading the published database and taking its reference
+ * @p_db - published database, holds one reference
+ *
+ * Read only databases are shared between threads by references. Owner
+ * of a database holds the initial reference, ssa_db_get() takes another
+ * one and ssa_db_release() drops a reference, freeing the database when
+ * it was the last one. ssa_db_destroy() frees the database regardless
+ * of the references and is used for databases which aren't shared.
+ *
+ * ssa_db_publish() replaces the published database, passing the
+ * caller's reference to it, and releases the previous one, which stays
+ * valid for readers that acquired it with ssa_db_acquire() until they
+ * release it.
+ */
+struct ssa_db_ref {
+	pthread_mutex_t		lock;
+	struct ssa_db		*p_db;
+};
+
+#define SSA_DB_REF_INITIALIZER	{ PTHREAD_MUTEX_INITIALIZER, NULL }
+
+void ssa_db_set_alloc_backend(int backend);
+int ssa_db_get_alloc_backend(void);
 struct ssa_db *ssa_db_alloc(uint64_t * p_num_recs_arr,
 			    size_t * p_recs_size_arr,
 			    uint64_t * p_num_field_recs_arr,
@@ -430,6 +547,25 @@ uint64_t ssa_db_calculate_data_tbl_num(const struct ssa_db *p_ssa_db);
 uint64_t ssa_db_get_epoch(const struct ssa_db *p_ssa_db, uint8_t tbl_id);
 uint64_t ssa_db_set_epoch(struct ssa_db *p_ssa_db, uint8_t tbl_id, uint64_t epoch);
 uint64_t ssa_db_increment_epoch(struct ssa_db *p_ssa_db, uint8_t tbl_id);
+uint32_t ssa_db_get_lineage(const struct ssa_db *p_ssa_db);
+void ssa_db_set_lineage(struct ssa_db *p_ssa_db, uint32_t lineage);
+void ssa_db_update_digests(struct ssa_db *p_ssa_db);
+int ssa_db_set_log(struct ssa_db *p_ssa_db, uint64_t tbl_id,
+		   void *p_log, uint64_t size);
+const void *ssa_db_get_log(const struct ssa_db *p_ssa_db, uint64_t tbl_id,
+			   uint64_t epoch, uint64_t *p_size);
+void *ssa_db_log_apply(const struct ssa_db *p_ssa_db, uint64_t tbl_id,
+		       const void *p_tbl, uint64_t tbl_size, uint64_t epoch);
+void *ssa_db_build_log(const struct ssa_db *p_ssa_db_prev,
+		       const struct ssa_db *p_ssa_db, uint64_t tbl_id,
+		       uint64_t *p_size);
+size_t ssa_mem_mismatch(const void *p1, const void *p2, size_t len);
+void *ssa_db_compress(const void *p_buf, uint64_t size, uint64_t *p_zsize);
+void *ssa_db_decompress(const void *p_zbuf, uint64_t zsize, uint64_t *p_size);
+struct ssa_db *ssa_db_get(struct ssa_db *p_ssa_db);
+void ssa_db_release(struct ssa_db *p_ssa_db);
+struct ssa_db *ssa_db_acquire(struct ssa_db_ref *p_ref);
+void ssa_db_publish(struct ssa_db_ref *p_ref, struct ssa_db *p_ssa_db);
 
 /**
  * ssa_db_attach():
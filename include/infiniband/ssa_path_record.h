@@ -78,6 +78,58 @@ extern void *ssa_pr_create_context();
 extern void ssa_pr_destroy_context(void *ctx);
 extern void ssa_pr_reinit_context(void *ctx, struct ssa_db *smdb);
 
+/* ssa_pr_set_partitions function enables partition aware path record
+ *					computation for a context. Path records are
+ *					computed only for destinations sharing a pkey
+ *					with the source, and the shared pkey is used.
+ *					If SMDB has no pkeys, all destinations are used.
+ *					A snapshot has to be set before it's shared.
+ * @ctx			- context or snapshot
+ * @enable		- 1 - partition aware, 0 - default pkey for all destinations
+ */
+extern void ssa_pr_set_partitions(void *ctx, int enable);
+
+/* ssa_pr_create_snapshot function creates an immutable context for
+ *					given SMDB. The index is built once, and
+ *					it's never rebuilt, so the snapshot can be shared
+ *					by several threads without locking. It can be used
+ *					only with the SMDB it was created for (same epoch).
+ * @smdb			- input smdb database
+ * @thread_num		- number of threads used for the index build
+ *
+ * @return value: the snapshot with reference count 1. NULL - failure.
+ */
+extern void *ssa_pr_create_snapshot(struct ssa_db *smdb, unsigned int thread_num);
+
+/* ssa_pr_get_snapshot function takes a reference to a snapshot.
+ * @return value: the snapshot.
+ */
+extern void *ssa_pr_get_snapshot(void *ctx);
+
+/* ssa_pr_put_snapshot function releases a reference to a snapshot.
+ * 					The snapshot is destroyed with the last reference.
+ */
+extern void ssa_pr_put_snapshot(void *ctx);
+
+/* ssa_pr_release_shared function releases "half world" PRDBs shared by
+ *					sources of the same class. PRDBs computed with the
+ *					snapshot afterwards aren't shared anymore. Called
+ *					once PRDBs of all known sources are computed.
+ */
+extern void ssa_pr_release_shared(void *ctx);
+
+
+/* ssa_pr_diff_snapshot function compares a snapshot with the previous one.
+ *					Differences are stored in the snapshot and are used
+ *					by ssa_pr_compute_half_world_delta. It has to be
+ *					called before the snapshot is shared.
+ * @ctx			- snapshot
+ * @prev_ctx		- previous snapshot
+ *
+ * @return value: 0 - success. Otherwise the snapshots can't be compared,
+ *					and path records will be recomputed completely.
+ */
+extern int ssa_pr_diff_snapshot(void *ctx, const void *prev_ctx);
 
 extern uint64_t ssa_pr_compute_pr_max_number(struct ssa_db *p_ssa_db_smdb,
 		be64_t port_guid);
@@ -99,6 +151,49 @@ extern ssa_pr_status_t ssa_pr_compute_half_world(struct ssa_db *p_ssa_db_smdb,
 						be64_t port_guid,
 						struct ssa_db **prdb);
 
+/* ssa_pr_compute_half_world_shared function computes "half world" path
+ *					records as ssa_pr_compute_half_world does. With a
+ *					snapshot, hosts attached to the same switch by links
+ *					of the same MTU and rate share one computation: the
+ *					first host PRDB is kept in the snapshot, and PRDBs of
+ *					other hosts are derived from it. It's safe to call
+ *					from several threads. The PRDB may be referenced by
+ *					the snapshot, so it's released by ssa_db_release.
+ * @p_ssa_db_smdb	- input smdb database
+ * @p_ctnx			- context or snapshot
+ * @port_guid		- input GUID
+ *
+ * @prdb		- double pointer to prdb database.
+ */
+extern ssa_pr_status_t ssa_pr_compute_half_world_shared(struct ssa_db *p_ssa_db_smdb,
+							void *p_ctnx,
+							be64_t port_guid,
+							struct ssa_db **prdb);
+
+/* ssa_pr_compute_half_world_delta function updates "half world" path records
+ *					computed for the previous snapshot SMDB. Only path
+ *					records to destinations affected by SMDB changes are
+ *					recomputed. If the previous PRDB can't be used, or too
+ *					many destinations are affected, the function computes
+ *					all path records as ssa_pr_compute_half_world_shared
+ *					does.
+ * @p_ssa_db_smdb	- input smdb database
+ * @p_ctnx			- snapshot
+ * @port_guid		- input GUID
+ * @prev_prdb		- previous prdb database of the GUID. It may be NULL.
+ * @prev_epoch		- epoch of smdb database the previous prdb was computed for
+ *
+ * @prdb		- double pointer to prdb database. It's set to NULL,
+ *						if the function succeeds, and the previous prdb
+ *						is not changed.
+ */
+extern ssa_pr_status_t ssa_pr_compute_half_world_delta(struct ssa_db *p_ssa_db_smdb,
+						       void *p_ctnx,
+						       be64_t port_guid,
+						       const struct ssa_db *prev_prdb,
+						       uint64_t prev_epoch,
+						       struct ssa_db **prdb);
+
 extern ssa_pr_status_t ssa_pr_half_world(struct ssa_db *p_ssa_db_smdb,
 					 void *context, be64_t port_guid,
 					 ssa_pr_path_dump_t dump_clbk,
@@ -109,6 +204,26 @@ extern ssa_pr_status_t ssa_pr_whole_world(struct ssa_db *p_ssa_db_smdb,
 					  ssa_pr_path_dump_t dump_clbk,
 					  void *clbk_prm);
 
+/* ssa_pr_whole_world_parallel function computes "whole world" path records
+ *					using several threads. Sources are split into
+ *					contiguous ranges of GUID to LID records, one
+ *					range per thread. The context is prepared before
+ *					the threads are started and is shared by them.
+ * @thread_num		- number of threads. It is limited by the number of sources.
+ * @dump_clbk		- thread i calls the callback with clbk_prm[i].
+ * 						The callback has to be thread safe, if the
+ * 						parameters are shared.
+ * @clbk_prm		- array of thread_num callback parameters (output shards).
+ * 						Shards concatenated in thread order contain
+ * 						the same path records in the same order as
+ * 						ssa_pr_whole_world produces.
+ */
+extern ssa_pr_status_t ssa_pr_whole_world_parallel(struct ssa_db *p_ssa_db_smdb,
+						   void *context,
+						   unsigned int thread_num,
+						   ssa_pr_path_dump_t dump_clbk,
+						   void **clbk_prm);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,8 @@
 #ifndef _SSA_PR_DB_H_
 #define _SSA_PR_DB_H_
 
+#include <string.h>
+#include <asm/byteorder.h>
 #include <infiniband/ssa_db.h>
 #include <infiniband/ssa_ipdb.h>
 
@@ -52,6 +54,10 @@ enum prdb_tbl_id {
 	PRDB_TBL_ID_IPv4,
 	PRDB_TBL_ID_IPv6,
 	PRDB_TBL_ID_NAME,
+	PRDB_TBL_ID_PR_LMC,
+	PRDB_TBL_ID_PR_V2,
+	PRDB_TBL_ID_PR_V2_ATTR,
+	PRDB_TBL_ID_PR_V2_GUID,
 	PRDB_TBL_ID_MAX
 };
 
@@ -76,12 +82,207 @@ struct prdb_pr {
 	uint8_t		is_reversible;
 };
 
+enum prdb_pr_lmc_fields {
+	PRDB_FIELD_ID_PR_LMC_DGUID,
+	PRDB_FIELD_ID_PR_LMC_DLID,
+	PRDB_FIELD_ID_PR_LMC_PK,
+	PRDB_FIELD_ID_PR_LMC_MTU,
+	PRDB_FIELD_ID_PR_LMC_RATE,
+	PRDB_FIELD_ID_PR_LMC_SL,
+	PRDB_FIELD_ID_PR_LMC_REVERSIBLE,
+	PRDB_FIELD_ID_PR_LMC_LMC,
+	PRDB_FIELD_ID_PR_LMC_RESERVED,
+	PRDB_FIELD_ID_PR_LMC_MAX
+};
+
+/*
+ * Path records to all LIDs of a destination port:
+ * lid .. lid + (1 << lmc) - 1. Records of LIDs with different
+ * attributes are kept in PR table, and they override the entry.
+ */
+struct prdb_pr_lmc {
+	be64_t		guid;
+	be16_t		lid;
+	be16_t		pk;
+	uint8_t		mtu;
+	uint8_t		rate;
+	uint8_t		sl;
+	uint8_t		is_reversible;
+	uint8_t		lmc;
+	uint8_t		reserved[7];
+};
+
+enum prdb_pr_v2_fields {
+	PRDB_FIELD_ID_PR_V2_DLID,
+	PRDB_FIELD_ID_PR_V2_ATTR,
+	PRDB_FIELD_ID_PR_V2_GUID_LEN,
+	PRDB_FIELD_ID_PR_V2_MAX
+};
+
+/*
+ * Compact path record (PRDB v2). Records are sorted by LID,
+ * one record per destination LID. Path attributes are an index
+ * into PR V2 ATTR table. Destination GUID is XOR of the previous
+ * record GUID (0 for the first record) with the guid_len least
+ * significant bytes taken from PR V2 GUID table; guid_len is 0
+ * for LIDs of the same port.
+ */
+struct prdb_pr_v2 {
+	be16_t		lid;
+	uint8_t		attr;
+	uint8_t		guid_len;
+};
+
+enum prdb_pr_v2_attr_fields {
+	PRDB_FIELD_ID_PR_V2_ATTR_PK,
+	PRDB_FIELD_ID_PR_V2_ATTR_MTU,
+	PRDB_FIELD_ID_PR_V2_ATTR_RATE,
+	PRDB_FIELD_ID_PR_V2_ATTR_SL,
+	PRDB_FIELD_ID_PR_V2_ATTR_REVERSIBLE,
+	PRDB_FIELD_ID_PR_V2_ATTR_RESERVED,
+	PRDB_FIELD_ID_PR_V2_ATTR_MAX
+};
+
+#define PRDB_PR_V2_ATTRS_MAX	256
+
+struct prdb_pr_v2_attr {
+	be16_t		pk;
+	uint8_t		mtu;
+	uint8_t		rate;
+	uint8_t		sl;
+	uint8_t		is_reversible;
+	uint8_t		reserved[2];
+};
+
+/* PR V2 GUID table record is a single byte of GUID delta stream */
+enum prdb_pr_v2_guid_fields {
+	PRDB_FIELD_ID_PR_V2_GUID_DELTA,
+	PRDB_FIELD_ID_PR_V2_GUID_MAX
+};
+
 #define PRDB_TBLS		PRDB_TBL_ID_MAX * 2 /* each data table has field table */
 #define PRDB_DATA_TBLS		PRDB_TBL_ID_MAX
-#define PRDB_FIELDS		PRDB_FIELD_ID_PR_MAX + IPDB_FIELDS
+#define PRDB_FIELDS		PRDB_FIELD_ID_PR_MAX + PRDB_FIELD_ID_PR_LMC_MAX + \
+				PRDB_FIELD_ID_PR_V2_MAX + PRDB_FIELD_ID_PR_V2_ATTR_MAX + \
+				PRDB_FIELD_ID_PR_V2_GUID_MAX + IPDB_FIELDS
 #define PRDB_TBL_OFFSET		1
 
 extern struct ssa_db  *ssa_prdb_create(uint64_t epoch, uint64_t num_recs[PRDB_TBL_ID_MAX]);
 
+/*
+ * Creates a copy of a PRDB, where path records to LIDs of a destination
+ * port are replaced by PR_LMC entries. Records repeated for other source
+ * LIDs are dropped, they don't depend on the source LID.
+ */
+extern struct ssa_db  *ssa_prdb_compress_lmc(const struct ssa_db *p_prdb);
+
+/*
+ * Creates a copy of a PRDB, where path records are replaced by
+ * PR V2 tables. Returns NULL if path records have more than
+ * PRDB_PR_V2_ATTRS_MAX different attribute tuples.
+ */
+extern struct ssa_db  *ssa_prdb_encode_v2(const struct ssa_db *p_prdb);
+
+/*
+ * PR V2 decoding: records are returned in LID order as
+ * struct prdb_pr. Tables are absent in PRDBs of older versions.
+ */
+struct prdb_pr_v2_iter {
+	const struct prdb_pr_v2		*p_recs;
+	const struct prdb_pr_v2_attr	*p_attrs;
+	const uint8_t			*p_guids;
+	uint64_t			rec_cnt;
+	uint64_t			attr_cnt;
+	uint64_t			guid_size;
+	uint64_t			rec_idx;
+	uint64_t			guid_off;
+	be64_t				guid;
+};
+
+static inline void prdb_pr_v2_iter_init(struct prdb_pr_v2_iter *p_iter,
+					const struct ssa_db *p_prdb)
+{
+	memset(p_iter, 0, sizeof(*p_iter));
+	if (p_prdb->data_tbl_cnt <= PRDB_TBL_ID_PR_V2_GUID)
+		return;
+
+	p_iter->p_recs = (const struct prdb_pr_v2 *)
+			 p_prdb->pp_tables[PRDB_TBL_ID_PR_V2];
+	p_iter->p_attrs = (const struct prdb_pr_v2_attr *)
+			  p_prdb->pp_tables[PRDB_TBL_ID_PR_V2_ATTR];
+	p_iter->p_guids = (const uint8_t *)
+			  p_prdb->pp_tables[PRDB_TBL_ID_PR_V2_GUID];
+	p_iter->rec_cnt =
+		__be64_to_cpu(p_prdb->p_db_tables[PRDB_TBL_ID_PR_V2].set_count);
+	p_iter->attr_cnt =
+		__be64_to_cpu(p_prdb->p_db_tables[PRDB_TBL_ID_PR_V2_ATTR].set_count);
+	p_iter->guid_size =
+		__be64_to_cpu(p_prdb->p_db_tables[PRDB_TBL_ID_PR_V2_GUID].set_count);
+}
+
+/*
+ * Returns 1 and fills p_rec with the next record, 0 at the end
+ * of the table, or -1 if the table is malformed.
+ */
+static inline int prdb_pr_v2_next(struct prdb_pr_v2_iter *p_iter,
+				  struct prdb_pr *p_rec)
+{
+	const struct prdb_pr_v2 *p_v2;
+	const struct prdb_pr_v2_attr *p_attr;
+	uint8_t *p_guid = (uint8_t *) &p_iter->guid;
+	int i, len;
+
+	if (p_iter->rec_idx >= p_iter->rec_cnt)
+		return 0;
+
+	p_v2 = p_iter->p_recs + p_iter->rec_idx;
+	len = p_v2->guid_len;
+	if (p_v2->attr >= p_iter->attr_cnt || len > (int) sizeof(be64_t) ||
+	    p_iter->guid_off + len > p_iter->guid_size)
+		return -1;
+
+	/* GUID is big endian: delta bytes are the trailing ones */
+	for (i = 0; i < len; i++)
+		p_guid[sizeof(be64_t) - len + i] ^=
+			p_iter->p_guids[p_iter->guid_off + i];
+	p_iter->guid_off += len;
+	p_iter->rec_idx++;
+
+	p_attr = p_iter->p_attrs + p_v2->attr;
+	p_rec->guid = p_iter->guid;
+	p_rec->lid = p_v2->lid;
+	p_rec->pk = p_attr->pk;
+	p_rec->mtu = p_attr->mtu;
+	p_rec->rate = p_attr->rate;
+	p_rec->sl = p_attr->sl;
+	p_rec->is_reversible = p_attr->is_reversible;
+
+	return 1;
+}
+
+/*
+ * Binary search of a LID in PR V2 table.
+ * Returns record index or -1 if the LID has no path record.
+ */
+static inline int64_t prdb_pr_v2_find(const struct prdb_pr_v2_iter *p_iter,
+				      uint16_t lid)
+{
+	uint64_t low = 0, high = p_iter->rec_cnt, mid;
+	uint16_t mid_lid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		mid_lid = __be16_to_cpu(p_iter->p_recs[mid].lid);
+		if (mid_lid == lid)
+			return (int64_t) mid;
+		if (mid_lid < lid)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return -1;
+}
+
 END_C_DECLS
 #endif				/* _SSA_PR_DB_H_ */
@@ -69,6 +69,11 @@ enum ssa_admin_counter_id {
 	COUNTER_ID_TIME_LAST_SSA_MAD_RCV,
 	COUNTER_ID_TIME_LAST_ERR,
 	COUNTER_ID_DB_EPOCH,
+	COUNTER_ID_COMPRESS_RAW_BYTES,
+	COUNTER_ID_COMPRESS_WIRE_BYTES,
+	COUNTER_ID_COMPRESS_RATIO,
+	COUNTER_ID_COMPRESS_USEC,
+	COUNTER_ID_DECOMPRESS_USEC,
 	COUNTER_ID_LAST
 };
 
@@ -92,7 +97,12 @@ static const enum ssa_counter_type ssa_admin_counters_type[] = {
 	[COUNTER_ID_TIME_LAST_DOWNSTR_CONN] = ssa_counter_timestamp,
 	[COUNTER_ID_TIME_LAST_SSA_MAD_RCV] = ssa_counter_timestamp,
 	[COUNTER_ID_TIME_LAST_ERR] = ssa_counter_timestamp,
-	[COUNTER_ID_DB_EPOCH] =ssa_counter_numeric
+	[COUNTER_ID_DB_EPOCH] =ssa_counter_numeric,
+	[COUNTER_ID_COMPRESS_RAW_BYTES] = ssa_counter_numeric,
+	[COUNTER_ID_COMPRESS_WIRE_BYTES] = ssa_counter_numeric,
+	[COUNTER_ID_COMPRESS_RATIO] = ssa_counter_numeric,
+	[COUNTER_ID_COMPRESS_USEC] = ssa_counter_numeric,
+	[COUNTER_ID_DECOMPRESS_USEC] = ssa_counter_numeric
 };
 
 
@@ -57,7 +57,10 @@ enum ssa_ctrl_msg_type {
 	SSA_DB_UPDATE,		/* struct ssa_db_update_msg */
 	SSA_DB_QUERY,		/* struct ssa_db_query_msg */
 	SSA_DB_UPDATE_PREPARE,	/* struct ssa_db_update_msg */
-	SSA_DB_UPDATE_READY	/* struct ssa_db_update_msg */
+	SSA_DB_UPDATE_READY,	/* struct ssa_db_update_msg */
+	SSA_CONN_ADD,		/* struct ssa_conn_add_msg */
+	SSA_CONN_DROP,		/* struct ssa_conn_add_msg */
+	SSA_DB_NOTIFY		/* struct ssa_db_update_msg */
 };
 
 struct ssa_ctrl_msg {
@@ -99,6 +102,25 @@ struct ssa_conn_done_msg {
 	struct ssa_conn_done_payload data;
 };
 
+struct ssa_conn;
+
+/*
+ * Hands an accepted downstream connection over to a downstream worker
+ * (SSA_CONN_ADD), or makes the workers drop older connections from the
+ * same GID (SSA_CONN_DROP).
+ */
+struct ssa_conn_add_payload {
+	struct ssa_conn		*conn;
+	union ibv_gid		remote_gid;
+	uint64_t		epoch;
+	int			notify;	/* SMDB update notification due */
+};
+
+struct ssa_conn_add_msg {
+	struct ssa_ctrl_msg	hdr;
+	struct ssa_conn_add_payload data;
+};
+
 enum ssa_db_update_flag {
 	SSA_DB_UPDATE_CHANGE		= (1 << 0)
 };
@@ -137,6 +159,7 @@ struct ssa_ctrl_msg_buf {
 		struct sa_umad		umad_sa;
 		struct ssa_svc		*svc;
 		struct ssa_conn_done_payload conn_data;
+		struct ssa_conn_add_payload conn_add;
 		struct ssa_db_update	db_upd;
 		int			status;
 	} data;
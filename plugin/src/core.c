@@ -92,11 +92,21 @@ extern int accum_log_file;
 extern int smdb_dump;
 extern int err_smdb_dump;
 extern int prdb_dump;
+extern int prdb_partitions;
+extern int prdb_lmc_compress;
+extern int prdb_v2;
 extern char smdb_dump_dir[128];
 extern char prdb_dump_dir[128];
 extern short smdb_port;
 extern short prdb_port;
 extern int keepalive;
+extern int db_stream;
+extern int db_rdma;
+extern int db_tbl_epoch;
+extern int db_tbl_log;
+extern int db_compress;
+extern int db_compress_threshold;
+extern int downstream_workers;
 extern int sock_accessextract[2];
 #ifdef SIM_SUPPORT_FAKE_ACM
 extern int fake_acm_num;
@@ -1398,6 +1408,7 @@ static void ssa_extract_send_db_update_prepare(int fd)
 static void ssa_extract_send_db_update(struct ssa_db *db, int fd, int flags)
 {
 	struct ssa_db_update_msg msg;
+	int ret;
 
 	ssa_log_func(SSA_LOG_CTRL);
 	msg.hdr.type = SSA_DB_UPDATE;
@@ -1408,7 +1419,14 @@ static void ssa_extract_send_db_update(struct ssa_db *db, int fd, int flags)
 	memset(&msg.db_upd.remote_gid, 0, sizeof(msg.db_upd.remote_gid));
 	msg.db_upd.remote_lid = 0;
 	msg.db_upd.epoch = ssa_db_get_epoch(db, DB_DEF_TBL_ID);
-	write(fd, (char *) &msg, sizeof(msg));
+	/* receiving thread releases the reference */
+	ssa_db_get(db);
+	ret = write(fd, (char *) &msg, sizeof(msg));
+	if (ret != sizeof(msg)) {
+		ssa_log_err(SSA_LOG_CTRL, "%d out of %d bytes written\n",
+			    ret, sizeof(msg));
+		ssa_db_release(db);
+	}
 }
 
 static int ssa_extract_db_update_prepare(struct ssa_db *db)
@@ -1532,7 +1550,7 @@ static int ssa_extract_process_smdb(struct ssa_db **pp_smdb)
 
 	if (pp_smdb) {
 		if (*pp_smdb)
-			ssa_db_destroy(*pp_smdb);
+			ssa_db_release(*pp_smdb);
 		*pp_smdb = p_smdb;
 	}
 
@@ -1542,7 +1560,6 @@ static int ssa_extract_process_smdb(struct ssa_db **pp_smdb)
 static void core_extract_db(osm_opensm_t *p_osm)
 {
 	struct ssa_db_diff *ssa_db_diff_old = NULL;
-	uint64_t epoch_prev = DB_EPOCH_INVALID;
 
 	CL_PLOCK_ACQUIRE(&p_osm->lock);
 	ssa_db->p_dump_db = ssa_db_extract(p_osm);
@@ -1558,12 +1575,11 @@ static void core_extract_db(osm_opensm_t *p_osm)
 
 	pthread_mutex_lock(&ssa_db_diff_lock);
 	/* Clear previous version */
-	if (ssa_db_diff)
-		epoch_prev = ssa_db_get_epoch(ssa_db_diff->p_smdb, DB_DEF_TBL_ID);
-
 	ssa_db_diff_old = ssa_db_diff;
 
-	ssa_db_diff = ssa_db_compare(ssa_db, epoch_prev, first_extraction);
+	ssa_db_diff = ssa_db_compare(ssa_db, ssa_db_diff_old ?
+				     ssa_db_diff_old->p_smdb : NULL,
+				     first_extraction);
 	if (ssa_db_diff) {
 		if (ssa_db_diff->dirty)
 		    ssa_db_diff_destroy(ssa_db_diff_old);
@@ -2008,7 +2024,7 @@ out2:
 #if 0
 #ifdef SIM_SUPPORT_SMDB
 	if (p_ref_smdb) {
-		ssa_db_destroy(p_ref_smdb);
+		ssa_db_release(p_ref_smdb);
 		p_ref_smdb = NULL;
 	}
 #endif
@@ -2211,10 +2227,32 @@ static void core_set_options(void)
 			err_smdb_dump = atoi(value);
 		else if (!strcasecmp("prdb_dump", opt))
 			prdb_dump = atoi(value);
+		else if (!strcasecmp("prdb_partitions", opt))
+			prdb_partitions = atoi(value);
+		else if (!strcasecmp("prdb_lmc_compress", opt))
+			prdb_lmc_compress = atoi(value);
+		else if (!strcasecmp("prdb_v2", opt))
+			prdb_v2 = atoi(value);
+		else if (!strcasecmp("db_hugepages", opt))
+			ssa_db_set_alloc_backend(atoi(value));
 		else if (!strcasecmp("smdb_deltas", opt))
 			smdb_deltas = atoi(value);
 		else if (!strcasecmp("keepalive", opt))
 			keepalive = atoi(value);
+		else if (!strcasecmp("db_stream", opt))
+			db_stream = atoi(value);
+		else if (!strcasecmp("db_rdma", opt))
+			db_rdma = atoi(value);
+		else if (!strcasecmp("db_tbl_epoch", opt))
+			db_tbl_epoch = atoi(value);
+		else if (!strcasecmp("db_tbl_log", opt))
+			db_tbl_log = atoi(value);
+		else if (!strcasecmp("db_compress", opt))
+			db_compress = atoi(value);
+		else if (!strcasecmp("db_compress_threshold", opt))
+			db_compress_threshold = atoi(value);
+		else if (!strcasecmp("downstream_workers", opt))
+			downstream_workers = atoi(value);
 #ifdef SIM_SUPPORT_FAKE_ACM
 		else if (!strcasecmp("fake_acm_num", opt))
 			fake_acm_num = atoi(value);
@@ -2242,8 +2280,21 @@ static void core_log_options(void)
 	ssa_log(SSA_LOG_DEFAULT, "smdb dump dir %s\n", smdb_dump_dir);
 	ssa_log(SSA_LOG_DEFAULT, "prdb dump %d\n", prdb_dump);
 	ssa_log(SSA_LOG_DEFAULT, "prdb dump dir %s\n", prdb_dump_dir);
+	ssa_log(SSA_LOG_DEFAULT, "prdb partitions %d\n", prdb_partitions);
+	ssa_log(SSA_LOG_DEFAULT, "prdb lmc compress %d\n", prdb_lmc_compress);
+	ssa_log(SSA_LOG_DEFAULT, "prdb v2 %d\n", prdb_v2);
 	ssa_log(SSA_LOG_DEFAULT, "smdb deltas %d\n", smdb_deltas);
+	ssa_log(SSA_LOG_DEFAULT, "db hugepages %d\n",
+		ssa_db_get_alloc_backend());
 	ssa_log(SSA_LOG_DEFAULT, "keepalive time %d\n", keepalive);
+	ssa_log(SSA_LOG_DEFAULT, "db stream %d\n", db_stream);
+	ssa_log(SSA_LOG_DEFAULT, "db rdma %d\n", db_rdma);
+	ssa_log(SSA_LOG_DEFAULT, "db table epoch %d\n", db_tbl_epoch);
+	ssa_log(SSA_LOG_DEFAULT, "db table log %d\n", db_tbl_log);
+	ssa_log(SSA_LOG_DEFAULT, "db compress %d\n", db_compress);
+	ssa_log(SSA_LOG_DEFAULT, "db compress threshold %d\n",
+		db_compress_threshold);
+	ssa_log(SSA_LOG_DEFAULT, "downstream workers %d\n", downstream_workers);
 #ifndef SIM_SUPPORT
 	ssa_log(SSA_LOG_DEFAULT, "distrib tree level 0x%x\n", distrib_tree_level);
 #endif
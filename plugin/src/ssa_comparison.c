@@ -32,6 +32,9 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <asm/byteorder.h>
 #include <common.h>
 #include <infiniband/ssa_database.h>
@@ -39,12 +42,141 @@
 #include <ssa_log.h>
 
 extern int smdb_deltas;
+extern int db_tbl_log;
 extern int addr_preload;
 extern char addr_data_file[128];
 extern struct ssa_db *ipdb;
 extern struct host_addr *parse_addr(const char *addr_file, uint64_t *ipv4,
 				    uint64_t *ipv6, uint64_t *name);
 
+/*
+ * Bulk record comparison primitives. Extracted tables of consecutive
+ * sweeps keep the OpenSM iteration order, so unchanged tables are
+ * byte identical and are recognized by a streaming scan instead of
+ * the key ordered qmap walk.
+ */
+enum ssa_rec_diff_type {
+	SSA_REC_CHANGED,	/* records at the same index differ */
+	SSA_REC_ADDED,		/* records beyond the end of the old table */
+	SSA_REC_REMOVED		/* records beyond the end of the new table */
+};
+
+/*
+ * Called for each range of differing records, @index is relative
+ * to the old table for SSA_REC_REMOVED and to the new one otherwise.
+ * Nonzero return value stops the comparison.
+ */
+typedef int (*ssa_rec_diff_pfn)(enum ssa_rec_diff_type type, uint64_t index,
+				uint64_t count, void *context);
+
+/*
+ * Compares two tables of fixed size records index by index and reports
+ * ranges of differing records through @diff_pfn (may be NULL).
+ *
+ * Return value: number of differing records, added and removed
+ * records included, or -1 if @diff_pfn stopped the comparison.
+ */
+static int64_t ssa_rec_diff(const void *p_tbl_old, uint64_t count_old,
+			    const void *p_tbl_new, uint64_t count_new,
+			    size_t rec_size, ssa_rec_diff_pfn diff_pfn,
+			    void *context)
+{
+	const uint8_t *p_old = (const uint8_t *) p_tbl_old;
+	const uint8_t *p_new = (const uint8_t *) p_tbl_new;
+	uint64_t count = count_old < count_new ? count_old : count_new;
+	uint64_t i = 0, first;
+	int64_t diff = 0;
+	size_t offset;
+
+	while (i < count) {
+		offset = ssa_mem_mismatch(p_old + i * rec_size,
+					  p_new + i * rec_size,
+					  (count - i) * rec_size);
+		i += offset / rec_size;
+		if (i == count)
+			break;
+
+		/* extend the range over the following differing records */
+		first = i++;
+		while (i < count &&
+		       ssa_mem_mismatch(p_old + i * rec_size,
+					p_new + i * rec_size, rec_size) < rec_size)
+			i++;
+
+		diff += i - first;
+		if (diff_pfn && diff_pfn(SSA_REC_CHANGED, first, i - first, context))
+			return -1;
+	}
+
+	if (count_new > count) {
+		diff += count_new - count;
+		if (diff_pfn && diff_pfn(SSA_REC_ADDED, count,
+					 count_new - count, context))
+			return -1;
+	} else if (count_old > count) {
+		diff += count_old - count;
+		if (diff_pfn && diff_pfn(SSA_REC_REMOVED, count,
+					 count_old - count, context))
+			return -1;
+	}
+
+	return diff;
+}
+
+static int ssa_db_diff_log_range(enum ssa_rec_diff_type type, uint64_t index,
+				 uint64_t count, void *context)
+{
+	static const char *type_str[] = { "changed", "added", "removed" };
+
+	ssa_log(SSA_LOG_DB, "%s records %" PRIu64 " - %" PRIu64 " %s\n",
+		(const char *) context, index, index + count - 1,
+		type_str[type]);
+
+	return 0;
+}
+
+/*
+ * Returns 1 if extracted tables are byte identical,
+ * so they have the same keys and records
+ */
+static int ssa_db_diff_tbl_same(const void *p_tbl_old, uint64_t count_old,
+				const void *p_tbl_new, uint64_t count_new,
+				size_t rec_size, const char *name)
+{
+	int64_t diff;
+
+	if (!count_old && !count_new)
+		return 1;
+
+	if (!p_tbl_old || !p_tbl_new)
+		return 0;
+
+	diff = ssa_rec_diff(p_tbl_old, count_old, p_tbl_new, count_new,
+			    rec_size, ssa_db_diff_log_range, (void *) name);
+	ssa_log(SSA_LOG_VERBOSE, "%s: %" PRId64 " records differ by index\n",
+		name, diff);
+
+	return diff == 0;
+}
+
+/*
+ * Epochs are assigned from scratch once the core is restarted, so the
+ * SMDBs are stamped by an identifier of this core instance. Downstream
+ * nodes reuse held tables only within the same lineage.
+ */
+static uint32_t ssa_db_diff_lineage(void)
+{
+	static uint32_t lineage;
+	struct timespec ts;
+
+	while (!lineage) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		lineage = (uint32_t) ts.tv_sec * 1000003 ^
+			  (uint32_t) ts.tv_nsec ^ ((uint32_t) getpid() << 16);
+	}
+	return lineage;
+}
+
 /** =========================================================================
  */
 struct ssa_db_diff *
@@ -55,6 +187,7 @@ ssa_db_diff_init(uint64_t epoch, uint64_t data_rec_cnt[SMDB_TBL_ID_MAX])
 	p_ssa_db_diff = (struct ssa_db_diff *) calloc(1, sizeof(*p_ssa_db_diff));
 	if (p_ssa_db_diff) {
 		p_ssa_db_diff->p_smdb = ssa_db_smdb_init(epoch, data_rec_cnt);
+		ssa_db_set_lineage(p_ssa_db_diff->p_smdb, ssa_db_diff_lineage());
 
 		cl_qmap_init(&p_ssa_db_diff->ep_guid_to_lid_tbl_added);
 		cl_qmap_init(&p_ssa_db_diff->ep_node_tbl_added);
@@ -559,7 +692,8 @@ static uint8_t ssa_db_diff_table_cmp(cl_qmap_t * p_map_old,
 				     cl_qmap_t * p_map_added,
 				     cl_qmap_t * p_map_removed,
 				     struct db_dataset *p_dataset,
-				     void **p_data_tbl)
+				     void **p_data_tbl,
+				     int same)
 {
 	cl_map_item_t *p_item_old, *p_item_new;
 	uint64_t key_old, key_new;
@@ -575,6 +709,10 @@ static uint8_t ssa_db_diff_table_cmp(cl_qmap_t * p_map_old,
 		}
 	}
 
+	/* identical tables have neither added nor removed records */
+	if (same)
+		return dirty;
+
 	p_item_old = cl_qmap_head(p_map_old);
 	p_item_new = cl_qmap_head(p_map_new);
 	while (p_item_old != cl_qmap_end(p_map_old) &&
@@ -652,7 +790,8 @@ static uint8_t ssa_db_diff_var_size_table_cmp(cl_qmap_t * p_map_old,
 					      struct db_dataset *p_dataset,
 					      void **p_data_tbl,
 					      struct db_dataset *p_ref_dataset,
-					      void **p_data_ref_tbl)
+					      void **p_data_ref_tbl,
+					      int same)
 {
 	cl_map_item_t *p_item_old, *p_item_new;
 	uint64_t key_old, key_new;
@@ -670,6 +809,10 @@ static uint8_t ssa_db_diff_var_size_table_cmp(cl_qmap_t * p_map_old,
 		}
 	}
 
+	/* identical tables have neither added nor removed records */
+	if (same)
+		return dirty;
+
 	p_item_old = cl_qmap_head(p_map_old);
 	p_item_new = cl_qmap_head(p_map_new);
 	while (p_item_old != cl_qmap_end(p_map_old) && p_item_new != cl_qmap_end(p_map_new)) {
@@ -775,7 +918,12 @@ static void ssa_db_diff_compare_subnet_tables(struct ssa_db_extract * p_previous
 				       &p_ssa_db_diff->ep_guid_to_lid_tbl_added,
 				       &p_ssa_db_diff->ep_guid_to_lid_tbl_removed,
 				       &p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_GUID2LID],
-				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID]);
+				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID],
+				       ssa_db_diff_tbl_same(p_previous_db->p_guid_to_lid_tbl,
+							    cl_qmap_count(&p_previous_db->ep_guid_to_lid_tbl),
+							    p_current_db->p_guid_to_lid_tbl,
+							    cl_qmap_count(&p_current_db->ep_guid_to_lid_tbl),
+							    sizeof(struct smdb_guid2lid), "GUID2LID"));
 
 	if (dirty & 1)
 		tbl_changed[SMDB_TBL_ID_GUID2LID] = TRUE;
@@ -793,7 +941,12 @@ static void ssa_db_diff_compare_subnet_tables(struct ssa_db_extract * p_previous
 				       &p_ssa_db_diff->ep_node_tbl_added,
 				       &p_ssa_db_diff->ep_node_tbl_removed,
 				       &p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_NODE],
-				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_NODE]);
+				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_NODE],
+				       ssa_db_diff_tbl_same(p_previous_db->p_node_tbl,
+							    cl_qmap_count(&p_previous_db->ep_node_tbl),
+							    p_current_db->p_node_tbl,
+							    cl_qmap_count(&p_current_db->ep_node_tbl),
+							    sizeof(struct smdb_node), "NODE"));
 
 	if (dirty & 1)
 		tbl_changed[SMDB_TBL_ID_NODE] = TRUE;
@@ -811,7 +964,12 @@ static void ssa_db_diff_compare_subnet_tables(struct ssa_db_extract * p_previous
 				       &p_ssa_db_diff->ep_link_tbl_added,
 				       &p_ssa_db_diff->ep_link_tbl_removed,
 				       &p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_LINK],
-				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_LINK]);
+				       (void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_LINK],
+				       ssa_db_diff_tbl_same(p_previous_db->p_link_tbl,
+							    cl_qmap_count(&p_previous_db->ep_link_tbl),
+							    p_current_db->p_link_tbl,
+							    cl_qmap_count(&p_current_db->ep_link_tbl),
+							    sizeof(struct smdb_link), "LINK"));
 
 	if (dirty & 1)
 		tbl_changed[SMDB_TBL_ID_LINK] = TRUE;
@@ -833,7 +991,17 @@ static void ssa_db_diff_compare_subnet_tables(struct ssa_db_extract * p_previous
 						&p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_PORT],
 						(void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_PORT],
 						&p_ssa_db_diff->p_smdb->p_db_tables[SMDB_TBL_ID_PKEY],
-						(void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_PKEY]);
+						(void **) &p_ssa_db_diff->p_smdb->pp_tables[SMDB_TBL_ID_PKEY],
+						ssa_db_diff_tbl_same(p_previous_db->p_port_tbl,
+								     cl_qmap_count(&p_previous_db->ep_port_tbl),
+								     p_current_db->p_port_tbl,
+								     cl_qmap_count(&p_current_db->ep_port_tbl),
+								     sizeof(struct smdb_port), "PORT") &&
+						ssa_db_diff_tbl_same(p_previous_db->p_pkey_tbl,
+								     p_previous_db->pkey_tbl_rec_num,
+								     p_current_db->p_pkey_tbl,
+								     p_current_db->pkey_tbl_rec_num,
+								     sizeof(*p_current_db->p_pkey_tbl), "PKEY"));
 
 	if (dirty & 1) {
 		tbl_changed[SMDB_TBL_ID_PORT] = TRUE;
@@ -1255,6 +1423,36 @@ static void ep_lft_top_qmap_copy(cl_qmap_t *p_dest_qmap,
 	}
 }
 
+/*
+ * Returns TRUE if some of the dumped LFT records are new or differ
+ * from the existing ones. OpenSM reports LFT blocks set during
+ * a heavy sweep even if the routing didn't change.
+ */
+static boolean_t ep_lft_qmap_changed(cl_qmap_t *p_db_qmap, const void *p_db_tbl,
+				     cl_qmap_t *p_dump_qmap, const void *p_dump_tbl,
+				     size_t rec_size)
+{
+	struct ep_map_rec *p_map_rec, *p_map_rec_db;
+
+	for (p_map_rec = (struct ep_map_rec *) cl_qmap_head(p_dump_qmap);
+	     p_map_rec != (struct ep_map_rec *) cl_qmap_end(p_dump_qmap);
+	     p_map_rec = (struct ep_map_rec *) cl_qmap_next(&p_map_rec->map_item)) {
+		p_map_rec_db = (struct ep_map_rec *)
+			cl_qmap_get(p_db_qmap, cl_qmap_key(&p_map_rec->map_item));
+		if (p_map_rec_db == (struct ep_map_rec *) cl_qmap_end(p_db_qmap))
+			return TRUE;
+
+		if (ssa_mem_mismatch((const uint8_t *) p_db_tbl +
+				     p_map_rec_db->offset * rec_size,
+				     (const uint8_t *) p_dump_tbl +
+				     p_map_rec->offset * rec_size,
+				     rec_size) < rec_size)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
 /** =========================================================================
  */
 static uint64_t ssa_db_diff_new_qmap_recs(cl_qmap_t * p_map_old,
@@ -1293,6 +1491,7 @@ static uint64_t ssa_db_diff_new_qmap_recs(cl_qmap_t * p_map_old,
  */
 static void
 ssa_db_diff_update_epoch(struct ssa_db_diff *p_ssa_db_diff,
+			 const struct ssa_db *p_smdb_prev,
 			 boolean_t *tbl_changed)
 {
 	struct ssa_db *p_smdb;
@@ -1316,8 +1515,13 @@ ssa_db_diff_update_epoch(struct ssa_db_diff *p_ssa_db_diff,
 		if (smdb_deltas && p_smdb->p_db_tables[i].set_size == 0)
 			continue;
 
-		if (!smdb_deltas && tbl_changed[i] == FALSE)
+		if (!smdb_deltas && tbl_changed[i] == FALSE) {
+			/* unchanged table keeps its epoch, so it isn't resent */
+			if (p_smdb_prev && i < p_smdb_prev->data_tbl_cnt)
+				p_smdb->p_db_tables[i].epoch =
+					p_smdb_prev->p_db_tables[i].epoch;
 			continue;
+		}
 
 		epoch = ssa_db_set_epoch(p_smdb, i, epoch_new);
 		if (epoch != DB_EPOCH_INVALID)
@@ -1346,6 +1550,46 @@ ssa_db_diff_update_epoch(struct ssa_db_diff *p_ssa_db_diff,
 	ssa_log(SSA_LOG_VERBOSE, "]\n");
 }
 
+/** =========================================================================
+ */
+static void
+ssa_db_diff_update_logs(struct ssa_db_diff *p_ssa_db_diff,
+			const struct ssa_db *p_smdb_prev,
+			boolean_t *tbl_changed)
+{
+	struct ssa_db *p_smdb = p_ssa_db_diff->p_smdb;
+	uint64_t i, size;
+	void *p_log;
+
+	if (!p_smdb_prev || !p_smdb_prev->pp_tables)
+		return;
+
+	for (i = 0; i < p_smdb->data_tbl_cnt && i < SMDB_TBL_ID_MAX; i++) {
+		if (!tbl_changed[i] || i >= p_smdb_prev->data_tbl_cnt ||
+		    ssa_db_get_epoch(p_smdb_prev, i) == DB_EPOCH_INVALID ||
+		    p_smdb_prev->p_db_tables[i].id.table !=
+		    p_smdb->p_db_tables[i].id.table)
+			continue;
+
+		p_log = ssa_db_build_log(p_smdb_prev, p_smdb, i, &size);
+		if (!p_log) {
+			ssa_log(SSA_LOG_VERBOSE,
+				"table %" PRIu64 " changes are sent in full\n", i);
+			continue;
+		}
+
+		if (ssa_db_set_log(p_smdb, i, p_log, size)) {
+			ssa_log_err(SSA_LOG_DEFAULT,
+				    "unable to keep table %" PRIu64 " log\n", i);
+			free(p_log);
+			continue;
+		}
+		ssa_log(SSA_LOG_VERBOSE,
+			"table %" PRIu64 " epoch 0x%" PRIx64 " log of %" PRIu64
+			" bytes\n", i, ssa_db_get_epoch(p_smdb, i), size);
+	}
+}
+
 /** =========================================================================
  */
 static void
@@ -1384,10 +1628,18 @@ ssa_db_diff_update_lfts(struct ssa_database *ssa_db, struct ssa_db_diff *p_ssa_d
 				     &ssa_db->p_lft_db->ep_dump_lft_top_tbl,
 				     ssa_db->p_lft_db->p_dump_lft_top_tbl);
 
-		if (cl_qmap_count(&ssa_db->p_lft_db->ep_dump_lft_top_tbl))
+		if (ep_lft_qmap_changed(&ssa_db->p_lft_db->ep_db_lft_top_tbl,
+					ssa_db->p_lft_db->p_db_lft_top_tbl,
+					&ssa_db->p_lft_db->ep_dump_lft_top_tbl,
+					ssa_db->p_lft_db->p_dump_lft_top_tbl,
+					sizeof(*ssa_db->p_lft_db->p_db_lft_top_tbl)))
 			tbl_changed[SMDB_TBL_ID_LFT_TOP] = TRUE;
 
-		if (cl_qmap_count(&ssa_db->p_lft_db->ep_dump_lft_block_tbl))
+		if (ep_lft_qmap_changed(&ssa_db->p_lft_db->ep_db_lft_block_tbl,
+					ssa_db->p_lft_db->p_db_lft_block_tbl,
+					&ssa_db->p_lft_db->ep_dump_lft_block_tbl,
+					ssa_db->p_lft_db->p_dump_lft_block_tbl,
+					sizeof(*ssa_db->p_lft_db->p_db_lft_block_tbl)))
 			tbl_changed[SMDB_TBL_ID_LFT_BLOCK] = TRUE;
 
 		new_recs = ssa_db_diff_new_qmap_recs(&ssa_db->p_lft_db->ep_db_lft_top_tbl,
@@ -1591,11 +1843,13 @@ out:
 /** =========================================================================
  */
 struct ssa_db_diff *
-ssa_db_compare(struct ssa_database * ssa_db, uint64_t epoch_prev, int first)
+ssa_db_compare(struct ssa_database * ssa_db, const struct ssa_db *p_smdb_prev,
+	       int first)
 {
 	struct ssa_db_diff *p_ssa_db_diff = NULL;
 	boolean_t tbl_changed[SMDB_TBL_ID_MAX] = { FALSE };
 	uint64_t data_rec_cnt[SMDB_TBL_ID_MAX] = { 0 };
+	uint64_t epoch_prev;
 
 	ssa_log(SSA_LOG_VERBOSE, "[\n");
 
@@ -1628,6 +1882,7 @@ ssa_db_compare(struct ssa_database * ssa_db, uint64_t epoch_prev, int first)
 		cl_qmap_count(&ssa_db->p_lft_db->ep_db_lft_block_tbl) +
 		cl_qmap_count(&ssa_db->p_lft_db->ep_dump_lft_block_tbl);
 
+	epoch_prev = ssa_db_get_epoch(p_smdb_prev, DB_DEF_TBL_ID);
 	p_ssa_db_diff = ssa_db_diff_init(epoch_prev, data_rec_cnt);
 	if (!p_ssa_db_diff) {
 		ssa_log_err(SSA_LOG_DEFAULT,
@@ -1649,7 +1904,9 @@ ssa_db_compare(struct ssa_database * ssa_db, uint64_t epoch_prev, int first)
                 goto Exit;
         }
 
-	ssa_db_diff_update_epoch(p_ssa_db_diff, tbl_changed);
+	ssa_db_diff_update_epoch(p_ssa_db_diff, p_smdb_prev, tbl_changed);
+	if (db_tbl_log && !smdb_deltas)
+		ssa_db_diff_update_logs(p_ssa_db_diff, p_smdb_prev, tbl_changed);
 #ifdef SSA_PLUGIN_VERBOSE_LOGGING
 	ssa_db_diff_dump(p_ssa_db_diff);
 #endif
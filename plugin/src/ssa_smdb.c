@@ -220,7 +220,7 @@ struct ssa_db *ssa_db_smdb_init(uint64_t epoch, uint64_t data_rec_cnt[SMDB_DATA_
  */
 void ssa_db_smdb_destroy(struct ssa_db * p_smdb)
 {
-	ssa_db_destroy(p_smdb);
+	ssa_db_release(p_smdb);
 }
 
 /** =========================================================================
@@ -39,11 +39,13 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <osd.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
 #include <sys/sysinfo.h>
 #include <sys/timerfd.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <rdma/rsocket.h>
 #include <netinet/tcp.h>
@@ -57,6 +59,7 @@
 #include <infiniband/ssa_smdb.h>
 #endif
 #include <infiniband/ssa_path_record.h>
+#include <infiniband/ssa_prdb.h>
 #include <infiniband/ssa_db_helper.h>
 #include <dlist.h>
 #include <search.h>
@@ -75,6 +78,9 @@ extern int ibv_read_sysfs_file(const char *dir, const char *file,
 #define MAX_UMAD_TIMEOUT	120 * DEFAULT_UMAD_TIMEOUT /* in milliseconds */
 
 #define FIRST_DATA_FD_SLOT		6
+#define CONN_TABLE_INIT_SIZE		1024
+#define MAX_DOWNSTREAM_WORKERS		64
+#define MAX_TBL_EPOCHS			256	/* by 8 bit table id */
 #define ACCESS_FDS_PER_SERVICE		2
 #define ACCESS_FIRST_SERVICE_FD_SLOT	2
 #define PRDB_LISTEN_FD_SLOT	FIRST_DATA_FD_SLOT - 1
@@ -88,6 +94,9 @@ extern int ibv_read_sysfs_file(const char *dir, const char *file,
 #define ADMIN_FIRST_SERVICE_FD_SLOT 3
 #define ADMIN_FDS_PER_SERVICE  2
 
+#define SSA_BULK_ALIGN(size) \
+	(((size) + SSA_DB_REGION_ALIGN - 1) & ~((uint64_t) SSA_DB_REGION_ALIGN - 1))
+
 #define SMDB_DUMP_PATH RDMA_CONF_DIR "/smdb_dump"
 #define PRDB_DUMP_PATH RDMA_CONF_DIR "/prdb_dump"
 
@@ -132,16 +141,17 @@ struct ssa_access_context {
 struct ssa_access_task {
 	struct ssa_access_member *consumer;
 	struct ssa_svc *svc;
+	struct ssa_db *smdb;
+	void *context;	/* path record snapshot reference */
 };
 
-static struct ssa_db *smdb;
+static struct ssa_db_ref smdb_ref = SSA_DB_REF_INITIALIZER;
 static struct ssa_db *db_previous;
-static int smdb_refcnt;
 static uint64_t epoch;
+static pthread_mutex_t downstream_conn_lock = PTHREAD_MUTEX_INITIALIZER;
 
 __thread char log_data[128];
 __thread char log_data1[128];
-__thread int update_pending;
 __thread int update_waiting;
 
 static int sock_adminctrl[2];
@@ -170,18 +180,29 @@ short smdb_port = 7475;
 short prdb_port = 7476;
 short admin_port = 7477;
 int keepalive = 60;		/* seconds */
+int db_stream = 1;
+int db_rdma = 1;
+int db_tbl_epoch = 1;
+int db_tbl_log = 1;
+int db_compress = 1;
+int db_compress_threshold = 4096;	/* bytes */
+int downstream_workers = 0;
 int reconnect_timeout = 10;	/* seconds */
 int reconnect_max_count = 10;
 int rejoin_timeout = 1;		/* seconds */
 
 #ifdef ACCESS
+int prdb_partitions = 0;
+int prdb_lmc_compress = 0;
+int prdb_v2 = 0;
 #ifdef SIM_SUPPORT_FAKE_ACM
 int fake_acm_num = 0;
 #endif
 
 struct ssa_access_member {
 	union ibv_gid gid;		/* consumer GID */
-	struct ssa_db *prdb_current;
+	struct ssa_db *prdb_current;	/* v1 form, compared and updated */
+	struct ssa_db *prdb_encoded;	/* form sent to the consumer */
 	uint64_t smdb_epoch;
 	int rsock;
 	uint16_t lid;
@@ -196,18 +217,14 @@ static struct ssa_sysinfo ssa_sysinfo;
 
 /* Forward declarations */
 static void ssa_close_ssa_conn(struct ssa_conn *conn);
+static short ssa_rsend_continue(struct ssa_conn *conn, short events);
 static int ssa_downstream_svc_server(struct ssa_svc *svc, struct ssa_conn *conn);
 static int ssa_upstream_initiate_conn(struct ssa_svc *svc, short dport);
 static int ssa_upstream_svc_client(struct ssa_svc *svc);
 static void ssa_upstream_query_db_resp(struct ssa_svc *svc, int status);
 static void ssa_upstream_reconnect(struct ssa_svc *svc, struct pollfd *fds);
-static int ssa_downstream_smdb_xfer_in_progress(struct ssa_svc *svc,
-						struct pollfd *fds, int nfds);
 static void ssa_send_db_update_ready(int fd);
-static void ssa_downstream_smdb_update_ready(struct ssa_conn *conn,
-					     struct ssa_svc *svc,
-					     struct pollfd **fds);
-static void ssa_downstream_start_listen(struct ssa_svc *svc, struct pollfd **fds);
+static void ssa_downstream_start_listen(struct ssa_svc *svc);
 static void ssa_close_port(struct ssa_port *port);
 #ifdef ACCESS
 static void ssa_db_update_init(struct ssa_svc *svc, struct ssa_db *db,
@@ -218,6 +235,7 @@ static int ssa_push_db_update(struct ssa_db_update_queue *p_queue,
 			      struct ssa_db_update *db_upd);
 static void ssa_access_wait_for_tasks_completion();
 static void ssa_access_process_task(struct ssa_access_task *task);
+static void ssa_access_update_context(struct ssa_db *smdb);
 #endif
 static void ssa_svc_schedule_join(struct ssa_svc *svc);
 static void ssa_upstream_conn(struct ssa_svc *svc, struct ssa_conn *conn,
@@ -482,8 +500,10 @@ static int ssa_downstream_listen(struct ssa_svc *svc,
 			errno, strerror(errno), conn_listen->rsock);
 		goto err;
 	}
-	if (svc->port->dev->ssa->node_type & SSA_NODE_ACCESS &&
-	    sport == prdb_port) {
+	/* epoch buffer on PRDB connections, RDMA window for bulk transfer */
+	val = (svc->port->dev->ssa->node_type & SSA_NODE_ACCESS &&
+	       sport == prdb_port) + (db_rdma != 0);
+	if (val) {
 		ret = rsetsockopt(conn_listen->rsock, SOL_RDMA, RDMA_IOMAPSIZE,
 				  (void *) &val, sizeof(val));
 		if (ret) {
@@ -683,6 +703,35 @@ void ssa_upstream_mad(struct ssa_svc *svc, struct ssa_ctrl_msg_buf *msg)
 	}
 }
 
+/* CPU time of the calling thread, for the compression counters */
+static long ssa_cpu_usec(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage))
+		return 0;
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L +
+	       usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/*
+ * Tables not shrinking count with their raw size on the wire, so the
+ * ratio tells whether compression pays off for the node.
+ */
+static void ssa_update_compress_counters(uint64_t raw, uint64_t wire,
+					 long usec)
+{
+	long raw_total, wire_total;
+
+	raw_total = ssa_add_runtime_counter(COUNTER_ID_COMPRESS_RAW_BYTES, raw);
+	wire_total = ssa_add_runtime_counter(COUNTER_ID_COMPRESS_WIRE_BYTES,
+					     wire);
+	ssa_add_runtime_counter(COUNTER_ID_COMPRESS_USEC, usec);
+	if (raw_total > 0)
+		ssa_set_runtime_counter(COUNTER_ID_COMPRESS_RATIO,
+					wire_total * 100 / raw_total);
+}
+
 static void ssa_init_ssa_conn(struct ssa_conn *conn, int conn_type,
 			      int conn_dbtype)
 {
@@ -705,6 +754,23 @@ static void ssa_init_ssa_conn(struct ssa_conn *conn, int conn_type,
 	conn->prdb_epoch = DB_EPOCH_INVALID;
 	conn->epoch_len = 0;
 	conn->reconnect_count = 0;
+	conn->stream = 0;
+	conn->slot = -1;
+	conn->bulk = SSA_BULK_NONE;
+	conn->bulk_buf = NULL;
+	conn->bulk_len = 0;
+	conn->bulk_offset = 0;
+	conn->bulk_pos = 0;
+	conn->rdma_offset = 0;
+	conn->tbl_epoch = SSA_TBL_EPOCH_NONE;
+	conn->peer_epochs = NULL;
+	conn->peer_epoch_cnt = 0;
+	conn->tbl_missing = 0;
+	conn->full_xfer = 0;
+	conn->tbl_log = 0;
+	conn->compress = 0;
+	conn->notify_epoch = DB_EPOCH_INVALID;
+	conn->zbuf = NULL;
 }
 
 static void ssa_close_ssa_conn(struct ssa_conn *conn)
@@ -723,6 +789,15 @@ static void ssa_close_ssa_conn(struct ssa_conn *conn)
 		}
 	}
 
+	/* buffer itself belongs to the database being received */
+	if (conn->bulk_buf) {
+		if (riounmap(conn->rsock, conn->bulk_buf, conn->bulk_len))
+			ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
+				"riounmap bulk window rsock %d ERROR %d (%s)\n",
+				conn->rsock, errno, strerror(errno));
+		conn->bulk_buf = NULL;
+	}
+
 	ssa_close_rsocket(conn->rsock);
 
 	conn->rsock = -1;
@@ -731,20 +806,128 @@ static void ssa_close_ssa_conn(struct ssa_conn *conn)
 	conn->phase = SSA_DB_IDLE;
 	conn->epoch_len = 0;
 	conn->rdma_write = 0;
+	conn->stream = 0;
+	conn->bulk = SSA_BULK_NONE;
+	conn->tbl_epoch = SSA_TBL_EPOCH_NONE;
+	free(conn->peer_epochs);
+	conn->peer_epochs = NULL;
+	conn->peer_epoch_cnt = 0;
+	conn->tbl_missing = 0;
+	conn->tbl_log = 0;
+	conn->compress = 0;
+	conn->notify_epoch = DB_EPOCH_INVALID;
+	free(conn->zbuf);
+	conn->zbuf = NULL;
+}
+
+/*
+ * The first query for a data table after bulk transfer or table epochs
+ * are negotiated passes the RDMA window and the held table epochs,
+ * so it is sent in streaming transfer as well.
+ */
+static int ssa_upstream_bulk_query(struct ssa_conn *conn, uint16_t op)
+{
+	return op == SSA_MSG_DB_QUERY_DATA_DATASET &&
+	       conn->phase == SSA_DB_DATA &&
+	       (conn->bulk == SSA_BULK_NEGOTIATED ||
+		conn->tbl_epoch == SSA_TBL_EPOCH_NEGOTIATED) &&
+	       conn->ssa_db && conn->ssa_db->p_db_tables;
+}
+
+/*
+ * Epoch of the data table held in the previous database, if that table
+ * may still be current or updated by a table log: both databases come
+ * from the same producer instance (lineage), table layout is the same
+ * and the database being received is newer.
+ */
+static uint64_t ssa_upstream_held_epoch(struct ssa_conn *conn, uint64_t i)
+{
+	struct ssa_db *ssa_db = conn->ssa_db;
+	struct ssa_db *prev = db_previous;
+
+	if (conn->tbl_epoch == SSA_TBL_EPOCH_NONE || !prev || prev == ssa_db ||
+	    !prev->pp_tables || !ssa_db_get_lineage(prev) ||
+	    ssa_db_get_lineage(prev) != ssa_db_get_lineage(ssa_db) ||
+	    prev->data_tbl_cnt != ssa_db_calculate_data_tbl_num(ssa_db) ||
+	    i >= prev->data_tbl_cnt ||
+	    ssa_db_get_epoch(prev, DB_DEF_TBL_ID) >=
+	    ntohll(ssa_db->db_def.epoch))
+		return DB_EPOCH_INVALID;
+
+	if (memcmp(&prev->p_db_tables[i].id, &ssa_db->p_db_tables[i].id,
+		   sizeof(prev->p_db_tables[i].id)) ||
+	    (!prev->pp_tables[i] && prev->p_db_tables[i].set_size))
+		return DB_EPOCH_INVALID;
+
+	return ssa_db_get_epoch(prev, i);
+}
+
+/* Held table expected to be skipped by the parent */
+static int ssa_upstream_tbl_current(struct ssa_conn *conn, uint64_t i)
+{
+	uint64_t epoch = ssa_upstream_held_epoch(conn, i);
+
+	return epoch != DB_EPOCH_INVALID &&
+	       epoch == ntohll(conn->ssa_db->p_db_tables[i].epoch) &&
+	       db_previous->p_db_tables[i].set_size ==
+	       conn->ssa_db->p_db_tables[i].set_size;
 }
 
-static int ssa_upstream_send_query(int rsock, struct ssa_msg_hdr *msg,
+static size_t ssa_upstream_query_size(struct ssa_conn *conn, uint16_t op)
+{
+	size_t size = sizeof(struct ssa_msg_hdr);
+
+	if (ssa_upstream_bulk_query(conn, op) &&
+	    conn->tbl_epoch == SSA_TBL_EPOCH_NEGOTIATED)
+		size += ssa_db_calculate_data_tbl_num(conn->ssa_db) *
+			sizeof(be64_t);
+	return size;
+}
+
+static int ssa_upstream_send_query(struct ssa_conn *conn,
+				   struct ssa_msg_hdr *msg, size_t size,
 				   uint16_t op, uint32_t id)
 {
+	be64_t *epochs = (be64_t *) (msg + 1);
+	uint64_t i, data_tbl_cnt;
 	uint32_t rdma_len;
+	uint64_t rdma_addr = 0;
+	uint16_t flags = SSA_MSG_FLAG_END;
 
 	if (op == SSA_MSG_DB_PUBLISH_EPOCH_BUF)
-		rdma_len = sizeof(((struct ssa_conn *) NULL)->prdb_epoch);
+		rdma_len = sizeof(conn->prdb_epoch);
 	else
 		rdma_len = 0;
-	ssa_init_ssa_msg_hdr(msg, op, sizeof(*msg), SSA_MSG_FLAG_END,
-			     id, rdma_len, 0);
-	return rsend(rsock, msg, sizeof(*msg), MSG_DONTWAIT);
+	if (op == SSA_MSG_DB_QUERY_DEF) {
+		if (db_stream)
+			flags |= SSA_MSG_FLAG_STREAM;
+		if (db_rdma)
+			flags |= SSA_MSG_FLAG_RDMA;
+		if (db_tbl_epoch && conn->dbtype == SSA_CONN_SMDB_TYPE &&
+		    !conn->full_xfer) {
+			flags |= SSA_MSG_FLAG_TBL_EPOCH;
+			if (db_tbl_log)
+				flags |= SSA_MSG_FLAG_TBL_LOG;
+		}
+		if (db_compress && !conn->full_xfer)
+			flags |= SSA_MSG_FLAG_COMPRESS;
+	} else if (ssa_upstream_bulk_query(conn, op)) {
+		if (conn->bulk == SSA_BULK_NEGOTIATED) {
+			rdma_len = conn->bulk_len;
+			rdma_addr = conn->bulk_offset;
+			conn->bulk = conn->bulk_buf ? SSA_BULK_WINDOW :
+						      SSA_BULK_NONE;
+		}
+		if (conn->tbl_epoch == SSA_TBL_EPOCH_NEGOTIATED) {
+			data_tbl_cnt = (size - sizeof(*msg)) / sizeof(*epochs);
+			for (i = 0; i < data_tbl_cnt; i++)
+				epochs[i] = htonll(ssa_upstream_held_epoch(conn, i));
+			flags |= SSA_MSG_FLAG_TBL_EPOCH;
+			conn->tbl_epoch = SSA_TBL_EPOCH_ADVERTISED;
+		}
+	}
+	ssa_init_ssa_msg_hdr(msg, op, size, flags, id, rdma_len, rdma_addr);
+	return rsend(conn->rsock, msg, size, MSG_DONTWAIT);
 }
 
 #ifdef ACM
@@ -831,17 +1014,35 @@ static void ssa_upstream_update_phase(struct ssa_conn *conn, uint16_t op)
 
 static short ssa_upstream_query(struct ssa_svc *svc, uint16_t op, short events)
 {
+	size_t size;
 	uint32_t id;
 	int ret;
 
-	svc->conn_dataup.sbuf = malloc(sizeof(struct ssa_msg_hdr));
+	/* streaming parent sends the response without the query */
+	if (svc->conn_dataup.stream && op != SSA_MSG_DB_QUERY_DEF &&
+	    op != SSA_MSG_DB_PUBLISH_EPOCH_BUF &&
+	    !ssa_upstream_bulk_query(&svc->conn_dataup, op)) {
+		ssa_upstream_update_phase(&svc->conn_dataup, op);
+		return POLLIN;
+	}
+	if (op == SSA_MSG_DB_QUERY_DEF) {
+		svc->conn_dataup.stream = 0;
+		svc->conn_dataup.tbl_epoch = SSA_TBL_EPOCH_NONE;
+		svc->conn_dataup.tbl_missing = 0;
+		svc->conn_dataup.tbl_log = 0;
+		svc->conn_dataup.compress = 0;
+	}
+
+	size = ssa_upstream_query_size(&svc->conn_dataup, op);
+	svc->conn_dataup.sbuf = malloc(size);
 	if (svc->conn_dataup.sbuf) {
-		svc->conn_dataup.ssize = sizeof(struct ssa_msg_hdr);
+		svc->conn_dataup.ssize = size;
 		svc->conn_dataup.soffset = 0;
 		id = svc->tid++;
 
-		ret = ssa_upstream_send_query(svc->conn_dataup.rsock,
-					      svc->conn_dataup.sbuf, op, id);
+		ret = ssa_upstream_send_query(&svc->conn_dataup,
+					      svc->conn_dataup.sbuf, size,
+					      op, id);
 		if (ret >= 0) {
 			ssa_upstream_update_phase(&svc->conn_dataup, op);
 			svc->conn_dataup.soffset += ret;
@@ -883,6 +1084,7 @@ static short ssa_riowrite(struct ssa_conn *conn, short events)
 	conn->ssize = sizeof(conn->prdb_epoch);
 	conn->soffset = 0;
 	conn->sbuf2 = NULL;
+	conn->rdma_offset = 0;
 	conn->rdma_write = 1;
 	ret = riowrite(conn->rsock, conn->sbuf, conn->ssize, 0, MSG_DONTWAIT);
 	if (ret < 0) {
@@ -903,18 +1105,33 @@ static short ssa_riowrite(struct ssa_conn *conn, short events)
 	return revents;
 }
 
+/*
+ * Once the RDMA write completes, a pending header (sbuf2) announcing
+ * it to the peer is sent over the regular rsend path.
+ */
 static short ssa_riowrite_continue(struct ssa_conn *conn, short events)
 {
 	int ret;
 
-	ret = riowrite(conn->rsock, conn->sbuf + conn->soffset,
-		       conn->ssize - conn->soffset, conn->soffset, MSG_DONTWAIT);
+	if (conn->soffset < conn->ssize)
+		ret = riowrite(conn->rsock, conn->sbuf + conn->soffset,
+			       conn->ssize - conn->soffset,
+			       conn->rdma_offset + conn->soffset, MSG_DONTWAIT);
+	else
+		ret = 0;
 	if (ret >= 0) {
 		conn->soffset += ret;
 		if (conn->soffset == conn->ssize) {
 			conn->rdma_write = 0;
 			conn->sbuf = NULL;
-			return POLLIN;
+			if (!conn->sbuf2)
+				return POLLIN;
+			/* header is sent and freed by ssa_rsend_continue */
+			conn->sbuf = conn->sbuf2;
+			conn->ssize = conn->ssize2;
+			conn->soffset = 0;
+			conn->sbuf2 = NULL;
+			return ssa_rsend_continue(conn, events);
 		} else
 			return POLLOUT | POLLIN;
 	} else {
@@ -950,6 +1167,7 @@ static short ssa_rsend_continue(struct ssa_conn *conn, short events)
 					if (ret >= 0) {
 						conn->soffset += ret;
 						if (conn->soffset == conn->ssize) {
+							conn->sbuf = NULL;
 							conn->sbuf2 = NULL;
 							return POLLIN;
 						} else
@@ -964,6 +1182,7 @@ static short ssa_rsend_continue(struct ssa_conn *conn, short events)
 					}
 				}
 			} else {
+				conn->sbuf = NULL;
 				conn->sbuf2 = NULL;
 				return POLLIN;
 			}
@@ -996,8 +1215,23 @@ static int ssa_upstream_handle_query_defs(struct ssa_conn *conn,
 			conn->rhdr = hdr;
 			if (conn->rindex)
 				size = sizeof(struct db_dataset);
-			else
+			else {
 				size = sizeof(struct db_def);
+				conn->stream = db_stream &&
+					       (ntohs(hdr->flags) & SSA_MSG_FLAG_STREAM);
+				conn->bulk = db_rdma &&
+					     (ntohs(hdr->flags) & SSA_MSG_FLAG_RDMA) ?
+					     SSA_BULK_NEGOTIATED : SSA_BULK_NONE;
+				conn->tbl_epoch = db_tbl_epoch &&
+						  conn->dbtype == SSA_CONN_SMDB_TYPE &&
+						  (ntohs(hdr->flags) & SSA_MSG_FLAG_TBL_EPOCH) ?
+						  SSA_TBL_EPOCH_NEGOTIATED :
+						  SSA_TBL_EPOCH_NONE;
+				conn->tbl_log = db_tbl_log && conn->tbl_epoch &&
+						(ntohs(hdr->flags) & SSA_MSG_FLAG_TBL_LOG);
+				conn->compress = db_compress &&
+						 (ntohs(hdr->flags) & SSA_MSG_FLAG_COMPRESS);
+			}
 			if (ntohl(hdr->len) != sizeof(*hdr) + size)
 				ssa_log(SSA_LOG_DEFAULT,
 					"SSA_MSG_DB_QUERY_DEF/TBL_DEF response "
@@ -1162,7 +1396,27 @@ static int ssa_upstream_handle_query_data(struct ssa_conn *conn,
 				conn->sid, ntohl(hdr->id), conn->rsock);
 		} else {
 			conn->rhdr = hdr;
-			if (ntohl(hdr->len) > sizeof(*hdr)) {
+			if (ntohl(hdr->len) == sizeof(*hdr) &&
+			    ntohl(hdr->rdma_len) &&
+			    conn->bulk == SSA_BULK_WINDOW) {
+				/* table already written into the RDMA window */
+				if (ntohl(hdr->rdma_len) > conn->bulk_len ||
+				    ntohll(hdr->rdma_addr) < conn->bulk_offset ||
+				    ntohll(hdr->rdma_addr) - conn->bulk_offset >
+				    conn->bulk_len - ntohl(hdr->rdma_len)) {
+					ssa_log_err(SSA_LOG_DEFAULT,
+						    "RDMA table 0x%" PRIx64 " len %u "
+						    "outside window on rsock %d\n",
+						    ntohll(hdr->rdma_addr),
+						    ntohl(hdr->rdma_len),
+						    conn->rsock);
+					return EINVAL;
+				}
+				conn->rbuf = conn->bulk_buf +
+					     (ntohll(hdr->rdma_addr) - conn->bulk_offset);
+				conn->rsize = ntohl(hdr->rdma_len);
+				conn->roffset = conn->rsize;
+			} else if (ntohl(hdr->len) > sizeof(*hdr)) {
 				buf = malloc(ntohl(hdr->len) - sizeof(*hdr));
 				if (!buf)
 					ssa_log(SSA_LOG_DEFAULT,
@@ -1277,25 +1531,234 @@ static void ssa_upstream_send_db_update(struct ssa_svc *svc, struct ssa_db *db,
 		memset(&msg.db_upd.remote_gid, 0, 16);
 	msg.db_upd.remote_lid = 0;
 	msg.db_upd.epoch = epoch;
+	/* each receiving thread gets its own reference */
 	if (svc->port->dev->ssa->node_type & SSA_NODE_ACCESS) {
+		ssa_db_get(db);
 		ret = write(svc->sock_accessup[0], (char *) &msg, sizeof(msg));
-		if (ret != sizeof(msg))
+		if (ret != sizeof(msg)) {
 			ssa_log_err(SSA_LOG_CTRL,
 				    "%d out of %d bytes written to access\n",
 				    ret, sizeof(msg));
+			ssa_db_release(db);
+		}
 	}
 	if (svc->port->dev->ssa->node_type & SSA_NODE_DISTRIBUTION) {
+		ssa_db_get(db);
 		ret = write(svc->sock_updown[0], (char *) &msg, sizeof(msg));
-		if (ret != sizeof(msg))
+		if (ret != sizeof(msg)) {
 			ssa_log_err(SSA_LOG_CTRL,
 				    "%d out of %d bytes written to downstream\n",
 				    ret, sizeof(msg));
+			ssa_db_release(db);
+		}
 	}
 	if (svc->process_msg)
 		svc->process_msg(svc, (struct ssa_ctrl_msg_buf *) &msg);
 	ssa_db_update_change_counters(epoch);
 }
 
+/*
+ * Allocates and maps a single RDMA window large enough for all data
+ * tables of the database being received. The window becomes the
+ * database data buffer, so tables written into it are used in place.
+ * On failure the transfer falls back to rsend.
+ */
+static void ssa_upstream_map_bulk(struct ssa_conn *conn)
+{
+	struct ssa_db *ssa_db = conn->ssa_db;
+	uint64_t i, data_tbl_cnt, len = 0;
+	void *buf;
+	off_t offset;
+
+	data_tbl_cnt = ssa_db_calculate_data_tbl_num(ssa_db);
+	for (i = 0; i < data_tbl_cnt; i++) {
+		/* tables still current are not transferred */
+		if (ssa_upstream_tbl_current(conn, i))
+			continue;
+		len += SSA_BULK_ALIGN(ntohll(ssa_db->p_db_tables[i].set_size));
+	}
+	if (!len || len > UINT32_MAX)
+		return;
+
+	if (posix_memalign(&buf, SSA_DB_REGION_ALIGN, len)) {
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "unable to allocate %" PRIu64 " bytes RDMA window "
+			    "on rsock %d\n", len, conn->rsock);
+		return;
+	}
+
+	offset = riomap(conn->rsock, buf, len, PROT_WRITE, 0, -1);
+	if (offset == -1) {
+		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
+			"riomap RDMA window rsock %d ERROR %d (%s)\n",
+			conn->rsock, errno, strerror(errno));
+		free(buf);
+		return;
+	}
+
+	conn->bulk_buf = buf;
+	conn->bulk_len = len;
+	conn->bulk_offset = offset;
+	ssa_db->p_data_buf = buf;
+	ssa_db->data_buf_size = len;
+	ssa_log(SSA_LOG_CTRL, "RDMA window %" PRIu64 " bytes at 0x%" PRIx64
+		" on rsock %d\n", len, (uint64_t) offset, conn->rsock);
+}
+
+/*
+ * Copies a data table the parent skipped as unchanged from the previous
+ * database, which is released once this one is complete. On failure the
+ * table is marked missing, so the database is transferred again in full.
+ */
+static void ssa_upstream_reuse_table(struct ssa_conn *conn, uint64_t i)
+{
+	uint64_t size;
+	void *buf;
+
+	if (!ssa_upstream_tbl_current(conn, i)) {
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "table %" PRIu64 " skipped but not held on rsock %d\n",
+			    i, conn->rsock);
+		conn->tbl_missing = 1;
+		return;
+	}
+
+	size = ntohll(db_previous->p_db_tables[i].set_size);
+	if (!size)
+		return;
+	buf = malloc(size);
+	if (!buf) {
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "unable to allocate %" PRIu64 " bytes for table %" PRIu64
+			    " on rsock %d\n", size, i, conn->rsock);
+		conn->tbl_missing = 1;
+		return;
+	}
+	memcpy(buf, db_previous->pp_tables[i], size);
+	conn->ssa_db->pp_tables[i] = buf;
+	ssa_log(SSA_LOG_CTRL, "table %" PRIu64 " epoch 0x%" PRIx64
+		" unchanged, %" PRIu64 " bytes reused on rsock %d\n", i,
+		ntohll(conn->ssa_db->p_db_tables[i].epoch), size, conn->rsock);
+}
+
+/*
+ * Applies the table log the parent sent instead of a changed data table
+ * to the table held in the previous database. The log is kept with the
+ * database being received, so it's passed on to the children. On failure
+ * the table is marked missing, so the database is transferred again in
+ * full.
+ */
+static void ssa_upstream_apply_log(struct ssa_conn *conn, uint64_t i)
+{
+	struct ssa_db *ssa_db = conn->ssa_db;
+	uint64_t epoch;
+	void *buf = NULL;
+
+	epoch = ssa_upstream_held_epoch(conn, i);
+	if (epoch == DB_EPOCH_INVALID ||
+	    ssa_db_set_log(ssa_db, i, conn->rbuf, conn->rsize)) {
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "table %" PRIu64 " log of %d bytes not applicable "
+			    "on rsock %d\n", i, conn->rsize, conn->rsock);
+		free(conn->rbuf);
+		conn->tbl_missing = 1;
+		return;
+	}
+
+	buf = ssa_db_log_apply(ssa_db, i, db_previous->pp_tables[i],
+			       ntohll(db_previous->p_db_tables[i].set_size),
+			       epoch);
+	if (!buf) {
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "unable to apply table %" PRIu64 " log on rsock %d\n",
+			    i, conn->rsock);
+		ssa_db_set_log(ssa_db, i, NULL, 0);
+		conn->tbl_missing = 1;
+		return;
+	}
+	ssa_db->pp_tables[i] = buf;
+	ssa_log(SSA_LOG_CTRL, "table %" PRIu64 " epoch 0x%" PRIx64 " -> 0x%"
+		PRIx64 " updated by %d bytes log on rsock %d\n", i, epoch,
+		ntohll(ssa_db->p_db_tables[i].epoch), conn->rsize, conn->rsock);
+}
+
+/*
+ * Replaces the compressed table or table log just received by its raw
+ * copy. On failure the table is marked missing, as for a log which can't
+ * be applied, and the database is transferred again uncompressed.
+ */
+static void ssa_upstream_decompress(struct ssa_conn *conn)
+{
+	struct ssa_msg_hdr *hdr = conn->rhdr;
+	uint64_t size = 0;
+	void *buf = NULL;
+	long usec = 0;
+
+	/* tables in the RDMA window are never compressed */
+	if (ntohl(hdr->len) > sizeof(*hdr)) {
+		usec = ssa_cpu_usec();
+		buf = ssa_db_decompress(conn->rbuf, conn->rsize, &size);
+		usec = ssa_cpu_usec() - usec;
+		ssa_add_runtime_counter(COUNTER_ID_DECOMPRESS_USEC, usec);
+		free(conn->rbuf);
+	}
+	if (!buf || size > INT_MAX) {
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "unable to decompress table %d of %d bytes "
+			    "on rsock %d\n", conn->rindex, conn->rsize,
+			    conn->rsock);
+		free(buf);
+		conn->rbuf = conn->rhdr;
+		conn->tbl_missing = 1;
+		return;
+	}
+
+	ssa_log(SSA_LOG_CTRL, "table %d decompressed %d -> %" PRIu64
+		" bytes in %ld usec on rsock %d\n", conn->rindex, conn->rsize,
+		size, usec, conn->rsock);
+	conn->rbuf = buf;
+	conn->rsize = size;
+}
+
+static void ssa_upstream_unmap_bulk(struct ssa_conn *conn)
+{
+	if (conn->bulk_buf &&
+	    riounmap(conn->rsock, conn->bulk_buf, conn->bulk_len))
+		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
+			"riounmap RDMA window rsock %d ERROR %d (%s)\n",
+			conn->rsock, errno, strerror(errno));
+	conn->bulk_buf = NULL;
+	conn->bulk = SSA_BULK_NONE;
+}
+
+static short ssa_upstream_update_conn(struct ssa_svc *svc, short events);
+
+/*
+ * A database missing a data table is never published. It's dropped and
+ * transferred again with all tables sent in full and uncompressed, so
+ * nothing is rebuilt from the previous database or decompressed.
+ */
+static short ssa_upstream_retransfer(struct ssa_svc *svc, short events)
+{
+	struct ssa_conn *conn = &svc->conn_dataup;
+
+	ssa_log_err(SSA_LOG_DEFAULT,
+		    "ssa_db %p incomplete, transferring it again in full "
+		    "on rsock %d\n", conn->ssa_db, conn->rsock);
+	conn->ssa_db->data_tbl_cnt = ssa_db_calculate_data_tbl_num(conn->ssa_db);
+	ssa_db_destroy(conn->ssa_db);
+	conn->tbl_missing = 0;
+	conn->full_xfer = 1;
+	conn->ssa_db = calloc(1, sizeof(*conn->ssa_db));
+	if (!conn->ssa_db) {
+		ssa_log_err(SSA_LOG_DEFAULT,
+			    "could not allocate ssa_db struct for retransfer\n");
+		return events;
+	}
+
+	return ssa_upstream_update_conn(svc, events);
+}
+
 static short ssa_upstream_update_conn(struct ssa_svc *svc, short events)
 {
 	uint64_t data_tbl_cnt, epoch;
@@ -1398,6 +1861,7 @@ ssa_log(SSA_LOG_DEFAULT, "SSA_DB_FIELD_DEFS index %d %p len %d rsock %d\n", svc-
 		if (svc->conn_dataup.rbuf == svc->conn_dataup.rhdr &&
 		    ntohs(((struct ssa_msg_hdr *)svc->conn_dataup.rhdr)->flags) & SSA_MSG_FLAG_END) {
 			svc->conn_dataup.phase = SSA_DB_IDLE;
+			ssa_upstream_unmap_bulk(&svc->conn_dataup);
 			if (svc->conn_dataup.rindex != ssa_db_calculate_data_tbl_num(svc->conn_dataup.ssa_db))
 				ssa_log_err(SSA_LOG_DEFAULT,
 					    "SSA_DB_DATA protocol error - rindex %d num tables %d mismatch\n",
@@ -1410,6 +1874,8 @@ ssa_log(SSA_LOG_DEFAULT, "SSA_DB_FIELD_DEFS index %d %p len %d rsock %d\n", svc-
 				svc->conn_dataup.ssa_db->pp_tables = calloc(1, data_tbl_cnt * sizeof(*svc->conn_dataup.ssa_db->pp_tables));
 ssa_log(SSA_LOG_DEFAULT, "SSA_DB_DATA ssa_db allocated pp_tables %p num tables %d rsock %d\n", svc->conn_dataup.ssa_db->pp_tables, data_tbl_cnt, svc->conn_dataup.rsock);
 				svc->conn_dataup.rindex = 0;
+				if (svc->conn_dataup.bulk == SSA_BULK_NEGOTIATED)
+					ssa_upstream_map_bulk(&svc->conn_dataup);
 			} else {
 				if (svc->conn_dataup.rindex >=
 				    ssa_db_calculate_data_tbl_num(svc->conn_dataup.ssa_db))
@@ -1423,8 +1889,18 @@ ssa_log(SSA_LOG_DEFAULT, "SSA_DB_DATA ssa_db allocated pp_tables %p num tables %
 							    "SSA_DB_DATA pp_tables rindex %d %p not NULL as expected\n",
 							    svc->conn_dataup.rindex,
 							    svc->conn_dataup.ssa_db->pp_tables[svc->conn_dataup.rindex]);
-					if (svc->conn_dataup.rbuf != svc->conn_dataup.rhdr)
+					if (svc->conn_dataup.rbuf != svc->conn_dataup.rhdr &&
+					    ntohs(((struct ssa_msg_hdr *)svc->conn_dataup.rhdr)->flags) & SSA_MSG_FLAG_COMPRESS)
+						ssa_upstream_decompress(&svc->conn_dataup);
+					if (svc->conn_dataup.rbuf != svc->conn_dataup.rhdr &&
+					    ntohs(((struct ssa_msg_hdr *)svc->conn_dataup.rhdr)->flags) & SSA_MSG_FLAG_TBL_LOG)
+						ssa_upstream_apply_log(&svc->conn_dataup,
+								       svc->conn_dataup.rindex);
+					else if (svc->conn_dataup.rbuf != svc->conn_dataup.rhdr)
 						svc->conn_dataup.ssa_db->pp_tables[svc->conn_dataup.rindex] = svc->conn_dataup.rbuf;
+					else if (ntohs(((struct ssa_msg_hdr *)svc->conn_dataup.rhdr)->flags) & SSA_MSG_FLAG_TBL_EPOCH)
+						ssa_upstream_reuse_table(&svc->conn_dataup,
+									 svc->conn_dataup.rindex);
 				} else ssa_log_err(SSA_LOG_DEFAULT,
 						   "SSA_DB_DATA no pp_tables for rindex %d\n",
 						   svc->conn_dataup.rindex);
@@ -1454,7 +1930,10 @@ ssa_log(SSA_LOG_DEFAULT, "SSA_DB_DATA index %d epoch 0x%" PRIx64 " %p len %d rso
 			revents = ssa_upstream_query(svc,
 						     SSA_MSG_DB_QUERY_DATA_DATASET,
 						     events);
+		} else if (svc->conn_dataup.tbl_missing) {
+			revents = ssa_upstream_retransfer(svc, events);
 		} else {
+			svc->conn_dataup.full_xfer = 0;
 			svc->conn_dataup.ssa_db->data_tbl_cnt = ssa_db_calculate_data_tbl_num(svc->conn_dataup.ssa_db);
 			epoch = ssa_db_get_epoch(svc->conn_dataup.ssa_db,
 						 DB_DEF_TBL_ID);
@@ -1463,7 +1942,7 @@ ssa_log(SSA_LOG_DEFAULT, "ssa_db %p epoch 0x%" PRIx64 " complete with num tables
 						    0, NULL, epoch);
 if (db_previous)
 ssa_log(SSA_LOG_DEFAULT, "destroying previous ssa_db %p\n", db_previous);
-			ssa_db_destroy(db_previous);
+			ssa_db_release(db_previous);
 			db_previous = svc->conn_dataup.ssa_db;
 ssa_log(SSA_LOG_DEFAULT, "previous ssa_db now %p\n", db_previous);
 		}
@@ -2307,6 +2786,8 @@ static void ssa_downstream_conn(struct ssa_svc *svc, struct ssa_conn *conn,
 		msg.hdr.type = SSA_CONN_DONE;
 	msg.hdr.len = sizeof(msg);
 	ssa_conn_msg_init(conn, &msg);
+	/* downstream workers report their connections concurrently */
+	pthread_mutex_lock(&downstream_conn_lock);
 	if (conn->dbtype == SSA_CONN_PRDB_TYPE) {
 		ret = write(svc->sock_accessdown[0], (char *) &msg, sizeof msg);
 		if (ret != sizeof msg)
@@ -2317,6 +2798,7 @@ static void ssa_downstream_conn(struct ssa_svc *svc, struct ssa_conn *conn,
 	if (ret != sizeof msg)
 		ssa_log_err(SSA_LOG_CTRL, "%d out of %d bytes written\n",
 			    ret, sizeof msg);
+	pthread_mutex_unlock(&downstream_conn_lock);
 }
 
 static short ssa_downstream_send(struct ssa_conn *conn, uint16_t op,
@@ -2381,14 +2863,59 @@ static short ssa_downstream_send(struct ssa_conn *conn, uint16_t op,
 	return events;
 }
 
+/*
+ * Writes the table into the RDMA window of the peer and then sends the
+ * header-only response locating it there. Both go over the same
+ * rsocket, so the header can't overtake the data.
+ */
+static short ssa_downstream_send_bulk(struct ssa_conn *conn, uint16_t op,
+				      uint32_t id, void *buf, size_t len,
+				      short events)
+{
+	int ret;
+
+	conn->sbuf2 = malloc(sizeof(struct ssa_msg_hdr));
+	if (!conn->sbuf2) {
+		ssa_log_err(SSA_LOG_CTRL,
+			    "failed to allocate ssa_msg_hdr for op %u "
+			    "on rsock %d\n", op, conn->rsock);
+		return events;
+	}
+	conn->ssize2 = sizeof(struct ssa_msg_hdr);
+	ssa_init_ssa_msg_hdr(conn->sbuf2, op, conn->ssize2, SSA_MSG_FLAG_RESP,
+			     id, len, conn->bulk_offset + conn->bulk_pos);
+
+	conn->sbuf = buf;
+	conn->ssize = len;
+	conn->soffset = 0;
+	conn->rdma_offset = conn->bulk_offset + conn->bulk_pos;
+	conn->rdma_write = 1;
+	conn->bulk_pos += SSA_BULK_ALIGN(len);
+
+	ret = riowrite(conn->rsock, conn->sbuf, conn->ssize,
+		       conn->rdma_offset, MSG_DONTWAIT);
+	if (ret >= 0) {
+		conn->soffset += ret;
+		if (conn->soffset == conn->ssize)
+			return ssa_riowrite_continue(conn, events);
+		return POLLOUT | POLLIN;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return POLLOUT | POLLIN;
+	ssa_log_err(SSA_LOG_CTRL,
+		    "riowrite failed: %d (%s) for op %u on rsock %d\n",
+		    errno, strerror(errno), op, conn->rsock);
+	return events;
+}
+
 static struct ssa_db *ssa_downstream_db(struct ssa_conn *conn)
 {
-	/* Use SSA DB if available; otherwise use preloaded DB */
-	if (conn->ssa_db)
-		return conn->ssa_db;
-	if (conn->dbtype == SSA_CONN_SMDB_TYPE)
-		return smdb;
-	return NULL;
+	/*
+	 * SMDB transfers use the reference acquired on the DEF query,
+	 * since downstream workers can't read the published SMDB
+	 * while the downstream thread replaces it.
+	 */
+	return conn->ssa_db;
 }
 
 static short ssa_downstream_handle_query_defs(struct ssa_conn *conn,
@@ -2396,8 +2923,16 @@ static short ssa_downstream_handle_query_defs(struct ssa_conn *conn,
 					      short events)
 {
 	struct ssa_db *ssadb;
+	uint16_t flags;
 	short revents = events;
 
+	/* transfer keeps its SMDB epoch while newer one is installed */
+	if (conn->phase == SSA_DB_IDLE && conn->dbtype == SSA_CONN_SMDB_TYPE &&
+	    !conn->ssa_db) {
+		conn->ssa_db = ssa_db_acquire(&smdb_ref);
+ssa_log(SSA_LOG_DEFAULT, "SMDB %p reference taken on rsock %d\n", conn->ssa_db, conn->rsock);
+	}
+
 	ssadb = ssa_downstream_db(conn);
 	if (!ssadb) {
 ssa_log(SSA_LOG_DEFAULT, "No ssa_db or prdb as yet\n");
@@ -2410,20 +2945,45 @@ ssa_log(SSA_LOG_DEFAULT, "No ssa_db or prdb as yet\n");
 	}
 
 	if (conn->phase == SSA_DB_IDLE) {
-		if (conn->dbtype == SSA_CONN_SMDB_TYPE) {
-			smdb_refcnt++;
-ssa_log(SSA_LOG_DEFAULT, "SMDB %p ref count was just incremented to %u\n", ssadb, smdb_refcnt);
-		}
 		conn->phase = SSA_DB_DEFS;
 		conn->rid = ntohl(hdr->id);
 		conn->roffset = 0;
+		conn->sindex = 0;
+		conn->stream = db_stream &&
+			       (ntohs(hdr->flags) & SSA_MSG_FLAG_STREAM);
+		conn->bulk = db_rdma &&
+			     (ntohs(hdr->flags) & SSA_MSG_FLAG_RDMA) ?
+			     SSA_BULK_NEGOTIATED : SSA_BULK_NONE;
+		conn->tbl_epoch = db_tbl_epoch &&
+				  conn->dbtype == SSA_CONN_SMDB_TYPE &&
+				  (ntohs(hdr->flags) & SSA_MSG_FLAG_TBL_EPOCH) ?
+				  SSA_TBL_EPOCH_NEGOTIATED : SSA_TBL_EPOCH_NONE;
+		conn->tbl_log = db_tbl_log && conn->tbl_epoch &&
+				(ntohs(hdr->flags) & SSA_MSG_FLAG_TBL_LOG);
+		conn->compress = db_compress &&
+				 (ntohs(hdr->flags) & SSA_MSG_FLAG_COMPRESS);
+		flags = SSA_MSG_FLAG_RESP;
+		if (conn->stream)
+			flags |= SSA_MSG_FLAG_STREAM;
+		if (conn->bulk)
+			flags |= SSA_MSG_FLAG_RDMA;
+		if (conn->tbl_epoch)
+			flags |= SSA_MSG_FLAG_TBL_EPOCH;
+		if (conn->tbl_log)
+			flags |= SSA_MSG_FLAG_TBL_LOG;
+		if (conn->compress)
+			flags |= SSA_MSG_FLAG_COMPRESS;
 		revents = ssa_downstream_send(conn,
-					      SSA_MSG_DB_QUERY_DEF,
-					      SSA_MSG_FLAG_RESP,
+					      SSA_MSG_DB_QUERY_DEF, flags,
 					      conn->rid, 0,
 					      &ssadb->db_def,
 					      sizeof(ssadb->db_def),
 					      events);
+		if (conn->stream) {
+			ssa_log(SSA_LOG_CTRL, "streaming transfer on rsock %d\n",
+				conn->rsock);
+			revents |= POLLOUT;
+		}
 	} else
 		ssa_log_warn(SSA_LOG_CTRL,
 			     "rsock %d phase %d not SSA_DB_IDLE "
@@ -2535,11 +3095,88 @@ ssa_log(SSA_LOG_DEFAULT, "pp_field_tables index %d %p len %d rsock %d\n", conn->
 	return revents;
 }
 
+/* Table epochs held by the peer follow the first data table query */
+static void ssa_downstream_peer_epochs(struct ssa_conn *conn,
+				       struct ssa_msg_hdr *hdr)
+{
+	be64_t *epochs = (be64_t *) (hdr + 1);
+	int i, cnt;
+
+	conn->tbl_epoch = SSA_TBL_EPOCH_ADVERTISED;
+	if (!(ntohs(hdr->flags) & SSA_MSG_FLAG_TBL_EPOCH) ||
+	    ntohl(hdr->len) <= sizeof(*hdr))
+		return;
+
+	cnt = (ntohl(hdr->len) - sizeof(*hdr)) / sizeof(*epochs);
+	conn->peer_epochs = malloc(cnt * sizeof(*conn->peer_epochs));
+	if (!conn->peer_epochs) {
+		ssa_log_err(SSA_LOG_CTRL,
+			    "unable to allocate %d table epochs on rsock %d\n",
+			    cnt, conn->rsock);
+		return;
+	}
+	for (i = 0; i < cnt; i++)
+		conn->peer_epochs[i] = ntohll(epochs[i]);
+	conn->peer_epoch_cnt = cnt;
+}
+
+/*
+ * Sends a data table or table log by rsend, compressed when compression
+ * is negotiated, the table reaches db_compress_threshold and it shrinks.
+ * The compressed copy belongs to the connection until the next table is
+ * sent or the transfer ends.
+ */
+static short ssa_downstream_send_tbl(struct ssa_conn *conn, uint16_t flags,
+				     void *buf, size_t len, short events)
+{
+	uint64_t zsize;
+	long usec;
+
+	free(conn->zbuf);
+	conn->zbuf = NULL;
+	if (conn->compress && db_compress_threshold >= 0 &&
+	    len >= (size_t) db_compress_threshold) {
+		usec = ssa_cpu_usec();
+		conn->zbuf = ssa_db_compress(buf, len, &zsize);
+		usec = ssa_cpu_usec() - usec;
+		if (!conn->zbuf)
+			zsize = len;
+		ssa_update_compress_counters(len, zsize, usec);
+		ssa_log(SSA_LOG_CTRL, "table %d %" PRIu64 " bytes %s %" PRIu64
+			" bytes in %ld usec on rsock %d\n", conn->sindex,
+			(uint64_t) len, conn->zbuf ? "compressed to" : "not shrunk, sent",
+			zsize, usec, conn->rsock);
+		if (conn->zbuf) {
+			flags |= SSA_MSG_FLAG_COMPRESS;
+			buf = conn->zbuf;
+			len = zsize;
+		}
+	}
+
+	return ssa_downstream_send(conn, SSA_MSG_DB_QUERY_DATA_DATASET, flags,
+				   conn->rid, 0, buf, len, events);
+}
+
+/* Log taking the table held by the peer to the one being sent, if any */
+static const void *ssa_downstream_tbl_log(struct ssa_conn *conn,
+					  struct ssa_db *ssadb,
+					  uint64_t *p_size)
+{
+	if (!conn->tbl_log || conn->sindex >= conn->peer_epoch_cnt)
+		return NULL;
+
+	return ssa_db_get_log(ssadb, conn->sindex,
+			      conn->peer_epochs[conn->sindex], p_size);
+}
+
 static short ssa_downstream_handle_query_data(struct ssa_conn *conn,
 					      struct ssa_msg_hdr *hdr,
 					      short events)
 {
 	struct ssa_db *ssadb;
+	const void *log;
+	uint64_t log_size;
+	size_t size;
 	short revents = events;
 
 	ssadb = ssa_downstream_db(conn);
@@ -2558,22 +3195,70 @@ static short ssa_downstream_handle_query_data(struct ssa_conn *conn,
 	} else if (conn->phase == SSA_DB_DATA) {
 		conn->rid = ntohl(hdr->id);
 		conn->roffset = 0;
+		if (conn->bulk == SSA_BULK_NEGOTIATED) {
+			/* first table query passes the RDMA window */
+			conn->bulk_len = ntohl(hdr->rdma_len);
+			conn->bulk_offset = ntohll(hdr->rdma_addr);
+			conn->bulk_pos = 0;
+			conn->bulk = conn->bulk_len ? SSA_BULK_WINDOW :
+						      SSA_BULK_NONE;
+			ssa_log(SSA_LOG_CTRL, "RDMA window %u bytes at 0x%"
+				PRIx64 " on rsock %d\n", conn->bulk_len,
+				conn->bulk_offset, conn->rsock);
+		}
+		if (conn->tbl_epoch == SSA_TBL_EPOCH_NEGOTIATED)
+			ssa_downstream_peer_epochs(conn, hdr);
 		if (conn->sindex < ssadb->data_tbl_cnt) {
-ssa_log(SSA_LOG_DEFAULT, "pp_tables index %d epoch 0x%" PRIx64 " %p len %d rsock %d\n", conn->sindex, ntohll(ssadb->p_db_tables[conn->sindex].epoch), ssadb->pp_tables[conn->sindex], ntohll(ssadb->p_db_tables[conn->sindex].set_size), conn->rsock);
-			revents = ssa_downstream_send(conn,
-						      SSA_MSG_DB_QUERY_DATA_DATASET,
-						      SSA_MSG_FLAG_RESP,
-						      conn->rid, 0,
-						      ssadb->pp_tables[conn->sindex],
-						      ntohll(ssadb->p_db_tables[conn->sindex].set_size),
-						      events);
+			size = ntohll(ssadb->p_db_tables[conn->sindex].set_size);
+ssa_log(SSA_LOG_DEFAULT, "pp_tables index %d epoch 0x%" PRIx64 " %p len %d rsock %d\n", conn->sindex, ntohll(ssadb->p_db_tables[conn->sindex].epoch), ssadb->pp_tables[conn->sindex], size, conn->rsock);
+			if (conn->sindex < conn->peer_epoch_cnt &&
+			    conn->peer_epochs[conn->sindex] != DB_EPOCH_INVALID &&
+			    conn->peer_epochs[conn->sindex] ==
+			    ntohll(ssadb->p_db_tables[conn->sindex].epoch))
+				/* peer holds this table already */
+				revents = ssa_downstream_send(conn,
+							      SSA_MSG_DB_QUERY_DATA_DATASET,
+							      SSA_MSG_FLAG_RESP |
+							      SSA_MSG_FLAG_TBL_EPOCH,
+							      conn->rid, 0, NULL, 0,
+							      events);
+			else if ((log = ssa_downstream_tbl_log(conn, ssadb,
+							       &log_size)))
+				/* peer updates its table by the log */
+				revents = ssa_downstream_send_tbl(conn,
+								  SSA_MSG_FLAG_RESP |
+								  SSA_MSG_FLAG_TBL_LOG,
+								  (void *) log,
+								  log_size, events);
+			else if (conn->bulk == SSA_BULK_WINDOW && size &&
+			    conn->bulk_pos + SSA_BULK_ALIGN(size) <= conn->bulk_len)
+				revents = ssa_downstream_send_bulk(conn,
+								   SSA_MSG_DB_QUERY_DATA_DATASET,
+								   conn->rid,
+								   ssadb->pp_tables[conn->sindex],
+								   size, events);
+			else
+				revents = ssa_downstream_send_tbl(conn,
+								  SSA_MSG_FLAG_RESP,
+								  ssadb->pp_tables[conn->sindex],
+								  size, events);
 			conn->sindex++;
 		} else {
 			if (conn->dbtype == SSA_CONN_SMDB_TYPE) {
-				smdb_refcnt--;
-ssa_log(SSA_LOG_DEFAULT, "SMDB %p ref count was just decremented to %u\n", ssadb, smdb_refcnt);
+ssa_log(SSA_LOG_DEFAULT, "SMDB %p reference released on rsock %d\n", ssadb, conn->rsock);
+				ssa_db_release(conn->ssa_db);
+				conn->ssa_db = NULL;
 			}
 			conn->phase = SSA_DB_IDLE;
+			conn->bulk = SSA_BULK_NONE;
+			conn->tbl_epoch = SSA_TBL_EPOCH_NONE;
+			free(conn->peer_epochs);
+			conn->peer_epochs = NULL;
+			conn->peer_epoch_cnt = 0;
+			conn->tbl_log = 0;
+			conn->compress = 0;
+			free(conn->zbuf);
+			conn->zbuf = NULL;
 			revents = ssa_downstream_send(conn,
 						      SSA_MSG_DB_QUERY_DATA_DATASET,
 						      SSA_MSG_FLAG_END | SSA_MSG_FLAG_RESP,
@@ -2587,11 +3272,75 @@ ssa_log(SSA_LOG_DEFAULT, "SMDB %p ref count was just decremented to %u\n", ssadb
 	return revents;
 }
 
+static int ssa_downstream_tbl_query_pending(struct ssa_conn *conn)
+{
+	return conn->bulk == SSA_BULK_NEGOTIATED ||
+	       conn->tbl_epoch == SSA_TBL_EPOCH_NEGOTIATED;
+}
+
+/*
+ * Streaming transfer is driven by POLLOUT: each time the previous
+ * response is sent, the next one is generated by the query handler as
+ * if its query had arrived. Flow control is left to rsocket, which
+ * doesn't report POLLOUT until the peer returns send credits.
+ */
+static short ssa_downstream_stream_next(struct ssa_conn *conn, short events)
+{
+	struct ssa_msg_hdr hdr;
+	struct ssa_db *ssadb;
+	short revents;
+
+	ssadb = ssa_downstream_db(conn);
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.id = htonl(conn->rid);
+	switch (conn->phase) {
+	case SSA_DB_DEFS:
+		if (!conn->sindex) {
+			revents = ssa_downstream_handle_query_tbl_def(conn, &hdr,
+								      events);
+			conn->sindex = 1;
+		} else
+			revents = ssa_downstream_handle_query_tbl_defs(conn, &hdr,
+								       events);
+		break;
+	case SSA_DB_TBL_DEFS:
+		revents = ssa_downstream_handle_query_field_defs(conn, &hdr,
+								 events);
+		break;
+	case SSA_DB_FIELD_DEFS:
+		/* sindex past the tables once the END response is sent */
+		if (conn->sindex > ssadb->data_tbl_cnt) {
+			revents = ssa_downstream_handle_query_data(conn, &hdr,
+								   events);
+		} else {
+			if (conn->sindex == ssadb->data_tbl_cnt)
+				conn->sindex++;
+			revents = ssa_downstream_handle_query_field_defs(conn,
+									 &hdr,
+									 events);
+		}
+		break;
+	case SSA_DB_DATA:
+		/* wait for the query passing the RDMA window and epochs */
+		if (ssa_downstream_tbl_query_pending(conn))
+			return POLLIN;
+		revents = ssa_downstream_handle_query_data(conn, &hdr, events);
+		break;
+	default:
+		return POLLIN;
+	}
+
+	if (revents && conn->phase != SSA_DB_IDLE)
+		revents |= POLLOUT;
+	return revents;
+}
+
 static short ssa_downstream_handle_epoch_publish(struct ssa_conn *conn,
 						 struct ssa_svc *svc,
 						 struct ssa_msg_hdr *hdr,
 						 short events)
 {
+	uint64_t prdb_epoch;
 	short revents = events;
 
 	ssa_log_func(SSA_LOG_CTRL);
@@ -2605,8 +3354,8 @@ static short ssa_downstream_handle_epoch_publish(struct ssa_conn *conn,
 	conn->rhdr = NULL;
 	conn->rbuf = NULL;
 	if (conn->ssa_db && conn->epoch_len == sizeof(conn->prdb_epoch)) {
-		epoch = ssa_db_get_epoch(conn->ssa_db, DB_DEF_TBL_ID);
-		if (epoch != DB_EPOCH_INVALID) {
+		prdb_epoch = ssa_db_get_epoch(conn->ssa_db, DB_DEF_TBL_ID);
+		if (prdb_epoch != DB_EPOCH_INVALID) {
 			/* RDMA write current epoch for the connnection/DB so (limited) ACM restart will work */
 			revents = ssa_riowrite(conn, events);
 		}
@@ -2618,7 +3367,7 @@ static short ssa_downstream_handle_epoch_publish(struct ssa_conn *conn,
 
 static short ssa_downstream_handle_op(struct ssa_conn *conn,
 				      struct ssa_msg_hdr *hdr, short events,
-				      struct ssa_svc *svc, struct pollfd **fds)
+				      struct ssa_svc *svc)
 {
 	uint16_t op;
 	short revents = events;
@@ -2644,13 +3393,6 @@ static short ssa_downstream_handle_op(struct ssa_conn *conn,
 		break;
 	case SSA_MSG_DB_QUERY_DATA_DATASET:
 		revents = ssa_downstream_handle_query_data(conn, hdr, events);
-		if (conn->phase == SSA_DB_IDLE &&
-		    conn->dbtype == SSA_CONN_SMDB_TYPE) {
-			if (update_pending) {
-ssa_log(SSA_LOG_DEFAULT, "rsock %d in SSA_DB_IDLE phase with update pending\n", conn->rsock);
-				ssa_downstream_smdb_update_ready(conn, svc, fds);
-			}
-		}
 		break;
 	case SSA_MSG_DB_PUBLISH_EPOCH_BUF:
 		revents = ssa_downstream_handle_epoch_publish(conn, svc, hdr, events);
@@ -2663,21 +3405,66 @@ ssa_log(SSA_LOG_DEFAULT, "rsock %d in SSA_DB_IDLE phase with update pending\n",
 	return revents;
 }
 
+/*
+ * Queries are headers, except for the first data table query carrying
+ * table epochs. Its rest is received into the grown rbuf.
+ *
+ * Returns 1 if the payload is to be received, 0 if the query is
+ * complete, and -1 if the payload can't be received: it would be left
+ * in the rsock, so the connection has to be removed.
+ */
+static int ssa_downstream_rrecv_payload(struct ssa_conn *conn)
+{
+	struct ssa_msg_hdr *hdr = conn->rbuf;
+	uint32_t len = ntohl(hdr->len);
+	void *buf;
+
+	if (conn->rsize != sizeof(*hdr) || len <= sizeof(*hdr))
+		return 0;
+
+	if (len > sizeof(*hdr) + MAX_TBL_EPOCHS * sizeof(be64_t)) {
+		ssa_log_err(SSA_LOG_CTRL,
+			    "op %u length %u too long on rsock %d\n",
+			    ntohs(hdr->op), len, conn->rsock);
+		return -1;
+	}
+
+	buf = realloc(conn->rbuf, len);
+	if (!buf) {
+		ssa_log_err(SSA_LOG_CTRL,
+			    "failed to allocate %u bytes for rrecv "
+			    "on data rsock %d\n", len, conn->rsock);
+		return -1;
+	}
+	conn->rbuf = buf;
+	conn->rsize = len;
+	return 1;
+}
+
 static short ssa_downstream_rrecv(struct ssa_conn *conn, short events,
-				  struct ssa_svc *svc, struct pollfd **fds)
+				  struct ssa_svc *svc)
 {
 	struct ssa_msg_hdr *hdr;
-	int ret;
+	int ret, payload;
 	short revents = events;
 
+	if (!conn->roffset)
+		conn->rsize = sizeof(*hdr);
 	ret = rrecv(conn->rsock, conn->rbuf + conn->roffset,
 		    conn->rsize - conn->roffset, MSG_DONTWAIT);
 	if (ret > 0) {
 		conn->roffset += ret;
+		if (conn->roffset == conn->rsize) {
+			payload = ssa_downstream_rrecv_payload(conn);
+			if (payload > 0)
+				return revents;
+			if (payload < 0)
+				return 0;
+		}
 		if (conn->roffset == conn->rsize) {
 			hdr = conn->rbuf;
 			if (validate_ssa_msg_hdr(hdr)) {
-				revents = ssa_downstream_handle_op(conn, hdr, events, svc, fds);
+				revents = ssa_downstream_handle_op(conn, hdr, events, svc);
 			} else
 				ssa_log_warn(SSA_LOG_CTRL,
 					     "validate_ssa_msg_hdr failed: "
@@ -2705,10 +3492,18 @@ ssa_log(SSA_LOG_DEFAULT, "rbuf %p rsize %d roffset %d state %d phase %d\n", conn
 	return revents;
 }
 
+static short ssa_downstream_notify_db_update(struct ssa_conn *conn,
+					     uint64_t epoch)
+{
+	usleep(1000);	/* 1 msec delay is a temporary workaround so rsend does not indicate EAGAIN/EWOULDBLOCK !!! */
+
+	return ssa_downstream_send(conn, SSA_MSG_DB_UPDATE, SSA_MSG_FLAG_END,
+				   0, epoch, NULL, 0, POLLIN);
+}
+
 static short ssa_downstream_handle_rsock_revents(struct ssa_conn *conn,
 						 short events,
-						 struct ssa_svc *svc,
-						 struct pollfd **fds)
+						 struct ssa_svc *svc)
 {
 	short revents = events;
 
@@ -2734,89 +3529,231 @@ static short ssa_downstream_handle_rsock_revents(struct ssa_conn *conn,
 					    conn->rsock);
 		}
 		if (conn->rbuf) {
-			revents = ssa_downstream_rrecv(conn, events, svc, fds);
+			revents = ssa_downstream_rrecv(conn, events, svc);
 			if (!revents)
 				return 0;
 		}
 	}
 	if (events & POLLOUT) {
-		if (!conn->rdma_write)
+		if (!conn->sbuf && conn->stream)
+			revents = ssa_downstream_stream_next(conn, events);
+		else if (!conn->rdma_write)
 			revents = ssa_rsend_continue(conn, events);
 		else
 			revents = ssa_riowrite_continue(conn, events);
 	}
+	if (revents && conn->stream && conn->phase != SSA_DB_IDLE &&
+	    !(conn->phase == SSA_DB_DATA &&
+	      ssa_downstream_tbl_query_pending(conn)))
+		revents |= POLLOUT;
+
+	/* DB update arrived while streaming: notify once END is sent */
+	if (revents && conn->notify_epoch != DB_EPOCH_INVALID &&
+	    conn->phase == SSA_DB_IDLE && !conn->sbuf) {
+		ssa_log(SSA_LOG_CTRL,
+			"rsock %d sending deferred DB update notification\n",
+			conn->rsock);
+		revents = ssa_downstream_notify_db_update(conn,
+							  conn->notify_epoch);
+		conn->notify_epoch = DB_EPOCH_INVALID;
+	}
 
 	return revents;
 }
 
-static short ssa_downstream_notify_db_update(struct ssa_conn *conn,
-					     uint64_t epoch)
+/*
+ * Downstream connections are kept by pollfd slot, so events map to
+ * their connection without a lookup. Free data slots are linked through
+ * next_free and the table doubles when they run out; rsock lookups
+ * (DB updates from access) go through the rsock hash.
+ */
+struct ssa_conn_table {
+	struct pollfd		*fds;		/* polled by the downstream thread */
+	struct ssa_conn		**conns;	/* connection per pollfd slot */
+	int			*next_free;
+	int			free_head;
+	int			size;		/* allocated slots */
+	int			nfds;		/* slots passed to rpoll */
+	volatile int		count;		/* connections, read by other threads */
+	GHashTable		*rsock_hash;
+};
+
+struct ssa_downstream_worker {
+	struct ssa_svc		*svc;
+	pthread_t		thread;
+	int			sock[2];	/* commands from downstream thread */
+	int			index;
+	volatile int		pending;	/* connections handed over */
+	struct ssa_conn_table	*conn_table;
+};
+
+static void ssa_conn_table_link_free(struct ssa_conn_table *tbl,
+				     int first, int last)
 {
-	usleep(1000);	/* 1 msec delay is a temporary workaround so rsend does not indicate EAGAIN/EWOULDBLOCK !!! */
+	int slot;
 
-	return ssa_downstream_send(conn, SSA_MSG_DB_UPDATE, SSA_MSG_FLAG_END,
-				   0, epoch, NULL, 0, POLLIN);
+	for (slot = last - 1; slot >= first; slot--) {
+		tbl->fds[slot].fd = -1;	/* placeholder for downstream connections */
+		tbl->fds[slot].events = 0;
+		tbl->fds[slot].revents = 0;
+		tbl->conns[slot] = NULL;
+		tbl->next_free[slot] = tbl->free_head;
+		tbl->free_head = slot;
+	}
 }
 
-static int ssa_find_pollfd_slot(struct pollfd *fds, int nfds)
+static struct ssa_conn_table *ssa_conn_table_create(int size)
 {
+	struct ssa_conn_table *tbl;
 	int slot;
 
-	for (slot = FIRST_DATA_FD_SLOT; slot < nfds; slot++)
-		if (fds[slot].fd == -1)
-			return slot;
-	return -1;
+	tbl = calloc(1, sizeof(*tbl));
+	if (!tbl)
+		return NULL;
+
+	tbl->fds = calloc(size, sizeof(*tbl->fds));
+	tbl->conns = calloc(size, sizeof(*tbl->conns));
+	tbl->next_free = calloc(size, sizeof(*tbl->next_free));
+	tbl->rsock_hash = g_hash_table_new_full(NULL, NULL, NULL, NULL);
+	if (!tbl->fds || !tbl->conns || !tbl->next_free || !tbl->rsock_hash) {
+		if (tbl->rsock_hash)
+			g_hash_table_destroy(tbl->rsock_hash);
+		free(tbl->next_free);
+		free(tbl->conns);
+		free(tbl->fds);
+		free(tbl);
+		return NULL;
+	}
+
+	for (slot = 0; slot < FIRST_DATA_FD_SLOT; slot++)
+		tbl->fds[slot].fd = -1;
+	tbl->size = size;
+	tbl->nfds = FIRST_DATA_FD_SLOT;
+	tbl->free_head = -1;
+	ssa_conn_table_link_free(tbl, FIRST_DATA_FD_SLOT, size);
+	return tbl;
 }
 
+static void ssa_conn_table_destroy(struct ssa_conn_table *tbl)
+{
+	if (!tbl)
+		return;
+	g_hash_table_destroy(tbl->rsock_hash);
+	free(tbl->next_free);
+	free(tbl->conns);
+	free(tbl->fds);
+	free(tbl);
+}
 
-static int ssa_downstream_smdb_xfer_in_progress(struct ssa_svc *svc,
-						struct pollfd *fds, int nfds)
+/*
+ * All arrays are allocated before any of them is replaced, so the table
+ * is left intact at its old size if an allocation fails.
+ */
+static int ssa_conn_table_grow(struct ssa_conn_table *tbl)
 {
-	struct ssa_conn *conn;
-	int slot;
+	struct pollfd *fds;
+	struct ssa_conn **conns;
+	int *next_free, size = tbl->size * 2;
 
-	for (slot = FIRST_DATA_FD_SLOT; slot < nfds; slot++) {
-		if (fds[slot].fd == -1)
-			continue;
-		conn = svc->fd_to_conn[fds[slot].fd];
-		if (conn && conn->dbtype == SSA_CONN_SMDB_TYPE) {
-			if (conn->phase != SSA_DB_IDLE)
-				return 1;
-		}
+	fds = malloc(size * sizeof(*fds));
+	conns = malloc(size * sizeof(*conns));
+	next_free = malloc(size * sizeof(*next_free));
+	if (!fds || !conns || !next_free) {
+		ssa_log_err(SSA_LOG_CTRL,
+			    "unable to grow connection table to %d slots\n",
+			    size);
+		free(next_free);
+		free(conns);
+		free(fds);
+		return -1;
 	}
 
+	memcpy(fds, tbl->fds, tbl->size * sizeof(*fds));
+	memcpy(conns, tbl->conns, tbl->size * sizeof(*conns));
+	memcpy(next_free, tbl->next_free, tbl->size * sizeof(*next_free));
+	free(tbl->fds);
+	free(tbl->conns);
+	free(tbl->next_free);
+	tbl->fds = fds;
+	tbl->conns = conns;
+	tbl->next_free = next_free;
+
+	ssa_conn_table_link_free(tbl, tbl->size, size);
+	tbl->size = size;
+	ssa_log(SSA_LOG_CTRL, "connection table grown to %d slots\n", size);
 	return 0;
 }
 
-static void ssa_downstream_smdb_update_ready(struct ssa_conn *conn,
-					     struct ssa_svc *svc,
-					     struct pollfd **fds)
+static int ssa_conn_table_add(struct ssa_conn_table *tbl,
+			      struct ssa_conn *conn, short events)
 {
-	int sock;
+	int slot;
 
-if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
-	if (!ssa_downstream_smdb_xfer_in_progress(svc, (struct pollfd *)fds,
-						  FD_SETSIZE)) {
-ssa_log(SSA_LOG_DEFAULT, "No SMDB transfer currently in progress\n");
-		if (svc->port->dev->ssa->node_type & SSA_NODE_CORE)
-			sock = svc->sock_extractdown[0];
-		else if (svc->port->dev->ssa->node_type & SSA_NODE_DISTRIBUTION)
-			sock = svc->sock_updown[1];
-		else
-			sock = -1;
-		update_waiting = 1;
-		update_pending = 0;
-		if (sock >= 0)
-			ssa_send_db_update_ready(sock);
-else ssa_log(SSA_LOG_DEFAULT, "No socket for update ready message\n");
-	}
-else ssa_log(SSA_LOG_DEFAULT, "SMDB transfer currently in progress\n");
+	if (g_hash_table_lookup(tbl->rsock_hash, GINT_TO_POINTER(conn->rsock)))
+		return -1;
+	if (tbl->free_head < 0 && ssa_conn_table_grow(tbl))
+		return -1;
+
+	slot = tbl->free_head;
+	tbl->free_head = tbl->next_free[slot];
+	tbl->fds[slot].fd = conn->rsock;
+	tbl->fds[slot].events = events;
+	tbl->fds[slot].revents = 0;
+	tbl->conns[slot] = conn;
+	conn->slot = slot;
+	g_hash_table_insert(tbl->rsock_hash, GINT_TO_POINTER(conn->rsock), conn);
+	if (slot >= tbl->nfds)
+		tbl->nfds = slot + 1;
+	__sync_add_and_fetch(&tbl->count, 1);
+	return slot;
+}
+
+static void ssa_conn_table_remove(struct ssa_conn_table *tbl, int slot)
+{
+	g_hash_table_remove(tbl->rsock_hash,
+			    GINT_TO_POINTER(tbl->fds[slot].fd));
+	tbl->fds[slot].fd = -1;
+	tbl->fds[slot].events = 0;
+	tbl->fds[slot].revents = 0;
+	if (tbl->conns[slot])
+		tbl->conns[slot]->slot = -1;
+	tbl->conns[slot] = NULL;
+	tbl->next_free[slot] = tbl->free_head;
+	tbl->free_head = slot;
+	__sync_sub_and_fetch(&tbl->count, 1);
+	while (tbl->nfds > FIRST_DATA_FD_SLOT &&
+	       tbl->fds[tbl->nfds - 1].fd == -1)
+		tbl->nfds--;
+}
+
+/* Tables of downstream workers are counted by the downstream thread too */
+static int ssa_conn_table_count(struct ssa_conn_table *tbl)
+{
+	return __sync_fetch_and_add(&tbl->count, 0);
+}
+
+static struct ssa_conn *ssa_conn_table_lookup(struct ssa_conn_table *tbl,
+					      int rsock)
+{
+	return g_hash_table_lookup(tbl->rsock_hash, GINT_TO_POINTER(rsock));
 }
 
+/* Closes remaining connections on shutdown */
+static void ssa_conn_table_close(struct ssa_conn_table *tbl)
+{
+	int slot;
+
+	for (slot = FIRST_DATA_FD_SLOT; slot < tbl->nfds; slot++) {
+		if (tbl->conns[slot] && tbl->conns[slot]->rsock >= 0) {
+			ssa_close_ssa_conn(tbl->conns[slot]);
+			ssa_conn_table_remove(tbl, slot);
+		}
+	}
+	ssa_conn_table_destroy(tbl);
+}
 
 static void ssa_downstream_close_ssa_conn(struct ssa_conn *conn,
-					  struct ssa_svc *svc,
-					  struct pollfd **fds)
+					  struct ssa_svc *svc)
 {
 ssa_log(SSA_LOG_DEFAULT, "conn %p phase %d dbtype %d\n", conn, conn->phase, conn->dbtype);
 
@@ -2825,13 +3762,11 @@ ssa_log(SSA_LOG_DEFAULT, "conn %p phase %d dbtype %d\n", conn, conn->phase, conn
 			ssa_downstream_conn(svc, conn, 1);
 			ssa_close_ssa_conn(conn);
 		} else if (conn->dbtype == SSA_CONN_SMDB_TYPE) {
-			smdb_refcnt--;
-ssa_log(SSA_LOG_DEFAULT, "SMDB %p ref count was just decremented to %u\n", ssa_downstream_db(conn), smdb_refcnt);
+ssa_log(SSA_LOG_DEFAULT, "SMDB %p reference released on rsock %d\n", conn->ssa_db, conn->rsock);
+			ssa_db_release(conn->ssa_db);
+			conn->ssa_db = NULL;
 			ssa_downstream_conn(svc, conn, 1);
 			ssa_close_ssa_conn(conn);
-ssa_log(SSA_LOG_DEFAULT, "SMDB transfer in progress %d update pending %d\n", ssa_downstream_smdb_xfer_in_progress(svc, (struct pollfd *)fds, FD_SETSIZE), update_pending);
-			if (update_pending)
-				ssa_downstream_smdb_update_ready(conn, svc, fds);
 		}
 	} else {
 		ssa_downstream_conn(svc, conn, 1);
@@ -2839,12 +3774,148 @@ ssa_log(SSA_LOG_DEFAULT, "SMDB transfer in progress %d update pending %d\n", ssa
 	}
 }
 
-static void ssa_check_listen_events(struct ssa_svc *svc, struct pollfd **fds,
-				    int conn_dbtype)
+static void ssa_downstream_remove_conn(struct ssa_svc *svc,
+				       struct ssa_conn_table *tbl, int slot)
+{
+	ssa_downstream_close_ssa_conn(tbl->conns[slot], svc);
+	ssa_conn_table_remove(tbl, slot);
+}
+
+static void ssa_downstream_close_conns(struct ssa_svc *svc,
+				       struct ssa_conn_table *tbl)
+{
+	int slot;
+
+	for (slot = FIRST_DATA_FD_SLOT; slot < tbl->nfds; slot++) {
+		if (tbl->conns[slot] && tbl->conns[slot]->rsock >= 0)
+			ssa_downstream_remove_conn(svc, tbl, slot);
+	}
+}
+
+static int ssa_downstream_children(struct ssa_svc *svc)
+{
+	int i, count = ssa_conn_table_count(svc->conn_table);
+
+	for (i = 0; i < svc->num_workers; i++)
+		count += ssa_conn_table_count(svc->workers[i].conn_table);
+	return count;
+}
+
+/*
+ * Starts serving an accepted connection. The SMDB update notification
+ * state is passed by the caller, as downstream workers don't see
+ * the downstream thread's.
+ */
+static int ssa_downstream_add_conn(struct ssa_svc *svc,
+				   struct ssa_conn_table *tbl,
+				   struct ssa_conn *conn_data,
+				   int notify, uint64_t smdb_epoch)
+{
+	int slot;
+
+	if (ssa_conn_table_lookup(tbl, conn_data->rsock)) {
+		ssa_log_warn(SSA_LOG_CTRL,
+			     "rsock %d in connection table already occupied\n",
+			     conn_data->rsock);
+		return -1;
+	}
+
+	slot = ssa_conn_table_add(tbl, conn_data, POLLIN);
+	if (slot < 0) {
+		ssa_log_warn(SSA_LOG_CTRL,
+			     "no pollfd slot available for rsock %d\n",
+			     conn_data->rsock);
+		return -1;
+	}
+
+	if (conn_data->dbtype == SSA_CONN_PRDB_TYPE)
+		ssa_log(SSA_LOG_DEFAULT,
+			"PRDB connection accepted, but access notification is deferred until RDMA epoch buffer is published\n");
+	else {
+		ssa_downstream_conn(svc, conn_data, 0);
+		if (notify)
+			tbl->fds[slot].events = ssa_downstream_notify_db_update(conn_data, smdb_epoch);
+else ssa_log(SSA_LOG_DEFAULT, "SMDB connection accepted but notify DB update deferred since update is waiting or no SMDB\n");
+	}
+	return 0;
+}
+
+/* Drops connections from the GID of a newly accepted connection */
+static void ssa_downstream_drop_gid(struct ssa_svc *svc,
+				    struct ssa_conn_table *tbl,
+				    struct ssa_conn *conn_data,
+				    union ibv_gid *remote_gid)
+{
+	int slot;
+
+	for (slot = FIRST_DATA_FD_SLOT; slot < tbl->nfds; slot++) {
+		if (tbl->conns[slot] &&
+		    tbl->conns[slot]->rsock >= 0 &&
+		    tbl->conns[slot] != conn_data &&
+		    !memcmp(tbl->conns[slot]->remote_gid.raw,
+			    remote_gid->raw, 16)) {
+			ssa_sprint_addr(SSA_LOG_CTRL, log_data,
+					sizeof log_data, SSA_ADDR_GID,
+					remote_gid->raw,
+					sizeof remote_gid->raw);
+			ssa_log_warn(SSA_LOG_CTRL,
+				     "removing old connection for "
+				     "rsock %d GID %s LID %u\n",
+				     tbl->fds[slot].fd, log_data,
+				     tbl->conns[slot]->remote_lid);
+
+			ssa_downstream_remove_conn(svc, tbl, slot);
+		}
+	}
+}
+
+static void ssa_downstream_worker_send(struct ssa_downstream_worker *worker,
+				       struct ssa_ctrl_msg *msg)
+{
+	int ret;
+
+	ret = write(worker->sock[0], (char *) msg, msg->len);
+	if (ret != msg->len)
+		ssa_log_err(SSA_LOG_CTRL,
+			    "%d out of %d bytes written to downstream worker %d\n",
+			    ret, msg->len, worker->index);
+}
+
+static void ssa_downstream_workers_send(struct ssa_svc *svc,
+					struct ssa_ctrl_msg *msg)
+{
+	int i;
+
+	for (i = 0; i < svc->num_workers; i++)
+		ssa_downstream_worker_send(&svc->workers[i], msg);
+}
+
+/* Least loaded worker, ties are broken round robin */
+static struct ssa_downstream_worker *
+ssa_downstream_pick_worker(struct ssa_svc *svc)
+{
+	struct ssa_downstream_worker *worker, *best = NULL;
+	int i, load, best_load = INT_MAX;
+
+	for (i = 0; i < svc->num_workers; i++) {
+		worker = &svc->workers[(svc->next_worker + i) % svc->num_workers];
+		load = ssa_conn_table_count(worker->conn_table) +
+		       __sync_fetch_and_add(&worker->pending, 0);
+		if (load < best_load) {
+			best = worker;
+			best_load = load;
+		}
+	}
+	svc->next_worker = (best->index + 1) % svc->num_workers;
+	return best;
+}
+
+static void ssa_check_listen_events(struct ssa_svc *svc, int conn_dbtype)
 {
+	struct ssa_downstream_worker *worker;
+	struct ssa_conn_add_msg msg;
 	struct ssa_conn *conn_data;
-	struct pollfd *pfd;
-	int fd, slot, i;
+	int fd;
 
 	conn_data = malloc(sizeof(*conn_data));
 	if (conn_data) {
@@ -2853,108 +3924,89 @@ static void ssa_check_listen_events(struct ssa_svc *svc, struct pollfd **fds,
 		fd = ssa_downstream_svc_server(svc, conn_data);
 		if (fd >= 0) {
 			ssa_set_runtime_counter_time(COUNTER_ID_TIME_LAST_DOWNSTR_CONN);
-			if (!svc->fd_to_conn[fd]) {
-				svc->fd_to_conn[fd] = conn_data;
-				pfd = (struct  pollfd *)fds;
-				slot = ssa_find_pollfd_slot(pfd, FD_SETSIZE);
-				if (slot >= 0) {
-					pfd = (struct  pollfd *)(fds + slot);
-					pfd->fd = fd;
-					pfd->events = POLLIN;
-					pfd->revents = 0;
-					if (conn_dbtype == SSA_CONN_PRDB_TYPE)
-						ssa_log(SSA_LOG_DEFAULT,
-							"PRDB connection accepted, but access notification is deferred until RDMA epoch buffer is published\n");
-					else if (conn_dbtype == SSA_CONN_SMDB_TYPE) {
-						ssa_downstream_conn(svc, conn_data, 0);
-						if (!update_pending && !update_waiting && smdb)
-							pfd->events = ssa_downstream_notify_db_update(conn_data, epoch);
-else ssa_log(SSA_LOG_DEFAULT, "SMDB connection accepted but notify DB update deferred since update is pending %d or waiting %d or no SMDB\n", update_pending, update_waiting);
-					} else {
-						ssa_close_ssa_conn(conn_data);
-						free(conn_data);
-						conn_data = NULL;
-						svc->fd_to_conn[fd] = NULL;
-						ssa_log_warn(SSA_LOG_CTRL,
-							     "connection db type %d not PRDB or SMDB\n",
-							     conn_dbtype);
-					}
-				} else {
-					ssa_close_ssa_conn(conn_data);
-					free(conn_data);
-					conn_data = NULL;
-					svc->fd_to_conn[fd] = NULL;
-					ssa_log_warn(SSA_LOG_CTRL,
-						     "no pollfd slot available for rsock %d\n",
-						     fd);
-				}
-			} else {
+			if (conn_dbtype != SSA_CONN_PRDB_TYPE &&
+			    conn_dbtype != SSA_CONN_SMDB_TYPE) {
 				ssa_close_ssa_conn(conn_data);
 				free(conn_data);
 				conn_data = NULL;
 				ssa_log_warn(SSA_LOG_CTRL,
-					     "rsock %d in fd_to_conn array already occupied\n",
-					     fd);
+					     "connection db type %d not PRDB or SMDB\n",
+					     conn_dbtype);
+			} else if (svc->num_workers) {
+				worker = ssa_downstream_pick_worker(svc);
+				ssa_log(SSA_LOG_CTRL,
+					"rsock %d handed over to downstream worker %d\n",
+					fd, worker->index);
+				msg.hdr.len = sizeof(msg);
+				msg.hdr.type = SSA_CONN_ADD;
+				msg.data.conn = conn_data;
+				msg.data.remote_gid = conn_data->remote_gid;
+				msg.data.epoch = epoch;
+				msg.data.notify = !update_waiting && smdb_ref.p_db;
+				__sync_add_and_fetch(&worker->pending, 1);
+				ssa_downstream_worker_send(worker, &msg.hdr);
+			} else if (ssa_downstream_add_conn(svc, svc->conn_table,
+							   conn_data,
+							   !update_waiting && smdb_ref.p_db,
+							   epoch)) {
+				ssa_close_ssa_conn(conn_data);
+				free(conn_data);
+				conn_data = NULL;
 			}
 		}
 	} else
 		ssa_log_err(SSA_LOG_DEFAULT, "struct ssa_conn allocation failed\n");
 
 	if (conn_data) {
-		for (i = 0; i < FD_SETSIZE; i++) {
-			if (svc->fd_to_conn[i] &&
-			    svc->fd_to_conn[i]->rsock >= 0 &&
-			    svc->fd_to_conn[i] != conn_data &&
-			    !memcmp(svc->fd_to_conn[i]->remote_gid.raw,
-				    conn_data->remote_gid.raw, 16)) {
-				ssa_sprint_addr(SSA_LOG_CTRL, log_data,
-						sizeof log_data, SSA_ADDR_GID,
-						conn_data->remote_gid.raw,
-						sizeof conn_data->remote_gid.raw);
-				ssa_log_warn(SSA_LOG_CTRL,
-					     "removing old connection for "
-					     "rsock %d GID %s LID %u\n",
-					     i, log_data, conn_data->remote_lid);
-
-				ssa_downstream_close_ssa_conn(svc->fd_to_conn[i],
-							      svc, fds);
-				svc->fd_to_conn[i] = NULL;
-
-				for (slot = FIRST_DATA_FD_SLOT; slot < FD_SETSIZE; slot++) {
-					pfd = (struct pollfd *)(fds + slot);
-					if (pfd->fd == i) {
-						pfd->fd = -1;
-						pfd->events = 0;
-						pfd->revents = 0;
-						break;
-					}
-				}
-
-				if (slot == FD_SETSIZE)
-					ssa_log_err(SSA_LOG_DEFAULT,
-						    "unable to find rsock %d in fd_to_conn struct\n", i);
-			}
-		}
+		if (svc->num_workers) {
+			/* handed over connection is queued ahead of the drop */
+			msg.hdr.type = SSA_CONN_DROP;
+			ssa_downstream_workers_send(svc, &msg.hdr);
+		} else
+			ssa_downstream_drop_gid(svc, svc->conn_table, conn_data,
+						&conn_data->remote_gid);
 	}
 }
 
 static void ssa_downstream_notify_smdb_conns(struct ssa_svc *svc,
-					     struct pollfd *fds, int nfds,
+					     struct ssa_conn_table *tbl,
 					     uint64_t epoch)
 {
 	struct ssa_conn *conn;
-	struct pollfd *pfd;
 	int slot;
 
-	for (slot = FIRST_DATA_FD_SLOT; slot < nfds; slot++) {
-		if (fds[slot].fd == -1)
-			continue;
-		conn = svc->fd_to_conn[fds[slot].fd];
-		if (conn && conn->dbtype == SSA_CONN_SMDB_TYPE) {
-			pfd = (struct pollfd *)(fds + slot);
-			pfd->events = ssa_downstream_notify_db_update(conn, epoch);
-		}
+	for (slot = FIRST_DATA_FD_SLOT; slot < tbl->nfds; slot++) {
+		conn = tbl->conns[slot];
+		if (conn && conn->dbtype == SSA_CONN_SMDB_TYPE) {
+			/* streamed responses are still being sent */
+			if (conn->stream &&
+			    (conn->phase != SSA_DB_IDLE || conn->sbuf)) {
+				ssa_log(SSA_LOG_CTRL,
+					"rsock %d streaming transfer in progress, "
+					"deferring DB update notification\n",
+					conn->rsock);
+				conn->notify_epoch = epoch;
+				continue;
+			}
+			tbl->fds[slot].events = ssa_downstream_notify_db_update(conn, epoch);
+		}
+	}
+}
+
+static void ssa_downstream_notify_smdb(struct ssa_svc *svc, uint64_t epoch)
+{
+	struct ssa_db_update_msg msg;
+
+	if (!svc->num_workers) {
+		ssa_downstream_notify_smdb_conns(svc, svc->conn_table, epoch);
+		return;
 	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.hdr.len = sizeof(msg);
+	msg.hdr.type = SSA_DB_NOTIFY;
+	msg.db_upd.epoch = epoch;
+	ssa_downstream_workers_send(svc, &msg.hdr);
 }
 
 static void ssa_send_db_update_ready(int fd)
@@ -2978,11 +4030,12 @@ static void ssa_send_db_update_ready(int fd)
 }
 
 static void ssa_downstream_dev_event(struct ssa_svc *svc,
-				     struct ssa_ctrl_msg_buf *msg,
-				     struct pollfd **fds)
+				     struct ssa_ctrl_msg_buf *msg)
 {
+#if 0
+	struct ssa_conn_table *tbl = svc->conn_table;
 	struct pollfd *pfd;
-	int i, slot;
+#endif
 
 	ssa_log(SSA_LOG_VERBOSE | SSA_LOG_CTRL, "%s %s\n", svc->name,
 		ibv_event_type_str(msg->data.event));
@@ -2994,7 +4047,7 @@ static void ssa_downstream_dev_event(struct ssa_svc *svc,
 		/* Core node became MASTER */
 		if (svc->port->state == IBV_PORT_ACTIVE &&
 		    svc->port->sm_lid == svc->port->lid) {
-			ssa_downstream_start_listen(svc, fds);
+			ssa_downstream_start_listen(svc);
 			break;
 		}
 		/*
@@ -3006,73 +4059,366 @@ static void ssa_downstream_dev_event(struct ssa_svc *svc,
 		/* Listening rsockets are not closed, due to RDMA CM library limitation */
 		if (svc->conn_listen_smdb.rsock >= 0) {
 			ssa_close_ssa_conn(&svc->conn_listen_smdb);
-			pfd = (struct pollfd *)(fds + SMDB_LISTEN_FD_SLOT);
+			pfd = &tbl->fds[SMDB_LISTEN_FD_SLOT];
 			pfd->fd = -1;
 			pfd->events = 0;
 			pfd->revents = 0;
 		}
 		if (svc->conn_listen_prdb.rsock >= 0) {
 			ssa_close_ssa_conn(&svc->conn_listen_prdb);
-			pfd = (struct pollfd *)(fds + PRDB_LISTEN_FD_SLOT);
+			pfd = &tbl->fds[PRDB_LISTEN_FD_SLOT];
 			pfd->fd = -1;
 			pfd->events = 0;
 			pfd->revents = 0;
 		}
 #endif
-		for (i = 0; i < FD_SETSIZE; i++) {
-			if (svc->fd_to_conn[i] &&
-			    svc->fd_to_conn[i]->rsock >= 0) {
-				ssa_downstream_close_ssa_conn(svc->fd_to_conn[i],
-							      svc, fds);
-				svc->fd_to_conn[i] = NULL;
-
-				for (slot = FIRST_DATA_FD_SLOT; slot < FD_SETSIZE; slot++) {
-					pfd = (struct pollfd *)(fds + slot);
-					if (pfd->fd == i) {
-						pfd->fd = -1;
-						pfd->events = 0;
-						pfd->revents = 0;
-						break;
-					}
-				}
-
-				if (slot == FD_SETSIZE)
-					ssa_log_err(SSA_LOG_DEFAULT,
-						    "unable to find rsock %d in fd_to_conn struct\n", i);
-			}
-		}
+		ssa_downstream_close_conns(svc, svc->conn_table);
+		ssa_downstream_workers_send(svc, &msg->hdr);
 		break;
 	case IBV_EVENT_PORT_ACTIVE:
-		ssa_downstream_start_listen(svc, fds);
+		ssa_downstream_start_listen(svc);
 		break;
 	default:
 		break;
 	}
 }
 
-static void ssa_downstream_start_listen(struct ssa_svc *svc, struct pollfd **fds)
+static void ssa_downstream_start_listen(struct ssa_svc *svc)
 {
 	struct pollfd *pfd;
 
 	if (svc->port->dev->ssa->node_type &
 	    (SSA_NODE_CORE | SSA_NODE_DISTRIBUTION)) {
-		pfd = (struct pollfd *)(fds + SMDB_LISTEN_FD_SLOT);
+		pfd = &svc->conn_table->fds[SMDB_LISTEN_FD_SLOT];
 		pfd->fd = ssa_downstream_listen(svc, &svc->conn_listen_smdb, smdb_port);
 	}
 
 	if (svc->port->dev->ssa->node_type & SSA_NODE_ACCESS) {
-		pfd = (struct pollfd *)(fds + PRDB_LISTEN_FD_SLOT);
+		pfd = &svc->conn_table->fds[PRDB_LISTEN_FD_SLOT];
 		pfd->fd = ssa_downstream_listen(svc, &svc->conn_listen_prdb, prdb_port);
 	}
 }
 
+/*
+ * Hands an access PRDB over to its connection in the table.
+ * Returns 0 when the update was consumed, -1 when its GID has no
+ * connection in the table.
+ */
+static int ssa_downstream_prdb_update(struct ssa_svc *svc,
+				      struct ssa_conn_table *tbl,
+				      struct ssa_db_update *db_upd)
+{
+	struct ssa_conn *conn;
+	int slot;
+
+	/* Use rsock in DB update msg as hint */
+	conn = ssa_conn_table_lookup(tbl, db_upd->rsock);
+	if (!conn || conn->rsock != db_upd->rsock ||
+	    memcmp(conn->remote_gid.raw,
+		   db_upd->remote_gid.raw, 16)) {
+		conn = NULL;
+		/* Full search when rsock hint doesn't work */
+		for (slot = FIRST_DATA_FD_SLOT; slot < tbl->nfds; slot++) {
+			if (tbl->conns[slot] &&
+			    tbl->conns[slot]->rsock >= 0 &&
+			    !memcmp(tbl->conns[slot]->remote_gid.raw,
+				    db_upd->remote_gid.raw, 16)) {
+				conn = tbl->conns[slot];
+				break;
+			}
+		}
+	}
+
+	if (conn && conn->rsock != db_upd->rsock) {
+		ssa_sprint_addr(SSA_LOG_DEFAULT, log_data, sizeof log_data,
+				SSA_ADDR_GID, db_upd->remote_gid.raw,
+				sizeof db_upd->remote_gid.raw);
+		ssa_log_warn(SSA_LOG_DEFAULT,
+			     "client %s reconnected from rsock %d to rsock %d\n",
+			     log_data,
+			     db_upd->rsock,
+			     conn->rsock);
+	}
+
+	/* Now ready to rsend to downstream client upon request */
+	if (!conn || conn->state != SSA_CONN_CONNECTED)
+		return -1;
+
+	if (conn->phase == SSA_DB_IDLE &&
+	    conn->epoch_len > 0) {
+		uint64_t prdb_epoch;
+		struct ssa_db *prdb_destroy = NULL;
+
+		prdb_epoch = ssa_db_get_epoch(db_upd->db, DB_DEF_TBL_ID);
+
+		if (prdb_epoch > conn->epoch ||
+		    conn->epoch == DB_EPOCH_INVALID) {
+			if (conn->ssa_db)
+				prdb_destroy = conn->ssa_db;
+			conn->ssa_db = db_upd->db;
+			conn->epoch = prdb_epoch;
+			conn->prdb_epoch = htonll(conn->epoch);
+			ssa_log(SSA_LOG_DEFAULT, "PRDB %p epoch 0x%" PRIx64 " epoch length %d\n", conn->ssa_db, ntohll(conn->prdb_epoch), conn->epoch_len);
+			if (conn->epoch_len ==
+			    sizeof(conn->prdb_epoch)) {
+				tbl->fds[conn->slot].events = ssa_riowrite(conn, POLLIN);
+			} else
+				ssa_log(SSA_LOG_DEFAULT,
+					"epoch length is %d but should be %d\n",
+					conn->epoch_len,
+					sizeof(conn->prdb_epoch));
+		} else
+			prdb_destroy = db_upd->db;
+
+		ssa_db_release(prdb_destroy);
+
+#ifdef ACCESS
+	} else {
+		struct ssa_db_update retry;
+
+		ssa_db_update_init(svc, db_upd->db,
+				   db_upd->remote_lid,
+				   &db_upd->remote_gid,
+				   conn->rsock,
+				   0, 0, &retry);
+		ssa_push_db_update(&update_queue, &retry);
+#endif
+	}
+
+	return 0;
+}
+
+static void ssa_downstream_handle_conn_events(struct ssa_svc *svc,
+					      struct ssa_conn_table *tbl)
+{
+	struct pollfd *pfd;
+	int i;
+
+	for (i = FIRST_DATA_FD_SLOT; i < tbl->nfds; i++) {
+		pfd = &tbl->fds[i];
+		if (pfd->revents) {
+			if (pfd->revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				char event_str[128] = {};
+
+				ssa_format_event(event_str,
+						 sizeof(event_str),
+						 pfd->revents);
+				ssa_log_err(SSA_LOG_DEFAULT,
+					    "error event 0x%x (%s) on rsock %d\n",
+					    pfd->revents, event_str, pfd->fd);
+				/* Update distribution tree (at least when core) ? */
+				/* Also, when not core, need to notify core via SSA MAD */
+				if (tbl->conns[i])
+					ssa_downstream_remove_conn(svc, tbl, i);
+				else {
+					pfd->fd = -1;
+					pfd->events = 0;
+				}
+			} else {
+				if (tbl->conns[i]) {
+					pfd->events = ssa_downstream_handle_rsock_revents(tbl->conns[i], pfd->revents, svc);
+					if (!pfd->events)
+						ssa_downstream_remove_conn(svc, tbl, i);
+				} else {
+					char event_str[128] = {};
+
+					ssa_format_event(event_str,
+							 sizeof(event_str),
+							 pfd->revents);
+					ssa_log_warn(SSA_LOG_CTRL,
+						     "event 0x%x (%s) on data rsock %d pollfd slot %d but connection table slot is empty\n",
+						     pfd->revents,
+						     event_str,
+						     pfd->fd, i);
+				}
+			}
+		}
+		pfd->revents = 0;
+	}
+}
+
+static void *ssa_downstream_worker_handler(void *context)
+{
+	struct ssa_downstream_worker *worker = context;
+	struct ssa_svc *svc = worker->svc;
+	struct ssa_conn_table *tbl = worker->conn_table;
+	struct ssa_conn *conn;
+	struct pollfd *pfd;
+	int ret;
+	struct ssa_ctrl_msg_buf msg;
+
+	SET_THREAD_NAME(worker->thread, "DN%d_%s", worker->index, svc->name);
+
+	ssa_log(SSA_LOG_VERBOSE | SSA_LOG_CTRL, "%s worker %d\n",
+		svc->name, worker->index);
+	pfd = &tbl->fds[0];
+	pfd->fd = worker->sock[1];
+	pfd->events = POLLIN;
+	pfd->revents = 0;
+
+	for (;;) {
+		ret = rpoll(tbl->fds, tbl->nfds, -1);
+		if (ret < 0) {
+			ssa_log_err(SSA_LOG_CTRL, "polling fds %d (%s)\n",
+				    errno, strerror(errno));
+			continue;
+		}
+		pfd = &tbl->fds[0];
+		if (pfd->revents) {
+			pfd->revents = 0;
+			ret = read(worker->sock[1], (char *) &msg,
+				   sizeof msg.hdr);
+			if (ret != sizeof msg.hdr)
+				ssa_log_err(SSA_LOG_CTRL,
+					    "%d out of %d header bytes read from downstream\n",
+					    ret, sizeof msg.hdr);
+			if (msg.hdr.len > sizeof msg.hdr) {
+				ret = read(worker->sock[1],
+					   (char *) &msg.hdr.data,
+					   msg.hdr.len - sizeof msg.hdr);
+				if (ret != msg.hdr.len - sizeof msg.hdr)
+					ssa_log_err(SSA_LOG_CTRL,
+						    "%d out of %d additional bytes read from downstream\n",
+						    ret,
+						    msg.hdr.len - sizeof msg.hdr);
+			}
+
+			switch (msg.hdr.type) {
+			case SSA_CONN_ADD:
+				conn = msg.data.conn_add.conn;
+				if (ssa_downstream_add_conn(svc, tbl, conn,
+							    msg.data.conn_add.notify,
+							    msg.data.conn_add.epoch)) {
+					ssa_close_ssa_conn(conn);
+					free(conn);
+				}
+				__sync_sub_and_fetch(&worker->pending, 1);
+				break;
+			case SSA_CONN_DROP:
+				ssa_downstream_drop_gid(svc, tbl,
+							msg.data.conn_add.conn,
+							&msg.data.conn_add.remote_gid);
+				break;
+			case SSA_DB_UPDATE:
+				if (ssa_downstream_prdb_update(svc, tbl,
+							       &msg.data.db_upd))
+					ssa_db_release(msg.data.db_upd.db);
+				break;
+			case SSA_DB_NOTIFY:
+				ssa_downstream_notify_smdb_conns(svc, tbl,
+								 msg.data.db_upd.epoch);
+				break;
+			case SSA_CTRL_DEV_EVENT:
+				ssa_downstream_close_conns(svc, tbl);
+				break;
+			case SSA_CTRL_EXIT:
+				goto out;
+			default:
+				ssa_log_warn(SSA_LOG_CTRL,
+					     "ignoring unexpected msg type %d "
+					     "from downstream\n",
+					     msg.hdr.type);
+				break;
+			}
+		}
+
+		ssa_downstream_handle_conn_events(svc, tbl);
+	}
+
+out:
+	return NULL;
+}
+
+/*
+ * Downstream connections are sharded over worker threads, each polling
+ * its own connection table. The downstream thread keeps accepting and
+ * hands connections and DB updates over by control messages.
+ */
+static void ssa_downstream_start_workers(struct ssa_svc *svc, int num)
+{
+	struct ssa_downstream_worker *worker;
+	int i, ret;
+
+	if (num > MAX_DOWNSTREAM_WORKERS) {
+		ssa_log_warn(SSA_LOG_CTRL,
+			     "%d downstream workers requested, using %d\n",
+			     num, MAX_DOWNSTREAM_WORKERS);
+		num = MAX_DOWNSTREAM_WORKERS;
+	}
+
+	svc->workers = calloc(num, sizeof(*svc->workers));
+	if (!svc->workers) {
+		ssa_log_err(SSA_LOG_CTRL,
+			    "unable to allocate %d downstream workers\n", num);
+		return;
+	}
+
+	for (i = 0; i < num; i++) {
+		worker = &svc->workers[i];
+		worker->svc = svc;
+		worker->index = i;
+		worker->conn_table = ssa_conn_table_create(CONN_TABLE_INIT_SIZE / num + FIRST_DATA_FD_SLOT);
+		if (!worker->conn_table) {
+			ssa_log_err(SSA_LOG_CTRL,
+				    "unable to allocate worker %d connection table\n",
+				    i);
+			break;
+		}
+
+		ret = socketpair(AF_UNIX, SOCK_STREAM, 0, worker->sock);
+		if (ret) {
+			ssa_log_err(SSA_LOG_CTRL,
+				    "creating downstream/worker socketpair\n");
+			ssa_conn_table_destroy(worker->conn_table);
+			worker->conn_table = NULL;
+			break;
+		}
+
+		ret = pthread_create(&worker->thread, NULL,
+				     ssa_downstream_worker_handler, worker);
+		if (ret) {
+			ssa_log_err(SSA_LOG_CTRL,
+				    "error %d creating downstream worker %d thread\n",
+				    ret, i);
+			close(worker->sock[0]);
+			close(worker->sock[1]);
+			ssa_conn_table_destroy(worker->conn_table);
+			worker->conn_table = NULL;
+			break;
+		}
+	}
+
+	/* serve from the downstream thread if no worker could be started */
+	svc->num_workers = i;
+	if (!svc->num_workers) {
+		free(svc->workers);
+		svc->workers = NULL;
+	}
+	ssa_log(SSA_LOG_CTRL, "%s: %d downstream workers started\n",
+		svc->name, svc->num_workers);
+}
+
+static void ssa_downstream_stop_workers(struct ssa_svc *svc)
+{
+	struct ssa_ctrl_msg msg;
+	int i;
+
+	msg.len = sizeof msg;
+	msg.type = SSA_CTRL_EXIT;
+	for (i = 0; i < svc->num_workers; i++) {
+		ssa_downstream_worker_send(&svc->workers[i], &msg);
+		pthread_join(svc->workers[i].thread, NULL);
+		close(svc->workers[i].sock[0]);
+		close(svc->workers[i].sock[1]);
+	}
+}
+
 static void *ssa_downstream_handler(void *context)
 {
 	struct ssa_svc *svc = context;
-	struct pollfd **fds;
-	struct pollfd *pfd, *pfd2;
-	struct ssa_conn *conn;
-	int ret, i, count;
+	struct ssa_conn_table *tbl;
+	struct pollfd *pfd;
+	int ret, i;
 	struct ssa_ctrl_msg_buf msg;
 
 	SET_THREAD_NAME(svc->downstream, "DN_%s", svc->name);
@@ -3085,50 +4431,47 @@ static void *ssa_downstream_handler(void *context)
 		ssa_log_err(SSA_LOG_CTRL, "%d out of %d bytes written\n",
 			    ret, sizeof msg.hdr);
 
-	fds = calloc(FD_SETSIZE, sizeof(**fds));
-	if (!fds)
+	tbl = ssa_conn_table_create(CONN_TABLE_INIT_SIZE);
+	if (!tbl)
 		goto out;
-	pfd = (struct pollfd *)fds;
+	svc->conn_table = tbl;
+	pfd = &tbl->fds[0];
 	pfd->fd = svc->sock_downctrl[1];
 	pfd->events = POLLIN;
 	pfd->revents = 0;
-	pfd = (struct pollfd *)(fds + 1);
+	pfd = &tbl->fds[1];
 	pfd->fd = svc->sock_accessdown[0];
 	pfd->events = POLLIN;
 	pfd->revents = 0;
-	pfd = (struct pollfd *)(fds + 2);
+	pfd = &tbl->fds[2];
 	pfd->fd = svc->sock_updown[1];
 	pfd->events = POLLIN;
 	pfd->revents = 0;
-	pfd = (struct pollfd *)(fds + 3);
+	pfd = &tbl->fds[3];
 	pfd->fd = svc->sock_extractdown[0];
 	pfd->events = POLLIN;
 	pfd->revents = 0;
-	pfd = (struct pollfd *)(fds + SMDB_LISTEN_FD_SLOT);
+	pfd = &tbl->fds[SMDB_LISTEN_FD_SLOT];
 	pfd->fd = -1;	/* placeholder for SMDB listen rsock */
 	pfd->events = POLLIN;
 	pfd->revents = 0;
-	pfd = (struct pollfd *)(fds + PRDB_LISTEN_FD_SLOT);
+	pfd = &tbl->fds[PRDB_LISTEN_FD_SLOT];
 	pfd->fd = -1;	/* placeholder for PRDB listen rsock */
 	pfd->events = POLLIN;
 	pfd->revents = 0;
-	for (i = FIRST_DATA_FD_SLOT; i < FD_SETSIZE; i++) {
-		pfd = (struct pollfd *)(fds + i);
-		pfd->fd = -1;	/* placeholder for downstream connections */
-		pfd->events = 0;
-		pfd->revents = 0;
-	}
-	update_pending = 0;
 	update_waiting = 0;
 
+	if (downstream_workers > 0)
+		ssa_downstream_start_workers(svc, downstream_workers);
+
 	for (;;) {
-		ret = rpoll((struct pollfd *)fds, FD_SETSIZE, -1);
+		ret = rpoll(tbl->fds, tbl->nfds, -1);
 		if (ret < 0) {
 			ssa_log_err(SSA_LOG_CTRL, "polling fds %d (%s)\n",
 				    errno, strerror(errno));
 			continue;
 		}
-		pfd = (struct pollfd *)fds;
+		pfd = &tbl->fds[0];
 		if (pfd->revents) {
 			pfd->revents = 0;
 			ret = read(svc->sock_downctrl[1], (char *) &msg,
@@ -3154,12 +4497,12 @@ static void *ssa_downstream_handler(void *context)
 
 			switch (msg.hdr.type) {
 			case SSA_LISTEN:
-				ssa_downstream_start_listen(svc, fds);
+				ssa_downstream_start_listen(svc);
 				break;
 			case SSA_CTRL_EXIT:
 				goto out;
 			case SSA_CTRL_DEV_EVENT:
-				ssa_downstream_dev_event(svc, &msg, fds);
+				ssa_downstream_dev_event(svc, &msg);
 				break;
 			default:
 				ssa_log_warn(SSA_LOG_CTRL,
@@ -3170,7 +4513,7 @@ static void *ssa_downstream_handler(void *context)
 			}
 		}
 
-		pfd = (struct pollfd *)(fds + 1);
+		pfd = &tbl->fds[1];
 		if (pfd->revents) {
 			pfd->revents = 0;
 			ret = read(svc->sock_accessdown[0], (char *) &msg,
@@ -3205,79 +4548,15 @@ static void *ssa_downstream_handler(void *context)
 					msg.data.db_upd.rsock, log_data,
 					msg.data.db_upd.remote_lid,
 					msg.data.db_upd.db);
-				conn = NULL;
-				/* Use rsock in DB update msg as hint */
-				i = msg.data.db_upd.rsock;
-				if (svc->fd_to_conn[i] &&
-				    svc->fd_to_conn[i]->rsock == i &&
-				    !memcmp(svc->fd_to_conn[i]->remote_gid.raw,
-					    msg.data.db_upd.remote_gid.raw, 16)) {
-					conn = svc->fd_to_conn[i];
-				} else {
-					/* Full search when rsock hint doesn't work */
-					for (i = 0; i < FD_SETSIZE; i++) {
-						if (svc->fd_to_conn[i] &&
-						    svc->fd_to_conn[i]->rsock >= 0 &&
-						    !memcmp(svc->fd_to_conn[i]->remote_gid.raw,
-							    msg.data.db_upd.remote_gid.raw, 16)) {
-							conn = svc->fd_to_conn[i];
-							break;
-						}
-					}
-				}
-
-				if (conn && conn->rsock != msg.data.db_upd.rsock)
-					ssa_log_warn(SSA_LOG_DEFAULT,
-						     "client %s reconnected from rsock %d to rsock %d\n",
-						     log_data,
-						     msg.data.db_upd.rsock,
-						     conn->rsock);
-
-				/* Now ready to rsend to downstream client upon request */
-				if (conn && conn->state == SSA_CONN_CONNECTED) {
-					if (conn->phase == SSA_DB_IDLE &&
-					    conn->epoch_len > 0) {
-						uint64_t prdb_epoch;
-						struct ssa_db *prdb_destroy = NULL;
-
-						prdb_epoch = ssa_db_get_epoch(msg.data.db_upd.db, DB_DEF_TBL_ID);
-
-						if (prdb_epoch > conn->epoch ||
-						    conn->epoch == DB_EPOCH_INVALID) {
-							if (conn->ssa_db)
-								prdb_destroy = conn->ssa_db;
-							conn->ssa_db = msg.data.db_upd.db;
-							conn->epoch = prdb_epoch;
-							conn->prdb_epoch = htonll(conn->epoch);
-							ssa_log(SSA_LOG_DEFAULT, "PRDB %p epoch 0x%" PRIx64 " epoch length %d\n", conn->ssa_db, ntohll(conn->prdb_epoch), conn->epoch_len);
-							if (conn->epoch_len ==
-							    sizeof(conn->prdb_epoch)) {
-								pfd2 = (struct pollfd *)(fds + i);
-								pfd2->events = ssa_riowrite(conn, POLLIN);
-							} else
-								ssa_log(SSA_LOG_DEFAULT,
-									"epoch length is %d but should be %d\n",
-									conn->epoch_len,
-									sizeof(conn->prdb_epoch));
-						} else
-							prdb_destroy = msg.data.db_upd.db;
-
-						ssa_db_destroy(prdb_destroy);
-
-#ifdef ACCESS
-					} else {
-						struct ssa_db_update db_upd;
-
-						ssa_db_update_init(svc, msg.data.db_upd.db,
-								   msg.data.db_upd.remote_lid,
-								   &msg.data.db_upd.remote_gid,
-								   conn->rsock,
-								   0, 0, &db_upd);
-						ssa_push_db_update(&update_queue,
-								   &db_upd);
-#endif
+				if (svc->num_workers) {
+					for (i = 0; i < svc->num_workers; i++) {
+						ssa_db_get(msg.data.db_upd.db);
+						ssa_downstream_worker_send(&svc->workers[i],
+									   &msg.hdr);
 					}
-				} else {
+					ssa_db_release(msg.data.db_upd.db);
+				} else if (ssa_downstream_prdb_update(svc, tbl,
+								      &msg.data.db_upd)) {
 					ssa_sprint_addr(SSA_LOG_CTRL, log_data,
 							sizeof log_data, SSA_ADDR_GID,
 							msg.data.db_upd.remote_gid.raw,
@@ -3285,7 +4564,7 @@ static void *ssa_downstream_handler(void *context)
 					ssa_log_warn(SSA_LOG_CTRL,
 						     "DB update for GID %s currently not connected\n",
 						     log_data);
-					ssa_db_destroy(msg.data.db_upd.db);
+					ssa_db_release(msg.data.db_upd.db);
 				}
 				break;
 			default:
@@ -3297,7 +4576,7 @@ static void *ssa_downstream_handler(void *context)
 			}
 		}
 
-		pfd = (struct pollfd *)(fds + 2);
+		pfd = &tbl->fds[2];
 		if (pfd->revents) {
 			pfd->revents = 0;
 			ret = read(svc->sock_updown[1], (char *) &msg,
@@ -3325,29 +4604,21 @@ static void *ssa_downstream_handler(void *context)
 			case SSA_DB_UPDATE_PREPARE:
 ssa_log(SSA_LOG_DEFAULT, "SSA_DB_UPDATE_PREPARE from upstream\n");
 if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
-				if (ssa_downstream_smdb_xfer_in_progress(svc,
-									 (struct pollfd *)fds,
-									 FD_SETSIZE)) {
-ssa_log(SSA_LOG_DEFAULT, "SMDB transfer currently in progress\n");
-					update_pending = 1;
-				} else {
-ssa_log(SSA_LOG_DEFAULT, "No SMDB transfer currently in progress\n");
-					update_waiting = 1;
-if (update_pending) ssa_log(SSA_LOG_DEFAULT, "unexpected update pending!\n");
-					ssa_send_db_update_ready(svc->sock_updown[1]);
-				}
+				/*
+				 * SMDB transfers in progress hold references
+				 * to their SMDB, so update can proceed
+				 */
+				update_waiting = 1;
+				ssa_send_db_update_ready(svc->sock_updown[1]);
 				break;
 			case SSA_DB_UPDATE:
 				ssa_log(SSA_LOG_DEFAULT,
 					"SSA DB update (SMDB) from upstream: ssa_db %p epoch 0x%" PRIx64 "\n",
 					msg.data.db_upd.db, msg.data.db_upd.epoch);
-				smdb = msg.data.db_upd.db;
+				ssa_db_publish(&smdb_ref, msg.data.db_upd.db);
 				update_waiting = 0;
 				epoch = msg.data.db_upd.epoch;
-				ssa_downstream_notify_smdb_conns(svc,
-								 (struct pollfd *)fds,
-								 FD_SETSIZE,
-								 epoch);
+				ssa_downstream_notify_smdb(svc, epoch);
 				break;
 			default:
 				ssa_log_warn(SSA_LOG_CTRL,
@@ -3358,7 +4629,7 @@ if (update_pending) ssa_log(SSA_LOG_DEFAULT, "unexpected update pending!\n");
 			}
 		}
 
-		pfd = (struct pollfd *)(fds + 3);
+		pfd = &tbl->fds[3];
 		if (pfd->revents) {
 			pfd->revents = 0;
 			ret = read(svc->sock_extractdown[0], (char *) &msg,
@@ -3385,31 +4656,23 @@ if (update_pending) ssa_log(SSA_LOG_DEFAULT, "unexpected update pending!\n");
 			case SSA_DB_UPDATE_PREPARE:
 ssa_log(SSA_LOG_DEFAULT, "SSA_DB_UPDATE_PREPARE from extract\n");
 if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
-				if (ssa_downstream_smdb_xfer_in_progress(svc,
-									 (struct pollfd *)fds,
-									 FD_SETSIZE)) {
-ssa_log(SSA_LOG_DEFAULT, "SMDB transfer currently in progress\n");
-					update_pending = 1;
-				} else {
-ssa_log(SSA_LOG_DEFAULT, "No SMDB transfer currently in progress\n");
-					update_waiting = 1;
-if (update_pending) ssa_log(SSA_LOG_DEFAULT, "unexpected update pending!\n");
-					ssa_send_db_update_ready(svc->sock_extractdown[0]);
-				}
+				/*
+				 * SMDB transfers in progress hold references
+				 * to their SMDB, so update can proceed
+				 */
+				update_waiting = 1;
+				ssa_send_db_update_ready(svc->sock_extractdown[0]);
 				break;
 			case SSA_DB_UPDATE:
 				ssa_log(SSA_LOG_DEFAULT,
 					"SSA DB update (SMDB) from extract: ssa_db %p flags 0x%x epoch 0x%" PRIx64 "\n",
 					msg.data.db_upd.db, msg.data.db_upd.flags,
 					msg.data.db_upd.epoch);
-				smdb = msg.data.db_upd.db;
+				ssa_db_publish(&smdb_ref, msg.data.db_upd.db);
 				update_waiting = 0;
 				epoch = msg.data.db_upd.epoch;
 				if (msg.data.db_upd.flags & SSA_DB_UPDATE_CHANGE)
-					ssa_downstream_notify_smdb_conns(svc,
-									 (struct pollfd *)fds,
-									 FD_SETSIZE,
-									 epoch);
+					ssa_downstream_notify_smdb(svc, epoch);
 				break;
 			default:
 				ssa_log_warn(SSA_LOG_CTRL,
@@ -3420,7 +4683,7 @@ if (update_pending) ssa_log(SSA_LOG_DEFAULT, "unexpected update pending!\n");
 			}
 		}
 
-		pfd = (struct pollfd *)(fds + SMDB_LISTEN_FD_SLOT);
+		pfd = &tbl->fds[SMDB_LISTEN_FD_SLOT];
 		if (pfd->revents & (POLLERR | POLLHUP | POLLNVAL)) {
 			char event_str[128] = {};
 
@@ -3439,10 +4702,11 @@ if (update_pending) ssa_log(SSA_LOG_DEFAULT, "unexpected update pending!\n");
 #endif
 		} else if (pfd->revents) {
 			pfd->revents = 0;
-			ssa_check_listen_events(svc, fds, SSA_CONN_SMDB_TYPE);
+			ssa_check_listen_events(svc, SSA_CONN_SMDB_TYPE);
 		}
 
-		pfd = (struct pollfd *)(fds + PRDB_LISTEN_FD_SLOT);
+		/* table may have grown on accepting the connection */
+		pfd = &tbl->fds[PRDB_LISTEN_FD_SLOT];
 		if (pfd->revents & (POLLERR | POLLHUP | POLLNVAL)) {
 			char event_str[128] = {};
 
@@ -3461,62 +4725,16 @@ if (update_pending) ssa_log(SSA_LOG_DEFAULT, "unexpected update pending!\n");
 #endif
 		} else if (pfd->revents) {
 			pfd->revents = 0;
-			ssa_check_listen_events(svc, fds, SSA_CONN_PRDB_TYPE);
+			ssa_check_listen_events(svc, SSA_CONN_PRDB_TYPE);
 		}
 
-		count = 0;
-		for (i = FIRST_DATA_FD_SLOT; i < FD_SETSIZE; i++) {
-			pfd = (struct pollfd *)(fds + i);
-			if (pfd->fd >= 0)
-				count++;
-			if (pfd->revents) {
-				if (pfd->revents & (POLLERR | POLLHUP | POLLNVAL)) {
-					char event_str[128] = {};
-
-					ssa_format_event(event_str,
-							 sizeof(event_str),
-							 pfd->revents);
-					ssa_log_err(SSA_LOG_DEFAULT,
-						    "error event 0x%x (%s) on rsock %d\n",
-						    pfd->revents, event_str, pfd->fd);
-					/* Update distribution tree (at least when core) ? */
-					/* Also, when not core, need to notify core via SSA MAD */
-					if (svc->fd_to_conn[pfd->fd])
-						ssa_downstream_close_ssa_conn(svc->fd_to_conn[pfd->fd], svc, fds);
-					svc->fd_to_conn[pfd->fd] = NULL;
-					pfd->fd = -1;
-					pfd->events = 0;
-					pfd->revents = 0;
-				} else {
-					if (svc->fd_to_conn[pfd->fd]) {
-						pfd->events = ssa_downstream_handle_rsock_revents(svc->fd_to_conn[pfd->fd], pfd->revents, svc, fds);
-						if (!pfd->events) {
-							ssa_downstream_close_ssa_conn(svc->fd_to_conn[pfd->fd], svc, fds);
-							svc->fd_to_conn[pfd->fd] = NULL;
-							pfd->fd = -1;
-						}
-					} else {
-						char event_str[128] = {};
-
-						ssa_format_event(event_str,
-								 sizeof(event_str),
-								 pfd->revents);
-						ssa_log_warn(SSA_LOG_CTRL,
-							     "event 0x%x (%s) on data rsock %d pollfd slot %d but fd_to_conn slot is empty\n",
-							     pfd->revents,
-							     event_str,
-							     pfd->fd, i);
-					}
-				}
-			}
-			pfd->revents = 0;
-		}
-		ssa_set_runtime_counter(COUNTER_ID_NUM_CHILDREN, count);
+		ssa_downstream_handle_conn_events(svc, tbl);
+		ssa_set_runtime_counter(COUNTER_ID_NUM_CHILDREN,
+					ssa_downstream_children(svc));
 	}
 
 out:
-	if (fds)
-		free(fds);
+	ssa_downstream_stop_workers(svc);
 	return NULL;
 }
 
@@ -3548,7 +4766,9 @@ static void ssa_access_send_db_update(struct ssa_svc *svc, struct ssa_db *db,
 }
 
 static struct ssa_db *ssa_calculate_prdb(struct ssa_svc *svc,
-					 struct ssa_access_member *consumer)
+					 struct ssa_access_member *consumer,
+					 struct ssa_db *access_smdb,
+					 void *context)
 {
 	struct ssa_db *prdb = NULL;
 	struct ssa_db *prdb_copy = NULL;
@@ -3557,15 +4777,33 @@ static struct ssa_db *ssa_calculate_prdb(struct ssa_svc *svc,
 	char dump_dir[1024];
 	struct stat dstat;
 
-	epoch = ssa_db_get_epoch(access_context.smdb, DB_DEF_TBL_ID);
+	epoch = ssa_db_get_epoch(access_smdb, DB_DEF_TBL_ID);
 	prdb_epoch = ssa_db_get_epoch(consumer->prdb_current, DB_DEF_TBL_ID);
 
+	if (!context) {
+		ssa_log_err(SSA_LOG_CTRL,
+			    "no path record snapshot for SMDB with epoch 0x%" PRIx64 "\n",
+			    epoch);
+		return NULL;
+	}
+
 	/* Call below "pulls" in access layer for any node type (if ACCESS defined) !!! */
-	ret = ssa_pr_compute_half_world(access_context.smdb,
-					access_context.context,
-					consumer->gid.global.interface_id,
-					&prdb);
-	if (ret == SSA_PR_PORT_ABSENT) {
+	ret = ssa_pr_compute_half_world_delta(access_smdb, context,
+					      consumer->gid.global.interface_id,
+					      consumer->prdb_current,
+					      consumer->smdb_epoch, &prdb);
+	if (ret == SSA_PR_SUCCESS && !prdb) {
+		/* only destinations not affected by SMDB changes */
+		ssa_sprint_addr(SSA_LOG_CTRL, log_data, sizeof log_data,
+				SSA_ADDR_GID, consumer->gid.raw,
+				sizeof consumer->gid.raw);
+		ssa_log(SSA_LOG_CTRL,
+			"PRDB for GID %s is not affected by SMDB changes. "
+			"Previous PRDB epoch 0x%" PRIx64 "\n",
+			log_data, prdb_epoch);
+		consumer->smdb_epoch = epoch;
+		return NULL;
+	} else if (ret == SSA_PR_PORT_ABSENT) {
 		ssa_sprint_addr(SSA_LOG_DEFAULT, log_data, sizeof log_data,
 				SSA_ADDR_GID, consumer->gid.raw,
 				sizeof consumer->gid.raw);
@@ -3579,9 +4817,12 @@ static struct ssa_db *ssa_calculate_prdb(struct ssa_svc *svc,
 				     ". Last used epoch 0x%" PRIx64 "\n",
 				     log_data, epoch, consumer->smdb_epoch);
 	} else if (ret == SSA_PR_SUCCESS) {
+		/* kept with the PRDB, once it becomes the current one */
+		ssa_db_update_digests(prdb);
 		if (consumer->prdb_current) {
 			ret = ssa_db_cmp(prdb, consumer->prdb_current);
 			if (!ret) {
+				consumer->smdb_epoch = epoch;
 				ssa_sprint_addr(SSA_LOG_CTRL, log_data, sizeof log_data,
 						SSA_ADDR_GID, consumer->gid.raw,
 						sizeof consumer->gid.raw);
@@ -3606,20 +4847,28 @@ static struct ssa_db *ssa_calculate_prdb(struct ssa_svc *svc,
 			 * structure.
 			 */
 			if (ret != 1) {
-				ssa_db_destroy(prdb);
+				ssa_db_release(prdb);
 				return NULL;
 			}
 		}
 
-		prdb_copy = ssa_db_copy(prdb);
-		if (!prdb_copy) {
+		/* v2 encoding fails if there are too many path attributes */
+		if (prdb_v2)
+			prdb_copy = ssa_prdb_encode_v2(prdb);
+		if (!prdb_copy && prdb_lmc_compress)
+			prdb_copy = ssa_prdb_compress_lmc(prdb);
+		if (!prdb_copy && prdb_lmc_compress) {
 			ssa_sprint_addr(SSA_LOG_DEFAULT, log_data, sizeof log_data,
 					SSA_ADDR_GID, consumer->gid.raw,
 					sizeof consumer->gid.raw);
 			ssa_log_warn(SSA_LOG_DEFAULT,
-				     "PRDB copy not created for GID %s for SMDB with epoch 0x%" PRIx64 "\n",
+				     "PR LMC copy not created for GID %s for SMDB with epoch 0x%" PRIx64
+				     ", sending v1 path records\n",
 				     log_data, epoch);
 		}
+		/* consumers are never left without the new PRDB */
+		if (!prdb_copy)
+			prdb_copy = ssa_db_get(prdb);
 
 		if (prdb_dump) {
 			n = snprintf(dump_dir, sizeof(dump_dir),
@@ -3666,7 +4915,7 @@ static struct ssa_db *ssa_calculate_prdb(struct ssa_svc *svc,
 						    errno, strerror(errno));
 					goto skip_db_save;
 				}
-				ssa_db_save(dump_dir, access_context.smdb,
+				ssa_db_save(dump_dir, access_smdb,
 					    err_smdb_dump);
 			}
 			ssa_log(SSA_LOG_DEFAULT, "SMDB dump %s\n", dump_dir);
@@ -3684,8 +4933,11 @@ skip_db_save:
 		if (actual_epoch == DB_EPOCH_INVALID)
 			ssa_log(SSA_LOG_VERBOSE, "PRDB copy epoch set failed\n");
 		consumer->smdb_epoch = epoch;
-		ssa_db_destroy(consumer->prdb_current);
+		ssa_db_release(consumer->prdb_current);
 		consumer->prdb_current = prdb;
+		/* sent as is when the consumer reconnects */
+		ssa_db_release(consumer->prdb_encoded);
+		consumer->prdb_encoded = ssa_db_get(prdb_copy ? prdb_copy : prdb);
 	}
 	return prdb_copy;
 }
@@ -3788,14 +5040,16 @@ static void g_al_callback(gpointer task, gpointer user_data)
 	ssa_log(SSA_LOG_DEFAULT,
 		"calculating PRDB for GID %s LID %u client\n",
 		log_data, consumer->lid);
-	prdb = ssa_calculate_prdb(svc, consumer);
+	prdb = ssa_calculate_prdb(svc, consumer, al_task->smdb,
+				  al_task->context);
+	ssa_pr_put_snapshot(al_task->context);
 	ssa_log(SSA_LOG_DEFAULT,
 		"GID %s LID %u rsock %d PRDB %p calculation complete\n",
 		log_data, consumer->lid, consumer->rsock, prdb);
 #ifdef SIM_SUPPORT_FAKE_ACM
 	if (ACM_FAKE_RSOCKET_ID == consumer->rsock) {
 		if (prdb)
-			ssa_db_destroy(prdb);
+			ssa_db_release(prdb);
 		goto out;
 	}
 #endif
@@ -3806,7 +5060,7 @@ static void g_al_callback(gpointer task, gpointer user_data)
 					   0, 0, &db_upd);
 			ssa_push_db_update(&update_queue, &db_upd);
 		} else
-			ssa_db_destroy(prdb);
+			ssa_db_release(prdb);
 	} else
 		ssa_log(SSA_LOG_DEFAULT, "No new PRDB calculated\n");
 #ifdef SIM_SUPPORT_FAKE_ACM
@@ -3856,6 +5110,8 @@ static void ssa_access_map_callback(const void *nodep, const VISIT which,
 		task = calloc(1, sizeof(*task));
 		task->svc = svc;
 		task->consumer = consumer;
+		task->smdb = access_context.smdb;
+		task->context = ssa_pr_get_snapshot(access_context.context);
 		atomic_inc(&access_context.num_tasks);
 		ssa_access_process_task(task);
 	}
@@ -4021,7 +5277,7 @@ static void *ssa_access_handler(void *context)
 	struct pollfd **fds = NULL;
 	struct pollfd *pfd;
 	struct ssa_ctrl_msg_buf msg;
-	struct ssa_db *prdb = NULL;
+	struct ssa_db *prdb = NULL, *smdb_prev;
 	int i, ret, d, p, s, svc_cnt = 0;
 #ifdef ACCESS
 	int j;
@@ -4077,11 +5333,6 @@ static void *ssa_access_handler(void *context)
 		}
 	}
 
-	if (!access_context.context) {
-		ssa_log_err(SSA_LOG_CTRL, "access context is empty\n");
-		goto out;
-	}
-
 	pfd = (struct pollfd  *)fds;
 	pfd->fd = sock_accessctrl[1];
 	pfd->events = POLLIN;
@@ -4179,8 +5430,10 @@ if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
 					msg.data.db_upd.db, msg.data.db_upd.flags,
 					msg.data.db_upd.epoch);
 				update_waiting = 0;
-				if (!(msg.data.db_upd.flags & SSA_DB_UPDATE_CHANGE))
+				if (!(msg.data.db_upd.flags & SSA_DB_UPDATE_CHANGE)) {
+					ssa_db_release(msg.data.db_upd.db);
 					break;
+				}
 #ifdef ACCESS
 #ifdef SIM_SUPPORT_FAKE_ACM
 				if (NULL == access_context.smdb)
@@ -4190,11 +5443,10 @@ if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
 #endif
 #endif
 				/* Should epoch be added to access context ? */
+				smdb_prev = access_context.smdb;
 				access_context.smdb = msg.data.db_upd.db;
 #ifdef ACCESS
-				/* Reinit context should be based on DB update flags indicating full update */
-				ssa_pr_reinit_context(access_context.context,
-						      access_context.smdb);
+				ssa_access_update_context(access_context.smdb);
 				/* Recalculate PRDBs for all downstream ACMs!!! */
 				/* Then cause RDMA write of the PRDB epochs */
 				atomic_set(&access_context.num_tasks, 0);
@@ -4205,7 +5457,11 @@ if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
 							  svc_arr[j]);
 				}
 				ssa_access_wait_for_tasks_completion();
+				/* PRDBs of all known consumers are computed */
+				ssa_pr_release_shared(access_context.context);
 #endif
+				/* all tasks on the previous SMDB are done */
+				ssa_db_release(smdb_prev);
 				break;
 			default:
 				ssa_log_warn(SSA_LOG_CTRL,
@@ -4265,11 +5521,10 @@ if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
 #endif
 #endif
 					/* Should epoch be added to access context ? */
+					smdb_prev = access_context.smdb;
 					access_context.smdb = msg.data.db_upd.db;
 #ifdef ACCESS
-					/* Reinit context should be based on DB update flags indicating full update */
-					ssa_pr_reinit_context(access_context.context,
-							      access_context.smdb);
+					ssa_access_update_context(access_context.smdb);
 					/* Recalculate PRDBs for all downstream ACMs!!! */
 					/* Then cause RDMA write of the PRDB epochs */
 					atomic_set(&access_context.num_tasks, 0);
@@ -4278,7 +5533,10 @@ if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
 							  ssa_access_map_callback,
 							  svc_arr[i]);
 					ssa_access_wait_for_tasks_completion();
+					/* PRDBs of all known consumers are computed */
+					ssa_pr_release_shared(access_context.context);
 #endif
+					ssa_db_release(smdb_prev);
 					break;
 				default:
 					ssa_log_warn(SSA_LOG_CTRL,
@@ -4354,7 +5612,7 @@ if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
 							if (consumer->smdb_epoch ==
 							    ssa_db_get_epoch(access_context.smdb,
 									     DB_DEF_TBL_ID)) {
-								prdb = ssa_db_copy(consumer->prdb_current);
+								prdb = ssa_db_get(consumer->prdb_encoded);
 								goto skip_prdb_calc;
 							}
 						}
@@ -4362,9 +5620,11 @@ if (update_waiting) ssa_log(SSA_LOG_DEFAULT, "unexpected update waiting!\n");
 						ssa_log(SSA_LOG_DEFAULT,
 							"calculating PRDB for GID %s LID %u client\n",
 							log_data, consumer->lid);
-						prdb = ssa_calculate_prdb(svc_arr[i], consumer);
-						if (!prdb && consumer->prdb_current)
-							 prdb = ssa_db_copy(consumer->prdb_current);
+						prdb = ssa_calculate_prdb(svc_arr[i], consumer,
+									  access_context.smdb,
+									  access_context.context);
+						if (!prdb && consumer->prdb_encoded)
+							 prdb = ssa_db_get(consumer->prdb_encoded);
 #endif
 						if (!prdb)
 							continue;
@@ -4835,11 +6095,9 @@ static int ssa_downstream_svc_server(struct ssa_svc *svc, struct ssa_conn *conn)
 		return -1;
 	}
 
-	if (conn->dbtype == SSA_CONN_SMDB_TYPE &&
-	    (update_pending || update_waiting)) {
+	if (conn->dbtype == SSA_CONN_SMDB_TYPE && update_waiting) {
 		ssa_log(SSA_LOG_DEFAULT | SSA_LOG_CTRL,
-			"update pending %d or waiting %d; closing rsock %d\n",
-			update_pending, update_waiting, fd);
+			"update waiting; closing rsock %d\n", fd);
 		ssa_close_rsocket(fd);
 		return -1;
 	}
@@ -4916,7 +6174,9 @@ static int ssa_upstream_initiate_conn(struct ssa_svc *svc, short dport)
 		goto close;
 	}
 
-	if (svc->port->dev->ssa->node_type == SSA_NODE_CONSUMER) {
+	val = (svc->port->dev->ssa->node_type == SSA_NODE_CONSUMER) +
+	      (db_rdma != 0);
+	if (val) {
 		ret = rsetsockopt(svc->conn_dataup.rsock, SOL_RDMA,
 				  RDMA_IOMAPSIZE, (void *) &val, sizeof(val));
 		if (ret) {
@@ -5521,6 +6781,38 @@ static void ssa_access_wait_for_tasks_completion()
 	}
 }
 
+/*
+ * Publishes path record snapshot for a new SMDB epoch. Tasks of
+ * the previous epoch keep their own references to the previous
+ * snapshot, so it is destroyed when the last of them completes.
+ *
+ * The snapshot is built on the access thread, not swapped in from a
+ * background one: every PRDB of the new epoch is computed on it, and
+ * the access thread waits for those tasks right after. Its route
+ * cache is already filled by num_workers threads, so a separate
+ * builder would only move the wait, not shorten it.
+ */
+static void ssa_access_update_context(struct ssa_db *smdb)
+{
+	void *context;
+
+	context = ssa_pr_create_snapshot(smdb, access_context.num_workers);
+	if (!context)
+		ssa_log_err(SSA_LOG_CTRL,
+			    "unable to create path record snapshot for SMDB "
+			    "with epoch 0x%" PRIx64 "\n",
+			    ssa_db_get_epoch(smdb, DB_DEF_TBL_ID));
+	else {
+		ssa_pr_set_partitions(context, prdb_partitions);
+		if (access_context.context)
+			ssa_pr_diff_snapshot(context, access_context.context);
+	}
+
+	if (access_context.context)
+		ssa_pr_put_snapshot(access_context.context);
+	access_context.context = context;
+}
+
 static void ssa_access_process_task(struct ssa_access_task *task)
 {
 	GError *g_error = NULL;
@@ -5612,12 +6904,8 @@ int ssa_start_access(struct ssa_class *ssa)
 	}
 
 #ifdef ACCESS
-	access_context.context = ssa_pr_create_context();
-	if (!access_context.context) {
-		ssa_log_err(SSA_LOG_CTRL,
-			    "unable to create access layer context\n");
-		goto err3;
-	}
+	/* path record snapshot is created on SMDB update */
+	access_context.context = NULL;
 
 	if (ssa_db_update_queue_init(&update_queue)) {
 		ssa_log_err(SSA_LOG_CTRL,
@@ -5687,11 +6975,10 @@ err5:
 	ssa_db_update_queue_destroy(&update_queue);
 err4:
 	if (access_context.context) {
-		ssa_pr_destroy_context(access_context.context);
+		ssa_pr_put_snapshot(access_context.context);
 		access_context.context = NULL;
 		access_context.smdb = NULL;
 	}
-err3:
 #endif
 	if (sock_accessextract[0] >= 0)
 		close(sock_accessextract[0]);
@@ -5730,11 +7017,10 @@ void ssa_stop_access(struct ssa_class *ssa)
 	ssa_db_update_queue_destroy(&update_queue);
 
 	if (access_context.context) {
-		ssa_pr_destroy_context(access_context.context);
+		ssa_pr_put_snapshot(access_context.context);
 		access_context.context = NULL;
 	}
-	if (access_context.smdb != smdb)
-		ssa_db_destroy(access_context.smdb);
+	ssa_db_release(access_context.smdb);
 	access_context.smdb = NULL;
 #endif
 
@@ -6036,15 +7322,15 @@ static void ssa_stop_svc(struct ssa_svc *svc)
 
 	if (svc->conn_dataup.rsock >= 0)
 		ssa_close_ssa_conn(&svc->conn_dataup);
-	if (svc->port->dev->ssa->node_type != SSA_NODE_CONSUMER) {
-		for (i = 0; i < FD_SETSIZE; i++) {
-			if (svc->fd_to_conn[i] &&
-			    svc->fd_to_conn[i]->rsock >= 0) {
-				ssa_close_ssa_conn(svc->fd_to_conn[i]);
-				svc->fd_to_conn[i] = NULL;
-			}
-		}
-	}
+	if (svc->conn_table) {
+		ssa_conn_table_close(svc->conn_table);
+		svc->conn_table = NULL;
+	}
+	for (i = 0; i < svc->num_workers; i++)
+		ssa_conn_table_close(svc->workers[i].conn_table);
+	free(svc->workers);
+	svc->workers = NULL;
+	svc->num_workers = 0;
 	if (svc->port->dev->ssa->node_type != SSA_NODE_CONSUMER) {
 		close(svc->sock_downctrl[0]);
 		close(svc->sock_downctrl[1]);
@@ -6099,13 +7385,13 @@ void ssa_close_devices(struct ssa_class *ssa)
 	ssa->dev_cnt = 0;
 
 	/*
-	 * In case of CORE node, smdb is destroyed in core_destroy()
+	 * Drop downstream and upstream references. In case of CORE node,
+	 * the owner's reference to smdb is dropped in core_destroy()
 	 * call via its wrapper object destroy method.
 	 */
-	if (smdb && !(ssa->node_type & SSA_NODE_CORE)) {
-		ssa_db_destroy(smdb);
-		smdb = NULL;
-	}
+	ssa_db_publish(&smdb_ref, NULL);
+	ssa_db_release(db_previous);
+	db_previous = NULL;
 }
 
 /*
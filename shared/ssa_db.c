@@ -38,9 +38,16 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <infiniband/ssa_db.h>
 
+static int ssa_db_alloc_backend = SSA_DB_ALLOC_HEAP;
+
 static int get_table_id(const char *name, struct db_dataset *dataset,
 			struct db_table_def *tbl_def)
 {
@@ -279,6 +286,102 @@ uint64_t ssa_db_increment_epoch(struct ssa_db *p_ssa_db, uint8_t tbl_id)
 	}
 }
 
+/** =========================================================================
+ */
+uint32_t ssa_db_get_lineage(const struct ssa_db *p_ssa_db)
+{
+	if (!p_ssa_db)
+		return 0;
+
+	return ntohl(p_ssa_db->db_def.lineage);
+}
+
+/** =========================================================================
+ */
+void ssa_db_set_lineage(struct ssa_db *p_ssa_db, uint32_t lineage)
+{
+	if (p_ssa_db)
+		p_ssa_db->db_def.lineage = htonl(lineage);
+}
+
+#define SSA_DB_ALIGN(size) \
+	(((size) + SSA_DB_REGION_ALIGN - 1) & ~((size_t) SSA_DB_REGION_ALIGN - 1))
+
+static int ssa_db_in_region(const struct ssa_db *p_ssa_db, const void *p)
+{
+	return p_ssa_db->region_size && (const char *) p >= (const char *) p_ssa_db &&
+	       (const char *) p < (const char *) p_ssa_db + p_ssa_db->region_size;
+}
+
+static int ssa_db_in_data_buf(const struct ssa_db *p_ssa_db, const void *p)
+{
+	return p_ssa_db->p_data_buf && (const char *) p >= (const char *) p_ssa_db->p_data_buf &&
+	       (const char *) p < (const char *) p_ssa_db->p_data_buf + p_ssa_db->data_buf_size;
+}
+
+/** =========================================================================
+ */
+void ssa_db_set_alloc_backend(int backend)
+{
+	ssa_db_alloc_backend = backend;
+}
+
+int ssa_db_get_alloc_backend(void)
+{
+	return ssa_db_alloc_backend;
+}
+
+/*
+ * Regions of at least a huge page are mapped, so their data tables are
+ * backed by huge pages when the selected backend and the kernel allow.
+ * MAP_HUGETLB falls back to transparent huge pages and those fall back
+ * to the heap. *p_mapped is set to the mapped length, 0 for the heap.
+ */
+static void *ssa_db_region_alloc(size_t size, size_t *p_mapped)
+{
+	void *p_region;
+	size_t len;
+
+	*p_mapped = 0;
+	if (ssa_db_alloc_backend != SSA_DB_ALLOC_HEAP &&
+	    size >= SSA_DB_HUGEPAGE_SIZE) {
+		len = (size + SSA_DB_HUGEPAGE_SIZE - 1) &
+		      ~((size_t) SSA_DB_HUGEPAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+		if (ssa_db_alloc_backend == SSA_DB_ALLOC_HUGETLB) {
+			p_region = mmap(NULL, len, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+					-1, 0);
+			if (p_region != MAP_FAILED) {
+				*p_mapped = len;
+				return p_region;
+			}
+		}
+#endif
+		p_region = mmap(NULL, len, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p_region != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+			madvise(p_region, len, MADV_HUGEPAGE);
+#endif
+			*p_mapped = len;
+			return p_region;
+		}
+	}
+
+	if (posix_memalign(&p_region, SSA_DB_REGION_ALIGN, size))
+		return NULL;
+	return p_region;
+}
+
+static void ssa_db_region_free(struct ssa_db *p_ssa_db)
+{
+	if (p_ssa_db->region_mapped)
+		munmap(p_ssa_db, p_ssa_db->region_mapped);
+	else
+		free(p_ssa_db);
+}
+
 /** =========================================================================
  */
 struct ssa_db *ssa_db_alloc(uint64_t * p_num_recs_arr,
@@ -287,82 +390,77 @@ struct ssa_db *ssa_db_alloc(uint64_t * p_num_recs_arr,
 			    uint64_t tbl_cnt)
 {
 	struct ssa_db *p_db;
-	int i, k, size;
+	char *p_region;
+	size_t size, hdr_size, offset, mapped;
+	uint64_t i;
 
-	p_db = (struct ssa_db *) calloc(1, sizeof(*p_db));
-	if (!p_db)
-		goto err1;
+	/* structure, definitions, datasets, table pointers and digests */
+	hdr_size = SSA_DB_ALIGN(sizeof(*p_db)) +
+		   SSA_DB_ALIGN(tbl_cnt * 2 * sizeof(*p_db->p_def_tbl)) +
+		   2 * SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->p_db_tables)) +
+		   SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->pp_field_tables)) +
+		   SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->pp_tables)) +
+		   SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->p_digests));
+
+	/* field tables are zeroed as well */
+	size = hdr_size;
+	for (i = 0; i < tbl_cnt; i++)
+		if (p_num_field_recs_arr[i] != DB_VARIABLE_SIZE)
+			size += SSA_DB_ALIGN(p_num_field_recs_arr[i] *
+					     sizeof(**p_db->pp_field_tables));
+	hdr_size = size;
+
+	for (i = 0; i < tbl_cnt; i++)
+		size += SSA_DB_ALIGN(p_data_recs_size_arr[i] * p_num_recs_arr[i]);
+
+	p_region = ssa_db_region_alloc(size, &mapped);
+	if (!p_region)
+		return NULL;
+	memset(p_region, 0, hdr_size);
+
+	p_db = (struct ssa_db *) p_region;
+	offset = SSA_DB_ALIGN(sizeof(*p_db));
 
 	/* number of data & field tables = tbl_cnt * 2 */
-	p_db->p_def_tbl = (struct db_table_def *)
-				calloc(tbl_cnt * 2, sizeof(*p_db->p_def_tbl));
-	if (!p_db->p_def_tbl)
-		goto err2;
+	p_db->p_def_tbl = (struct db_table_def *) (p_region + offset);
+	offset += SSA_DB_ALIGN(tbl_cnt * 2 * sizeof(*p_db->p_def_tbl));
 
-	p_db->p_db_tables = (struct db_dataset *)
-				calloc(tbl_cnt, sizeof(*p_db->p_db_tables));
-	if (!p_db->p_db_tables)
-		goto err3;
+	p_db->p_db_tables = (struct db_dataset *) (p_region + offset);
+	offset += SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->p_db_tables));
+
+	p_db->p_db_field_tables = (struct db_dataset *) (p_region + offset);
+	offset += SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->p_db_field_tables));
+
+	p_db->pp_field_tables = (struct db_field_def **) (p_region + offset);
+	offset += SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->pp_field_tables));
 
-	p_db->p_db_field_tables = (struct db_dataset *)
-				calloc(tbl_cnt, sizeof(*p_db->p_db_field_tables));
-	if (!p_db->p_db_field_tables)
-		goto err4;
+	p_db->pp_tables = (void **) (p_region + offset);
+	offset += SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->pp_tables));
 
-	p_db->pp_tables = (void **) calloc(tbl_cnt, sizeof(*p_db->pp_tables));
-	if (!p_db->pp_tables)
-		goto err5;
+	p_db->p_digests = (struct ssa_db_digest *) (p_region + offset);
+	offset += SSA_DB_ALIGN(tbl_cnt * sizeof(*p_db->p_digests));
 
 	for (i = 0; i < tbl_cnt; i++) {
-		size = p_data_recs_size_arr[i] * p_num_recs_arr[i];
-		if (!size)
+		if (p_num_field_recs_arr[i] == DB_VARIABLE_SIZE ||
+		    !p_num_field_recs_arr[i])
 			continue;
-		p_db->pp_tables[i] = (void *) malloc(size);
-		if (!p_db->pp_tables[i]) {
-			for (k = i - 1; k >= 0; k--)
-				free(p_db->pp_tables[k]);
-			goto err6;
-		}
+		p_db->pp_field_tables[i] = (struct db_field_def *) (p_region + offset);
+		offset += SSA_DB_ALIGN(p_num_field_recs_arr[i] *
+				       sizeof(**p_db->pp_field_tables));
 	}
 
-	p_db->pp_field_tables = (struct db_field_def **)
-				calloc(tbl_cnt, sizeof(*p_db->pp_field_tables));
-	if (!p_db->pp_field_tables)
-		goto err7;
-
 	for (i = 0; i < tbl_cnt; i++) {
-		if (p_num_field_recs_arr[i] == DB_VARIABLE_SIZE)
+		if (!p_data_recs_size_arr[i] || !p_num_recs_arr[i])
 			continue;
-
-		p_db->pp_field_tables[i] = (struct db_field_def *)
-				calloc(p_num_field_recs_arr[i], sizeof(**(p_db->pp_field_tables)));
-		if (!p_db->pp_field_tables[i]) {
-			for (k = i - 1; k >= 0; k--)
-				free(p_db->pp_field_tables[k]);
-			goto err8;
-		}
+		p_db->pp_tables[i] = p_region + offset;
+		offset += SSA_DB_ALIGN(p_data_recs_size_arr[i] * p_num_recs_arr[i]);
 	}
 
 	p_db->data_tbl_cnt = tbl_cnt;
+	p_db->region_size = size;
+	p_db->region_mapped = mapped;
 
 	return p_db;
-err8:
-	free(p_db->pp_field_tables);
-err7:
-	for (k = tbl_cnt - 1; k >= 0; k--)
-		free(p_db->pp_tables[k]);
-err6:
-	free(p_db->pp_tables);
-err5:
-	free(p_db->p_db_field_tables);
-err4:
-	free(p_db->p_db_tables);
-err3:
-	free(p_db->p_def_tbl);
-err2:
-	free(p_db);
-err1:
-	return NULL;
 }
 
 /** =========================================================================
@@ -450,6 +548,13 @@ void ssa_db_init(struct ssa_db * p_ssa_db, char * name,
         }
 }
 
+/* Database being received doesn't have data_tbl_cnt set yet */
+static uint64_t ssa_db_log_cnt(const struct ssa_db *p_ssa_db)
+{
+	return p_ssa_db->data_tbl_cnt ? p_ssa_db->data_tbl_cnt :
+	       ssa_db_calculate_data_tbl_num(p_ssa_db);
+}
+
 /** =========================================================================
  */
 void ssa_db_destroy(struct ssa_db * p_ssa_db)
@@ -462,6 +567,25 @@ void ssa_db_destroy(struct ssa_db * p_ssa_db)
 
 	tbl_cnt = p_ssa_db->data_tbl_cnt;
 
+	if (p_ssa_db->p_logs) {
+		for (i = ssa_db_log_cnt(p_ssa_db) - 1; i >= 0; i--)
+			free(p_ssa_db->p_logs[i].p_log);
+		free(p_ssa_db->p_logs);
+		p_ssa_db->p_logs = NULL;
+	}
+
+	/* only tables attached after allocation are outside of the region */
+	if (p_ssa_db->region_size) {
+		for (i = tbl_cnt - 1; i >= 0; i--) {
+			if (!ssa_db_in_region(p_ssa_db, p_ssa_db->pp_field_tables[i]))
+				free(p_ssa_db->pp_field_tables[i]);
+			if (!ssa_db_in_region(p_ssa_db, p_ssa_db->pp_tables[i]))
+				free(p_ssa_db->pp_tables[i]);
+		}
+		ssa_db_region_free(p_ssa_db);
+		return;
+	}
+
 	for (i = tbl_cnt - 1; i >= 0; i--) {
 		if (!p_ssa_db->pp_field_tables[i])
 			continue;
@@ -472,11 +596,14 @@ void ssa_db_destroy(struct ssa_db * p_ssa_db)
 	p_ssa_db->pp_field_tables = NULL;
 
 	for (i = tbl_cnt - 1; i >= 0; i--) {
-		free(p_ssa_db->pp_tables[i]);
+		if (!ssa_db_in_data_buf(p_ssa_db, p_ssa_db->pp_tables[i]))
+			free(p_ssa_db->pp_tables[i]);
 		p_ssa_db->pp_tables[i] = NULL;
 	}
 	free(p_ssa_db->pp_tables);
 	p_ssa_db->pp_tables = NULL;
+	free(p_ssa_db->p_data_buf);
+	p_ssa_db->p_data_buf = NULL;
 
 	free(p_ssa_db->p_db_field_tables);
 	p_ssa_db->p_db_field_tables = NULL;
@@ -489,6 +616,821 @@ void ssa_db_destroy(struct ssa_db * p_ssa_db)
 	free(p_ssa_db);
 }
 
+static inline uint64_t ssa_db_rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t ssa_db_fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+/*
+ * MurmurHash3 x64 128 bit variant. Digests are host local, so
+ * the result depends on the host byte order.
+ */
+static void ssa_db_hash128(const void *data, size_t len, uint64_t hash[2])
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	const uint8_t *p = (const uint8_t *) data;
+	uint8_t tail[16];
+	uint64_t h1 = 0, h2 = 0, k1, k2;
+	size_t i;
+
+	for (i = 0; i < len / 16; i++, p += 16) {
+		memcpy(&k1, p, sizeof(k1));
+		memcpy(&k2, p + 8, sizeof(k2));
+
+		k1 *= c1; k1 = ssa_db_rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = ssa_db_rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = ssa_db_rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = ssa_db_rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	if (len & 15) {
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, p, len & 15);
+		memcpy(&k1, tail, sizeof(k1));
+		memcpy(&k2, tail + 8, sizeof(k2));
+
+		k2 *= c2; k2 = ssa_db_rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		k1 *= c1; k1 = ssa_db_rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = ssa_db_fmix64(h1);
+	h2 = ssa_db_fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	hash[0] = h1;
+	hash[1] = h2;
+}
+
+static void ssa_db_tbl_digest_update(struct ssa_db *p_ssa_db, uint64_t tbl_id)
+{
+	struct ssa_db_digest *p_digest = &p_ssa_db->p_digests[tbl_id];
+	be64_t set_size = p_ssa_db->p_db_tables[tbl_id].set_size;
+
+	if (set_size && !p_ssa_db->pp_tables[tbl_id]) {
+		p_digest->valid = 0;
+		return;
+	}
+
+	ssa_db_hash128(p_ssa_db->pp_tables[tbl_id], ntohll(set_size),
+		       p_digest->hash);
+	p_digest->set_size = set_size;
+	p_digest->valid = 1;
+}
+
+/*
+ *	Return values:
+ *	 0 - equal table digests
+ *	 1 - different table digests
+ *	-1 - there are no valid digests to compare
+ */
+static int ssa_db_tbl_digest_cmp(struct ssa_db const * const ssa_db1, uint64_t id1,
+				 struct ssa_db const * const ssa_db2, uint64_t id2)
+{
+	const struct ssa_db_digest *digest1, *digest2;
+
+	if (!ssa_db1->p_digests || !ssa_db2->p_digests)
+		return -1;
+
+	digest1 = &ssa_db1->p_digests[id1];
+	digest2 = &ssa_db2->p_digests[id2];
+
+	/* digest of a table, which size was changed afterwards, is stale */
+	if (!digest1->valid || !digest2->valid ||
+	    digest1->set_size != ssa_db1->p_db_tables[id1].set_size ||
+	    digest2->set_size != ssa_db2->p_db_tables[id2].set_size)
+		return -1;
+
+	return digest1->hash[0] != digest2->hash[0] ||
+	       digest1->hash[1] != digest2->hash[1];
+}
+
+/** =========================================================================
+ */
+void ssa_db_update_digests(struct ssa_db *p_ssa_db)
+{
+	uint64_t i;
+
+	if (!p_ssa_db || !p_ssa_db->p_digests)
+		return;
+
+	for (i = 0; i < p_ssa_db->data_tbl_cnt; i++)
+		ssa_db_tbl_digest_update(p_ssa_db, i);
+}
+
+/*
+ * Validates the framing of a table log and the bounds of its entries.
+ * Returns the START and END entries and the largest table size
+ * reached while the log is applied.
+ */
+static int ssa_db_log_check(const void *p_log, uint64_t size,
+			    const struct db_trans_log_entry **pp_start,
+			    const struct db_trans_log_entry **pp_end,
+			    uint64_t *p_max_size)
+{
+	const struct db_trans_log_entry *entry, *start, *end;
+	uint64_t cnt, i, tbl_size, max_size, len, offset, data_offset;
+
+	if (!p_log || size < 2 * sizeof(*entry))
+		return -1;
+
+	start = (const struct db_trans_log_entry *) p_log;
+	data_offset = ntohll(start->entry_offset);
+	if (start->operation != DB_OP_START || data_offset > size ||
+	    data_offset % sizeof(*entry) || data_offset < 2 * sizeof(*entry))
+		return -1;
+
+	cnt = data_offset / sizeof(*entry);
+	end = start + cnt - 1;
+	if (end->operation != DB_OP_END || ntohll(end->entry_offset) != size ||
+	    end->table_id != start->table_id)
+		return -1;
+
+	tbl_size = max_size = ntohll(start->record_offset);
+	for (i = 1; i < cnt - 1; i++) {
+		entry = start + i;
+		len = ntohs(entry->entry_size);
+		offset = ntohll(entry->record_offset);
+		if (entry->table_id != start->table_id || offset > tbl_size)
+			return -1;
+
+		switch (entry->operation) {
+		case DB_OP_INSERT:
+		case DB_OP_UPDATE:
+			if (ntohll(entry->entry_offset) < data_offset ||
+			    ntohll(entry->entry_offset) > size ||
+			    len > size - ntohll(entry->entry_offset))
+				return -1;
+			if (entry->operation == DB_OP_UPDATE) {
+				if (len > tbl_size - offset)
+					return -1;
+				break;
+			}
+			tbl_size += len;
+			if (tbl_size > max_size)
+				max_size = tbl_size;
+			break;
+		case DB_OP_DELETE:
+			if (len > tbl_size - offset)
+				return -1;
+			tbl_size -= len;
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	if (tbl_size != ntohll(end->record_offset))
+		return -1;
+
+	*pp_start = start;
+	*pp_end = end;
+	*p_max_size = max_size;
+	return 0;
+}
+
+/** =========================================================================
+ */
+int ssa_db_set_log(struct ssa_db *p_ssa_db, uint64_t tbl_id,
+		   void *p_log, uint64_t size)
+{
+	const struct db_trans_log_entry *start, *end;
+	struct db_dataset *dataset;
+	uint64_t max_size;
+
+	if (!p_ssa_db || !p_ssa_db->p_db_tables ||
+	    tbl_id >= ssa_db_log_cnt(p_ssa_db))
+		return -1;
+
+	dataset = &p_ssa_db->p_db_tables[tbl_id];
+	if (p_log &&
+	    (ssa_db_log_check(p_log, size, &start, &end, &max_size) ||
+	     ntohl(start->table_id) != dataset->id.table ||
+	     end->epoch != dataset->epoch ||
+	     end->record_offset != dataset->set_size))
+		return -1;
+
+	if (!p_ssa_db->p_logs) {
+		if (!p_log)
+			return 0;
+		p_ssa_db->p_logs = calloc(ssa_db_log_cnt(p_ssa_db),
+					  sizeof(*p_ssa_db->p_logs));
+		if (!p_ssa_db->p_logs)
+			return -1;
+	}
+
+	free(p_ssa_db->p_logs[tbl_id].p_log);
+	p_ssa_db->p_logs[tbl_id].p_log = p_log;
+	p_ssa_db->p_logs[tbl_id].size = p_log ? size : 0;
+	return 0;
+}
+
+/** =========================================================================
+ */
+const void *ssa_db_get_log(const struct ssa_db *p_ssa_db, uint64_t tbl_id,
+			   uint64_t epoch, uint64_t *p_size)
+{
+	const struct db_trans_log_entry *start;
+	const struct ssa_db_log *log;
+
+	if (!p_ssa_db || !p_ssa_db->p_logs || tbl_id >= ssa_db_log_cnt(p_ssa_db) ||
+	    epoch == DB_EPOCH_INVALID)
+		return NULL;
+
+	log = &p_ssa_db->p_logs[tbl_id];
+	if (!log->p_log)
+		return NULL;
+
+	/* log continues the table epoch held by the peer */
+	start = (const struct db_trans_log_entry *) log->p_log;
+	if (ntohll(start->epoch) != epoch)
+		return NULL;
+
+	*p_size = log->size;
+	return log->p_log;
+}
+
+/** =========================================================================
+ */
+void *ssa_db_log_apply(const struct ssa_db *p_ssa_db, uint64_t tbl_id,
+		       const void *p_tbl, uint64_t tbl_size, uint64_t epoch)
+{
+	const struct db_trans_log_entry *start, *end, *entry;
+	const uint8_t *p_log;
+	uint64_t log_size, max_size, offset, len, size;
+	uint8_t *p_new, *p;
+
+	p_log = ssa_db_get_log(p_ssa_db, tbl_id, epoch, &log_size);
+	if (!p_log || (!p_tbl && tbl_size) ||
+	    ssa_db_log_check(p_log, log_size, &start, &end, &max_size) ||
+	    ntohll(start->record_offset) != tbl_size)
+		return NULL;
+
+	p_new = malloc(max_size ? max_size : 1);
+	if (!p_new)
+		return NULL;
+	if (tbl_size)
+		memcpy(p_new, p_tbl, tbl_size);
+
+	size = tbl_size;
+	for (entry = start + 1; entry < end; entry++) {
+		offset = ntohll(entry->record_offset);
+		len = ntohs(entry->entry_size);
+		p = p_new + offset;
+		switch (entry->operation) {
+		case DB_OP_INSERT:
+			memmove(p + len, p, size - offset);
+			memcpy(p, p_log + ntohll(entry->entry_offset), len);
+			size += len;
+			break;
+		case DB_OP_DELETE:
+			memmove(p, p + len, size - offset - len);
+			size -= len;
+			break;
+		case DB_OP_UPDATE:
+			memcpy(p, p_log + ntohll(entry->entry_offset), len);
+			break;
+		}
+	}
+
+	return p_new;
+}
+
+static size_t ssa_mem_mismatch_scalar(const void *p1, const void *p2, size_t len)
+{
+	const uint8_t *b1 = (const uint8_t *) p1, *b2 = (const uint8_t *) p2;
+	uint64_t w1, w2;
+	size_t i = 0;
+
+	for (; i + sizeof(w1) <= len; i += sizeof(w1)) {
+		memcpy(&w1, b1 + i, sizeof(w1));
+		memcpy(&w2, b2 + i, sizeof(w2));
+		if (w1 != w2)
+			break;
+	}
+
+	for (; i < len; i++)
+		if (b1[i] != b2[i])
+			break;
+
+	return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+static size_t ssa_mem_mismatch_sse42(const void *p1, const void *p2, size_t len)
+{
+	const uint8_t *b1 = (const uint8_t *) p1, *b2 = (const uint8_t *) p2;
+	__m128i v1, v2;
+	unsigned mask;
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		v1 = _mm_loadu_si128((const __m128i *) (b1 + i));
+		v2 = _mm_loadu_si128((const __m128i *) (b2 + i));
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)) ^ 0xffff;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + ssa_mem_mismatch_scalar(b1 + i, b2 + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t ssa_mem_mismatch_avx2(const void *p1, const void *p2, size_t len)
+{
+	const uint8_t *b1 = (const uint8_t *) p1, *b2 = (const uint8_t *) p2;
+	__m256i v1, v2;
+	unsigned mask;
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		v1 = _mm256_loadu_si256((const __m256i *) (b1 + i));
+		v2 = _mm256_loadu_si256((const __m256i *) (b2 + i));
+		mask = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v1, v2));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	return i + ssa_mem_mismatch_sse42(b1 + i, b2 + i, len - i);
+}
+#endif
+
+/*
+ * Returns offset of the first differing byte, or @len if the buffers
+ * are equal. The widest vector unit supported by the CPU is used.
+ */
+size_t ssa_mem_mismatch(const void *p1, const void *p2, size_t len)
+{
+	static size_t (*mismatch_pfn)(const void *, const void *, size_t);
+
+	if (!mismatch_pfn) {
+		mismatch_pfn = ssa_mem_mismatch_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			mismatch_pfn = ssa_mem_mismatch_avx2;
+		else if (__builtin_cpu_supports("sse4.2"))
+			mismatch_pfn = ssa_mem_mismatch_sse42;
+#endif
+	}
+
+	return mismatch_pfn(p1, p2, len);
+}
+
+/*
+ * Table log builder. Records differing between two epochs of a data
+ * table are recorded as update, insert and delete entries of a table log (see
+ * db_trans_log_entry), so a peer holding the previous table applies
+ * them instead of receiving the whole table. Records inserted or
+ * removed in the middle of a table are recognized by looking ahead
+ * for the next matching record.
+ */
+#define SSA_TBL_LOG_RESYNC_MAX	8	/* records inserted or removed at once */
+
+struct ssa_tbl_log {
+	struct db_trans_log_entry	*p_entries;
+	uint64_t			entry_cnt;
+	uint64_t			entry_max;
+	uint8_t				*p_data;
+	uint64_t			data_size;
+	uint64_t			data_max;
+	uint64_t			limit;		/* largest log worth sending */
+	uint64_t			entry_len;	/* entry_size limit */
+	be64_t				epoch;
+	be32_t				table_id;
+};
+
+static int ssa_tbl_log_grow(void **pp_buf, uint64_t *p_max, uint64_t size,
+			    size_t elem_size)
+{
+	uint64_t max = *p_max ? *p_max : 16;
+	void *p_buf;
+
+	if (size <= *p_max)
+		return 0;
+
+	while (max < size)
+		max *= 2;
+	p_buf = realloc(*pp_buf, max * elem_size);
+	if (!p_buf)
+		return -1;
+
+	*pp_buf = p_buf;
+	*p_max = max;
+	return 0;
+}
+
+/*
+ * Adds @len bytes operation at @offset of the table being rewritten,
+ * merging it with the previous entry when they are contiguous.
+ * Returns -1 once the log grows over its limit.
+ */
+static int ssa_tbl_log_add(struct ssa_tbl_log *p_log, uint8_t op,
+			   uint64_t offset, const uint8_t *p_rec, uint64_t len)
+{
+	struct db_trans_log_entry *p_entry;
+	uint64_t size, prev_offset, chunk;
+
+	while (len) {
+		p_entry = p_log->entry_cnt ?
+			  &p_log->p_entries[p_log->entry_cnt - 1] : NULL;
+		chunk = 0;
+		if (p_entry && p_entry->operation == op) {
+			size = ntohs(p_entry->entry_size);
+			prev_offset = ntohll(p_entry->record_offset);
+			if (op == DB_OP_DELETE ? prev_offset == offset :
+						 prev_offset + size == offset)
+				chunk = p_log->entry_len - size;
+		}
+		if (chunk) {
+			if (chunk > len)
+				chunk = len;
+			p_entry->entry_size = htons(ntohs(p_entry->entry_size) + chunk);
+		} else {
+			if (ssa_tbl_log_grow((void **) &p_log->p_entries,
+					     &p_log->entry_max,
+					     p_log->entry_cnt + 1,
+					     sizeof(*p_log->p_entries)))
+				return -1;
+			chunk = len < p_log->entry_len ? len : p_log->entry_len;
+			p_entry = &p_log->p_entries[p_log->entry_cnt++];
+			memset(p_entry, 0, sizeof(*p_entry));
+			p_entry->epoch = p_log->epoch;
+			p_entry->table_id = p_log->table_id;
+			p_entry->operation = op;
+			p_entry->entry_size = htons(chunk);
+			p_entry->entry_offset = htonll(p_log->data_size);
+			p_entry->record_offset = htonll(offset);
+		}
+
+		if (op != DB_OP_DELETE) {
+			if (ssa_tbl_log_grow((void **) &p_log->p_data,
+					     &p_log->data_max,
+					     p_log->data_size + chunk, 1))
+				return -1;
+			memcpy(p_log->p_data + p_log->data_size, p_rec, chunk);
+			p_log->data_size += chunk;
+			p_rec += chunk;
+			offset += chunk;
+		}
+		len -= chunk;
+
+		if ((p_log->entry_cnt + 2) * sizeof(*p_entry) +
+		    p_log->data_size > p_log->limit)
+			return -1;
+	}
+
+	return 0;
+}
+
+static uint64_t ssa_db_rec_size(const struct ssa_db *p_ssa_db, uint64_t i)
+{
+	uint64_t k;
+
+	for (k = 0; k < ntohll(p_ssa_db->db_table_def.set_count); k++)
+		if (p_ssa_db->p_def_tbl[k].type == DBT_TYPE_DATA &&
+		    p_ssa_db->p_def_tbl[k].id.table == p_ssa_db->p_db_tables[i].id.table)
+			return ntohl(p_ssa_db->p_def_tbl[k].record_size);
+
+	return 0;
+}
+
+/*
+ * Builds the log taking the table of the previous database to the one
+ * of the new database. Returns NULL if the log isn't notably smaller than
+ * the table.
+ */
+void *ssa_db_build_log(const struct ssa_db *p_ssa_db_prev,
+		       const struct ssa_db *p_ssa_db, uint64_t tbl_id,
+		       uint64_t *p_size)
+{
+	const struct db_dataset *p_dataset_prev =
+				&p_ssa_db_prev->p_db_tables[tbl_id];
+	const struct db_dataset *p_dataset = &p_ssa_db->p_db_tables[tbl_id];
+	const uint8_t *p_old = p_ssa_db_prev->pp_tables[tbl_id];
+	const uint8_t *p_new = p_ssa_db->pp_tables[tbl_id];
+	struct ssa_tbl_log log;
+	struct db_trans_log_entry *p_entry;
+	uint64_t rec_size, n_old, n_new, i = 0, j = 0, k, len, hdr_size;
+	uint8_t *p_buf = NULL;
+	int ret = 0;
+
+	rec_size = ssa_db_rec_size(p_ssa_db, tbl_id);
+	if (!rec_size || rec_size == DB_VARIABLE_SIZE || rec_size > 0xFFFF ||
+	    (!p_old && p_dataset_prev->set_size) ||
+	    (!p_new && p_dataset->set_size))
+		return NULL;
+
+	n_old = ntohll(p_dataset_prev->set_size) / rec_size;
+	n_new = ntohll(p_dataset->set_size) / rec_size;
+
+	memset(&log, 0, sizeof(log));
+	log.limit = ntohll(p_dataset->set_size) / 2;
+	log.entry_len = (0xFFFF / rec_size) * rec_size;
+	log.epoch = p_dataset->epoch;
+	log.table_id = htonl(p_dataset->id.table);
+
+	while (!ret && i < n_old && j < n_new) {
+		len = n_old - i < n_new - j ? n_old - i : n_new - j;
+		k = ssa_mem_mismatch(p_old + i * rec_size, p_new + j * rec_size,
+				     len * rec_size) / rec_size;
+		i += k;
+		j += k;
+		if (k == len)
+			break;
+
+		for (k = 1; k <= SSA_TBL_LOG_RESYNC_MAX; k++) {
+			if (i + k < n_old &&
+			    ssa_mem_mismatch(p_old + (i + k) * rec_size,
+					     p_new + j * rec_size,
+					     rec_size) == rec_size) {
+				ret = ssa_tbl_log_add(&log, DB_OP_DELETE,
+						      j * rec_size, NULL,
+						      k * rec_size);
+				i += k;
+				break;
+			}
+			if (j + k < n_new &&
+			    ssa_mem_mismatch(p_old + i * rec_size,
+					     p_new + (j + k) * rec_size,
+					     rec_size) == rec_size) {
+				ret = ssa_tbl_log_add(&log, DB_OP_INSERT,
+						      j * rec_size,
+						      p_new + j * rec_size,
+						      k * rec_size);
+				j += k;
+				break;
+			}
+		}
+		if (k > SSA_TBL_LOG_RESYNC_MAX) {
+			ret = ssa_tbl_log_add(&log, DB_OP_UPDATE, j * rec_size,
+					      p_new + j * rec_size, rec_size);
+			i++;
+			j++;
+		}
+	}
+
+	if (!ret && j < n_new)
+		ret = ssa_tbl_log_add(&log, DB_OP_INSERT, j * rec_size,
+				      p_new + j * rec_size,
+				      (n_new - j) * rec_size);
+	else if (!ret && i < n_old)
+		ret = ssa_tbl_log_add(&log, DB_OP_DELETE, j * rec_size, NULL,
+				      (n_old - i) * rec_size);
+	if (ret)
+		goto out;
+
+	/* START and END entries frame the log, record data follows */
+	hdr_size = (log.entry_cnt + 2) * sizeof(*p_entry);
+	*p_size = hdr_size + log.data_size;
+	p_buf = malloc(*p_size);
+	if (!p_buf)
+		goto out;
+
+	p_entry = (struct db_trans_log_entry *) p_buf;
+	memset(p_entry, 0, sizeof(*p_entry));
+	p_entry->epoch = p_dataset_prev->epoch;
+	p_entry->table_id = log.table_id;
+	p_entry->operation = DB_OP_START;
+	p_entry->entry_offset = htonll(hdr_size);
+	p_entry->record_offset = p_dataset_prev->set_size;
+
+	for (k = 0; k < log.entry_cnt; k++) {
+		p_entry++;
+		*p_entry = log.p_entries[k];
+		if (p_entry->operation != DB_OP_DELETE)
+			p_entry->entry_offset =
+				htonll(ntohll(p_entry->entry_offset) + hdr_size);
+		else
+			p_entry->entry_offset = 0;
+	}
+
+	p_entry++;
+	memset(p_entry, 0, sizeof(*p_entry));
+	p_entry->epoch = p_dataset->epoch;
+	p_entry->table_id = log.table_id;
+	p_entry->operation = DB_OP_END;
+	p_entry->entry_offset = htonll(*p_size);
+	p_entry->record_offset = p_dataset->set_size;
+
+	if (log.data_size)
+		memcpy(p_buf + hdr_size, log.p_data, log.data_size);
+out:
+	free(log.p_entries);
+	free(log.p_data);
+	return p_buf;
+}
+
+/*
+ * Compressed tables are sent as the be64 size of the raw table followed
+ * by an LZ4 style block: sequences of a token (literal length in the high
+ * nibble, match length less 4 in the low one, 15 meaning more length
+ * bytes follow, each added until one isn't 255), the literals, the 16 bit
+ * little endian match offset and the extra match length bytes. The last
+ * sequence holds literals only. LFT blocks and PRDB records, which repeat
+ * the same few values, mostly turn into short overlapping matches.
+ */
+#define SSA_DB_LZ_MIN_MATCH	4
+#define SSA_DB_LZ_LAST_LITERALS	5
+#define SSA_DB_LZ_MAX_OFFSET	0xFFFF
+#define SSA_DB_LZ_HASH_BITS	12
+
+static inline uint32_t ssa_db_lz_hash(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v * 2654435761U) >> (32 - SSA_DB_LZ_HASH_BITS);
+}
+
+static uint8_t *ssa_db_lz_put_len(uint8_t *p, uint64_t len)
+{
+	for (; len >= 255; len -= 255)
+		*p++ = 255;
+	*p++ = (uint8_t) len;
+	return p;
+}
+
+static uint8_t *ssa_db_lz_put_seq(uint8_t *p, const uint8_t *lit,
+				  uint64_t lit_len, uint64_t match_len)
+{
+	uint8_t *token = p++;
+
+	*token = (lit_len < 15 ? lit_len : 15) << 4;
+	if (lit_len >= 15)
+		p = ssa_db_lz_put_len(p, lit_len - 15);
+	memcpy(p, lit, lit_len);
+	p += lit_len;
+	if (!match_len)
+		return p;
+
+	match_len -= SSA_DB_LZ_MIN_MATCH;
+	*token |= match_len < 15 ? match_len : 15;
+	return p;
+}
+
+static int ssa_db_lz_get_len(const uint8_t *p_in, uint64_t in_size,
+			     uint64_t *p_pos, uint64_t *p_len)
+{
+	uint8_t b;
+
+	do {
+		if (*p_pos >= in_size)
+			return -1;
+		b = p_in[(*p_pos)++];
+		*p_len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+/** =========================================================================
+ */
+void *ssa_db_compress(const void *p_buf, uint64_t size, uint64_t *p_zsize)
+{
+	const uint8_t *in = p_buf;
+	uint8_t *p_zbuf, *p;
+	uint32_t *hash;
+	uint64_t pos, anchor, ref, len, limit, bound;
+	uint32_t h;
+
+	bound = sizeof(be64_t) + size + size / 255 + 16;
+	if (!p_buf || !size || bound >= UINT32_MAX)
+		return NULL;
+
+	hash = calloc(1 << SSA_DB_LZ_HASH_BITS, sizeof(*hash));
+	p_zbuf = malloc(bound);
+	if (!hash || !p_zbuf)
+		goto err;
+
+	*(be64_t *) p_zbuf = htonll(size);
+	p = p_zbuf + sizeof(be64_t);
+
+	limit = size > SSA_DB_LZ_LAST_LITERALS + SSA_DB_LZ_MIN_MATCH ?
+		size - SSA_DB_LZ_LAST_LITERALS : 0;
+	pos = anchor = 0;
+	while (pos + SSA_DB_LZ_MIN_MATCH <= limit) {
+		h = ssa_db_lz_hash(in + pos);
+		ref = hash[h];
+		hash[h] = pos + 1;	/* 0 stands for an empty slot */
+		if (!ref || pos - (ref - 1) > SSA_DB_LZ_MAX_OFFSET ||
+		    memcmp(in + ref - 1, in + pos, SSA_DB_LZ_MIN_MATCH)) {
+			pos++;
+			continue;
+		}
+		ref--;
+
+		for (len = SSA_DB_LZ_MIN_MATCH;
+		     pos + len < limit && in[ref + len] == in[pos + len]; len++)
+			;
+
+		p = ssa_db_lz_put_seq(p, in + anchor, pos - anchor, len);
+		*p++ = (pos - ref) & 0xFF;
+		*p++ = (pos - ref) >> 8;
+		if (len - SSA_DB_LZ_MIN_MATCH >= 15)
+			p = ssa_db_lz_put_len(p, len - SSA_DB_LZ_MIN_MATCH - 15);
+		pos += len;
+		anchor = pos;
+	}
+	p = ssa_db_lz_put_seq(p, in + anchor, size - anchor, 0);
+	free(hash);
+
+	*p_zsize = p - p_zbuf;
+	if (*p_zsize >= size) {
+		free(p_zbuf);
+		return NULL;
+	}
+	return p_zbuf;
+
+err:
+	free(hash);
+	free(p_zbuf);
+	return NULL;
+}
+
+/** =========================================================================
+ */
+void *ssa_db_decompress(const void *p_zbuf, uint64_t zsize, uint64_t *p_size)
+{
+	const uint8_t *in = p_zbuf;
+	uint8_t *p_buf;
+	uint64_t pos, out, size, lit_len, match_len, offset;
+	uint8_t token;
+
+	if (!p_zbuf || zsize < sizeof(be64_t) + 1)
+		return NULL;
+
+	size = ntohll(*(be64_t *) p_zbuf);
+	/* one output byte takes at least 1/255 input bytes */
+	if (!size || size / 255 > zsize)
+		return NULL;
+
+	p_buf = malloc(size);
+	if (!p_buf)
+		return NULL;
+
+	pos = sizeof(be64_t);
+	out = 0;
+	for (;;) {
+		if (pos >= zsize)
+			goto err;
+		token = in[pos++];
+
+		lit_len = token >> 4;
+		if (lit_len == 15 &&
+		    ssa_db_lz_get_len(in, zsize, &pos, &lit_len))
+			goto err;
+		if (lit_len > zsize - pos || lit_len > size - out)
+			goto err;
+		memcpy(p_buf + out, in + pos, lit_len);
+		pos += lit_len;
+		out += lit_len;
+		if (pos == zsize)
+			break;		/* last sequence has no match */
+
+		if (zsize - pos < 2)
+			goto err;
+		offset = in[pos] | (in[pos + 1] << 8);
+		pos += 2;
+		match_len = token & 0xF;
+		if (match_len == 15 &&
+		    ssa_db_lz_get_len(in, zsize, &pos, &match_len))
+			goto err;
+		match_len += SSA_DB_LZ_MIN_MATCH;
+		if (!offset || offset > out || match_len > size - out)
+			goto err;
+		/* byte by byte, as the match may overlap its own output */
+		for (; match_len; match_len--, out++)
+			p_buf[out] = p_buf[out - offset];
+	}
+
+	if (out != size)
+		goto err;
+	*p_size = size;
+	return p_buf;
+
+err:
+	free(p_buf);
+	return NULL;
+}
+
 /*
  *	Return values:
  *	 0 - equal ssa_db structures
@@ -499,24 +1441,24 @@ int ssa_db_tbl_cmp(struct ssa_db *ssa_db1, struct ssa_db *ssa_db2, const char *n
 {
 	struct db_dataset *dataset1, *dataset2;
 	void *tbl1, *tbl2;
-	int id;
+	int id1, id2, ret;
 
 	if (!ssa_db1 || !ssa_db2 || !name)
 		goto err;
 
-	id = get_table_id(name, &ssa_db1->db_table_def, ssa_db1->p_def_tbl);
-	if (id < 0)
+	id1 = get_table_id(name, &ssa_db1->db_table_def, ssa_db1->p_def_tbl);
+	if (id1 < 0)
 		goto err;
 
-	dataset1 = &ssa_db1->p_db_tables[id];
-	tbl1 = ssa_db1->pp_tables[id];
+	dataset1 = &ssa_db1->p_db_tables[id1];
+	tbl1 = ssa_db1->pp_tables[id1];
 
-	id = get_table_id(name, &ssa_db2->db_table_def, ssa_db2->p_def_tbl);
-	if (id < 0)
+	id2 = get_table_id(name, &ssa_db2->db_table_def, ssa_db2->p_def_tbl);
+	if (id2 < 0)
 		goto err;
 
-	dataset2 = &ssa_db2->p_db_tables[id];
-	tbl2 = ssa_db2->pp_tables[id];
+	dataset2 = &ssa_db2->p_db_tables[id2];
+	tbl2 = ssa_db2->pp_tables[id2];
 
 	if ((dataset1->size		!= dataset2->size) ||
 	    (dataset1->version		!= dataset2->version) ||
@@ -531,6 +1473,10 @@ int ssa_db_tbl_cmp(struct ssa_db *ssa_db1, struct ssa_db *ssa_db2, const char *n
 	if ((!tbl1 && tbl2) || (tbl1 && !tbl2))
 		return 1;
 
+	ret = ssa_db_tbl_digest_cmp(ssa_db1, id1, ssa_db2, id2);
+	if (ret >= 0)
+		return ret;
+
 	if (memcmp(tbl1, tbl2, ntohll(dataset1->set_size)))
 		return 1;
 
@@ -549,7 +1495,7 @@ err:
 int ssa_db_cmp(struct ssa_db const * const ssa_db1, struct ssa_db const * const ssa_db2)
 {
 	uint64_t i, j;
-	int ret = 0;
+	int ret = 0, digest_ret;
 
 	if (!ssa_db1 ||				!ssa_db2 ||
 	    !ssa_db1->p_def_tbl ||		!ssa_db2->p_def_tbl ||
@@ -607,7 +1553,16 @@ int ssa_db_cmp(struct ssa_db const * const ssa_db1, struct ssa_db const * const
 			goto out;
 		}
 
-		if (memcmp(ssa_db1->pp_tables[i], ssa_db2->pp_tables[i],
+		digest_ret = ssa_db_tbl_digest_cmp(ssa_db1, i, ssa_db2, i);
+		if (digest_ret > 0) {
+			ret = 1;
+			goto out;
+		} else if (!digest_ret) {
+			continue;
+		}
+
+		if (dataset1->set_size &&
+		    memcmp(ssa_db1->pp_tables[i], ssa_db2->pp_tables[i],
 			   ntohll(dataset1->set_size))) {
 			ret = 1;
 			goto out;
@@ -618,6 +1573,85 @@ out:
 	return ret;
 }
 
+/*
+ * Rebases a pointer of a database region copy. Pointers outside
+ * of the region are set to NULL.
+ */
+static void *ssa_db_rebase(const struct ssa_db *ssa_db,
+			   const struct ssa_db *ssa_db_copy, const void *p)
+{
+	if (!ssa_db_in_region(ssa_db, p))
+		return NULL;
+
+	return (char *) ssa_db_copy + ((const char *) p - (const char *) ssa_db);
+}
+
+static void *ssa_db_dup_tbl(const void *p_tbl, const struct db_dataset *dataset)
+{
+	void *p_copy;
+
+	p_copy = malloc(ntohll(dataset->set_size));
+	if (p_copy)
+		memcpy(p_copy, p_tbl, ntohll(dataset->set_size));
+
+	return p_copy;
+}
+
+static struct ssa_db *ssa_db_copy_region(struct ssa_db const * const ssa_db)
+{
+	struct ssa_db *ssa_db_copy;
+	size_t mapped;
+	uint64_t i;
+
+	ssa_db_copy = ssa_db_region_alloc(ssa_db->region_size, &mapped);
+	if (!ssa_db_copy)
+		return NULL;
+
+	memcpy(ssa_db_copy, ssa_db, ssa_db->region_size);
+	ssa_db_copy->region_mapped = mapped;
+	ssa_db_copy->refcnt = 0;
+
+	ssa_db_copy->p_def_tbl = ssa_db_rebase(ssa_db, ssa_db_copy, ssa_db->p_def_tbl);
+	ssa_db_copy->p_db_field_tables =
+		ssa_db_rebase(ssa_db, ssa_db_copy, ssa_db->p_db_field_tables);
+	ssa_db_copy->pp_field_tables =
+		ssa_db_rebase(ssa_db, ssa_db_copy, ssa_db->pp_field_tables);
+	ssa_db_copy->p_db_tables = ssa_db_rebase(ssa_db, ssa_db_copy, ssa_db->p_db_tables);
+	ssa_db_copy->pp_tables = ssa_db_rebase(ssa_db, ssa_db_copy, ssa_db->pp_tables);
+	ssa_db_copy->p_digests = ssa_db_rebase(ssa_db, ssa_db_copy, ssa_db->p_digests);
+	ssa_db_copy->p_logs = NULL;
+
+	for (i = 0; i < ssa_db->data_tbl_cnt; i++) {
+		ssa_db_copy->pp_field_tables[i] =
+			ssa_db_rebase(ssa_db, ssa_db_copy, ssa_db->pp_field_tables[i]);
+		ssa_db_copy->pp_tables[i] =
+			ssa_db_rebase(ssa_db, ssa_db_copy, ssa_db->pp_tables[i]);
+	}
+
+	/* attached tables */
+	for (i = 0; i < ssa_db->data_tbl_cnt; i++) {
+		if (ssa_db->pp_tables[i] && !ssa_db_copy->pp_tables[i]) {
+			ssa_db_copy->pp_tables[i] =
+				ssa_db_dup_tbl(ssa_db->pp_tables[i],
+					       &ssa_db->p_db_tables[i]);
+			if (!ssa_db_copy->pp_tables[i])
+				goto err;
+		}
+		if (ssa_db->pp_field_tables[i] && !ssa_db_copy->pp_field_tables[i]) {
+			ssa_db_copy->pp_field_tables[i] =
+				ssa_db_dup_tbl(ssa_db->pp_field_tables[i],
+					       &ssa_db->p_db_field_tables[i]);
+			if (!ssa_db_copy->pp_field_tables[i])
+				goto err;
+		}
+	}
+
+	return ssa_db_copy;
+err:
+	ssa_db_destroy(ssa_db_copy);
+	return NULL;
+}
+
 struct ssa_db *ssa_db_copy(struct ssa_db const * const ssa_db)
 {
 	uint64_t *field_cnt = NULL, *rec_cnt = NULL;
@@ -630,6 +1664,9 @@ struct ssa_db *ssa_db_copy(struct ssa_db const * const ssa_db)
 	    !ssa_db->p_db_tables || !ssa_db->pp_tables)
 		goto out;
 
+	if (ssa_db->region_size)
+		return ssa_db_copy_region(ssa_db);
+
 	tbl_cnt = ssa_db->data_tbl_cnt;
 
 	field_cnt = (uint64_t *) malloc(tbl_cnt * sizeof(*field_cnt));
@@ -679,10 +1716,15 @@ struct ssa_db *ssa_db_copy(struct ssa_db const * const ssa_db)
 		if (ssa_db->pp_field_tables[i])
 			memcpy(ssa_db_copy->pp_field_tables[i], ssa_db->pp_field_tables[i],
 			       ntohll(ssa_db->p_db_field_tables[i].set_size));
-		memcpy(ssa_db_copy->pp_tables[i], ssa_db->pp_tables[i],
-		       ntohll(ssa_db->p_db_tables[i].set_size));
+		if (ssa_db->pp_tables[i])
+			memcpy(ssa_db_copy->pp_tables[i], ssa_db->pp_tables[i],
+			       ntohll(ssa_db->p_db_tables[i].set_size));
 	}
 
+	if (ssa_db->p_digests)
+		memcpy(ssa_db_copy->p_digests, ssa_db->p_digests,
+		       tbl_cnt * sizeof(*ssa_db_copy->p_digests));
+
 err3:
 	free(rec_size);
 err2:
@@ -693,6 +1735,52 @@ out:
 	return ssa_db_copy;
 }
 
+/** =========================================================================
+ */
+struct ssa_db *ssa_db_get(struct ssa_db *p_ssa_db)
+{
+	if (p_ssa_db)
+		__sync_add_and_fetch(&p_ssa_db->refcnt, 1);
+
+	return p_ssa_db;
+}
+
+/** =========================================================================
+ */
+void ssa_db_release(struct ssa_db *p_ssa_db)
+{
+	/* no references in addition to the owner's one */
+	if (p_ssa_db && __sync_fetch_and_sub(&p_ssa_db->refcnt, 1) == 0)
+		ssa_db_destroy(p_ssa_db);
+}
+
+/** =========================================================================
+ */
+struct ssa_db *ssa_db_acquire(struct ssa_db_ref *p_ref)
+{
+	struct ssa_db *p_ssa_db;
+
+	pthread_mutex_lock(&p_ref->lock);
+	p_ssa_db = ssa_db_get(p_ref->p_db);
+	pthread_mutex_unlock(&p_ref->lock);
+
+	return p_ssa_db;
+}
+
+/** =========================================================================
+ */
+void ssa_db_publish(struct ssa_db_ref *p_ref, struct ssa_db *p_ssa_db)
+{
+	struct ssa_db *p_prev;
+
+	pthread_mutex_lock(&p_ref->lock);
+	p_prev = p_ref->p_db;
+	p_ref->p_db = p_ssa_db;
+	pthread_mutex_unlock(&p_ref->lock);
+
+	ssa_db_release(p_prev);
+}
+
 /** =========================================================================
  */
 uint64_t ssa_db_calculate_data_tbl_num(const struct ssa_db *p_ssa_db)
@@ -746,6 +1834,9 @@ int ssa_db_attach(struct ssa_db *ssa_db, const char *tbl_name,
 	dataset->set_size = tbl_dataset.set_size;
 	dataset->set_count = tbl_dataset.set_count;
 
+	if (ssa_db->p_digests)
+		ssa_db_tbl_digest_update(ssa_db, id);
+
 skip_attach:
 	return 0;
 
@@ -768,11 +1859,15 @@ void ssa_db_detach(struct ssa_db *ssa_db, const char *tbl_name)
 	dataset = &ssa_db->p_db_tables[id];
 	dataset->set_size = 0;
 	dataset->set_count = 0;
+	if (ssa_db->p_digests)
+		ssa_db->p_digests[id].valid = 0;
 
 	if (!ssa_db->pp_tables[id])
 		goto out;
 
-	free(ssa_db->pp_tables[id]);
+	if (!ssa_db_in_region(ssa_db, ssa_db->pp_tables[id]) &&
+	    !ssa_db_in_data_buf(ssa_db, ssa_db->pp_tables[id]))
+		free(ssa_db->pp_tables[id]);
 	ssa_db->pp_tables[id] = NULL;
 out:
 	return;
@@ -85,6 +85,11 @@ long  ssa_inc_runtime_counter(int id)
 	return atomic_inc(&ssa_runtime_stat.counters[id]);
 }
 
+long  ssa_add_runtime_counter(int id, long val)
+{
+	return atomic_add(&ssa_runtime_stat.counters[id], val);
+}
+
 void ssa_set_runtime_counter_time(int id)
 {
 	ssa_set_runtime_counter(id, ssa_runtime_shift(ssa_runtime_stat.start_time));
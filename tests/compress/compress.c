@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under the terms of the
+ * OpenIB.org BSD license included below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Round trip and robustness tests of ssa_db_compress() and
+ * ssa_db_decompress(). Compressed buffers are copied into exactly
+ * sized allocations before they are decompressed, so reads past their
+ * end are reported by memory checkers (valgrind, -fsanitize=address).
+ *
+ * The exit status is the number of failed checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <infiniband/ssa_db.h>
+#include <common.h>
+
+#define TEST_SEED	1
+#define CORRUPT_ROUNDS	64
+
+static int failures;
+
+#define CHECK(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			failures++;				\
+			printf("FAIL %s:%d: ", __func__, __LINE__); \
+			printf(__VA_ARGS__);			\
+			printf("\n");				\
+		}						\
+	} while (0)
+
+static void *dup_exact(const void *p_buf, uint64_t size)
+{
+	void *p = malloc(size ? size : 1);
+
+	if (p && size)
+		memcpy(p, p_buf, size);
+	return p;
+}
+
+static uint64_t round_trip(const char *name, const uint8_t *p_buf,
+			   uint64_t size)
+{
+	uint8_t *p_zbuf, *p_zexact, *p_out;
+	uint64_t zsize = 0, out_size = 0;
+
+	p_zbuf = ssa_db_compress(p_buf, size, &zsize);
+	if (!p_zbuf)
+		return 0;
+
+	p_zexact = dup_exact(p_zbuf, zsize);
+	p_out = ssa_db_decompress(p_zexact, zsize, &out_size);
+	CHECK(p_out && out_size == size && !memcmp(p_out, p_buf, size),
+	      "%s: %" PRIu64 " bytes don't survive the round trip", name, size);
+	CHECK(zsize < size, "%s: %" PRIu64 " bytes compressed to %" PRIu64,
+	      name, size, zsize);
+
+	free(p_out);
+	free(p_zexact);
+	free(p_zbuf);
+	return zsize;
+}
+
+static void test_empty(void)
+{
+	uint8_t byte = 0, hdr[sizeof(be64_t) + 1];
+	uint64_t zsize = 0, size = 0;
+
+	CHECK(!ssa_db_compress(&byte, 0, &zsize), "empty input compressed");
+	CHECK(!ssa_db_compress(NULL, 16, &zsize), "NULL input compressed");
+	CHECK(!ssa_db_decompress(NULL, 16, &size), "NULL input decompressed");
+	CHECK(!ssa_db_decompress(&byte, 0, &size), "empty input decompressed");
+
+	/* a header alone and a zero raw size are both rejected */
+	memset(hdr, 0, sizeof(hdr));
+	CHECK(!ssa_db_decompress(hdr, sizeof(be64_t), &size),
+	      "header only input decompressed");
+	CHECK(!ssa_db_decompress(hdr, sizeof(hdr), &size),
+	      "zero raw size decompressed");
+}
+
+static void test_incompressible(void)
+{
+	uint8_t buf[4096], stream[sizeof(be64_t) + 2 + 16];
+	uint8_t *p_out;
+	uint64_t i, zsize = 0, size = 0;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = rand();
+	CHECK(!ssa_db_compress(buf, sizeof(buf), &zsize),
+	      "random data compressed to %" PRIu64 " bytes", zsize);
+	CHECK(!ssa_db_compress(buf, 3, &zsize),
+	      "3 bytes compressed to %" PRIu64 " bytes", zsize);
+
+	/* literals only: 16 bytes need one length extension byte */
+	*(be64_t *) stream = htonll(16);
+	stream[sizeof(be64_t)] = 0xF0;
+	stream[sizeof(be64_t) + 1] = 1;
+	memcpy(stream + sizeof(be64_t) + 2, buf, 16);
+	p_out = ssa_db_decompress(stream, sizeof(stream), &size);
+	CHECK(p_out && size == 16 && !memcmp(p_out, buf, 16),
+	      "literal only stream not decoded");
+	free(p_out);
+}
+
+static void test_long_matches(void)
+{
+	uint64_t i, size = 1024 * 1024, zsize;
+	uint8_t *buf = malloc(size);
+
+	if (!buf) {
+		CHECK(0, "unable to allocate %" PRIu64 " bytes", size);
+		return;
+	}
+
+	/* offset 1 matches, overlapping their own output */
+	memset(buf, 0, size);
+	zsize = round_trip("zeros", buf, size);
+	CHECK(zsize && zsize < size / 200,
+	      "zeros compressed to %" PRIu64 " bytes", zsize);
+
+	/* repeated LFT block like records */
+	for (i = 0; i < size; i++)
+		buf[i] = (i / 64) % 7 + (i % 64 < 4 ? i / 4096 : 0);
+	CHECK(round_trip("records", buf, size), "records not compressed");
+
+	/* matches right up to the end, the last literals are short */
+	for (i = 0; i < size; i++)
+		buf[i] = i % 251;
+	CHECK(round_trip("period 251", buf, size), "period not compressed");
+
+	/* matches of all lengths around the extension boundaries */
+	for (i = 0; i < 600; i++) {
+		uint64_t len = 1000 + i;
+
+		memset(buf, 'a', len);
+		buf[i] = 'b';
+		round_trip("one odd byte", buf, len);
+	}
+	free(buf);
+}
+
+static void test_truncated(void)
+{
+	uint64_t i, size = 64 * 1024, zsize = 0, out_size;
+	uint8_t *buf = malloc(size), *p_zbuf, *p_cut, *p_out;
+
+	if (!buf) {
+		CHECK(0, "unable to allocate %" PRIu64 " bytes", size);
+		return;
+	}
+	for (i = 0; i < size; i++)
+		buf[i] = (i % 40 < 30) ? 5 : rand();
+	p_zbuf = ssa_db_compress(buf, size, &zsize);
+	CHECK(p_zbuf, "mixed data not compressed");
+	for (i = 0; p_zbuf && i < zsize; i++) {
+		p_cut = dup_exact(p_zbuf, i);
+		p_out = ssa_db_decompress(p_cut, i, &out_size);
+		CHECK(!p_out, "%" PRIu64 " out of %" PRIu64
+		      " bytes decompressed", i, zsize);
+		free(p_out);
+		free(p_cut);
+	}
+	free(p_zbuf);
+	free(buf);
+}
+
+static void test_corrupt(void)
+{
+	uint64_t i, size = 16 * 1024, zsize = 0, out_size;
+	uint8_t *buf = malloc(size), *p_zbuf, *p_bad, *p_out;
+	uint8_t stream[sizeof(be64_t) + 16];
+	int round;
+
+	if (!buf) {
+		CHECK(0, "unable to allocate %" PRIu64 " bytes", size);
+		return;
+	}
+
+	/*
+	 * 'x', then an offset 1 match of 4 bytes and an empty last
+	 * sequence: decodes to "xxxxx", each change below breaks it
+	 */
+	*(be64_t *) stream = htonll(5);
+	stream[8] = 0x10; stream[9] = 'x'; stream[10] = 1; stream[11] = 0;
+	stream[12] = 0x00;
+	p_out = ssa_db_decompress(stream, 13, &out_size);
+	CHECK(p_out && out_size == 5 && !memcmp(p_out, "xxxxx", 5),
+	      "valid stream not decoded");
+	free(p_out);
+
+	stream[10] = 0;
+	CHECK(!ssa_db_decompress(stream, 13, &out_size), "offset 0 accepted");
+	stream[10] = 2;
+	CHECK(!ssa_db_decompress(stream, 13, &out_size),
+	      "offset past the output start accepted");
+
+	/* match longer than the declared size */
+	stream[10] = 1;
+	*(be64_t *) stream = htonll(4);
+	CHECK(!ssa_db_decompress(stream, 13, &out_size),
+	      "match past the declared size accepted");
+
+	/* output shorter than the declared size */
+	*(be64_t *) stream = htonll(6);
+	CHECK(!ssa_db_decompress(stream, 13, &out_size),
+	      "short output accepted");
+
+	/* length extension running off the end of the input */
+	stream[8] = 0xF0; stream[9] = 255; stream[10] = 255;
+	CHECK(!ssa_db_decompress(stream, 11, &out_size),
+	      "unterminated length accepted");
+
+	/* declared size far beyond what the input may expand to */
+	*(be64_t *) stream = htonll(UINT64_MAX);
+	CHECK(!ssa_db_decompress(stream, 13, &out_size),
+	      "huge declared size accepted");
+
+	for (i = 0; i < size; i++)
+		buf[i] = (i / 64) % 7 + (i % 97 == 0 ? rand() : 0);
+	p_zbuf = ssa_db_compress(buf, size, &zsize);
+	CHECK(p_zbuf, "records not compressed");
+	for (round = 0; p_zbuf && round < CORRUPT_ROUNDS * 16; round++) {
+		p_bad = dup_exact(p_zbuf, zsize);
+		p_bad[rand() % zsize] ^= 1 << (rand() % 8);
+		if (round % 2)
+			p_bad[rand() % zsize] = rand();
+		/* either rejected or decoded to exactly the declared size */
+		p_out = ssa_db_decompress(p_bad, zsize, &out_size);
+		CHECK(!p_out || out_size == ntohll(*(be64_t *) p_bad),
+		      "corrupt input decoded to %" PRIu64 " bytes", out_size);
+		free(p_out);
+		free(p_bad);
+	}
+	free(p_zbuf);
+	free(buf);
+}
+
+int main(int argc, char **argv)
+{
+	srand(TEST_SEED);
+
+	test_empty();
+	test_incompressible();
+	test_long_matches();
+	test_truncated();
+	test_corrupt();
+
+	printf("%s: %d failures\n", argv[0], failures);
+	return failures;
+}
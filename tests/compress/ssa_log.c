@@ -0,0 +1 @@
+../../shared/ssa_log.c
\ No newline at end of file
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under the terms of the
+ * OpenIB.org BSD license included below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * "Half world" delta tests: path records updated by
+ * ssa_pr_compute_half_world_delta() after an LFT change have to be equal
+ * to the ones computed from scratch. The SMDB is a two level fat tree
+ * with LMC 2 hosts, built in memory. Each host LID has its own LFT
+ * entries, so changes of non base LIDs are covered too.
+ *
+ * The exit status is the number of failed checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <ssa_db.h>
+#include <ssa_smdb.h>
+#include <ssa_prdb.h>
+#include <infiniband/ssa_path_record.h>
+
+#define LEAF_NUM	4
+#define SPINE_NUM	3
+#define HOST_NUM	4	/* per leaf */
+#define HOST_LMC	2
+#define SWITCH_NUM	(LEAF_NUM + SPINE_NUM)
+#define LIDS_PER_HOST	(1 << HOST_LMC)
+#define HOST_BASE_LID	((SWITCH_NUM / LIDS_PER_HOST + 1) * LIDS_PER_HOST)
+#define MAX_LID		(HOST_BASE_LID + LEAF_NUM * HOST_NUM * LIDS_PER_HOST - 1)
+#define PORT_RATE	7
+#define NO_PATH		255
+
+static int failures;
+
+#define CHECK(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			failures++;				\
+			printf("FAIL %s:%d: ", __func__, __LINE__); \
+			printf(__VA_ARGS__);			\
+			printf("\n");				\
+		}						\
+	} while (0)
+
+/* leaves are LIDs 1..LEAF_NUM, spines follow them */
+static uint8_t leaf_port(int leaf, int lid)
+{
+	int host;
+
+	if (lid == leaf + 1)
+		return 0;
+	if (lid >= HOST_BASE_LID) {
+		host = (lid - HOST_BASE_LID) / LIDS_PER_HOST;
+		if (host / HOST_NUM == leaf)
+			return host % HOST_NUM + 1;
+	} else if (lid > LEAF_NUM) {
+		return HOST_NUM + lid - LEAF_NUM;
+	}
+	/* each LID of a host goes up through its own spine */
+	return HOST_NUM + 1 + lid % SPINE_NUM;
+}
+
+static uint8_t spine_port(int spine, int lid)
+{
+	if (lid == LEAF_NUM + spine + 1)
+		return 0;
+	if (lid >= HOST_BASE_LID)
+		return (lid - HOST_BASE_LID) / LIDS_PER_HOST / HOST_NUM + 1;
+	if (lid <= LEAF_NUM)
+		return lid;
+	return 1 + lid % LEAF_NUM;
+}
+
+static void add_port(struct ssa_db *p_smdb, uint64_t *p_cnt, int lid,
+		     int num, int is_switch, uint8_t mtu)
+{
+	struct smdb_port *p_port = (struct smdb_port *)
+		p_smdb->pp_tables[SMDB_TBL_ID_PORT] + p_cnt[SMDB_TBL_ID_PORT]++;
+	be16_t *p_pkey = (be16_t *) p_smdb->pp_tables[SMDB_TBL_ID_PKEY] +
+			 p_cnt[SMDB_TBL_ID_PKEY]++;
+
+	memset(p_port, 0, sizeof(*p_port));
+	*p_pkey = htons(0xffff);
+	p_port->pkey_tbl_offset = htonll((p_cnt[SMDB_TBL_ID_PKEY] - 1) *
+					 sizeof(*p_pkey));
+	p_port->pkey_tbl_size = htons(sizeof(*p_pkey));
+	p_port->port_lid = htons(lid);
+	p_port->port_num = num;
+	p_port->mtu_cap = mtu;
+	p_port->rate = PORT_RATE | (is_switch ? SSA_DB_PORT_IS_SWITCH_MASK : 0);
+}
+
+static void add_link(struct ssa_db *p_smdb, uint64_t *p_cnt,
+		     int lid1, int port1, int lid2, int port2)
+{
+	struct smdb_link *p_link = (struct smdb_link *)
+		p_smdb->pp_tables[SMDB_TBL_ID_LINK] + p_cnt[SMDB_TBL_ID_LINK];
+
+	p_link[0].from_lid = htons(lid1);
+	p_link[0].from_port_num = port1;
+	p_link[0].to_lid = htons(lid2);
+	p_link[0].to_port_num = port2;
+	p_link[1].from_lid = htons(lid2);
+	p_link[1].from_port_num = port2;
+	p_link[1].to_lid = htons(lid1);
+	p_link[1].to_port_num = port1;
+	p_cnt[SMDB_TBL_ID_LINK] += 2;
+}
+
+static struct ssa_db *fat_tree_smdb(uint64_t epoch)
+{
+	struct smdb_subnet_opts *p_opts;
+	struct smdb_guid2lid *p_guid2lid;
+	struct smdb_lft_top *p_top;
+	struct smdb_lft_block *p_block;
+	struct ssa_db *p_smdb;
+	uint64_t cnt[SMDB_TBL_ID_MAX] = { 0 };
+	uint64_t max[SMDB_TBL_ID_MAX] = { 0 };
+	uint64_t rec_size[SMDB_TBL_ID_MAX] = { 0 };
+	int host_cnt = LEAF_NUM * HOST_NUM, blocks = MAX_LID / 64 + 1;
+	int i, j, lid;
+
+	max[SMDB_TBL_ID_SUBNET_OPTS] = 1;
+	max[SMDB_TBL_ID_GUID2LID] = SWITCH_NUM + host_cnt;
+	max[SMDB_TBL_ID_PORT] = LEAF_NUM * (1 + HOST_NUM + SPINE_NUM) +
+				SPINE_NUM * (1 + LEAF_NUM) + host_cnt;
+	max[SMDB_TBL_ID_PKEY] = max[SMDB_TBL_ID_PORT];
+	max[SMDB_TBL_ID_LINK] = 2 * (LEAF_NUM * SPINE_NUM + host_cnt);
+	max[SMDB_TBL_ID_LFT_TOP] = SWITCH_NUM;
+	max[SMDB_TBL_ID_LFT_BLOCK] = SWITCH_NUM * blocks;
+
+	p_smdb = ssa_db_smdb_init(epoch, max);
+	if (!p_smdb)
+		return NULL;
+
+	p_opts = (struct smdb_subnet_opts *)
+		 p_smdb->pp_tables[SMDB_TBL_ID_SUBNET_OPTS];
+	memset(p_opts, 0, sizeof(*p_opts));
+	p_opts->lmc = HOST_LMC;
+	p_opts->subnet_timeout = 18;
+	cnt[SMDB_TBL_ID_SUBNET_OPTS] = 1;
+
+	p_guid2lid = (struct smdb_guid2lid *)
+		     p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	for (i = 0; i < SWITCH_NUM + host_cnt; i++) {
+		memset(&p_guid2lid[i], 0, sizeof(p_guid2lid[i]));
+		p_guid2lid[i].guid = htonll(0x1000 + i);
+		p_guid2lid[i].is_switch = i < SWITCH_NUM;
+		p_guid2lid[i].lid = htons(i < SWITCH_NUM ? i + 1 :
+			HOST_BASE_LID + (i - SWITCH_NUM) * LIDS_PER_HOST);
+		p_guid2lid[i].lmc = i < SWITCH_NUM ? 0 : HOST_LMC;
+	}
+	cnt[SMDB_TBL_ID_GUID2LID] = SWITCH_NUM + host_cnt;
+
+	/* spines differ by MTU, so path records depend on the route */
+	for (i = 0; i < LEAF_NUM; i++) {
+		add_port(p_smdb, cnt, i + 1, 0, 1, 5);
+		for (j = 1; j <= HOST_NUM + SPINE_NUM; j++)
+			add_port(p_smdb, cnt, i + 1, j, 1, 5);
+	}
+	for (i = 0; i < SPINE_NUM; i++) {
+		add_port(p_smdb, cnt, LEAF_NUM + i + 1, 0, 1, 5);
+		for (j = 1; j <= LEAF_NUM; j++)
+			add_port(p_smdb, cnt, LEAF_NUM + i + 1, j, 1, 3 + i);
+	}
+	for (i = 0; i < host_cnt; i++)
+		add_port(p_smdb, cnt, HOST_BASE_LID + i * LIDS_PER_HOST, 1, 0, 5);
+
+	for (i = 0; i < LEAF_NUM; i++)
+		for (j = 0; j < SPINE_NUM; j++)
+			add_link(p_smdb, cnt, i + 1, HOST_NUM + j + 1,
+				 LEAF_NUM + j + 1, i + 1);
+	for (i = 0; i < host_cnt; i++)
+		add_link(p_smdb, cnt, HOST_BASE_LID + i * LIDS_PER_HOST, 1,
+			 i / HOST_NUM + 1, i % HOST_NUM + 1);
+
+	p_top = (struct smdb_lft_top *) p_smdb->pp_tables[SMDB_TBL_ID_LFT_TOP];
+	p_block = (struct smdb_lft_block *)
+		  p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
+	for (i = 0; i < SWITCH_NUM; i++) {
+		p_top[i].lid = htons(i + 1);
+		p_top[i].lft_top = htons(MAX_LID);
+		for (j = 0; j < blocks; j++, p_block++) {
+			p_block->lid = htons(i + 1);
+			p_block->block_num = htons(j);
+			for (lid = j * 64; lid < (j + 1) * 64; lid++) {
+				if (!lid || lid > MAX_LID ||
+				    (lid > SWITCH_NUM && lid < HOST_BASE_LID))
+					p_block->block[lid % 64] = NO_PATH;
+				else
+					p_block->block[lid % 64] = i < LEAF_NUM ?
+						leaf_port(i, lid) :
+						spine_port(i - LEAF_NUM, lid);
+			}
+		}
+	}
+	cnt[SMDB_TBL_ID_LFT_TOP] = SWITCH_NUM;
+	cnt[SMDB_TBL_ID_LFT_BLOCK] = SWITCH_NUM * blocks;
+
+	rec_size[SMDB_TBL_ID_SUBNET_OPTS] = sizeof(struct smdb_subnet_opts);
+	rec_size[SMDB_TBL_ID_GUID2LID] = sizeof(struct smdb_guid2lid);
+	rec_size[SMDB_TBL_ID_PORT] = sizeof(struct smdb_port);
+	rec_size[SMDB_TBL_ID_PKEY] = sizeof(be16_t);
+	rec_size[SMDB_TBL_ID_LINK] = sizeof(struct smdb_link);
+	rec_size[SMDB_TBL_ID_LFT_TOP] = sizeof(struct smdb_lft_top);
+	rec_size[SMDB_TBL_ID_LFT_BLOCK] = sizeof(struct smdb_lft_block);
+	for (i = 0; i < SMDB_TBL_ID_MAX; i++) {
+		p_smdb->p_db_tables[i].set_count = htonll(cnt[i]);
+		p_smdb->p_db_tables[i].set_size = htonll(cnt[i] * rec_size[i]);
+	}
+
+	return p_smdb;
+}
+
+/* sets LFT entry of @lid on all leaves, except the one of the host */
+static int set_leaf_route(struct ssa_db *p_smdb, int lid, uint8_t port)
+{
+	struct smdb_lft_block *p_block = (struct smdb_lft_block *)
+		p_smdb->pp_tables[SMDB_TBL_ID_LFT_BLOCK];
+	int leaf, blocks = MAX_LID / 64 + 1, changes = 0;
+	uint8_t *p_entry;
+
+	for (leaf = 0; leaf < LEAF_NUM; leaf++) {
+		p_entry = &p_block[leaf * blocks + lid / 64].block[lid % 64];
+		if (*p_entry > HOST_NUM && *p_entry != port) {
+			*p_entry = port;
+			changes++;
+		}
+	}
+	return changes;
+}
+
+static int prdb_equal(const struct ssa_db *p_prdb1,
+		      const struct ssa_db *p_prdb2)
+{
+	uint64_t size = ntohll(p_prdb1->p_db_tables[PRDB_TBL_ID_PR].set_size);
+
+	return size == ntohll(p_prdb2->p_db_tables[PRDB_TBL_ID_PR].set_size) &&
+	       !memcmp(p_prdb1->pp_tables[PRDB_TBL_ID_PR],
+		       p_prdb2->pp_tables[PRDB_TBL_ID_PR], size);
+}
+
+/*
+ * Computes path records of all sources for the changed SMDB from scratch
+ * and by delta. Returns number of sources, which path records changed.
+ */
+static int check_delta(const char *name, struct ssa_db *p_smdb,
+		       struct ssa_db *p_smdb_new)
+{
+	const struct smdb_guid2lid *p_guid2lid = (const struct smdb_guid2lid *)
+		p_smdb->pp_tables[SMDB_TBL_ID_GUID2LID];
+	uint64_t i, count;
+	void *p_snap, *p_snap_new;
+	int changed = 0;
+
+	count = ntohll(p_smdb->p_db_tables[SMDB_TBL_ID_GUID2LID].set_count);
+	p_snap = ssa_pr_create_snapshot(p_smdb, 1);
+	p_snap_new = ssa_pr_create_snapshot(p_smdb_new, 1);
+	if (!p_snap || !p_snap_new) {
+		CHECK(0, "%s: unable to create snapshots", name);
+		goto out;
+	}
+	CHECK(!ssa_pr_diff_snapshot(p_snap_new, p_snap),
+	      "%s: snapshots aren't compared", name);
+
+	for (i = 0; i < count; i++) {
+		struct ssa_db *p_prdb = NULL, *p_full = NULL, *p_delta = NULL;
+		ssa_pr_status_t ret;
+
+		ssa_pr_compute_half_world(p_smdb, p_snap,
+					  p_guid2lid[i].guid, &p_prdb);
+		ssa_pr_compute_half_world(p_smdb_new, p_snap_new,
+					  p_guid2lid[i].guid, &p_full);
+		ret = ssa_pr_compute_half_world_delta(p_smdb_new, p_snap_new,
+						      p_guid2lid[i].guid, p_prdb,
+						      ssa_db_get_epoch(p_smdb,
+							DB_DEF_TBL_ID),
+						      &p_delta);
+		if (!p_prdb || !p_full || SSA_PR_SUCCESS != ret) {
+			CHECK(0, "%s: path records of 0x%" PRIx64
+			      " aren't computed", name,
+			      ntohll(p_guid2lid[i].guid));
+		} else {
+			CHECK(prdb_equal(p_delta ? p_delta : p_prdb, p_full),
+			      "%s: delta path records of 0x%" PRIx64
+			      " differ from the computed ones", name,
+			      ntohll(p_guid2lid[i].guid));
+			changed += !prdb_equal(p_prdb, p_full);
+		}
+
+		if (p_prdb)
+			ssa_db_destroy(p_prdb);
+		if (p_full)
+			ssa_db_destroy(p_full);
+		/* may be shared with the snapshot */
+		ssa_db_release(p_delta);
+	}
+
+out:
+	if (p_snap)
+		ssa_pr_put_snapshot(p_snap);
+	if (p_snap_new)
+		ssa_pr_put_snapshot(p_snap_new);
+	return changed;
+}
+
+static void test_lft_change(const char *name, int lid, uint8_t port,
+			    int expect_changes)
+{
+	struct ssa_db *p_smdb = fat_tree_smdb(1);
+	struct ssa_db *p_smdb_new = fat_tree_smdb(2);
+	int changed;
+
+	if (!p_smdb || !p_smdb_new) {
+		CHECK(0, "%s: unable to build SMDB", name);
+		goto out;
+	}
+
+	CHECK(set_leaf_route(p_smdb_new, lid, port),
+	      "%s: LFT of LID %d isn't changed", name, lid);
+	changed = check_delta(name, p_smdb, p_smdb_new);
+	CHECK(!expect_changes || changed,
+	      "%s: no path records changed", name);
+out:
+	if (p_smdb)
+		ssa_db_smdb_destroy(p_smdb);
+	if (p_smdb_new)
+		ssa_db_smdb_destroy(p_smdb_new);
+}
+
+int main(int argc, char **argv)
+{
+	int host_lid = HOST_BASE_LID + (HOST_NUM + 1) * LIDS_PER_HOST;
+
+	test_lft_change("base LID", host_lid, NO_PATH, 1);
+	test_lft_change("base LID spine", host_lid, HOST_NUM + 1, 0);
+	test_lft_change("non base LID", host_lid + 1, NO_PATH, 0);
+	test_lft_change("non base LID spine", host_lid + LIDS_PER_HOST - 1,
+			HOST_NUM + 1, 0);
+
+	printf("%s: %d failures\n", argv[0], failures);
+	return failures;
+}
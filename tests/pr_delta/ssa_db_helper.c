@@ -0,0 +1 @@
+../../shared/ssa_db_helper.c
\ No newline at end of file
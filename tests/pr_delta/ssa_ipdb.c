@@ -0,0 +1 @@
+../../shared/ssa_ipdb.c
\ No newline at end of file
@@ -0,0 +1 @@
+../../access/src/ssa_path_record.c
\ No newline at end of file
@@ -0,0 +1 @@
+../../access/src/ssa_path_record_helper.c
\ No newline at end of file
@@ -0,0 +1 @@
+../../access/src/ssa_prdb.c
\ No newline at end of file
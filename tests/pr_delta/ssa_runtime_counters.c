@@ -0,0 +1 @@
+../../shared/ssa_runtime_counters.c
\ No newline at end of file
@@ -0,0 +1 @@
+../../plugin/src/ssa_smdb.c
\ No newline at end of file
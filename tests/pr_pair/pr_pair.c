@@ -171,13 +171,16 @@ static void print_usage(FILE *file,const char *name)
 {
 	int i = 0;
 
-	fprintf(file,"Usage: %s [-h] [-o output file | -O output folder] [-n number | -f file name | -a] [-l | -g] [-L file name] [-v number] input folder\n", name);
+	fprintf(file,"Usage: %s [-h] [-o output file | -O output folder | -b] [-n number | -f file name | -a] [-t number] [-p] [-l | -g] [-L file name] [-v number] input folder\n", name);
 	fprintf(file,"\t-h\t\t-Print this help\n");
 	fprintf(file,"\t-o\t\t-Output file location. If ommited, stdout is used\n");
 	fprintf(file,"\t-O\t\t-PRDB location\n");
+	fprintf(file,"\t-b\t\t-Benchmark \"half world\" computation for heap and huge page backed databases\n");
 	fprintf(file,"\t-f\t\t-Input file location. One ID per line\n");
 	fprintf(file,"\t-n\t\t-Input ID\n");
 	fprintf(file,"\t-a\t\t-Use all possible IDs. It's a default parameter.\n");
+	fprintf(file,"\t-t\t\t-Number of threads for \"whole world\" computation. Default value is 1\n");
+	fprintf(file,"\t-p\t\t-Compute path records only for destinations sharing a partition\n");
 	fprintf(file,"\t-l\t\t-Input ID is LID\n");
 	fprintf(file,"\t-g\t\t-Input ID is GUID. It's a default parameter\n");
 	fprintf(file,"\t-L\t\t-Access Layer log file path. If ommited, stdout is used.\n");
@@ -251,7 +254,10 @@ struct input_prm
 	char input_path[PATH_MAX];
 	char log_path[PATH_MAX];
 	uint64_t id;
+	unsigned int thread_num;
+	uint8_t partitions;
 	uint8_t whole_world;
+	uint8_t benchmark;
 	uint8_t is_guid;
 	uint8_t log_verbosity;
 };
@@ -285,8 +291,14 @@ static void print_input_prm(const struct input_prm *prm)
 
 	if(prm->whole_world) {
 		printf("Compute \"whole world\" path records.\n");
-		return;
+		if(prm->thread_num > 1)
+			printf("Threads: %u\n",prm->thread_num);
 	}
+
+	if(prm->benchmark)
+		printf("Benchmark \"half world\" computation.\n");
+	if(prm->partitions)
+		printf("Partition aware path records.\n");
 }
 
 static ptrvector_t  *init_pr_path_container()
@@ -389,6 +401,50 @@ static int ssa_pr_path_output(const ssa_path_parms_t *p_path_prm, void *prm)
 	return 0;
 }
 
+static ssa_pr_status_t run_whole_world_parallel(struct ssa_db *p_db_diff,
+		void *p_context,
+		unsigned int thread_num,
+		ptrvector_t *path_arr)
+{
+	ptrvector_t **shards = NULL;
+	ssa_pr_status_t pr_res = SSA_PR_SUCCESS;
+	void *element = NULL;
+	unsigned int i = 0;
+	size_t j = 0;
+
+	shards = (ptrvector_t **)calloc(thread_num,sizeof(*shards));
+	if(!shards) {
+		fprintf(stderr,"Can't create path record shards.\n");
+		return SSA_PR_ERROR;
+	}
+
+	for(i = 0; i < thread_num; ++i) {
+		shards[i] = ptrvector_create(1000,1,0);
+		if(!shards[i]) {
+			fprintf(stderr,"Can't create a storage for path records.\n");
+			pr_res = SSA_PR_ERROR;
+			goto Exit;
+		}
+	}
+
+	pr_res = ssa_pr_whole_world_parallel(p_db_diff,p_context,thread_num,
+			ssa_pr_path_output,(void **)shards);
+
+	/*
+	 * Shards are merged in thread order. It gives the same order
+	 * as a single thread computation.
+	 */
+	for(i = 0; i < thread_num; ++i)
+		for(j = 0; !ptrvector_get(shards[i],j,&element); ++j)
+			ptrvector_pushback(path_arr,element);
+
+Exit:
+	for(i = 0; i < thread_num; ++i)
+		ptrvector_destroy(shards[i]);
+	free(shards);
+	return pr_res;
+}
+
 static struct ssa_db *load_smdb(const char *path)
 {
 	struct ssa_db *db_diff = NULL;
@@ -549,6 +605,8 @@ static int run_pr_calculation(struct input_prm* p_prm)
 		goto Exit;
 	}
 
+	ssa_pr_set_partitions(p_context,p_prm->partitions);
+
 	if(dump_to_prdb) {
 		get_input_guids(p_prm,p_db_diff,guids_arr);
 		if(guids_arr->count) {
@@ -579,6 +637,9 @@ static int run_pr_calculation(struct input_prm* p_prm)
 
 			pr_res = ssa_pr_half_world(p_db_diff,p_context,guid,ssa_pr_path_output,path_arr);
 		}
+	} else if(p_prm->thread_num > 1) {
+		pr_res = run_whole_world_parallel(p_db_diff,p_context,
+				p_prm->thread_num,path_arr);
 	} else {
 		pr_res = ssa_pr_whole_world(p_db_diff,p_context,ssa_pr_path_output,path_arr);
 	}
@@ -631,6 +692,86 @@ Exit:
 	return res;
 }
 
+static const char *alloc_backend_str[] = {
+	"heap", "transparent huge pages", "hugetlb"
+};
+
+static int run_pr_benchmark(struct input_prm *p_prm)
+{
+	struct ssa_db *p_db_diff = NULL;
+	struct ssa_db *p_prdb = NULL;
+	ptrvector_t *guids_arr = NULL;
+	void *p_context = NULL;
+	struct timespec start, end;
+	double elapsed;
+	size_t i, prdb_mapped;
+	int backend, res = 0;
+
+	for(backend = SSA_DB_ALLOC_HEAP; backend <= SSA_DB_ALLOC_HUGETLB && !res; ++backend) {
+		ssa_db_set_alloc_backend(backend);
+		prdb_mapped = 0;
+
+		p_db_diff = load_smdb(p_prm->smdb_path);
+		if(NULL == p_db_diff) {
+			fprintf(stderr,"Can't create smdb database from: %s .",p_prm->smdb_path);
+			res = -1;
+			break;
+		}
+
+		guids_arr = ptrvector_create(10000,1,0);
+		p_context = ssa_pr_create_context();
+		if(NULL == guids_arr || NULL == p_context) {
+			fprintf(stderr,"Can't create path record calculation context\n");
+			res = -1;
+			goto Next;
+		}
+		ssa_pr_set_partitions(p_context,p_prm->partitions);
+		get_input_guids(p_prm,p_db_diff,guids_arr);
+
+		clock_gettime(CLOCK_MONOTONIC,&start);
+		for(i = 0; i < guids_arr->count; ++i) {
+			be64_t guid;
+
+			ptrvector_get(guids_arr,i,(void**)&guid);
+			guid = htonll(guid);
+			if(ssa_pr_compute_half_world(p_db_diff,p_context,guid,&p_prdb) != SSA_PR_SUCCESS) {
+				fprintf(stderr,"Path record computation failed for GUID: 0x%"PRIx64"\n",ntohll(guid));
+				res = -1;
+				goto Next;
+			}
+			if(p_prdb->region_mapped)
+				prdb_mapped++;
+			ssa_db_destroy(p_prdb);
+			p_prdb = NULL;
+		}
+		clock_gettime(CLOCK_MONOTONIC,&end);
+
+		elapsed = (end.tv_sec - start.tv_sec) +
+			  (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+		printf("%s: %zu \"half world\" computations in %.5f sec. (%.5f msec. each)\n",
+		       alloc_backend_str[backend],guids_arr->count,elapsed,
+		       guids_arr->count ? elapsed * 1000 / guids_arr->count : 0);
+		printf("%s: smdb %s, %zu of %zu prdb mapped\n",
+		       alloc_backend_str[backend],
+		       p_db_diff->region_mapped ? "mapped" : "on heap",
+		       prdb_mapped,guids_arr->count);
+Next:
+		if(p_context) {
+			ssa_pr_destroy_context(p_context);
+			p_context = NULL;
+		}
+		if(guids_arr) {
+			ptrvector_destroy(guids_arr);
+			guids_arr = NULL;
+		}
+		destroy_smdb(p_db_diff);
+		p_db_diff = NULL;
+	}
+
+	ssa_db_set_alloc_backend(SSA_DB_ALLOC_HEAP);
+	return res;
+}
+
 int main(int argc,char *argv[])
 {
 	int opt = 0;
@@ -654,6 +795,8 @@ int main(int argc,char *argv[])
 	uint64_t id = 0;
 	char id_string_val[PATH_MAX] = {};
 	char verbosity_string_val[PATH_MAX] = {};
+	char thread_string_val[PATH_MAX] = {};
+	short use_thread_opt = 0;
 	int rt = 0;
 	static struct option long_options[] = {
 		{0, 0, 0, 0 }
@@ -665,15 +808,20 @@ int main(int argc,char *argv[])
 	ssa_set_ssa_signal_handler();
 
 
-	while ((opt = getopt_long(argc, argv, "glan:f:o:O:hL:v:?", long_options, &option_index)) != -1) {
+	while ((opt = getopt_long(argc, argv, "glpabn:f:o:O:hL:v:t:?", long_options, &option_index)) != -1) {
 		switch (opt) {
 			case 'O':
 				use_prdb_dump  = 1;
 				strncpy(prdb_path,optarg,PATH_MAX);
-				err_opt = use_file_opt  || use_all_opt ;
+				err_opt = use_file_opt  || use_all_opt || prm.benchmark;
+				break;
+			case 'b':
+				prm.benchmark = 1;
+				err_opt = use_prdb_dump || use_output_opt;
 				break;
 			case 'o':
 				use_output_opt = 1;
+				err_opt = prm.benchmark;
 				strncpy(dump_path,optarg,PATH_MAX);
 				break;
 			case 'L':
@@ -692,6 +840,13 @@ int main(int argc,char *argv[])
 					strncpy(id_string_val,optarg,PATH_MAX);
 				}
 				break;
+			case 't':
+				use_thread_opt = 1;
+				strncpy(thread_string_val,optarg,PATH_MAX);
+				break;
+			case 'p':
+				prm.partitions = 1;
+				break;
 			case 'v':
 				use_verbosity_opt  = 1;
 				strncpy(verbosity_string_val,optarg,PATH_MAX);
@@ -797,6 +952,23 @@ int main(int argc,char *argv[])
 		prm.log_verbosity = 1;
 	}
 
+	if(use_thread_opt && strlen(thread_string_val)) {
+		int res = 0;
+		int thread_num = 0;
+
+		res = sscanf(thread_string_val,"%d",&thread_num);
+
+		if(res != 1 || thread_num < 1) {
+			fprintf(stderr,"Number of threads has wrong value: %s.\n",
+					thread_string_val);
+			print_usage(stderr,argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		prm.thread_num = thread_num;
+	} else {
+		prm.thread_num = 1;
+	}
+
 	if(strlen(log_path)) {
 		if(is_file_exist(log_path)) {
 			fprintf(stderr,"Log file will be replaced: %s\n",log_path);
@@ -846,7 +1018,10 @@ int main(int argc,char *argv[])
 
 	print_input_prm(&prm);
 
-	rt = run_pr_calculation(&prm);
+	if(prm.benchmark)
+		rt = run_pr_benchmark(&prm);
+	else
+		rt = run_pr_calculation(&prm);
 
 	ssa_close_log ();
 
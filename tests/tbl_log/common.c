@@ -0,0 +1 @@
+../../shared/common.c
\ No newline at end of file
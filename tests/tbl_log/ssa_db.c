@@ -0,0 +1 @@
+../../shared/ssa_db.c
\ No newline at end of file
@@ -0,0 +1 @@
+../../shared/ssa_signal_handler.c
\ No newline at end of file
@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2015 Mellanox Technologies LTD. All rights reserved.
+ *
+ * This software is available to you under the terms of the
+ * OpenIB.org BSD license included below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Table log tests: ssa_db_build_log() builds the log between two
+ * epochs of a single table database, ssa_db_set_log() keeps it and
+ * ssa_db_log_apply() has to reproduce the new table from the old one.
+ * Logs that don't match the table they are applied to are rejected.
+ * Consecutive SMDB sweeps are followed by a child as it receives them.
+ *
+ * The exit status is the number of failed checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <infiniband/ssa_db.h>
+#include <common.h>
+
+#define TEST_SEED	1
+#define TEST_RECS	1000
+#define RANDOM_ROUNDS	200
+#define SWEEPS		30
+
+struct test_rec {
+	be64_t	key;
+	be64_t	value;
+};
+
+/* single data table database */
+struct test_db {
+	struct ssa_db		db;
+	struct db_table_def	def;
+	struct db_dataset	dataset;
+	void			*p_tbl;
+};
+
+static int failures;
+
+#define CHECK(cond, ...)					\
+	do {							\
+		if (!(cond)) {					\
+			failures++;				\
+			printf("FAIL %s:%d: ", __func__, __LINE__); \
+			printf(__VA_ARGS__);			\
+			printf("\n");				\
+		}						\
+	} while (0)
+
+static void test_db_init(struct test_db *p_tdb, uint64_t epoch,
+			 struct test_rec *p_recs, uint64_t cnt)
+{
+	memset(p_tdb, 0, sizeof(*p_tdb));
+	p_tdb->def.type = DBT_TYPE_DATA;
+	p_tdb->def.record_size = htonl(sizeof(*p_recs));
+	p_tdb->dataset.epoch = htonll(epoch);
+	p_tdb->dataset.set_size = htonll(cnt * sizeof(*p_recs));
+	p_tdb->dataset.set_count = htonll(cnt);
+	p_tdb->p_tbl = p_recs;
+
+	p_tdb->db.db_table_def.set_count = htonll(1);
+	p_tdb->db.p_def_tbl = &p_tdb->def;
+	p_tdb->db.p_db_tables = &p_tdb->dataset;
+	p_tdb->db.pp_tables = &p_tdb->p_tbl;
+	p_tdb->db.data_tbl_cnt = 1;
+}
+
+static void test_db_cleanup(struct test_db *p_tdb)
+{
+	ssa_db_set_log(&p_tdb->db, 0, NULL, 0);
+	free(p_tdb->db.p_logs);
+	p_tdb->db.p_logs = NULL;
+}
+
+static void rec_set(struct test_rec *p_rec, uint64_t key)
+{
+	p_rec->key = htonll(key);
+	p_rec->value = htonll(key * 7 + 3);
+}
+
+static void recs_reset(struct test_rec *p_recs, uint64_t cnt)
+{
+	uint64_t i;
+
+	for (i = 0; i < cnt; i++)
+		rec_set(&p_recs[i], i);
+}
+
+static struct test_rec *recs_alloc(uint64_t cnt)
+{
+	struct test_rec *p_recs = malloc(cnt * sizeof(*p_recs));
+
+	if (!p_recs) {
+		printf("unable to allocate %" PRIu64 " records\n", cnt);
+		exit(1);
+	}
+	recs_reset(p_recs, cnt);
+	return p_recs;
+}
+
+/* inserts @cnt records with new keys before record @index */
+static uint64_t recs_insert(struct test_rec *p_recs, uint64_t total,
+			    uint64_t index, uint64_t cnt, uint64_t key)
+{
+	memmove(&p_recs[index + cnt], &p_recs[index],
+		(total - index) * sizeof(*p_recs));
+	while (cnt--) {
+		rec_set(&p_recs[index++], key++);
+		total++;
+	}
+	return total;
+}
+
+static uint64_t recs_delete(struct test_rec *p_recs, uint64_t total,
+			    uint64_t index, uint64_t cnt)
+{
+	memmove(&p_recs[index], &p_recs[index + cnt],
+		(total - index - cnt) * sizeof(*p_recs));
+	return total - cnt;
+}
+
+static void check_framing(const char *name, const void *p_log, uint64_t size,
+			  const struct test_db *p_old, const struct test_db *p_new)
+{
+	const struct db_trans_log_entry *start, *end;
+
+	start = (const struct db_trans_log_entry *) p_log;
+	CHECK(start->operation == DB_OP_START, "%s: log starts by %u",
+	      name, start->operation);
+	CHECK(start->epoch == p_old->dataset.epoch &&
+	      start->record_offset == p_old->dataset.set_size,
+	      "%s: START doesn't describe the old table", name);
+
+	end = (const struct db_trans_log_entry *)
+	      ((const uint8_t *) p_log + ntohll(start->entry_offset)) - 1;
+	CHECK(end->operation == DB_OP_END, "%s: log ends by %u",
+	      name, end->operation);
+	CHECK(end->epoch == p_new->dataset.epoch &&
+	      end->record_offset == p_new->dataset.set_size &&
+	      ntohll(end->entry_offset) == size,
+	      "%s: END doesn't describe the new table", name);
+}
+
+/*
+ * Builds the log taking @p_old_recs to @p_new_recs, keeps it with the
+ * new database and applies it to the old table. Returns 0 if no log was
+ * built, as the tables differ too much, and 1 otherwise.
+ */
+static int log_round_trip(const char *name,
+			  struct test_rec *p_old_recs, uint64_t old_cnt,
+			  struct test_rec *p_new_recs, uint64_t new_cnt)
+{
+	struct test_db old_db, new_db;
+	uint64_t size, new_size = new_cnt * sizeof(*p_new_recs);
+	void *p_log, *p_tbl;
+
+	test_db_init(&old_db, 10, p_old_recs, old_cnt);
+	test_db_init(&new_db, 11, p_new_recs, new_cnt);
+
+	p_log = ssa_db_build_log(&old_db.db, &new_db.db, 0, &size);
+	if (!p_log)
+		return 0;
+
+	check_framing(name, p_log, size, &old_db, &new_db);
+	CHECK(size <= new_size / 2 + 2 * sizeof(struct db_trans_log_entry),
+	      "%s: log of %" PRIu64 " bytes for a %" PRIu64 " bytes table",
+	      name, size, new_size);
+	if (ssa_db_set_log(&new_db.db, 0, p_log, size)) {
+		CHECK(0, "%s: log isn't accepted", name);
+		free(p_log);
+		return 1;
+	}
+
+	p_tbl = ssa_db_log_apply(&new_db.db, 0, p_old_recs,
+				 old_cnt * sizeof(*p_old_recs), 10);
+	CHECK(p_tbl && !memcmp(p_tbl, p_new_recs, new_size),
+	      "%s: applied log doesn't reproduce the new table", name);
+	free(p_tbl);
+
+	test_db_cleanup(&new_db);
+	return 1;
+}
+
+static void test_edits(void)
+{
+	struct test_rec *p_old = recs_alloc(TEST_RECS);
+	struct test_rec *p_new = recs_alloc(TEST_RECS + 16);
+	uint64_t cnt;
+
+	CHECK(log_round_trip("same", p_old, TEST_RECS, p_new, TEST_RECS),
+	      "no log of an unchanged table");
+
+	rec_set(&p_new[0], 5000);
+	rec_set(&p_new[500], 5001);
+	rec_set(&p_new[501], 5002);
+	rec_set(&p_new[TEST_RECS - 1], 5003);
+	CHECK(log_round_trip("update", p_old, TEST_RECS, p_new, TEST_RECS),
+	      "no log of updated records");
+
+	recs_reset(p_new, TEST_RECS);
+	cnt = recs_insert(p_new, TEST_RECS, 0, 1, 6000);
+	cnt = recs_insert(p_new, cnt, 300, 8, 6001);
+	cnt = recs_delete(p_new, cnt, 700, 3);
+	CHECK(log_round_trip("insert delete", p_old, TEST_RECS, p_new, cnt),
+	      "no log of inserted and removed records");
+
+	recs_reset(p_new, TEST_RECS);
+	cnt = recs_insert(p_new, TEST_RECS, TEST_RECS, 16, 7000);
+	CHECK(log_round_trip("append", p_old, TEST_RECS, p_new, cnt),
+	      "no log of appended records");
+	CHECK(log_round_trip("truncate", p_new, cnt, p_old, TEST_RECS - 10),
+	      "no log of a truncated table");
+
+	/* most records differ, the table is sent instead */
+	memset(p_new, 0xA5, TEST_RECS * sizeof(*p_new));
+	CHECK(!log_round_trip("rewrite", p_old, TEST_RECS, p_new, TEST_RECS),
+	      "log of a rewritten table");
+	CHECK(!log_round_trip("from empty", p_old, 0, p_old, TEST_RECS),
+	      "log of a table that was empty");
+
+	free(p_new);
+	free(p_old);
+}
+
+static void test_random(void)
+{
+	struct test_rec *p_old = recs_alloc(TEST_RECS);
+	struct test_rec *p_new = recs_alloc(2 * TEST_RECS);
+	uint64_t cnt, index, n, key = 10000;
+	int round, edit, logs = 0;
+
+	for (round = 0; round < RANDOM_ROUNDS; round++) {
+		memcpy(p_new, p_old, TEST_RECS * sizeof(*p_new));
+		cnt = TEST_RECS;
+		for (edit = rand() % 20; edit >= 0; edit--) {
+			index = rand() % cnt;
+			n = 1 + rand() % 12;
+			switch (rand() % 3) {
+			case 0:
+				rec_set(&p_new[index], key++);
+				break;
+			case 1:
+				cnt = recs_insert(p_new, cnt, index, n, key);
+				key += n;
+				break;
+			default:
+				if (n > cnt - index)
+					n = cnt - index;
+				cnt = recs_delete(p_new, cnt, index, n);
+				break;
+			}
+		}
+		logs += log_round_trip("random", p_old, TEST_RECS, p_new, cnt);
+	}
+	CHECK(logs > RANDOM_ROUNDS / 2, "only %d out of %d logs built",
+	      logs, RANDOM_ROUNDS);
+
+	free(p_new);
+	free(p_old);
+}
+
+/*
+ * Consecutive sweeps, as ssa_db_compare() runs them: a changed table
+ * gets the new SMDB epoch and the log from the previous SMDB, while an
+ * unchanged one keeps its epoch and has no log. A child that holds the
+ * previous table epoch applies the log. A child that missed a change
+ * gets no log and receives the table in full.
+ */
+static void test_sweeps(void)
+{
+	uint64_t max = TEST_RECS + 16, rec_size = sizeof(struct test_rec);
+	struct test_rec *p_prev = recs_alloc(max), *p_next = recs_alloc(max);
+	struct test_rec *p_held = recs_alloc(max), *p_tmp;
+	struct test_db prev_db, next_db;
+	uint64_t prev_cnt = TEST_RECS, next_cnt, held_cnt = TEST_RECS;
+	uint64_t epoch = 10, tbl_epoch, held_epoch = 10, key = 20000;
+	uint64_t index, size;
+	void *p_log, *p_tbl;
+	int sweep, logs = 0, fulls = 0;
+
+	test_db_init(&prev_db, epoch, p_prev, prev_cnt);
+	for (sweep = 1; sweep <= SWEEPS; sweep++) {
+		memcpy(p_next, p_prev, prev_cnt * rec_size);
+		next_cnt = prev_cnt;
+		if (sweep % 3) {
+			rec_set(&p_next[rand() % next_cnt], key++);
+			if (!(sweep % 4)) {
+				index = rand() % next_cnt;
+				next_cnt = recs_insert(p_next, next_cnt, index,
+						       2, key);
+				key += 2;
+				next_cnt = recs_delete(p_next, next_cnt,
+						       rand() % (next_cnt - 2), 2);
+			}
+		}
+
+		epoch++;
+		tbl_epoch = ntohll(prev_db.dataset.epoch);
+		if (next_cnt != prev_cnt ||
+		    memcmp(p_next, p_prev, next_cnt * rec_size))
+			tbl_epoch = epoch;
+		test_db_init(&next_db, tbl_epoch, p_next, next_cnt);
+		if (tbl_epoch == epoch) {
+			p_log = ssa_db_build_log(&prev_db.db, &next_db.db, 0,
+						 &size);
+			CHECK(p_log, "sweep %d: no log of a changed table", sweep);
+			if (p_log && ssa_db_set_log(&next_db.db, 0, p_log, size)) {
+				CHECK(0, "sweep %d: log isn't accepted", sweep);
+				free(p_log);
+			}
+		}
+
+		/* the child is down during every 7th sweep */
+		if (sweep % 7 && tbl_epoch != held_epoch) {
+			p_tbl = ssa_db_log_apply(&next_db.db, 0, p_held,
+						 held_cnt * rec_size,
+						 held_epoch);
+			if (p_tbl) {
+				memcpy(p_held, p_tbl, next_cnt * rec_size);
+				free(p_tbl);
+				logs++;
+			} else {
+				memcpy(p_held, p_next, next_cnt * rec_size);
+				fulls++;
+			}
+			held_cnt = next_cnt;
+			held_epoch = tbl_epoch;
+		}
+		if (sweep % 7)
+			CHECK(held_cnt == next_cnt &&
+			      !memcmp(p_held, p_next, next_cnt * rec_size),
+			      "sweep %d: child table differs", sweep);
+
+		test_db_cleanup(&next_db);
+		p_tmp = p_prev;
+		p_prev = p_next;
+		p_next = p_tmp;
+		prev_cnt = next_cnt;
+		test_db_init(&prev_db, tbl_epoch, p_prev, prev_cnt);
+	}
+	CHECK(logs > SWEEPS / 3, "only %d logs applied", logs);
+	CHECK(fulls, "no table sent in full after a missed change");
+
+	free(p_held);
+	free(p_next);
+	free(p_prev);
+}
+
+static void test_reject(void)
+{
+	struct test_rec *p_old = recs_alloc(TEST_RECS);
+	struct test_rec *p_new = recs_alloc(TEST_RECS);
+	struct test_db old_db, new_db;
+	struct db_trans_log_entry *end;
+	uint64_t size, old_size = TEST_RECS * sizeof(*p_old);
+	uint8_t *p_log, *p_bad;
+
+	rec_set(&p_new[100], 8000);
+	test_db_init(&old_db, 10, p_old, TEST_RECS);
+	test_db_init(&new_db, 11, p_new, TEST_RECS);
+	p_log = ssa_db_build_log(&old_db.db, &new_db.db, 0, &size);
+	CHECK(p_log, "no log of an updated record");
+	if (!p_log)
+		goto out;
+
+	/* log of another epoch or size than the database table */
+	new_db.dataset.epoch = htonll(12);
+	CHECK(ssa_db_set_log(&new_db.db, 0, p_log, size),
+	      "log of another epoch accepted");
+	new_db.dataset.epoch = htonll(11);
+	new_db.dataset.set_size = htonll(old_size - sizeof(*p_old));
+	CHECK(ssa_db_set_log(&new_db.db, 0, p_log, size),
+	      "log of another table size accepted");
+	new_db.dataset.set_size = htonll(old_size);
+
+	/* broken framing */
+	p_bad = malloc(size);
+	memcpy(p_bad, p_log, size);
+	end = (struct db_trans_log_entry *) (p_bad + ntohll(
+		((struct db_trans_log_entry *) p_bad)->entry_offset)) - 1;
+	end->record_offset = htonll(old_size + sizeof(*p_old));
+	CHECK(ssa_db_set_log(&new_db.db, 0, p_bad, size),
+	      "END size not matching the entries accepted");
+	end->record_offset = htonll(old_size);
+	CHECK(ssa_db_set_log(&new_db.db, 0, p_bad, size - 1),
+	      "END entry_offset not matching the log size accepted");
+	((struct db_trans_log_entry *) p_bad)->operation = DB_OP_UPDATE;
+	CHECK(ssa_db_set_log(&new_db.db, 0, p_bad, size),
+	      "log without START accepted");
+	free(p_bad);
+
+	if (ssa_db_set_log(&new_db.db, 0, p_log, size)) {
+		CHECK(0, "log isn't accepted");
+		free(p_log);
+		goto out;
+	}
+
+	/* applied to a table of another epoch or size */
+	CHECK(!ssa_db_log_apply(&new_db.db, 0, p_old, old_size, 9),
+	      "log applied to another epoch");
+	CHECK(!ssa_db_log_apply(&new_db.db, 0, p_old, old_size - 1, 10),
+	      "log applied to a shorter table");
+	CHECK(!ssa_db_log_apply(&new_db.db, 0, NULL, old_size, 10),
+	      "log applied to no table");
+	test_db_cleanup(&new_db);
+out:
+	free(p_new);
+	free(p_old);
+}
+
+int main(int argc, char **argv)
+{
+	srand(TEST_SEED);
+
+	test_edits();
+	test_random();
+	test_sweeps();
+	test_reject();
+
+	printf("%s: %d failures\n", argv[0], failures);
+	return failures;
+}